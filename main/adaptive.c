@@ -0,0 +1,74 @@
+#include "adaptive.h"
+#include <math.h>
+
+void adaptive_init(const adaptive_config_t *config, adaptive_state_t *state, int initial_period_ms)
+{
+    state->primed = false;
+    state->level = 0.0f;
+    state->trend = 0.0f;
+    state->last_value = 0.0f;
+    
+    if (initial_period_ms < config->min_period_ms) initial_period_ms = config->min_period_ms;
+    if (initial_period_ms > config->max_period_ms) initial_period_ms = config->max_period_ms;
+    state->period_ms = initial_period_ms;
+    
+    adaptive_reset_stats(state);
+}
+
+int adaptive_update(const adaptive_config_t *config, adaptive_state_t *state, float value, int elapsed_ms)
+{
+    if (!state->primed) {
+        state->level = value;
+        state->last_value = value;
+        state->primed = true;
+        return state->period_ms;
+    }
+    
+    // What a sample-and-hold host would have shown until this sample arrived
+    float hold_err = value - state->last_value;
+    state->err_sq_sum += hold_err * hold_err;
+    state->samples++;
+    state->elapsed_ms += (uint32_t)elapsed_ms;
+    state->last_value = value;
+    
+    // Holt level/trend filter: innovation is the surprise against the predicted value
+    float predicted = state->level + state->trend * (float)elapsed_ms;
+    float innovation = value - predicted;
+    float new_level = predicted + config->alpha * innovation;
+    if (elapsed_ms > 0) {
+        float observed_trend = (new_level - state->level) / (float)elapsed_ms;
+        state->trend += config->alpha * (observed_trend - state->trend);
+    }
+    state->level = new_level;
+    
+    // AIMD: halve the period when the signal moves, creep back towards max when flat
+    if (fabsf(innovation) > config->threshold) {
+        state->period_ms /= 2;
+    } else {
+        int step = (config->max_period_ms - config->min_period_ms) / 8;
+        state->period_ms += step > 0 ? step : 1;
+    }
+    if (state->period_ms < config->min_period_ms) state->period_ms = config->min_period_ms;
+    if (state->period_ms > config->max_period_ms) state->period_ms = config->max_period_ms;
+    
+    return state->period_ms;
+}
+
+float adaptive_sample_rate_hz(const adaptive_state_t *state)
+{
+    if (state->elapsed_ms == 0) return 0.0f;
+    return (float)state->samples * 1000.0f / (float)state->elapsed_ms;
+}
+
+float adaptive_rms_error(const adaptive_state_t *state)
+{
+    if (state->samples == 0) return 0.0f;
+    return sqrtf(state->err_sq_sum / (float)state->samples);
+}
+
+void adaptive_reset_stats(adaptive_state_t *state)
+{
+    state->samples = 0;
+    state->elapsed_ms = 0;
+    state->err_sq_sum = 0.0f;
+}
@@ -0,0 +1,140 @@
+#include "bulk.h"
+#include "history.h"
+#include "lz_compress.h"
+#include "task_manager.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_rom_crc.h"
+#include <stdio.h>
+#include <string.h>
+
+static const char *TAG = "Bulk";
+
+// Serialized block header, see BLOCK_HEADER in python_gui/telemetry_codec.py
+#define BLOCK_RECORD_HEADER 14
+
+typedef struct {
+    uint8_t raw[BULK_CHUNK_BYTES];
+    uint8_t packed[LZ_BOUND(BULK_CHUNK_BYTES)];
+    size_t raw_len;
+    int frames;
+    uint32_t raw_total;
+    uint32_t sent_total;
+} bulk_stream_t;
+
+static bulk_stream_t stream;
+static history_block_t block;
+
+static void put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+    put_u16(p, (uint16_t)v);
+    put_u16(p + 2, (uint16_t)(v >> 16));
+}
+
+// Compress the pending chunk and send it; incompressible chunks go out stored
+static void flush_frame(void)
+{
+    if (stream.raw_len == 0) return;
+    
+    const uint8_t *payload = stream.packed;
+    size_t len = lz_compress(stream.raw, stream.raw_len, stream.packed, sizeof(stream.packed));
+    if (len == 0 || len >= stream.raw_len) {
+        payload = stream.raw;
+        len = stream.raw_len;
+    }
+    
+    char header[64];
+    snprintf(header, sizeof(header), "BULK_FRAME %u %u %08lx\n",
+             (unsigned)stream.raw_len, (unsigned)len,
+             (unsigned long)esp_rom_crc32_le(0, payload, len));
+    uart_write_frame(header, payload, len);
+    
+    stream.frames++;
+    stream.raw_total += stream.raw_len;
+    stream.sent_total += strlen(header) + len;
+    stream.raw_len = 0;
+}
+
+static void append_block(int task_id, const history_block_t *b)
+{
+    size_t need = BLOCK_RECORD_HEADER + b->used;
+    if (stream.raw_len + need > sizeof(stream.raw)) {
+        flush_frame();
+    }
+    
+    uint8_t *p = stream.raw + stream.raw_len;
+    p[0] = (uint8_t)task_id;
+    put_u32(p + 1, b->first_ts_ms);
+    put_u32(p + 5, b->last_ts_ms);
+    put_u16(p + 9, b->count);
+    put_u16(p + 11, b->used);
+    p[13] = b->channel_mask;
+    memcpy(p + BLOCK_RECORD_HEADER, b->data, b->used);
+    stream.raw_len += need;
+}
+
+static int send_block_text(int task_id, const history_block_t *b)
+{
+    history_reader_t reader;
+    uint32_t ts;
+    int16_t values[CHANNEL_COUNT];
+    char line[128];
+    int samples = 0;
+    
+    history_reader_init(&reader, b);
+    while (history_reader_next(&reader, &ts, values)) {
+        int n = snprintf(line, sizeof(line), "BULK_SAMPLE %d %lu", task_id, (unsigned long)ts);
+        for (int ch = 0; ch < CHANNEL_COUNT && n < (int)sizeof(line); ch++) {
+            if (!(b->channel_mask & (1u << ch))) continue;
+            n += snprintf(line + n, sizeof(line) - n, " %s=%.3f",
+                          sensor_channel_name((sensor_channel_t)ch),
+                          history_dequantize((sensor_channel_t)ch, values[ch]));
+        }
+        uart_log("BULK", "%s\n", line);
+        stream.sent_total += strlen(line) + 1;
+        samples++;
+    }
+    return samples;
+}
+
+int bulk_dump(bool compressed)
+{
+    memset(&stream, 0, sizeof(stream));
+    int64_t t0 = esp_timer_get_time();
+    
+    // Task id -> name map so the host can label samples
+    for (int id = 0; id < task_manager_task_count(); id++) {
+        uart_log("BULK", "BULK_TASK %d %s\n", id, task_manager_task_name(id));
+    }
+    uart_log("BULK", "BULK_BEGIN %s\n", compressed ? "lz4" : "text");
+    
+    uint32_t seq = 0;
+    uint32_t next = 0;
+    int task_id = -1;
+    int samples = 0;
+    while (history_snapshot(next, &block, &task_id, &seq) == 0) {
+        next = seq + 1;
+        if (compressed) {
+            append_block(task_id, &block);
+            samples += block.count;
+        } else {
+            samples += send_block_text(task_id, &block);
+        }
+    }
+    if (compressed) {
+        flush_frame();
+    }
+    
+    int64_t elapsed = esp_timer_get_time() - t0;
+    uart_log("BULK", "BULK_END frames=%d samples=%d raw=%lu sent=%lu elapsed_us=%lld\n",
+             stream.frames, samples, (unsigned long)stream.raw_total,
+             (unsigned long)stream.sent_total, (long long)elapsed);
+    ESP_LOGI(TAG, "Dumped %d samples in %lld us", samples, (long long)elapsed);
+    return samples;
+}
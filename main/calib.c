@@ -0,0 +1,205 @@
+#include "calib.h"
+#include "sensors.h"
+#include "esp_log.h"
+#include "nvs.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+static const char *TAG = "Calib";
+
+#define NAMESPACE "calib"
+#define CALIB_VERSION 1
+#define CAPTURE_INTERVAL_MS 10
+#define GRAVITY_TOLERANCE_G 0.2f
+
+// Stored records carry a version so a layout change reads as "nothing stored"
+typedef struct {
+    uint32_t version;
+    imu_calib_t calib;
+} imu_record_t;
+
+// NVS keys are at most 15 characters; ids and task names can be longer
+static void make_key(char *key, size_t size, char kind, const char *name)
+{
+    uint32_t h = 2166136261u;   // FNV-1a
+    for (const char *c = name; *c; c++) {
+        h = (h ^ (uint8_t)*c) * 16777619u;
+    }
+    snprintf(key, size, "%c%08lx", kind, (unsigned long)h);
+}
+
+int calib_blob_load(const char *space, char kind, const char *name, void *blob, size_t len)
+{
+    char key[16];
+    make_key(key, sizeof(key), kind, name);
+    nvs_handle_t nvs;
+    if (nvs_open(space, NVS_READONLY, &nvs) != ESP_OK) return -1;
+    size_t stored = len;
+    esp_err_t err = nvs_get_blob(nvs, key, blob, &stored);
+    nvs_close(nvs);
+    return err == ESP_OK && stored == len ? 0 : -1;
+}
+
+int calib_blob_save(const char *space, char kind, const char *name, const void *blob, size_t len)
+{
+    char key[16];
+    make_key(key, sizeof(key), kind, name);
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(space, NVS_READWRITE, &nvs);
+    if (err == ESP_OK) {
+        err = nvs_set_blob(nvs, key, blob, len);
+        if (err == ESP_OK) err = nvs_commit(nvs);
+        nvs_close(nvs);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Saving %s failed: %s", name, esp_err_to_name(err));
+        return -1;
+    }
+    return 0;
+}
+
+void calib_imu_identity(imu_calib_t *calib)
+{
+    memset(calib, 0, sizeof(*calib));
+    for (int a = 0; a < 3; a++) calib->scale[a] = 1.0f;
+}
+
+void calib_imu_apply(const imu_calib_t *calib, float *x, float *y, float *z)
+{
+    *x = (*x - calib->bias[0]) * calib->scale[0];
+    *y = (*y - calib->bias[1]) * calib->scale[1];
+    *z = (*z - calib->bias[2]) * calib->scale[2];
+}
+
+int calib_imu_load(const char *id, imu_calib_t *calib)
+{
+    imu_record_t record;
+    if (calib_blob_load(NAMESPACE, 'i', id, &record, sizeof(record)) != 0 || record.version != CALIB_VERSION) return -1;
+    *calib = record.calib;
+    return 0;
+}
+
+int calib_imu_save(const char *id, const imu_calib_t *calib)
+{
+    imu_record_t record = { .version = CALIB_VERSION, .calib = *calib };
+    return calib_blob_save(NAMESPACE, 'i', id, &record, sizeof(record));
+}
+
+// Fold one capture into the calibration: the axis under gravity gets a
+// two-point fit once it has been seen both ways up, otherwise a bias for the
+// current scale; the level axes read zero, unless they already have a fit
+static void fold_capture(imu_calib_t *calib, const calib_capture_t *capture)
+{
+    int g = capture->axis;
+    uint8_t bit = 1u << g;
+    if (capture->sign > 0) {
+        calib->pos[g] = capture->mean[g];
+        calib->seen_pos |= bit;
+    } else {
+        calib->neg[g] = capture->mean[g];
+        calib->seen_neg |= bit;
+    }
+
+    for (int a = 0; a < 3; a++) {
+        uint8_t b = 1u << a;
+        if ((calib->seen_pos & b) && (calib->seen_neg & b)) {
+            calib->scale[a] = 2.0f / (calib->pos[a] - calib->neg[a]);
+            calib->bias[a] = (calib->pos[a] + calib->neg[a]) / 2.0f;
+        } else if (a == g) {
+            calib->bias[a] = capture->mean[a] - (float)capture->sign / calib->scale[a];
+        } else {
+            calib->bias[a] = capture->mean[a];
+        }
+    }
+}
+
+int calib_imu_capture(int instance, int samples, calib_capture_t *capture)
+{
+    memset(capture, 0, sizeof(*capture));
+    sensor_instance_t *sensor = sensors_get_instance(instance);
+    if (!sensor || sensor->type != SENSOR_MPU6050 || samples < 2) return -1;
+
+    // Welford mean and variance per axis
+    float mean[3] = { 0 }, m2[3] = { 0 };
+    int n = 0;
+    for (int i = 0; i < samples; i++) {
+        float raw[3];
+        if (sensors_imu_sample_raw(sensor, raw) == 0) {
+            n++;
+            for (int a = 0; a < 3; a++) {
+                float d = raw[a] - mean[a];
+                mean[a] += d / (float)n;
+                m2[a] += d * (raw[a] - mean[a]);
+            }
+        }
+        vTaskDelay(pdMS_TO_TICKS(CAPTURE_INTERVAL_MS));
+    }
+    if (n < samples / 2) {
+        ESP_LOGE(TAG, "%s: only %d of %d reads succeeded", sensor->id, n, samples);
+        return -1;
+    }
+
+    int axis = 0;
+    for (int a = 0; a < 3; a++) {
+        capture->mean[a] = mean[a];
+        capture->sd[a] = sqrtf(m2[a] / (float)(n - 1));
+        if (fabsf(mean[a]) > fabsf(mean[axis])) axis = a;
+    }
+    capture->axis = axis;
+    capture->sign = mean[axis] >= 0.0f ? 1 : -1;
+
+    for (int a = 0; a < 3; a++) {
+        if (capture->sd[a] > CALIB_MAX_SD_G) {
+            ESP_LOGE(TAG, "%s: moving during capture (sd %.3f g)", sensor->id, capture->sd[a]);
+            return -1;
+        }
+    }
+    if (fabsf(fabsf(mean[axis]) - 1.0f) > GRAVITY_TOLERANCE_G) {
+        ESP_LOGE(TAG, "%s: gravity reads %.3f g, not a level orientation", sensor->id, mean[axis]);
+        return -1;
+    }
+
+    imu_calib_t calib = sensor->mpu.calib;
+    fold_capture(&calib, capture);
+    sensors_set_imu_calib(instance, &calib);
+    return calib_imu_save(sensor->id, &calib);
+}
+
+int calib_state_load(const char *task_name, void *blob, size_t len)
+{
+    return calib_blob_load(NAMESPACE, 't', task_name, blob, len);
+}
+
+int calib_state_save(const char *task_name, const void *blob, size_t len)
+{
+    return calib_blob_save(NAMESPACE, 't', task_name, blob, len);
+}
+
+int calib_clear(void)
+{
+    nvs_handle_t nvs;
+    if (nvs_open(NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK) return -1;
+    esp_err_t err = nvs_erase_all(nvs);
+    if (err == ESP_OK) err = nvs_commit(nvs);
+    nvs_close(nvs);
+    return err == ESP_OK ? 0 : -1;
+}
+
+static void snapshot_task(void *arg)
+{
+    void (*save)(void) = (void (*)(void))arg;
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_CALIB_SNAPSHOT_INTERVAL_S * 1000));
+        save();
+    }
+}
+
+void calib_start_snapshots(void (*save)(void))
+{
+    static TaskHandle_t handle = NULL;
+    if (CONFIG_CALIB_SNAPSHOT_INTERVAL_S <= 0 || handle) return;
+    if (xTaskCreate(snapshot_task, "snapshot", 3072, (void *)save, 1, &handle) != pdPASS) {
+        ESP_LOGW(TAG, "No snapshot task, filter state is not persisted");
+    }
+}
@@ -0,0 +1,208 @@
+#include "cfglib.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+#include "esp_log.h"
+#include "nvs.h"
+#include "sdkconfig.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "CfgLib";
+
+#ifndef CONFIG_CFGLIB_SLOTS
+#define CONFIG_CFGLIB_SLOTS 8
+#endif
+
+#define PARTITION_LABEL "cfglib"
+#define NAMESPACE "cfglib"
+#define SLOT_MAGIC 0x4c474643u      // "CFGL"
+#define SECTOR_SIZE 4096
+
+// Slot layout: header, then the image. The header is written last, so an
+// interrupted install reads as an empty slot.
+typedef struct {
+    uint32_t magic;
+    uint32_t size;              // Image bytes
+    uint32_t crc;               // CRC32 of the image
+    char name[CFGLIB_NAME_LEN];
+    uint32_t reserved;          // Keeps the image 8-byte aligned
+} slot_header_t;
+
+typedef struct {
+    const slot_header_t *header;
+    const config_image_t *image;
+    esp_partition_mmap_handle_t handle;
+} mapped_slot_t;
+
+static const esp_partition_t *partition = NULL;
+static int slot_count = 0;
+static size_t slot_size = 0;
+
+int cfglib_init(void)
+{
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, PARTITION_LABEL);
+    if (!partition) {
+        ESP_LOGW(TAG, "No %s partition, config library unavailable", PARTITION_LABEL);
+        return -1;
+    }
+    slot_count = CONFIG_CFGLIB_SLOTS;
+    if ((size_t)slot_count > partition->size / SECTOR_SIZE) slot_count = (int)(partition->size / SECTOR_SIZE);
+    slot_size = slot_count > 0 ? (partition->size / slot_count) & ~(size_t)(SECTOR_SIZE - 1) : 0;
+    ESP_LOGI(TAG, "%d slots of %u bytes", slot_count, (unsigned)slot_size);
+    return 0;
+}
+
+int cfglib_slot_count(void)
+{
+    return partition ? slot_count : 0;
+}
+
+size_t cfglib_slot_size(void)
+{
+    return slot_size > sizeof(slot_header_t) ? slot_size - sizeof(slot_header_t) : 0;
+}
+
+static int read_header(int slot, slot_header_t *header)
+{
+    if (!partition || slot < 0 || slot >= slot_count) return -1;
+    if (esp_partition_read(partition, (size_t)slot * slot_size, header, sizeof(*header)) != ESP_OK) return -1;
+    return header->magic == SLOT_MAGIC && header->size <= cfglib_slot_size() ? 0 : -1;
+}
+
+// Map a slot and check its CRC; -1 if it is empty or corrupt
+static int map_slot(int slot, mapped_slot_t *mapped)
+{
+    slot_header_t header;
+    if (read_header(slot, &header) != 0) return -1;
+
+    const void *ptr;
+    if (esp_partition_mmap(partition, (size_t)slot * slot_size, sizeof(header) + header.size,
+                           ESP_PARTITION_MMAP_DATA, &ptr, &mapped->handle) != ESP_OK) {
+        ESP_LOGE(TAG, "Mapping slot %d failed", slot);
+        return -1;
+    }
+    mapped->header = (const slot_header_t *)ptr;
+    mapped->image = (const config_image_t *)((const uint8_t *)ptr + sizeof(slot_header_t));
+    if (esp_rom_crc32_le(0, (const uint8_t *)mapped->image, header.size) != header.crc) {
+        ESP_LOGW(TAG, "Slot %d is corrupt", slot);
+        esp_partition_munmap(mapped->handle);
+        return -1;
+    }
+    return 0;
+}
+
+int cfglib_get(int slot, cfglib_entry_t *entry)
+{
+    mapped_slot_t mapped;
+    if (map_slot(slot, &mapped) != 0) return -1;
+
+    const config_image_t *image = mapped.image;
+    memset(entry, 0, sizeof(*entry));
+    memcpy(entry->name, mapped.header->name, CFGLIB_NAME_LEN - 1);
+    entry->size = mapped.header->size;
+    entry->current = image->version == CONFIG_IMAGE_VERSION && image->config_size == sizeof(task_config_t) &&
+                     image->sensor_size == sizeof(sensor_instance_t);
+    entry->tasks = (int)image->task_count;
+    entry->modes = (int)image->mode_count;
+    esp_partition_munmap(mapped.handle);
+    return 0;
+}
+
+static int find_name(const char *name)
+{
+    for (int slot = 0; slot < slot_count; slot++) {
+        slot_header_t header;
+        if (read_header(slot, &header) == 0 && strncmp(header.name, name, CFGLIB_NAME_LEN) == 0) return slot;
+    }
+    return -1;
+}
+
+int cfglib_find(const char *id)
+{
+    char *end;
+    long slot = strtol(id, &end, 10);
+    if (*id && *end == '\0') {
+        slot_header_t header;
+        return read_header((int)slot, &header) == 0 ? (int)slot : -1;
+    }
+    return find_name(id);
+}
+
+int cfglib_install(const char *name, const config_image_t *image, size_t size)
+{
+    if (!partition || !*name || strlen(name) >= CFGLIB_NAME_LEN) return -1;
+    if (size > cfglib_slot_size()) {
+        ESP_LOGE(TAG, "Image of %u bytes does not fit a %u byte slot", (unsigned)size, (unsigned)cfglib_slot_size());
+        return -1;
+    }
+
+    // Same name replaces the entry, otherwise the first free slot
+    int slot = find_name(name);
+    for (int i = 0; slot < 0 && i < slot_count; i++) {
+        slot_header_t header;
+        if (read_header(i, &header) != 0) slot = i;
+    }
+    if (slot < 0) {
+        ESP_LOGE(TAG, "Library full (%d slots)", slot_count);
+        return -1;
+    }
+
+    slot_header_t header = {
+        .magic = SLOT_MAGIC,
+        .size = (uint32_t)size,
+        .crc = esp_rom_crc32_le(0, (const uint8_t *)image, (uint32_t)size),
+    };
+    strncpy(header.name, name, CFGLIB_NAME_LEN - 1);
+
+    size_t offset = (size_t)slot * slot_size;
+    size_t used = (sizeof(header) + size + SECTOR_SIZE - 1) & ~(size_t)(SECTOR_SIZE - 1);
+    esp_err_t err = esp_partition_erase_range(partition, offset, used);
+    if (err == ESP_OK) err = esp_partition_write(partition, offset + sizeof(header), image, size);
+    if (err == ESP_OK) err = esp_partition_write(partition, offset, &header, sizeof(header));
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Writing slot %d failed: %s", slot, esp_err_to_name(err));
+        return -1;
+    }
+    ESP_LOGI(TAG, "Installed %s in slot %d (%u bytes)", name, slot, (unsigned)size);
+    return slot;
+}
+
+int cfglib_erase(int slot)
+{
+    if (!partition || slot < 0 || slot >= slot_count) return -1;
+    // The header sector is enough: without it the slot reads as free
+    return esp_partition_erase_range(partition, (size_t)slot * slot_size, SECTOR_SIZE) == ESP_OK ? 0 : -1;
+}
+
+int cfglib_activate(int slot)
+{
+    mapped_slot_t mapped;
+    if (map_slot(slot, &mapped) != 0) return -1;
+
+    int created = task_manager_activate(mapped.image, mapped.header->size);
+    if (created >= 0) ESP_LOGI(TAG, "Activated %.*s: %d tasks", CFGLIB_NAME_LEN, mapped.header->name, created);
+    esp_partition_munmap(mapped.handle);
+    return created;
+}
+
+int cfglib_boot_slot(void)
+{
+    nvs_handle_t nvs;
+    int32_t slot = -1;
+    if (nvs_open(NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) return -1;
+    if (nvs_get_i32(nvs, "boot", &slot) != ESP_OK) slot = -1;
+    nvs_close(nvs);
+    return (int)slot;
+}
+
+int cfglib_set_boot(int slot)
+{
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(NAMESPACE, NVS_READWRITE, &nvs);
+    if (err == ESP_OK) {
+        err = nvs_set_i32(nvs, "boot", slot);
+        if (err == ESP_OK) err = nvs_commit(nvs);
+        nvs_close(nvs);
+    }
+    return err == ESP_OK ? 0 : -1;
+}
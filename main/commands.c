@@ -0,0 +1,864 @@
+#include "commands.h"
+#include "task_manager.h"
+#include "history.h"
+#include "bulk.h"
+#include "mqtt_pub.h"
+#include "sensor_trace.h"
+#include "fault.h"
+#include "profiler.h"
+#include "telemetry.h"
+#include "expr.h"
+#include "calib.h"
+#include "wcet.h"
+#include "cfglib.h"
+#include "esp_timer.h"
+#include <stdlib.h>
+#include "esp_log.h"
+#include "transport.h"
+#include <string.h>
+
+static const char *TAG = "Commands";
+
+typedef int (*command_handler_t)(int argc, char **argv);
+
+typedef struct {
+    const char *name;
+    command_handler_t handler;
+} command_t;
+
+// The line being dispatched, before and after splitting into arguments
+static char raw_line[CMD_LINE_MAX];
+static char *split_line;
+
+// The command line from an argument to its end as typed, for commands whose
+// last argument may contain spaces or run past CMD_MAX_ARGS
+static const char *raw_args(const char *arg)
+{
+    return raw_line + (arg - split_line);
+}
+
+// MODE                      -> report the active mode
+// MODE <name> [NOW|HYPERPERIOD]
+static int cmd_mode(int argc, char **argv)
+{
+    if (argc < 2) {
+        const char *mode = task_manager_active_mode();
+        uart_log("CMD", "MODE %s\n", mode ? mode : "-");
+        return 0;
+    }
+    
+    bool at_hyperperiod = false;
+    if (argc > 2) {
+        if (strcmp(argv[2], "HYPERPERIOD") == 0) {
+            at_hyperperiod = true;
+        } else if (strcmp(argv[2], "NOW") != 0) {
+            return -1;
+        }
+    }
+    return task_manager_switch_mode(argv[1], at_hyperperiod);
+}
+
+// HISTORY                          -> pool usage and compression ratio
+// HISTORY RANGE <task> <ch> <sec>   -> min/max of a channel over the last <sec> seconds
+// HISTORY BENCH [samples]           -> encode cost in CPU cycles per sample
+// HISTORY CLEAR
+static int cmd_history(int argc, char **argv)
+{
+    if (argc < 2) {
+        history_stats_t stats;
+        history_get_stats(&stats);
+        float ratio = stats.bytes ? (float)stats.raw_bytes / (float)stats.bytes : 0.0f;
+        uart_log("CMD", "HISTORY blocks=%d/%d samples=%lu bytes=%lu raw=%lu ratio=%.1fx\n",
+                 stats.blocks_used, HISTORY_BLOCK_COUNT, (unsigned long)stats.samples,
+                 (unsigned long)stats.bytes, (unsigned long)stats.raw_bytes, ratio);
+        return 0;
+    }
+    
+    if (strcmp(argv[1], "RANGE") == 0 && argc >= 5) {
+        int task_id = task_manager_find_task(argv[2]);
+        sensor_channel_t channel = sensor_channel_from_name(argv[3]);
+        uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000);
+        uint32_t span_ms = (uint32_t)atoi(argv[4]) * 1000;
+        uint32_t from_ms = span_ms < now_ms ? now_ms - span_ms : 0;
+        float min, max;
+        if (task_id < 0 || history_range_minmax(task_id, channel, from_ms, now_ms, &min, &max) != 0) {
+            return -1;
+        }
+        uart_log("CMD", "HISTORY %s %s min=%.3f max=%.3f\n", argv[2], argv[3], min, max);
+        return 0;
+    }
+    
+    if (strcmp(argv[1], "BENCH") == 0) {
+        int samples = argc > 2 ? atoi(argv[2]) : 1000;
+        uint32_t cycles = history_bench_encode(samples);
+        uart_log("CMD", "HISTORY BENCH samples=%d cycles_per_sample=%lu\n", samples, (unsigned long)cycles);
+        return 0;
+    }
+    
+    if (strcmp(argv[1], "CLEAR") == 0) {
+        history_clear();
+        return 0;
+    }
+    return -1;
+}
+
+// DUMP [TEXT]   -> stream recorded history, LZ4-compressed frames by default
+static int cmd_dump(int argc, char **argv)
+{
+    bool text = argc > 1 && strcmp(argv[1], "TEXT") == 0;
+    return bulk_dump(!text) >= 0 ? 0 : -1;
+}
+
+// LINK                      -> report the active transport
+// LINK <uart|tcp|file> [port|path]
+static int cmd_link(int argc, char **argv)
+{
+    if (argc < 2) {
+        uart_log("CMD", "LINK %s\n", transport_active_name());
+        return 0;
+    }
+    return transport_select(argv[1], argc > 2 ? argv[2] : NULL) == ESP_OK ? 0 : -1;
+}
+
+// MQTT                      -> publisher state, throughput and latency
+// MQTT RESET                -> restart the statistics window
+static int cmd_mqtt(int argc, char **argv)
+{
+    if (argc > 1) {
+        if (strcmp(argv[1], "RESET") != 0) return -1;
+        mqtt_pub_reset_stats();
+        return 0;
+    }
+    
+    mqtt_pub_stats_t st;
+    mqtt_pub_get_stats(&st);
+    if (!st.enabled) {
+        uart_log("CMD", "MQTT disabled\n");
+        return -1;
+    }
+    float secs = st.elapsed_ms ? st.elapsed_ms / 1000.0f : 1.0f;
+    uart_log("CMD", "MQTT connected=%d queued=%lu spilled=%lu dropped=%lu msgs=%lu samples=%lu "
+             "rate=%.1fmsg/s %.1fsamples/s %.0fB/s\n",
+             st.connected, (unsigned long)st.queued, (unsigned long)st.spilled,
+             (unsigned long)st.dropped, (unsigned long)st.messages, (unsigned long)st.samples,
+             st.messages / secs, st.samples / secs, st.bytes / secs);
+    uart_log("CMD", "MQTT latency ack_avg=%luus ack_max=%luus acked=%lu age_avg=%lums age_max=%lums\n",
+             (unsigned long)st.ack_avg_us, (unsigned long)st.ack_max_us, (unsigned long)st.acked,
+             (unsigned long)st.age_avg_ms, (unsigned long)st.age_max_ms);
+    return 0;
+}
+
+// TRACE                     -> trace mode and replay counters
+// TRACE RECORD | STOP       -> emit a TRACE line per raw read / back to live sensors
+// TRACE REPLAY [path]       -> replay the loaded records, or replace them with <path> first
+// TRACE CLEAR
+// TRACE ADD <id> <latency_us> <ok> <v0> <v1> <v2>   -> upload one record over the link
+static int cmd_trace(int argc, char **argv)
+{
+    static const char *const mode_names[] = { "live", "record", "replay" };
+    
+    if (argc < 2) {
+        sensor_trace_stats_t st;
+        sensor_trace_get_stats(&st);
+        uart_log("CMD", "TRACE mode=%s records=%d sensors=%d replayed=%lu wraps=%lu misses=%lu\n",
+                 mode_names[st.mode], st.records, st.streams, (unsigned long)st.replayed,
+                 (unsigned long)st.wraps, (unsigned long)st.misses);
+        return 0;
+    }
+    
+    if (strcmp(argv[1], "RECORD") == 0) {
+        sensor_trace_set_mode(SENSOR_TRACE_RECORD);
+        return 0;
+    }
+    if (strcmp(argv[1], "STOP") == 0) {
+        sensor_trace_set_mode(SENSOR_TRACE_LIVE);
+        return 0;
+    }
+    if (strcmp(argv[1], "REPLAY") == 0) {
+        if (argc > 2) {
+            sensor_trace_clear();
+            if (sensor_trace_load(argv[2]) < 0) return -1;
+        }
+        sensor_trace_set_mode(SENSOR_TRACE_REPLAY);
+        return sensor_trace_mode() == SENSOR_TRACE_REPLAY ? 0 : -1;
+    }
+    if (strcmp(argv[1], "CLEAR") == 0) {
+        if (sensor_trace_mode() == SENSOR_TRACE_REPLAY) return -1;
+        sensor_trace_clear();
+        return 0;
+    }
+    if (strcmp(argv[1], "ADD") == 0 && argc >= 8) {
+        int32_t v[SENSOR_TRACE_VALUES] = { atoi(argv[5]), atoi(argv[6]), atoi(argv[7]) };
+        return sensor_trace_add(argv[2], (uint32_t)strtoul(argv[3], NULL, 10), atoi(argv[4]) != 0, v);
+    }
+    return -1;
+}
+
+// FAULT                                         -> armed rules and hit counts
+// FAULT <kind> <target> <permille> <us> [count]   -> arm a rule; target is a sensor id,
+//                                                    a transport name or *
+// FAULT SEED <n> | FAULT CLEAR
+static int cmd_fault(int argc, char **argv)
+{
+    if (argc < 2) {
+        fault_rule_t rules[MAX_FAULTS];
+        int n = fault_list(rules, MAX_FAULTS);
+        for (int i = 0; i < n; i++) {
+            uart_log("CMD", "FAULT %s %s %u %lu left=%ld hits=%lu\n", fault_kind_name(rules[i].kind),
+                     rules[i].target, rules[i].permille, (unsigned long)rules[i].us,
+                     (long)rules[i].remaining, (unsigned long)rules[i].hits);
+        }
+        return 0;
+    }
+    
+    if (strcmp(argv[1], "CLEAR") == 0) {
+        fault_clear();
+        return 0;
+    }
+    if (strcmp(argv[1], "SEED") == 0 && argc > 2) {
+        fault_seed((uint32_t)strtoul(argv[2], NULL, 10));
+        return 0;
+    }
+    
+    fault_kind_t kind = fault_kind_from_name(argv[1]);
+    if (kind == FAULT_KIND_COUNT || argc < 5) return -1;
+    return fault_add(kind, argv[2], (uint16_t)atoi(argv[3]), (uint32_t)strtoul(argv[4], NULL, 10),
+                     argc > 5 ? atoi(argv[5]) : -1);
+}
+
+// STATS         -> response times, deadline misses and overruns per task
+// STATS RESET
+static int cmd_stats(int argc, char **argv)
+{
+    if (argc > 1) {
+        if (strcmp(argv[1], "RESET") != 0) return -1;
+        task_manager_reset_stats();
+        return 0;
+    }
+    
+    for (int id = 0; id < task_manager_task_count(); id++) {
+        task_stats_t st;
+        uint32_t overruns, throttled;
+        if (task_manager_get_stats(id, &st, &overruns, &throttled) != 0) continue;
+        uart_log("CMD", "STATS %s jobs=%lu miss=%lu err=%lu ovr=%lu thr=%lu avg=%luus p50=%luus "
+                 "p90=%luus p99=%luus max=%luus out=%luus jit=%luus\n",
+                 task_manager_task_name(id), (unsigned long)st.jobs, (unsigned long)st.misses,
+                 (unsigned long)st.errors, (unsigned long)overruns, (unsigned long)throttled,
+                 (unsigned long)(st.jobs ? st.sum_us / st.jobs : 0),
+                 (unsigned long)task_stats_percentile(&st, 50), (unsigned long)task_stats_percentile(&st, 90),
+                 (unsigned long)task_stats_percentile(&st, 99), (unsigned long)st.max_us,
+                 (unsigned long)(st.outputs ? st.out_sum_us / st.outputs : 0),
+                 (unsigned long)task_stats_output_jitter(&st));
+    }
+    return 0;
+}
+
+#ifndef CONFIG_PROFILER_DEFAULT_HZ
+#define CONFIG_PROFILER_DEFAULT_HZ 1000
+#endif
+
+// PROFILE               -> sampler state, lost samples and measured overhead
+// PROFILE START [hz]    -> sample every core at hz (default from menuconfig)
+// PROFILE STOP
+// PROFILE DUMP          -> drain the buffer as PROF <core> <task n> <pc> [<caller>...]
+//                          in hex, then PROF TASK <n> <name> for each task seen
+static int cmd_profile(int argc, char **argv)
+{
+    if (argc < 2) {
+        profiler_stats_t st;
+        profiler_get_stats(&st);
+        uart_log("CMD", "PROFILE running=%d hz=%lu taken=%lu lost=%lu pending=%lu isr=%lucyc overhead=%lu.%02lu%%\n",
+                 st.running, (unsigned long)st.hz, (unsigned long)st.taken, (unsigned long)st.lost,
+                 (unsigned long)st.pending, (unsigned long)st.isr_cycles_avg,
+                 (unsigned long)(st.overhead_ppm / 10000), (unsigned long)(st.overhead_ppm / 100 % 100));
+        return 0;
+    }
+    
+    if (strcmp(argv[1], "START") == 0) {
+        uint32_t hz = argc > 2 ? (uint32_t)strtoul(argv[2], NULL, 10) : CONFIG_PROFILER_DEFAULT_HZ;
+        return profiler_start(hz) == ESP_OK ? 0 : -1;
+    }
+    if (strcmp(argv[1], "STOP") == 0) {
+        profiler_stop();
+        return 0;
+    }
+    if (strcmp(argv[1], "DUMP") == 0) {
+        // Bounded by what is pending now: a running sampler fills faster than the link drains
+        profiler_stats_t st;
+        profiler_get_stats(&st);
+        profiler_sample_t batch[16];
+        int left = (int)st.pending;
+        int n;
+        while (left > 0 && (n = profiler_drain(batch, left < 16 ? left : 16)) > 0) {
+            left -= n;
+            for (int i = 0; i < n; i++) {
+                char line[16 + CONFIG_PROFILER_DEPTH * 11];
+                int len = snprintf(line, sizeof(line), "PROF %u %u", batch[i].core, batch[i].task);
+                for (int d = 0; d < batch[i].depth; d++) {
+                    len += snprintf(line + len, sizeof(line) - len, " %08lx", (unsigned long)batch[i].pc[d]);
+                }
+                uart_log("CMD", "%s\n", line);
+            }
+        }
+        // Names go last: every sample drained above refers to a task already in the table
+        for (int t = 0; t < PROFILER_MAX_TASKS; t++) {
+            const char *name = profiler_task_name((uint8_t)t);
+            if (strcmp(name, "?") == 0) break;
+            uart_log("CMD", "PROF TASK %d %s\n", t, name);
+        }
+        return 0;
+    }
+    return -1;
+}
+
+// TXSTATS         -> per task link share: lines/bytes sent and dropped, backlog
+// TXSTATS RESET
+static int cmd_txstats(int argc, char **argv)
+{
+    if (argc > 1) {
+        if (strcmp(argv[1], "RESET") != 0) return -1;
+        telemetry_reset_stats();
+        return 0;
+    }
+    
+    for (int id = 0; id < task_manager_task_count(); id++) {
+        telemetry_stats_t st;
+        telemetry_config_t cfg;
+        if (telemetry_get_stats(id, &st, &cfg) != 0) continue;
+        uint32_t rate = st.elapsed_ms ? (uint32_t)((uint64_t)st.bytes_sent * 1000 / st.elapsed_ms) : 0;
+        uart_log("CMD", "TXSTATS %s weight=%u critical=%d policy=%s sent=%lu/%luB dropped=%lu/%luB "
+                 "queued=%luB peak=%luB rate=%luB/s\n",
+                 task_manager_task_name(id), cfg.weight, cfg.critical, telemetry_policy_name(cfg.policy),
+                 (unsigned long)st.lines_sent, (unsigned long)st.bytes_sent,
+                 (unsigned long)st.lines_dropped, (unsigned long)st.bytes_dropped,
+                 (unsigned long)st.queued, (unsigned long)st.peak, (unsigned long)rate);
+    }
+    return 0;
+}
+
+#define DERIVED_BENCH_RUNS 1000
+
+// DERIVED                 -> per derived channel: bytecode size, last value, cost per evaluation
+// DERIVED BENCH <expr>    -> compile against all channels and time DERIVED_BENCH_RUNS evaluations
+static int cmd_derived(int argc, char **argv)
+{
+    if (argc < 2) {
+        for (int id = 0; id < task_manager_task_count(); id++) {
+            derived_info_t info;
+            for (int i = 0; task_manager_get_derived(id, i, &info) == 0; i++) {
+                uart_log("CMD", "DERIVED %s %s ops=%u depth=%u value=%.3f evals=%lu avg=%luns max=%luns\n",
+                         task_manager_task_name(id), info.name, info.ops, info.depth, info.value,
+                         (unsigned long)info.evals, (unsigned long)info.avg_ns, (unsigned long)info.max_ns);
+            }
+        }
+        return 0;
+    }
+    
+    if (strcmp(argv[1], "BENCH") != 0 || argc < 3) return -1;
+    
+    // The expression is the rest of the line as typed, past the argument limit
+    const char *source = raw_args(argv[2]);
+    
+    expr_program_t program;
+    char err[64];
+    if (expr_compile(source, NULL, (1u << CHANNEL_COUNT) - 1, &program, err, sizeof(err)) != 0) {
+        uart_log("CMD", "DERIVED BENCH %s\n", err);
+        return -1;
+    }
+    
+    // Plausible readings, so library functions take their usual paths
+    float vars[EXPR_VAR_COUNT] = { 45.0f, 23.5f, 100.0f, 0.012f, -0.034f, 0.998f };
+    float prev[EXPR_VAR_COUNT] = { 44.0f, 23.4f, 104.0f, 0.010f, -0.030f, 1.001f };
+    volatile float sink = 0.0f;
+    uint32_t best = UINT32_MAX;
+    uint32_t t0 = expr_clock();
+    for (int i = 0; i < DERIVED_BENCH_RUNS; i++) {
+        uint32_t t = expr_clock();
+        sink = expr_eval(&program, vars, prev, 0.1f);
+        uint32_t ns = expr_clock_to_ns(expr_clock() - t);
+        if (ns < best) best = ns;
+    }
+    uint32_t total_ns = expr_clock_to_ns(expr_clock() - t0);
+    uart_log("CMD", "DERIVED BENCH ops=%u depth=%u consts=%u value=%.4f avg=%luns min=%luns\n",
+             program.len, program.depth, program.const_count, sink,
+             (unsigned long)(total_ns / DERIVED_BENCH_RUNS), (unsigned long)best);
+    return 0;
+}
+
+// CALIBRATE                   -> stored correction of every MPU6050 instance
+// CALIBRATE <id> [samples]    -> stationary capture: hold the sensor still with one axis
+//                                vertical; repeat with each axis up and down for scale
+// CALIBRATE SNAPSHOT          -> store the tasks' filter state now
+// CALIBRATE CLEAR             -> forget calibrations and snapshots (current ones stay in use)
+static int cmd_calibrate(int argc, char **argv)
+{
+    if (argc < 2) {
+        for (int i = 0; i < sensors_instance_count(); i++) {
+            sensor_instance_t *sensor = sensors_get_instance(i);
+            if (sensor->type != SENSOR_MPU6050) continue;
+            const imu_calib_t *c = &sensor->mpu.calib;
+            uart_log("CMD", "CALIBRATE %s bias=%.4f,%.4f,%.4f scale=%.4f,%.4f,%.4f up=0x%x down=0x%x\n",
+                     sensor->id, c->bias[0], c->bias[1], c->bias[2], c->scale[0], c->scale[1], c->scale[2],
+                     c->seen_pos, c->seen_neg);
+        }
+        return 0;
+    }
+    
+    if (strcmp(argv[1], "SNAPSHOT") == 0) {
+        task_manager_save_state();
+        return 0;
+    }
+    if (strcmp(argv[1], "CLEAR") == 0) {
+        return calib_clear();
+    }
+    
+    int instance = sensors_find_instance(argv[1]);
+    int samples = argc > 2 ? atoi(argv[2]) : CALIB_DEFAULT_SAMPLES;
+    if (instance < 0 || samples < 2 || samples > 5000) return -1;
+    
+    calib_capture_t capture;
+    int ret = calib_imu_capture(instance, samples, &capture);
+    uart_log("CMD", "CALIBRATE %s axis=%c%c mean=%.4f,%.4f,%.4f sd=%.4f,%.4f,%.4f\n",
+             argv[1], capture.sign > 0 ? '+' : '-', "xyz"[capture.axis],
+             capture.mean[0], capture.mean[1], capture.mean[2], capture.sd[0], capture.sd[1], capture.sd[2]);
+    return ret;
+}
+
+// DETECT -> per detector: baseline, last score, events, and the per-cycle cost of the task's detectors
+static int cmd_detect(int argc, char **argv)
+{
+    for (int id = 0; id < task_manager_task_count(); id++) {
+        const detect_config_t *config;
+        detect_state_t st;
+        uint32_t avg_ns, max_ns;
+        bool boosted;
+        for (int i = 0; task_manager_get_detector(id, i, &config, &st, &avg_ns, &max_ns, &boosted) == 0; i++) {
+            uart_log("CMD", "DETECT %s %s %s n=%lu mean=%.3f sd=%.3f score=%.2f events=%lu boost=%d "
+                     "avg=%luns max=%luns\n",
+                     task_manager_task_name(id), sensor_channel_name(config->channel),
+                     detect_method_name(config->method), (unsigned long)st.n, st.mean,
+                     st.n >= config->warmup ? detect_sd(&st) : 0.0f, st.score, (unsigned long)st.events,
+                     boosted, (unsigned long)avg_ns, (unsigned long)max_ns);
+        }
+    }
+    return 0;
+}
+
+// LET                   -> output mode of every task and how many records missed their deadline
+// LET <task|*> ON|OFF   -> publish at the deadline / as soon as the cycle finishes
+static int cmd_let(int argc, char **argv)
+{
+    if (argc < 2) {
+        for (int id = 0; id < task_manager_task_count(); id++) {
+            bool enabled;
+            uint32_t late;
+            if (task_manager_get_let(id, &enabled, &late) != 0) continue;
+            uart_log("CMD", "LET %s %s late=%lu\n", task_manager_task_name(id), enabled ? "on" : "off",
+                     (unsigned long)late);
+        }
+        return 0;
+    }
+    
+    if (argc < 3) return -1;
+    bool enabled;
+    if (strcmp(argv[2], "ON") == 0) enabled = true;
+    else if (strcmp(argv[2], "OFF") == 0) enabled = false;
+    else return -1;
+    
+    if (strcmp(argv[1], "*") != 0) {
+        return task_manager_set_let(task_manager_find_task(argv[1]), enabled);
+    }
+    for (int id = 0; id < task_manager_task_count(); id++) {
+        task_manager_set_let(id, enabled);
+    }
+    return 0;
+}
+
+// SPREAD                   -> sampling mode of every task and samples per cycle
+// SPREAD <task|*> ON|OFF   -> spread the samples over the period / take them in one burst
+static int cmd_spread(int argc, char **argv)
+{
+    if (argc < 2) {
+        for (int id = 0; id < task_manager_task_count(); id++) {
+            bool enabled;
+            int samples;
+            if (task_manager_get_spread(id, &enabled, &samples) != 0) continue;
+            uart_log("CMD", "SPREAD %s %s samples=%d\n", task_manager_task_name(id), enabled ? "on" : "off", samples);
+        }
+        return 0;
+    }
+    
+    if (argc < 3) return -1;
+    bool enabled;
+    if (strcmp(argv[2], "ON") == 0) enabled = true;
+    else if (strcmp(argv[2], "OFF") == 0) enabled = false;
+    else return -1;
+    
+    if (strcmp(argv[1], "*") != 0) {
+        return task_manager_set_spread(task_manager_find_task(argv[1]), enabled);
+    }
+    for (int id = 0; id < task_manager_task_count(); id++) {
+        task_manager_set_spread(id, enabled);
+    }
+    return 0;
+}
+
+// Record fields of a subscription in output order: channels, then derived channels
+static void subscription_fields(int id, const task_subscription_t *sub, char *out, size_t size)
+{
+    size_t len = 0;
+    out[0] = '\0';
+    for (int ch = 0; ch < CHANNEL_COUNT; ch++) {
+        if (sub->field_mask & (1u << ch)) {
+            len += snprintf(out + len, size - len, "%s%s", len ? "," : "", sensor_channel_name((sensor_channel_t)ch));
+            if (len >= size) return;
+        }
+    }
+    derived_info_t info;
+    for (int d = 0; task_manager_get_derived(id, d, &info) == 0; d++) {
+        if (sub->derived_mask & (1u << d)) {
+            len += snprintf(out + len, size - len, "%s%s", len ? "," : "", info.name);
+            if (len >= size) return;
+        }
+    }
+}
+
+// SUB                                           -> every task's subscription
+// SUB <task|*> <max_hz> [TEXT|COMPACT] [fields] -> send a task's records at most max_hz times
+//                                                  a second (0 = every cycle); fields is a comma
+//                                                  separated list of channel and derived names.
+//                                                  SUB * replaces every task's subscription.
+static int cmd_sub(int argc, char **argv)
+{
+    if (argc < 2) {
+        for (int id = 0; id < task_manager_task_count(); id++) {
+            task_subscription_t sub;
+            if (task_manager_get_subscription(id, &sub) != 0) continue;
+            if (!sub.active) {
+                uart_log("CMD", "SUB %s id=%d off\n", task_manager_task_name(id), id);
+                continue;
+            }
+            char fields[96];
+            subscription_fields(id, &sub, fields, sizeof(fields));
+            uart_log("CMD", "SUB %s id=%d hz=%.2f enc=%s fields=%s\n", task_manager_task_name(id), id,
+                     sub.max_hz, telemetry_encoding_name(sub.encoding), fields);
+        }
+        return 0;
+    }
+    
+    if (argc < 3) return -1;
+    char *end;
+    float max_hz = strtof(argv[2], &end);
+    if (*end != '\0') return -1;
+    
+    telemetry_encoding_t encoding = TELEMETRY_TEXT;
+    const char *fields = NULL;
+    int arg = 3;
+    if (argc > arg && (int)telemetry_encoding_from_name(argv[arg]) >= 0) {
+        encoding = telemetry_encoding_from_name(argv[arg++]);
+    }
+    if (argc > arg) fields = argv[arg];
+    
+    int id = -1;
+    if (strcmp(argv[1], "*") != 0) {
+        id = task_manager_find_task(argv[1]);
+        if (id < 0) return -1;
+    }
+    return task_manager_subscribe(id, max_hz, encoding, fields) < 0 ? -1 : 0;
+}
+
+// UNSUB <task|*>  -> stop a task's records; a task nobody subscribes to formats nothing
+static int cmd_unsub(int argc, char **argv)
+{
+    if (argc < 2) return -1;
+    if (strcmp(argv[1], "*") == 0) return task_manager_unsubscribe(-1);
+    int id = task_manager_find_task(argv[1]);
+    return id < 0 ? -1 : task_manager_unsubscribe(id);
+}
+
+// LOCKS        -> per sensor instance: mutex takes by sample reads, how many had to wait, wait times
+// LOCKS RESET  -> clear the counters
+static int cmd_locks(int argc, char **argv)
+{
+    if (argc > 1) {
+        if (strcmp(argv[1], "RESET") != 0) return -1;
+        sensors_reset_lock_stats();
+        return 0;
+    }
+    
+    for (int i = 0; i < sensors_instance_count(); i++) {
+        sensor_lock_stats_t st;
+        sensors_get_lock_stats(i, &st);
+        uint32_t avg = st.contended ? (uint32_t)(st.wait_sum_us / st.contended) : 0;
+        uart_log("CMD", "LOCKS %s takes=%lu contended=%lu avg=%luus max=%luus\n",
+                 sensors_get_instance(i)->id, (unsigned long)st.takes, (unsigned long)st.contended,
+                 (unsigned long)avg, (unsigned long)st.wait_max_us);
+    }
+    return 0;
+}
+
+// RULES        -> per reflex rule: condition, state, trips, sample-to-action latency
+// RULES RESET  -> clear the trip counts and latencies
+static int cmd_rules(int argc, char **argv)
+{
+    if (argc > 1) {
+        if (strcmp(argv[1], "RESET") != 0) return -1;
+        task_manager_reset_rules();
+        return 0;
+    }
+    
+    for (int id = 0; id < task_manager_task_count(); id++) {
+        reflex_rule_t rule;
+        for (int i = 0; task_manager_get_rule(id, i, &rule) == 0; i++) {
+            char action[24];
+            if (rule.action == REFLEX_ACTION_GPIO) {
+                snprintf(action, sizeof(action), "gpio%d%s", rule.gpio, rule.active_low ? "/low" : "");
+            } else {
+                snprintf(action, sizeof(action), "callback");
+            }
+            uint32_t avg = rule.trips ? (uint32_t)(rule.latency_sum_us / rule.trips) : 0;
+            uart_log("CMD", "RULES %s %s %s%s%.3f hyst=%.3f debounce=%u action=%s state=%s trips=%lu "
+                     "lat=%luus avg=%luus max=%luus\n",
+                     task_manager_task_name(id), rule.name, sensor_channel_name(rule.channel),
+                     rule.below ? "<" : ">", rule.threshold, rule.hysteresis, rule.debounce, action,
+                     rule.active ? "on" : "off", (unsigned long)rule.trips,
+                     (unsigned long)rule.latency_last_us, (unsigned long)avg, (unsigned long)rule.latency_max_us);
+        }
+    }
+    return 0;
+}
+
+// WCET                         -> measured cost of one read per sensor and of a cycle per task
+// WCET CALIBRATE [iterations]  -> park the tasks, measure everything again and store it
+static int cmd_wcet(int argc, char **argv)
+{
+    if (argc > 1) {
+        if (strcmp(argv[1], "CALIBRATE") != 0) return -1;
+        int iterations = argc > 2 ? atoi(argv[2]) : WCET_TASK_ITERATIONS;
+        if (iterations < 1 || iterations > 1000) return -1;
+        if (task_manager_calibrate_wcet(iterations) != 0) return -1;
+    }
+    
+    for (int i = 0; i < sensors_instance_count(); i++) {
+        wcet_cost_t cost;
+        if (wcet_sensor_cost(i, &cost) != 0) continue;
+        sensor_instance_t *sensor = sensors_get_instance(i);
+        uart_log("CMD", "WCET SENSOR %s %s n=%lu p50=%luus p99=%luus max=%luus\n",
+                 sensor->id, sensor_type_name(sensor->type), (unsigned long)cost.n,
+                 (unsigned long)cost.p50_us, (unsigned long)cost.p99_us, (unsigned long)cost.max_us);
+    }
+    for (int id = 0; id < task_manager_task_count(); id++) {
+        wcet_cost_t cpu, wall;
+        bool measured;
+        if (task_manager_task_wcet(id, &cpu, &wall, &measured) != 0) continue;
+        uart_log("CMD", "WCET TASK %s cpu_p99=%luus cpu_max=%luus wall_p99=%luus wall_max=%luus measured=%d\n",
+                 task_manager_task_name(id), (unsigned long)cpu.p99_us, (unsigned long)cpu.max_us,
+                 (unsigned long)wall.p99_us, (unsigned long)wall.max_us, measured);
+    }
+    return 0;
+}
+
+// LIB                        -> library slots and every stored config: slot, name, tasks, modes, size
+// LIB INSTALL <name>         -> replies READY, then takes a JSON config up to an END line,
+//                               compiles it and stores it (replacing an entry of that name)
+// LIB LOAD <slot|name>       -> stop the running tasks and start the entry's
+// LIB ERASE <slot|name>      -> remove an entry
+// LIB BOOT <slot|name|NONE>  -> entry started at power-up instead of waiting for an upload
+static int cmd_lib(int argc, char **argv)
+{
+    if (cfglib_slot_count() == 0) return -1;
+    
+    if (argc < 2) {
+        int boot = cfglib_boot_slot();
+        uart_log("CMD", "LIB slots=%d slot_bytes=%u\n", cfglib_slot_count(), (unsigned)cfglib_slot_size());
+        for (int slot = 0; slot < cfglib_slot_count(); slot++) {
+            cfglib_entry_t entry;
+            if (cfglib_get(slot, &entry) != 0) continue;
+            uart_log("CMD", "LIB %d %s tasks=%d modes=%d bytes=%lu%s%s\n", slot, entry.name, entry.tasks,
+                     entry.modes, (unsigned long)entry.size, slot == boot ? " boot" : "",
+                     entry.current ? "" : " stale");
+        }
+        return 0;
+    }
+    
+    if (argc < 3) return -1;
+    
+    if (strcmp(argv[1], "INSTALL") == 0) {
+        if (strlen(argv[2]) >= CFGLIB_NAME_LEN) return -1;
+        char *json = commands_receive_config(false);
+        if (!json) return -1;
+        size_t size;
+        config_image_t *image = task_manager_compile(json, &size);
+        free(json);
+        if (!image) return -1;
+        int slot = cfglib_install(argv[2], image, size);
+        free(image);
+        if (slot < 0) return -1;
+        uart_log("CMD", "LIB INSTALLED %d %s bytes=%u\n", slot, argv[2], (unsigned)size);
+        return 0;
+    }
+    
+    if (strcmp(argv[1], "BOOT") == 0 && strcmp(argv[2], "NONE") == 0) {
+        return cfglib_set_boot(-1);
+    }
+    
+    int slot = cfglib_find(argv[2]);
+    if (slot < 0) return -1;
+    if (strcmp(argv[1], "LOAD") == 0) {
+        int64_t t0 = esp_timer_get_time();
+        int created = cfglib_activate(slot);
+        int64_t elapsed = esp_timer_get_time() - t0;
+        if (created <= 0) return -1;
+        calib_start_snapshots(task_manager_save_state);
+        uart_log("CMD", "LIB LOADED %s tasks=%d %lldus\n", argv[2], created, (long long)elapsed);
+        return 0;
+    } else if (strcmp(argv[1], "ERASE") == 0) {
+        if (slot == cfglib_boot_slot()) cfglib_set_boot(-1);
+        return cfglib_erase(slot);
+    } else if (strcmp(argv[1], "BOOT") == 0) {
+        return cfglib_set_boot(slot);
+    }
+    return -1;
+}
+
+static const command_t commands[] = {
+    { "MODE", cmd_mode },
+    { "HISTORY", cmd_history },
+    { "DUMP", cmd_dump },
+    { "LINK", cmd_link },
+    { "MQTT", cmd_mqtt },
+    { "TRACE", cmd_trace },
+    { "FAULT", cmd_fault },
+    { "STATS", cmd_stats },
+    { "PROFILE", cmd_profile },
+    { "TXSTATS", cmd_txstats },
+    { "DERIVED", cmd_derived },
+    { "RULES", cmd_rules },
+    { "LET", cmd_let },
+    { "SPREAD", cmd_spread },
+    { "SUB", cmd_sub },
+    { "UNSUB", cmd_unsub },
+    { "LOCKS", cmd_locks },
+    { "DETECT", cmd_detect },
+    { "CALIBRATE", cmd_calibrate },
+    { "WCET", cmd_wcet },
+    { "LIB", cmd_lib },
+};
+
+static void dispatch(char *line)
+{
+    char *argv[CMD_MAX_ARGS];
+    int argc = 0;
+    char *save = NULL;
+    
+    strcpy(raw_line, line);
+    split_line = line;
+    for (char *tok = strtok_r(line, " \t", &save); tok && argc < CMD_MAX_ARGS;
+         tok = strtok_r(NULL, " \t", &save)) {
+        argv[argc++] = tok;
+    }
+    if (argc == 0) return;
+    
+    for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); i++) {
+        if (strcmp(argv[0], commands[i].name) == 0) {
+            if (commands[i].handler(argc, argv) == 0) {
+                uart_log("CMD", "OK %s\n", argv[0]);
+            } else {
+                uart_log("CMD", "ERROR %s\n", argv[0]);
+            }
+            return;
+        }
+    }
+    
+    ESP_LOGW(TAG, "Unknown command: %s", argv[0]);
+    uart_log("CMD", "ERROR %s\n", argv[0]);
+}
+
+#define CONFIG_BUF_SIZE (4096)
+#define CONFIG_IDLE_TIMEOUT_MS 10000    // Silence after READY that abandons the upload
+
+char *commands_receive_config(bool await_start)
+{
+    char *config_buffer = (char *)malloc(CONFIG_BUF_SIZE);
+    if (!config_buffer) {
+        ESP_LOGE(TAG, "Failed to allocate config buffer");
+        return NULL;
+    }
+    
+    int total_len = 0;
+    bool started = !await_start;
+    uint8_t data[128];
+    TickType_t last_rx = xTaskGetTickCount();
+    
+    if (started) transport_write("READY\n", 6);
+    while (1) {
+        int len = transport_read(data, sizeof(data) - 1, pdMS_TO_TICKS(100));
+        if (len <= 0 && started && xTaskGetTickCount() - last_rx > pdMS_TO_TICKS(CONFIG_IDLE_TIMEOUT_MS)) {
+            // The host went away mid-upload: give the command loop back
+            ESP_LOGW(TAG, "No config data for %dms, giving up", CONFIG_IDLE_TIMEOUT_MS);
+            free(config_buffer);
+            return NULL;
+        }
+        if (len > 0) {
+            last_rx = xTaskGetTickCount();
+            data[len] = '\0';
+            
+            // Look for START signal
+            if (!started) {
+                if (strstr((char *)data, "START")) {
+                    ESP_LOGI(TAG, "Received START signal, ready for config");
+                    transport_write("READY\n", 6);
+                    started = true;
+                }
+                continue;
+            }
+            
+            // Look for END signal
+            if (strstr((char *)data, "END")) {
+                ESP_LOGI(TAG, "Received END signal, config complete");
+                break;
+            }
+            
+            // Accumulate data
+            if (total_len + len < CONFIG_BUF_SIZE - 1) {
+                memcpy(config_buffer + total_len, data, len);
+                total_len += len;
+                config_buffer[total_len] = '\0';
+            }
+        }
+    }
+    
+    if (total_len > 0) {
+        ESP_LOGI(TAG, "Received %d bytes of config data", total_len);
+        return config_buffer;
+    }
+    
+    free(config_buffer);
+    return NULL;
+}
+
+void commands_loop(void)
+{
+    char line[CMD_LINE_MAX];
+    int len = 0;
+    uint8_t data[64];
+    
+    ESP_LOGI(TAG, "Listening for commands");
+    
+    while (1) {
+        int n = transport_read(data, sizeof(data), pdMS_TO_TICKS(100));
+        task_manager_flush_reports();
+        for (int i = 0; i < n; i++) {
+            char c = (char)data[i];
+            if (c == '\n' || c == '\r') {
+                if (len > 0) {
+                    line[len] = '\0';
+                    dispatch(line);
+                    len = 0;
+                }
+            } else if (len < CMD_LINE_MAX - 1) {
+                line[len++] = c;
+            }
+        }
+    }
+}
@@ -0,0 +1,114 @@
+#include "detect.h"
+#include <math.h>
+#include <string.h>
+
+static const char *const method_names[DETECT_METHOD_COUNT] = { "cusum", "ewma", "zscore" };
+
+// Half the step of each channel's reading, so a quantized signal sitting on
+// one value does not turn its first change into an infinite z-score
+static const float channel_min_sd[CHANNEL_COUNT] = {
+    [CHANNEL_HUMIDITY]    = 0.5f,
+    [CHANNEL_TEMPERATURE] = 0.5f,
+    [CHANNEL_DISTANCE]    = 0.5f,
+    [CHANNEL_ACCEL_X]     = 0.005f,
+    [CHANNEL_ACCEL_Y]     = 0.005f,
+    [CHANNEL_ACCEL_Z]     = 0.005f,
+};
+
+detect_method_t detect_method_from_name(const char *name)
+{
+    for (int i = 0; i < DETECT_METHOD_COUNT; i++) {
+        if (strcmp(method_names[i], name) == 0) return (detect_method_t)i;
+    }
+    return DETECT_METHOD_COUNT;
+}
+
+const char *detect_method_name(detect_method_t method)
+{
+    return method < DETECT_METHOD_COUNT ? method_names[method] : "none";
+}
+
+void detect_default_config(detect_config_t *config, sensor_channel_t channel, detect_method_t method)
+{
+    memset(config, 0, sizeof(*config));
+    config->channel = channel;
+    config->method = method;
+    config->threshold = method == DETECT_CUSUM ? 5.0f : 3.0f;
+    config->slack = 0.5f;
+    config->lambda = 0.2f;
+    config->alpha = 0.005f;
+    config->min_sd = channel < CHANNEL_COUNT ? channel_min_sd[channel] : 0.0f;
+    config->warmup = 20;
+}
+
+void detect_init(detect_state_t *state)
+{
+    uint32_t events = state->events;
+    memset(state, 0, sizeof(*state));
+    state->events = events;
+}
+
+float detect_sd(const detect_state_t *state)
+{
+    return sqrtf(state->var);
+}
+
+int detect_update(const detect_config_t *config, detect_state_t *state, float value)
+{
+    // Learn the baseline (Welford), then start scoring
+    if (state->n < config->warmup) {
+        state->n++;
+        float d = value - state->mean;
+        state->mean += d / (float)state->n;
+        state->var += d * (value - state->mean);
+        if (state->n == config->warmup) {
+            state->var = state->n > 1 ? state->var / (float)(state->n - 1) : 0.0f;
+            state->ewma = state->mean;
+        }
+        return 0;
+    }
+
+    float sd = fmaxf(sqrtf(state->var), config->min_sd);
+    if (sd <= 0.0f) sd = 1e-6f;
+    float z = (value - state->mean) / sd;
+
+    float score;
+    switch (config->method) {
+        case DETECT_CUSUM:
+            state->pos = fmaxf(0.0f, state->pos + z - config->slack);
+            state->neg = fmaxf(0.0f, state->neg - z - config->slack);
+            score = state->pos >= state->neg ? state->pos : -state->neg;
+            break;
+        case DETECT_EWMA:
+            state->ewma += config->lambda * (value - state->ewma);
+            // Steady-state standard deviation of the EWMA is sd * sqrt(lambda / (2 - lambda))
+            score = (state->ewma - state->mean) / (sd * sqrtf(config->lambda / (2.0f - config->lambda)));
+            break;
+        default:
+            score = z;
+            break;
+    }
+    state->score = score;
+
+    if (fabsf(score) > config->threshold) {
+        if (!state->alarm) {
+            state->events++;
+            if (config->method == DETECT_CUSUM) {
+                // The level has moved: learn the new one instead of alarming on it forever
+                detect_init(state);
+                state->score = score;
+            } else {
+                state->alarm = true;
+            }
+            return score > 0.0f ? 1 : -1;
+        }
+    } else if (fabsf(score) < config->threshold * 0.5f) {
+        state->alarm = false;       // Re-arm once clearly back inside the limits
+    }
+
+    // Track slow drift of the baseline (exponentially weighted mean and variance)
+    float d = value - state->mean;
+    state->mean += config->alpha * d;
+    state->var = (1.0f - config->alpha) * (state->var + config->alpha * d * d);
+    return 0;
+}
@@ -0,0 +1,306 @@
+#include "expr.h"
+#include "sdkconfig.h"
+#include <ctype.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if CONFIG_IDF_TARGET_LINUX
+#include <time.h>
+#else
+#include "esp_cpu.h"
+#endif
+
+typedef enum {
+    OP_CONST,       // arg: constant index
+    OP_VAR,         // arg: variable slot
+    OP_PREV,        // arg: variable slot
+    OP_DT,
+    OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_POW, OP_NEG,
+    OP_ABS, OP_SQRT, OP_EXP, OP_LOG, OP_SIN, OP_COS, OP_DEG, OP_RAD,
+    OP_MIN, OP_MAX, OP_ATAN2,
+    OP_CLAMP,
+} expr_op_t;
+
+typedef struct {
+    const char *name;
+    uint8_t argc;
+    uint8_t op;
+} expr_function_t;
+
+static const expr_function_t functions[] = {
+    { "abs", 1, OP_ABS },   { "sqrt", 1, OP_SQRT }, { "exp", 1, OP_EXP },
+    { "log", 1, OP_LOG },   { "sin", 1, OP_SIN },   { "cos", 1, OP_COS },
+    { "deg", 1, OP_DEG },   { "rad", 1, OP_RAD },
+    { "min", 2, OP_MIN },   { "max", 2, OP_MAX },   { "atan2", 2, OP_ATAN2 },
+    { "clamp", 3, OP_CLAMP },
+};
+
+typedef struct {
+    const char *src;
+    const char *pos;
+    const char *const *derived_names;
+    uint32_t var_mask;
+    expr_program_t *out;
+    int depth;                  // Stack depth at this point of the program
+    int nesting;                // Parser recursion, bounded to protect the caller's stack
+    char *err;
+    size_t err_len;
+    int failed;
+} parser_t;
+
+static int expr(parser_t *p);
+
+static int fail(parser_t *p, const char *format, ...)
+{
+    if (!p->failed) {
+        int n = snprintf(p->err, p->err_len, "col %d: ", (int)(p->pos - p->src) + 1);
+        va_list args;
+        va_start(args, format);
+        if (n >= 0 && (size_t)n < p->err_len) vsnprintf(p->err + n, p->err_len - n, format, args);
+        va_end(args);
+        p->failed = 1;
+    }
+    return -1;
+}
+
+// Appends one instruction; pushes/pops describe its stack effect
+static int emit(parser_t *p, expr_op_t op, uint8_t arg, int pops, int pushes)
+{
+    if (p->out->len >= EXPR_MAX_CODE) return fail(p, "expression too long");
+    p->out->code[p->out->len++] = (expr_instr_t){ (uint8_t)op, arg };
+    p->depth += pushes - pops;
+    if (p->depth > EXPR_STACK_DEPTH) return fail(p, "expression nested too deeply");
+    if (p->depth > p->out->depth) p->out->depth = (uint8_t)p->depth;
+    return 0;
+}
+
+static void skip_space(parser_t *p)
+{
+    while (isspace((unsigned char)*p->pos)) p->pos++;
+}
+
+static int accept(parser_t *p, char c)
+{
+    skip_space(p);
+    if (*p->pos != c) return 0;
+    p->pos++;
+    return 1;
+}
+
+static int identifier(parser_t *p, char *name, size_t size)
+{
+    skip_space(p);
+    size_t n = 0;
+    while (isalnum((unsigned char)*p->pos) || *p->pos == '_') {
+        if (n + 1 >= size) return fail(p, "name too long");
+        name[n++] = *p->pos++;
+    }
+    name[n] = '\0';
+    return n > 0 ? 0 : fail(p, "expected a name");
+}
+
+static int variable_slot(parser_t *p, const char *name)
+{
+    int slot = (int)sensor_channel_from_name(name);
+    if (slot == CHANNEL_NONE) {
+        slot = -1;
+        for (int i = 0; i < EXPR_MAX_DERIVED && p->derived_names && p->derived_names[i]; i++) {
+            if (strcmp(p->derived_names[i], name) == 0) slot = CHANNEL_COUNT + i;
+        }
+    }
+    if (slot < 0) return fail(p, "unknown name '%s'", name);
+    if (!(p->var_mask & (1u << slot))) return fail(p, "'%s' is not available to this task", name);
+    return slot;
+}
+
+static int primary(parser_t *p)
+{
+    skip_space(p);
+
+    if (isdigit((unsigned char)*p->pos) || *p->pos == '.') {
+        char *end;
+        float value = strtof(p->pos, &end);
+        if (end == p->pos) return fail(p, "bad number");
+        p->pos = end;
+        int index = -1;
+        for (int i = 0; i < p->out->const_count; i++) {
+            if (p->out->consts[i] == value) index = i;
+        }
+        if (index < 0) {
+            if (p->out->const_count >= EXPR_MAX_CONSTS) return fail(p, "too many constants");
+            index = p->out->const_count++;
+            p->out->consts[index] = value;
+        }
+        return emit(p, OP_CONST, (uint8_t)index, 0, 1);
+    }
+
+    if (accept(p, '(')) {
+        if (expr(p) != 0) return -1;
+        return accept(p, ')') ? 0 : fail(p, "expected ')'");
+    }
+
+    char name[EXPR_MAX_NAME_LEN + 1];
+    if (identifier(p, name, sizeof(name)) != 0) return -1;
+
+    if (strcmp(name, "dt") == 0) return emit(p, OP_DT, 0, 0, 1);
+
+    if (strcmp(name, "prev") == 0) {
+        char var[EXPR_MAX_NAME_LEN + 1];
+        if (!accept(p, '(') || identifier(p, var, sizeof(var)) != 0) return fail(p, "prev() takes a name");
+        int slot = variable_slot(p, var);
+        if (slot < 0) return -1;
+        if (!accept(p, ')')) return fail(p, "expected ')'");
+        return emit(p, OP_PREV, (uint8_t)slot, 0, 1);
+    }
+
+    for (size_t i = 0; i < sizeof(functions) / sizeof(functions[0]); i++) {
+        if (strcmp(functions[i].name, name) != 0) continue;
+        if (!accept(p, '(')) return fail(p, "expected '(' after %s", name);
+        for (int a = 0; a < functions[i].argc; a++) {
+            if (a > 0 && !accept(p, ',')) return fail(p, "%s() takes %d arguments", name, functions[i].argc);
+            if (expr(p) != 0) return -1;
+        }
+        if (!accept(p, ')')) return fail(p, "%s() takes %d arguments", name, functions[i].argc);
+        return emit(p, (expr_op_t)functions[i].op, 0, functions[i].argc, 1);
+    }
+
+    int slot = variable_slot(p, name);
+    if (slot < 0) return -1;
+    return emit(p, OP_VAR, (uint8_t)slot, 0, 1);
+}
+
+// unary := '-' unary | primary ('^' unary)?
+static int unary(parser_t *p)
+{
+    if (accept(p, '-')) {
+        if (++p->nesting > EXPR_STACK_DEPTH * 2) return fail(p, "expression nested too deeply");
+        if (unary(p) != 0) return -1;
+        p->nesting--;
+        return emit(p, OP_NEG, 0, 1, 1);
+    }
+    if (primary(p) != 0) return -1;
+    if (accept(p, '^')) {
+        if (unary(p) != 0) return -1;
+        return emit(p, OP_POW, 0, 2, 1);
+    }
+    return 0;
+}
+
+static int term(parser_t *p)
+{
+    if (unary(p) != 0) return -1;
+    while (1) {
+        expr_op_t op;
+        if (accept(p, '*')) op = OP_MUL;
+        else if (accept(p, '/')) op = OP_DIV;
+        else return 0;
+        if (unary(p) != 0 || emit(p, op, 0, 2, 1) != 0) return -1;
+    }
+}
+
+static int expr(parser_t *p)
+{
+    if (++p->nesting > EXPR_STACK_DEPTH * 2) return fail(p, "expression nested too deeply");
+    if (term(p) != 0) return -1;
+    while (1) {
+        expr_op_t op;
+        if (accept(p, '+')) op = OP_ADD;
+        else if (accept(p, '-')) op = OP_SUB;
+        else break;
+        if (term(p) != 0 || emit(p, op, 0, 2, 1) != 0) return -1;
+    }
+    p->nesting--;
+    return 0;
+}
+
+bool expr_reserved_name(const char *name)
+{
+    if (strcmp(name, "dt") == 0 || strcmp(name, "prev") == 0) return true;
+    if (sensor_channel_from_name(name) != CHANNEL_NONE) return true;
+    for (size_t i = 0; i < sizeof(functions) / sizeof(functions[0]); i++) {
+        if (strcmp(functions[i].name, name) == 0) return true;
+    }
+    return false;
+}
+
+int expr_compile(const char *src, const char *const *derived_names, uint32_t var_mask,
+                 expr_program_t *out, char *err, size_t err_len)
+{
+    memset(out, 0, sizeof(*out));
+    parser_t p = {
+        .src = src,
+        .pos = src,
+        .derived_names = derived_names,
+        .var_mask = var_mask,
+        .out = out,
+        .err = err,
+        .err_len = err_len,
+    };
+    if (err_len) err[0] = '\0';
+
+    if (expr(&p) != 0) return -1;
+    skip_space(&p);
+    if (*p.pos != '\0') return fail(&p, "unexpected '%c'", *p.pos);
+    return 0;
+}
+
+float expr_eval(const expr_program_t *program, const float *vars, const float *prev, float dt)
+{
+    float stack[EXPR_STACK_DEPTH];
+    int sp = 0;
+
+    for (int i = 0; i < program->len; i++) {
+        const expr_instr_t in = program->code[i];
+        switch ((expr_op_t)in.op) {
+            case OP_CONST: stack[sp++] = program->consts[in.arg]; break;
+            case OP_VAR:   stack[sp++] = vars[in.arg]; break;
+            case OP_PREV:  stack[sp++] = prev[in.arg]; break;
+            case OP_DT:    stack[sp++] = dt; break;
+            case OP_ADD:   sp--; stack[sp - 1] += stack[sp]; break;
+            case OP_SUB:   sp--; stack[sp - 1] -= stack[sp]; break;
+            case OP_MUL:   sp--; stack[sp - 1] *= stack[sp]; break;
+            case OP_DIV:   sp--; stack[sp - 1] /= stack[sp]; break;
+            case OP_POW:   sp--; stack[sp - 1] = powf(stack[sp - 1], stack[sp]); break;
+            case OP_NEG:   stack[sp - 1] = -stack[sp - 1]; break;
+            case OP_ABS:   stack[sp - 1] = fabsf(stack[sp - 1]); break;
+            case OP_SQRT:  stack[sp - 1] = sqrtf(stack[sp - 1]); break;
+            case OP_EXP:   stack[sp - 1] = expf(stack[sp - 1]); break;
+            case OP_LOG:   stack[sp - 1] = logf(stack[sp - 1]); break;
+            case OP_SIN:   stack[sp - 1] = sinf(stack[sp - 1]); break;
+            case OP_COS:   stack[sp - 1] = cosf(stack[sp - 1]); break;
+            case OP_DEG:   stack[sp - 1] *= (float)(180.0 / M_PI); break;
+            case OP_RAD:   stack[sp - 1] *= (float)(M_PI / 180.0); break;
+            case OP_MIN:   sp--; stack[sp - 1] = fminf(stack[sp - 1], stack[sp]); break;
+            case OP_MAX:   sp--; stack[sp - 1] = fmaxf(stack[sp - 1], stack[sp]); break;
+            case OP_ATAN2: sp--; stack[sp - 1] = atan2f(stack[sp - 1], stack[sp]); break;
+            case OP_CLAMP:
+                sp -= 2;
+                stack[sp - 1] = fminf(fmaxf(stack[sp - 1], stack[sp]), stack[sp + 1]);
+                break;
+        }
+    }
+    return sp > 0 ? stack[sp - 1] : 0.0f;
+}
+
+uint32_t expr_clock(void)
+{
+#if CONFIG_IDF_TARGET_LINUX
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec);
+#else
+    return esp_cpu_get_cycle_count();
+#endif
+}
+
+uint32_t expr_clock_to_ns(uint32_t ticks)
+{
+#if CONFIG_IDF_TARGET_LINUX
+    return ticks;
+#else
+    return (uint32_t)((uint64_t)ticks * 1000 / CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ);
+#endif
+}
@@ -0,0 +1,103 @@
+#include "fault.h"
+#include "freertos/FreeRTOS.h"
+#include <string.h>
+
+static const char *const kind_names[FAULT_KIND_COUNT] = {
+    "LATENCY", "FAIL", "ECHO_STUCK", "UART_STALL"
+};
+
+static fault_rule_t rules[MAX_FAULTS];
+static volatile int rule_count = 0;
+static uint32_t rng_state = 1;
+static portMUX_TYPE fault_lock = portMUX_INITIALIZER_UNLOCKED;
+
+fault_kind_t fault_kind_from_name(const char *name)
+{
+    if (strcmp(name, "NACK") == 0) return FAULT_FAIL;
+    for (int i = 0; i < FAULT_KIND_COUNT; i++) {
+        if (strcmp(name, kind_names[i]) == 0) return (fault_kind_t)i;
+    }
+    return FAULT_KIND_COUNT;
+}
+
+const char *fault_kind_name(fault_kind_t kind)
+{
+    return kind < FAULT_KIND_COUNT ? kind_names[kind] : "?";
+}
+
+// xorshift32: deterministic for a given seed and sequence of operations
+static uint32_t next_random(void)
+{
+    uint32_t x = rng_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    rng_state = x;
+    return x;
+}
+
+int fault_add(fault_kind_t kind, const char *target, uint16_t permille, uint32_t us, int32_t count)
+{
+    if (kind >= FAULT_KIND_COUNT || permille == 0 || permille > 1000) return -1;
+    
+    portENTER_CRITICAL(&fault_lock);
+    if (rule_count >= MAX_FAULTS) {
+        portEXIT_CRITICAL(&fault_lock);
+        return -1;
+    }
+    fault_rule_t *rule = &rules[rule_count];
+    rule->kind = kind;
+    strncpy(rule->target, target, FAULT_TARGET_LEN - 1);
+    rule->target[FAULT_TARGET_LEN - 1] = '\0';
+    rule->permille = permille;
+    rule->us = us;
+    rule->remaining = count > 0 ? count : -1;
+    rule->hits = 0;
+    rule_count++;
+    portEXIT_CRITICAL(&fault_lock);
+    return 0;
+}
+
+void fault_clear(void)
+{
+    portENTER_CRITICAL(&fault_lock);
+    rule_count = 0;
+    portEXIT_CRITICAL(&fault_lock);
+}
+
+void fault_seed(uint32_t seed)
+{
+    portENTER_CRITICAL(&fault_lock);
+    rng_state = seed ? seed : 1;
+    portEXIT_CRITICAL(&fault_lock);
+}
+
+int fault_list(fault_rule_t *out, int max)
+{
+    portENTER_CRITICAL(&fault_lock);
+    int n = rule_count < max ? rule_count : max;
+    memcpy(out, rules, n * sizeof(fault_rule_t));
+    portEXIT_CRITICAL(&fault_lock);
+    return n;
+}
+
+bool fault_hit(fault_kind_t kind, const char *target, uint32_t *us)
+{
+    if (rule_count == 0) return false;
+    
+    bool hit = false;
+    portENTER_CRITICAL(&fault_lock);
+    for (int i = 0; i < rule_count && !hit; i++) {
+        fault_rule_t *rule = &rules[i];
+        if (rule->kind != kind || rule->remaining == 0) continue;
+        if (strcmp(rule->target, "*") != 0 && strcmp(rule->target, target) != 0) continue;
+        if (next_random() % 1000 >= rule->permille) continue;
+        
+        if (rule->remaining > 0) rule->remaining--;
+        rule->hits++;
+        *us = rule->us;
+        hit = true;
+    }
+    portEXIT_CRITICAL(&fault_lock);
+    return hit;
+}
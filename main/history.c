@@ -0,0 +1,247 @@
+#include "history.h"
+#include "task_manager.h"
+#include "esp_timer.h"
+#include "esp_cpu.h"
+#include <math.h>
+#include <string.h>
+
+typedef struct {
+    int8_t owner;           // Task id, -1 when free
+    uint32_t seq;           // Allocation order, used to recycle the oldest block
+} block_meta_t;
+
+typedef struct {
+    int block;              // Open block index, -1 if none
+    history_cursor_t enc;
+} stream_t;
+
+static history_block_t blocks[HISTORY_BLOCK_COUNT];
+static block_meta_t meta[HISTORY_BLOCK_COUNT];
+static stream_t streams[MAX_TASKS];
+static uint32_t next_seq = 0;
+static SemaphoreHandle_t history_mutex = NULL;
+
+void history_init(void)
+{
+    if (!history_mutex) {
+        history_mutex = xSemaphoreCreateMutex();
+    }
+    history_clear();
+}
+
+void history_clear(void)
+{
+    if (history_mutex) xSemaphoreTake(history_mutex, portMAX_DELAY);
+    for (int i = 0; i < HISTORY_BLOCK_COUNT; i++) {
+        meta[i].owner = -1;
+        meta[i].seq = 0;
+    }
+    for (int i = 0; i < MAX_TASKS; i++) {
+        streams[i].block = -1;
+    }
+    next_seq = 0;
+    if (history_mutex) xSemaphoreGive(history_mutex);
+}
+
+static bool block_is_open(int idx)
+{
+    int owner = meta[idx].owner;
+    return owner >= 0 && streams[owner].block == idx;
+}
+
+// Take a free block, or recycle the oldest sealed one
+static int alloc_block(int task_id)
+{
+    int victim = -1;
+    for (int i = 0; i < HISTORY_BLOCK_COUNT; i++) {
+        if (meta[i].owner < 0) {
+            victim = i;
+            break;
+        }
+        if (!block_is_open(i) && (victim < 0 || meta[i].seq < meta[victim].seq)) {
+            victim = i;
+        }
+    }
+    if (victim < 0) return -1;
+    
+    meta[victim].owner = (int8_t)task_id;
+    meta[victim].seq = next_seq++;
+    return victim;
+}
+
+void history_append(int task_id, uint8_t channel_mask, const sensor_readings_t *readings)
+{
+    if (!history_mutex || task_id < 0 || task_id >= MAX_TASKS) return;
+    
+    int16_t values[CHANNEL_COUNT];
+    history_quantize(readings, values);
+    uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    
+    xSemaphoreTake(history_mutex, portMAX_DELAY);
+    
+    stream_t *stream = &streams[task_id];
+    if (stream->block >= 0 && blocks[stream->block].channel_mask != channel_mask) {
+        stream->block = -1;     // Channel set changed, seal the block
+    }
+    
+    for (int attempt = 0; attempt < 2; attempt++) {
+        if (stream->block < 0) {
+            stream->block = alloc_block(task_id);
+            if (stream->block < 0) break;
+            history_block_start(&blocks[stream->block], &stream->enc, channel_mask);
+        }
+        if (history_block_append(&blocks[stream->block], &stream->enc, now_ms, values)) break;
+        stream->block = -1;     // Full: seal and retry in a fresh block
+    }
+    
+    xSemaphoreGive(history_mutex);
+}
+
+static bool overlaps(const history_block_t *block, uint32_t from_ms, uint32_t to_ms)
+{
+    return block->count > 0 && block->last_ts_ms >= from_ms && block->first_ts_ms <= to_ms;
+}
+
+int history_range_minmax(int task_id, sensor_channel_t channel, uint32_t from_ms, uint32_t to_ms,
+                         float *min, float *max)
+{
+    if (!history_mutex || channel >= CHANNEL_COUNT) return -1;
+    
+    int16_t lo = INT16_MAX, hi = INT16_MIN;
+    bool found = false;
+    
+    xSemaphoreTake(history_mutex, portMAX_DELAY);
+    for (int i = 0; i < HISTORY_BLOCK_COUNT; i++) {
+        const history_block_t *block = &blocks[i];
+        if (meta[i].owner != task_id || !(block->channel_mask & (1u << channel))) continue;
+        if (!overlaps(block, from_ms, to_ms)) continue;
+        
+        if (block->first_ts_ms >= from_ms && block->last_ts_ms <= to_ms) {
+            if (block->min[channel] < lo) lo = block->min[channel];
+            if (block->max[channel] > hi) hi = block->max[channel];
+            found = true;
+            continue;
+        }
+        
+        history_reader_t reader;
+        uint32_t ts;
+        int16_t values[CHANNEL_COUNT];
+        history_reader_init(&reader, block);
+        while (history_reader_next(&reader, &ts, values)) {
+            if (ts < from_ms || ts > to_ms) continue;
+            if (values[channel] < lo) lo = values[channel];
+            if (values[channel] > hi) hi = values[channel];
+            found = true;
+        }
+    }
+    xSemaphoreGive(history_mutex);
+    
+    if (!found) return -1;
+    *min = history_dequantize(channel, lo);
+    *max = history_dequantize(channel, hi);
+    return 0;
+}
+
+int history_query(int task_id, uint32_t from_ms, uint32_t to_ms, history_visit_fn_t fn, void *ctx)
+{
+    if (!history_mutex || !fn) return -1;
+    
+    int visited = 0;
+    uint32_t last_seq = 0;
+    bool first = true;
+    
+    xSemaphoreTake(history_mutex, portMAX_DELAY);
+    while (1) {
+        // Next block of this task in allocation order
+        int idx = -1;
+        for (int i = 0; i < HISTORY_BLOCK_COUNT; i++) {
+            if (meta[i].owner != task_id) continue;
+            if (!first && meta[i].seq <= last_seq) continue;
+            if (idx < 0 || meta[i].seq < meta[idx].seq) idx = i;
+        }
+        if (idx < 0) break;
+        first = false;
+        last_seq = meta[idx].seq;
+        
+        const history_block_t *block = &blocks[idx];
+        if (!overlaps(block, from_ms, to_ms)) continue;
+        
+        history_reader_t reader;
+        uint32_t ts;
+        int16_t values[CHANNEL_COUNT];
+        history_reader_init(&reader, block);
+        while (history_reader_next(&reader, &ts, values)) {
+            if (ts < from_ms || ts > to_ms) continue;
+            fn(ts, values, block->channel_mask, ctx);
+            visited++;
+        }
+    }
+    xSemaphoreGive(history_mutex);
+    return visited;
+}
+
+void history_get_stats(history_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    if (!history_mutex) return;
+    
+    xSemaphoreTake(history_mutex, portMAX_DELAY);
+    for (int i = 0; i < HISTORY_BLOCK_COUNT; i++) {
+        if (meta[i].owner < 0) continue;
+        stats->blocks_used++;
+        stats->samples += blocks[i].count;
+        stats->bytes += offsetof(history_block_t, data) + blocks[i].used;
+    }
+    xSemaphoreGive(history_mutex);
+    stats->raw_bytes = stats->samples * (sizeof(uint32_t) + sizeof(sensor_readings_t));
+}
+
+int history_snapshot(uint32_t min_seq, history_block_t *out, int *task_id, uint32_t *seq)
+{
+    if (!history_mutex) return -1;
+    
+    xSemaphoreTake(history_mutex, portMAX_DELAY);
+    int idx = -1;
+    for (int i = 0; i < HISTORY_BLOCK_COUNT; i++) {
+        if (meta[i].owner < 0 || meta[i].seq < min_seq) continue;
+        if (idx < 0 || meta[i].seq < meta[idx].seq) idx = i;
+    }
+    if (idx >= 0) {
+        memcpy(out, &blocks[idx], sizeof(*out));
+        *task_id = meta[idx].owner;
+        *seq = meta[idx].seq;
+    }
+    xSemaphoreGive(history_mutex);
+    return idx >= 0 ? 0 : -1;
+}
+
+uint32_t history_bench_encode(int samples)
+{
+    static history_block_t scratch;
+    history_cursor_t enc;
+    sensor_readings_t readings = {0};
+    int16_t values[CHANNEL_COUNT];
+    uint32_t cycles = 0;
+    const uint8_t mask = (1u << CHANNEL_DISTANCE) | (1u << CHANNEL_ACCEL_X) |
+                         (1u << CHANNEL_ACCEL_Y) | (1u << CHANNEL_ACCEL_Z);
+    
+    if (samples <= 0) return 0;
+    
+    history_block_start(&scratch, &enc, mask);
+    for (int i = 0; i < samples; i++) {
+        // Slow drift with a little noise, sampled every 100 ms
+        readings.ultrasonic_distance = 50 + (i / 16) % 8;
+        readings.mpu_accel_x = 0.01f * sinf((float)i * 0.1f);
+        readings.mpu_accel_y = -0.02f;
+        readings.mpu_accel_z = 1.0f + 0.003f * (float)(i % 3);
+        
+        uint32_t t0 = esp_cpu_get_cycle_count();
+        history_quantize(&readings, values);
+        if (!history_block_append(&scratch, &enc, (uint32_t)i * 100, values)) {
+            history_block_start(&scratch, &enc, mask);
+            history_block_append(&scratch, &enc, (uint32_t)i * 100, values);
+        }
+        cycles += esp_cpu_get_cycle_count() - t0;
+    }
+    return cycles / (uint32_t)samples;
+}
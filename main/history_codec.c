@@ -0,0 +1,144 @@
+#include "history_codec.h"
+#include <math.h>
+#include <string.h>
+
+static const float channel_scale[CHANNEL_COUNT] = {
+    10.0f,      // hum: 0.1 %RH
+    10.0f,      // temp: 0.1 C
+    1.0f,       // dist: 1 cm
+    1000.0f,    // ax: 1 mg
+    1000.0f,    // ay
+    1000.0f,    // az
+};
+
+static int16_t clamp_i16(float v)
+{
+    if (v > 32767.0f) return 32767;
+    if (v < -32768.0f) return -32768;
+    return (int16_t)lrintf(v);
+}
+
+void history_quantize(const sensor_readings_t *readings, int16_t values[CHANNEL_COUNT])
+{
+    for (int ch = 0; ch < CHANNEL_COUNT; ch++) {
+        values[ch] = clamp_i16(sensor_readings_get(readings, (sensor_channel_t)ch) * channel_scale[ch]);
+    }
+}
+
+float history_dequantize(sensor_channel_t channel, int16_t value)
+{
+    return channel < CHANNEL_COUNT ? (float)value / channel_scale[channel] : 0.0f;
+}
+
+static inline uint32_t zigzag_encode(int32_t v)
+{
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static inline int32_t zigzag_decode(uint32_t v)
+{
+    return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+static inline size_t varint_put(uint8_t *out, uint32_t v)
+{
+    size_t n = 0;
+    while (v >= 0x80) {
+        out[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    out[n++] = (uint8_t)v;
+    return n;
+}
+
+static inline bool varint_get(const uint8_t *in, uint16_t len, uint16_t *pos, uint32_t *v)
+{
+    uint32_t result = 0;
+    for (int shift = 0; shift < 35 && *pos < len; shift += 7) {
+        uint8_t b = in[(*pos)++];
+        result |= (uint32_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) {
+            *v = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+void history_block_start(history_block_t *block, history_cursor_t *enc, uint8_t channel_mask)
+{
+    memset(block, 0, offsetof(history_block_t, data));
+    block->channel_mask = channel_mask;
+    memset(enc, 0, sizeof(*enc));
+}
+
+bool history_block_append(history_block_t *block, history_cursor_t *enc,
+                          uint32_t ts_ms, const int16_t values[CHANNEL_COUNT])
+{
+    if (HISTORY_BLOCK_DATA_BYTES - block->used < HISTORY_SAMPLE_MAX_BYTES) return false;
+    
+    uint8_t *out = block->data + block->used;
+    size_t n = 0;
+    
+    // The first timestamp lives in the header; later ones are delta-of-delta
+    if (block->count == 0) {
+        block->first_ts_ms = ts_ms;
+    } else {
+        int32_t delta = (int32_t)(ts_ms - enc->prev_ts);
+        n += varint_put(out + n, zigzag_encode(delta - enc->prev_delta));
+        enc->prev_delta = delta;
+    }
+    enc->prev_ts = ts_ms;
+    
+    for (int ch = 0; ch < CHANNEL_COUNT; ch++) {
+        if (!(block->channel_mask & (1u << ch))) continue;
+        int16_t v = values[ch];
+        n += varint_put(out + n, zigzag_encode((int32_t)v - enc->prev[ch]));
+        enc->prev[ch] = v;
+        
+        if (block->count == 0 || v < block->min[ch]) block->min[ch] = v;
+        if (block->count == 0 || v > block->max[ch]) block->max[ch] = v;
+    }
+    
+    block->used += (uint16_t)n;
+    block->last_ts_ms = ts_ms;
+    block->count++;
+    return true;
+}
+
+void history_reader_init(history_reader_t *reader, const history_block_t *block)
+{
+    memset(reader, 0, sizeof(*reader));
+    reader->block = block;
+}
+
+bool history_reader_next(history_reader_t *reader, uint32_t *ts_ms, int16_t values[CHANNEL_COUNT])
+{
+    const history_block_t *block = reader->block;
+    history_cursor_t *cur = &reader->cursor;
+    uint32_t raw;
+    
+    if (reader->index >= block->count) return false;
+    
+    if (reader->index == 0) {
+        cur->prev_ts = block->first_ts_ms;
+    } else {
+        if (!varint_get(block->data, block->used, &reader->pos, &raw)) return false;
+        cur->prev_delta += zigzag_decode(raw);
+        cur->prev_ts += (uint32_t)cur->prev_delta;
+    }
+    *ts_ms = cur->prev_ts;
+    
+    for (int ch = 0; ch < CHANNEL_COUNT; ch++) {
+        if (!(block->channel_mask & (1u << ch))) {
+            values[ch] = 0;
+            continue;
+        }
+        if (!varint_get(block->data, block->used, &reader->pos, &raw)) return false;
+        cur->prev[ch] = (int16_t)(cur->prev[ch] + zigzag_decode(raw));
+        values[ch] = cur->prev[ch];
+    }
+    
+    reader->index++;
+    return true;
+}
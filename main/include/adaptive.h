@@ -0,0 +1,43 @@
+#ifndef ADAPTIVE_H
+#define ADAPTIVE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sensors.h"
+
+#define ADAPTIVE_REPORT_MS 5000     // Interval between ADAPT statistics lines
+
+// Adaptive sampling parameters (part of the task config)
+typedef struct {
+    bool enabled;
+    sensor_channel_t channel;   // Channel whose dynamics drive the rate
+    int min_period_ms;
+    int max_period_ms;
+    float threshold;            // Innovation (channel units) that counts as "moving"
+    float alpha;                // Level/trend smoothing factor, 0..1
+} adaptive_config_t;
+
+// Per-task filter and statistics state
+typedef struct {
+    bool primed;
+    float level;                // Filtered signal
+    float trend;                // Filtered rate of change per ms
+    float last_value;
+    int period_ms;              // Current effective period
+    // Statistics since the last report
+    uint32_t samples;
+    uint32_t elapsed_ms;
+    float err_sq_sum;           // Squared sample-and-hold reconstruction error
+} adaptive_state_t;
+
+void adaptive_init(const adaptive_config_t *config, adaptive_state_t *state, int initial_period_ms);
+
+// Feed one sample taken elapsed_ms after the previous one; returns the next period
+int adaptive_update(const adaptive_config_t *config, adaptive_state_t *state, float value, int elapsed_ms);
+
+// Average sample rate (Hz) and RMS reconstruction error since the last reset
+float adaptive_sample_rate_hz(const adaptive_state_t *state);
+float adaptive_rms_error(const adaptive_state_t *state);
+void adaptive_reset_stats(adaptive_state_t *state);
+
+#endif // ADAPTIVE_H
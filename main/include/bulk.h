@@ -0,0 +1,13 @@
+#ifndef BULK_H
+#define BULK_H
+
+#include <stdbool.h>
+
+#define BULK_CHUNK_BYTES 1024       // Raw bytes per compressed frame
+
+// Stream the whole history over UART. Compressed mode sends serialized history
+// blocks in LZ4-compressed frames; text mode sends one line per sample (the
+// uncompressed baseline). Returns the number of samples sent.
+int bulk_dump(bool compressed);
+
+#endif // BULK_H
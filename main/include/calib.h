@@ -0,0 +1,65 @@
+#ifndef CALIB_H
+#define CALIB_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+
+#ifndef CONFIG_CALIB_SNAPSHOT_INTERVAL_S
+#define CONFIG_CALIB_SNAPSHOT_INTERVAL_S 600
+#endif
+
+#define CALIB_DEFAULT_SAMPLES 200
+#define CALIB_MAX_SD_G 0.02f        // Noisier than this per axis and the capture counts as moving
+
+// Accelerometer correction: calibrated = (raw - bias) * scale, in g.
+// pos/neg remember the raw gravity reading of each axis pointing up and
+// down; once both are known the axis gets a two-point bias and scale.
+typedef struct {
+    float bias[3];
+    float scale[3];
+    float pos[3];
+    float neg[3];
+    uint8_t seen_pos;           // Bit per axis
+    uint8_t seen_neg;
+} imu_calib_t;
+
+// Result of one stationary capture
+typedef struct {
+    int axis;                   // Axis gravity was on, 0..2
+    int sign;                   // +1 pointing up, -1 down
+    float mean[3];              // Raw, g
+    float sd[3];
+} calib_capture_t;
+
+void calib_imu_identity(imu_calib_t *calib);
+void calib_imu_apply(const imu_calib_t *calib, float *x, float *y, float *z);
+
+// NVS storage, keyed by sensor instance id; -1 if nothing valid is stored
+int calib_imu_load(const char *id, imu_calib_t *calib);
+int calib_imu_save(const char *id, const imu_calib_t *calib);
+
+// Average samples raw readings of a registered MPU6050 instance held still,
+// fold them into its calibration and store it. -1 if the readings failed,
+// the sensor moved (sd above CALIB_MAX_SD_G) or gravity was not near 1 g.
+int calib_imu_capture(int instance, int samples, calib_capture_t *capture);
+
+// Raw record storage for other modules, in an NVS namespace of their own so
+// calib_clear() leaves it alone: kind is one letter per record type, name the
+// sensor or task it belongs to; -1 if nothing of that size is stored
+int calib_blob_load(const char *space, char kind, const char *name, void *blob, size_t len);
+int calib_blob_save(const char *space, char kind, const char *name, const void *blob, size_t len);
+
+// Opaque per-task filter snapshots (warm start), keyed by task name
+int calib_state_load(const char *task_name, void *blob, size_t len);
+int calib_state_save(const char *task_name, const void *blob, size_t len);
+
+// Drop all stored calibrations and snapshots
+int calib_clear(void);
+
+// Starts a low-priority task calling save every CALIB_SNAPSHOT_INTERVAL_S
+// (disabled when 0), so flash writes never happen on a sampling task
+void calib_start_snapshots(void (*save)(void));
+
+#endif // CALIB_H
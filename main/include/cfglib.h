@@ -0,0 +1,44 @@
+#ifndef CFGLIB_H
+#define CFGLIB_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "task_manager.h"
+
+#define CFGLIB_NAME_LEN 16
+
+// Library of compiled configs (config_image_t) in the "cfglib" flash
+// partition, one per slot. Activating an entry maps the slot and creates the
+// tasks from the mapped image: no upload and no JSON parse.
+typedef struct {
+    char name[CFGLIB_NAME_LEN];
+    uint32_t size;              // Image bytes
+    int tasks;
+    int modes;
+    bool current;               // Compiled by this firmware's config layout
+} cfglib_entry_t;
+
+// Locate the partition; -1 if the partition table has none
+int cfglib_init(void);
+int cfglib_slot_count(void);
+size_t cfglib_slot_size(void);     // Largest image a slot holds
+
+// Entry in a slot; -1 if the slot is empty or corrupt
+int cfglib_get(int slot, cfglib_entry_t *entry);
+// Slot of an entry given by slot number or name; -1 if there is none
+int cfglib_find(const char *id);
+
+// Store an image under name, replacing the entry of that name or taking the
+// first free slot. Returns the slot, -1 if it does not fit or the library is full.
+int cfglib_install(const char *name, const config_image_t *image, size_t size);
+int cfglib_erase(int slot);
+
+// Replace the running tasks with an entry's; returns the number created, -1 on error
+int cfglib_activate(int slot);
+
+// Entry activated at boot instead of waiting for an upload, -1 = none
+int cfglib_boot_slot(void);
+int cfglib_set_boot(int slot);
+
+#endif // CFGLIB_H
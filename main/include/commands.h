@@ -0,0 +1,17 @@
+#ifndef COMMANDS_H
+#define COMMANDS_H
+
+#include <stdbool.h>
+
+#define CMD_LINE_MAX 128
+#define CMD_MAX_ARGS 8
+
+// Read newline-terminated commands from the active transport and dispatch them (never returns)
+void commands_loop(void);
+
+// Receive a JSON config over the active transport: wait for START (if
+// await_start), reply READY, then collect until END. Returns a malloc'd
+// string, NULL if nothing arrived or the link went quiet for 10 s after READY.
+char *commands_receive_config(bool await_start);
+
+#endif // COMMANDS_H
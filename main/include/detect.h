@@ -0,0 +1,59 @@
+#ifndef DETECT_H
+#define DETECT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sensors.h"
+
+#define DETECT_MAX_PER_TASK CHANNEL_COUNT
+
+typedef enum {
+    DETECT_CUSUM,       // Two-sided CUSUM of the z-score: sustained level shifts
+    DETECT_EWMA,        // EWMA control chart: smaller drifts, smoothed against noise
+    DETECT_ZSCORE,      // Single-sample outliers against the running mean and variance
+    DETECT_METHOD_COUNT
+} detect_method_t;
+
+// Online change/anomaly detector on one channel of the task's averaged readings
+// (part of the task config). All methods score against a baseline mean and
+// variance learned over the first warmup samples and then tracked with alpha.
+typedef struct {
+    sensor_channel_t channel;
+    detect_method_t method;
+    float threshold;            // Score (in standard deviations) that raises an event
+    float slack;                // CUSUM: drift allowance k per sample, in standard deviations
+    float lambda;               // EWMA: smoothing of the charted statistic, 0..1
+    float alpha;                // Baseline tracking rate, 0..1
+    float min_sd;               // Floor on the standard deviation (sensor resolution)
+    uint16_t warmup;            // Samples to learn the baseline before scoring
+    int boost_period_ms;        // Period while boosted after an event, 0 = no boost
+    int boost_window_ms;
+} detect_config_t;
+
+typedef struct {
+    uint32_t n;                 // Samples in the current baseline
+    float mean;
+    float var;                  // Sum of squared deviations while warming up
+    float ewma;
+    float pos;                  // CUSUM upper and lower sums
+    float neg;
+    float score;                // Last statistic, signed
+    bool alarm;
+    uint32_t events;
+} detect_state_t;
+
+detect_method_t detect_method_from_name(const char *name);  // DETECT_METHOD_COUNT if unknown
+const char *detect_method_name(detect_method_t method);
+
+// Defaults for a channel: resolution-based min_sd and per-method thresholds
+void detect_default_config(detect_config_t *config, sensor_channel_t channel, detect_method_t method);
+
+void detect_init(detect_state_t *state);
+
+// Feed one sample; returns +1 or -1 (direction) when it raises an event, else 0.
+// A CUSUM event marks a change point, so the baseline is learned again.
+int detect_update(const detect_config_t *config, detect_state_t *state, float value);
+
+float detect_sd(const detect_state_t *state);
+
+#endif // DETECT_H
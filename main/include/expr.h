@@ -0,0 +1,55 @@
+#ifndef EXPR_H
+#define EXPR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "sensors.h"
+
+#define EXPR_MAX_CODE 48
+#define EXPR_MAX_CONSTS 8
+#define EXPR_STACK_DEPTH 16
+#define EXPR_MAX_DERIVED 4
+#define EXPR_MAX_NAME_LEN 12
+
+// Variable slots: the sensor channels, then the task's derived values in
+// declaration order (a derived expression may use the ones before it)
+#define EXPR_VAR_COUNT (CHANNEL_COUNT + EXPR_MAX_DERIVED)
+
+typedef struct {
+    uint8_t op;
+    uint8_t arg;
+} expr_instr_t;
+
+// Compiled arithmetic over channels, e.g. "(dist - prev(dist)) / dt" or
+// "deg(atan2(ax, az))". Postfix bytecode for a small stack machine; evaluation
+// touches only the program and a fixed stack, never the heap.
+typedef struct {
+    expr_instr_t code[EXPR_MAX_CODE];
+    float consts[EXPR_MAX_CONSTS];
+    uint8_t len;
+    uint8_t const_count;
+    uint8_t depth;              // Stack slots needed
+} expr_program_t;
+
+// Grammar: + - * / ^, unary minus, parentheses, numbers, channel names (hum,
+// temp, dist, ax, ay, az), earlier derived names, dt (seconds since the last
+// cycle), prev(<name>) (its value last cycle) and the functions abs sqrt exp
+// log sin cos deg rad min max atan2 clamp.
+// var_mask limits which variable slots may be referenced. Returns -1 with a
+// message in err on a syntax error, unknown name or a program too large.
+int expr_compile(const char *src, const char *const *derived_names, uint32_t var_mask,
+                 expr_program_t *out, char *err, size_t err_len);
+
+// True for channel, function and built-in names, which derived channels cannot use
+bool expr_reserved_name(const char *name);
+
+// vars and prev hold EXPR_VAR_COUNT values
+float expr_eval(const expr_program_t *program, const float *vars, const float *prev, float dt);
+
+// For measuring evaluation cost: a free-running counter (CPU cycles on the
+// target, ns on the host build) and the length of an interval of it in ns
+uint32_t expr_clock(void);
+uint32_t expr_clock_to_ns(uint32_t ticks);
+
+#endif // EXPR_H
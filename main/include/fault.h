@@ -0,0 +1,42 @@
+#ifndef FAULT_H
+#define FAULT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define MAX_FAULTS 8
+#define FAULT_TARGET_LEN 16
+
+// Injected misbehaviour for exercising timeout and error paths under load.
+// Each rule fires on a fraction of the matching operations, drawn from a
+// seeded generator so a scripted run is repeatable.
+typedef enum {
+    FAULT_LATENCY,      // Busy-wait <us> extra on a sensor read (mutex held)
+    FAULT_FAIL,         // Sensor read fails after <us> (I2C NACK, DHT timeout)
+    FAULT_ECHO_STUCK,   // Ultrasonic echo reads high, the measurement runs into its timeout
+    FAULT_UART_STALL,   // Link write stalls <us> while holding the TX lock
+    FAULT_KIND_COUNT
+} fault_kind_t;
+
+typedef struct {
+    fault_kind_t kind;
+    char target[FAULT_TARGET_LEN];  // Sensor id, or "*" for any
+    uint16_t permille;              // Chance per operation, 1000 = always
+    uint32_t us;
+    int32_t remaining;              // Hits left, -1 = unlimited
+    uint32_t hits;
+} fault_rule_t;
+
+fault_kind_t fault_kind_from_name(const char *name);    // FAULT_KIND_COUNT if unknown
+const char *fault_kind_name(fault_kind_t kind);
+
+int fault_add(fault_kind_t kind, const char *target, uint16_t permille, uint32_t us, int32_t count);
+void fault_clear(void);
+void fault_seed(uint32_t seed);
+int fault_list(fault_rule_t *out, int max);
+
+// True when a rule of this kind fires for target; *us receives its parameter.
+// Cheap when no rules are armed.
+bool fault_hit(fault_kind_t kind, const char *target, uint32_t *us);
+
+#endif // FAULT_H
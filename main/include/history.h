@@ -0,0 +1,42 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include "history_codec.h"
+
+#define HISTORY_BLOCK_COUNT 48      // ~12 KB of compressed history
+
+typedef struct {
+    int blocks_used;
+    uint32_t samples;
+    uint32_t bytes;                 // Compressed bytes including block headers
+    uint32_t raw_bytes;             // Same samples stored as timestamp + sensor_readings_t
+} history_stats_t;
+
+typedef void (*history_visit_fn_t)(uint32_t ts_ms, const int16_t values[CHANNEL_COUNT],
+                                   uint8_t channel_mask, void *ctx);
+
+void history_init(void);
+void history_clear(void);
+
+// Record one sample of a task's channels, timestamped now. Oldest blocks are
+// recycled once the pool is exhausted.
+void history_append(int task_id, uint8_t channel_mask, const sensor_readings_t *readings);
+
+// Min/max of one channel over [from_ms, to_ms]; block summaries answer fully
+// covered blocks, only boundary blocks are decoded. Returns -1 if no samples.
+int history_range_minmax(int task_id, sensor_channel_t channel, uint32_t from_ms, uint32_t to_ms,
+                         float *min, float *max);
+
+// Visit every sample of a task in [from_ms, to_ms], oldest block first
+int history_query(int task_id, uint32_t from_ms, uint32_t to_ms, history_visit_fn_t fn, void *ctx);
+
+void history_get_stats(history_stats_t *stats);
+
+// Copy the oldest block allocated at or after min_seq (for export without holding
+// the history lock). Returns 0 and fills task_id/seq, or -1 when none is left.
+int history_snapshot(uint32_t min_seq, history_block_t *out, int *task_id, uint32_t *seq);
+
+// Average encode cost in CPU cycles per sample over a synthetic signal
+uint32_t history_bench_encode(int samples);
+
+#endif // HISTORY_H
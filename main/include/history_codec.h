@@ -0,0 +1,55 @@
+#ifndef HISTORY_CODEC_H
+#define HISTORY_CODEC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "sensor_channels.h"
+
+// Compressed sample block. Timestamps are stored as zig-zag varint delta-of-deltas,
+// channel values as fixed-point zig-zag varint deltas, so a steady signal costs about
+// one byte per channel per sample.
+#define HISTORY_BLOCK_DATA_BYTES 216
+
+// Worst case encoded size of one sample (timestamp + every channel)
+#define HISTORY_SAMPLE_MAX_BYTES (5 + 3 * CHANNEL_COUNT)
+
+typedef struct {
+    uint32_t first_ts_ms;
+    uint32_t last_ts_ms;
+    uint16_t count;                 // Samples in the block
+    uint16_t used;                  // Payload bytes used
+    uint8_t channel_mask;           // Bit per sensor_channel_t stored in the block
+    int16_t min[CHANNEL_COUNT];     // Fixed-point summaries for range queries
+    int16_t max[CHANNEL_COUNT];
+    uint8_t data[HISTORY_BLOCK_DATA_BYTES];
+} history_block_t;
+
+// Delta state shared by the encoder and the decoder
+typedef struct {
+    uint32_t prev_ts;
+    int32_t prev_delta;
+    int16_t prev[CHANNEL_COUNT];
+} history_cursor_t;
+
+typedef struct {
+    const history_block_t *block;
+    uint16_t pos;
+    uint16_t index;
+    history_cursor_t cursor;
+} history_reader_t;
+
+// Fixed-point conversion: 0.1 %RH, 0.1 C, 1 cm, 1 mg
+void history_quantize(const sensor_readings_t *readings, int16_t values[CHANNEL_COUNT]);
+float history_dequantize(sensor_channel_t channel, int16_t value);
+
+void history_block_start(history_block_t *block, history_cursor_t *enc, uint8_t channel_mask);
+
+// Append one sample; returns false (block untouched) when the block is full
+bool history_block_append(history_block_t *block, history_cursor_t *enc,
+                          uint32_t ts_ms, const int16_t values[CHANNEL_COUNT]);
+
+void history_reader_init(history_reader_t *reader, const history_block_t *block);
+bool history_reader_next(history_reader_t *reader, uint32_t *ts_ms, int16_t values[CHANNEL_COUNT]);
+
+#endif // HISTORY_CODEC_H
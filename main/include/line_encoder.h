@@ -0,0 +1,44 @@
+#ifndef LINE_ENCODER_H
+#define LINE_ENCODER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "sensors.h"
+
+#define LINE_ENCODER_PREFIX_LEN 36
+#define LINE_ENCODER_MAX_VALUES 4
+#define LINE_ENCODER_LABEL_LEN 16
+
+// Text record of one task cycle, e.g. "[Proximity] Dist:52cm\n". Built once at
+// config time from the channels a task prints, so the per-cycle work is a
+// prefix copy plus one fixed-point conversion per field, with no format
+// string parsing. The compact form ("@3,52,-0.4\n") drops labels and units
+// for hosts that know the field order from their subscription.
+typedef struct {
+    char prefix[LINE_ENCODER_PREFIX_LEN];   // "[TaskName]" or "@<id>"
+    uint8_t prefix_len;
+    bool compact;
+    uint8_t count;
+    uint8_t fields[CHANNEL_COUNT];          // sensor_channel_t, in output order
+    uint8_t value_count;                    // Named values appended after the fields
+    uint8_t value_index[LINE_ENCODER_MAX_VALUES];   // Entry of the values array printed
+    uint8_t value_decimals[LINE_ENCODER_MAX_VALUES];
+    char value_labels[LINE_ENCODER_MAX_VALUES][LINE_ENCODER_LABEL_LEN];    // " name:"
+} line_encoder_t;
+
+// Fields are the channels in mask, in channel order
+void line_encoder_build(line_encoder_t *encoder, const char *task_name, uint8_t mask);
+
+// Switch to the compact form, prefixed with the task id instead of its name
+void line_encoder_set_compact(line_encoder_t *encoder, int task_id);
+
+// Append values[index] (a derived channel) printed as " name:<value>"; -1 if full
+int line_encoder_add_value(line_encoder_t *encoder, int index, const char *name, int decimals);
+
+// Writes the newline-terminated record; values is indexed as given to add_value.
+// Returns the length (truncated to size - 1).
+size_t line_encoder_encode(const line_encoder_t *encoder, const sensor_readings_t *readings,
+                           const float *values, char *out, size_t size);
+
+#endif // LINE_ENCODER_H
@@ -0,0 +1,17 @@
+#ifndef LZ_COMPRESS_H
+#define LZ_COMPRESS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Inputs are compressed in chunks of at most this size (positions fit in 16 bits)
+#define LZ_MAX_INPUT 4096
+
+// Output capacity that always fits the compressed form of len bytes
+#define LZ_BOUND(len) ((len) + (len) / 255 + 16)
+
+// Compress one chunk into the LZ4 block format (no frame header, no checksum).
+// Returns the compressed size, or 0 if out_cap is too small or len > LZ_MAX_INPUT.
+size_t lz_compress(const uint8_t *in, size_t len, uint8_t *out, size_t out_cap);
+
+#endif // LZ_COMPRESS_H
@@ -0,0 +1,44 @@
+#ifndef MQTT_PUB_H
+#define MQTT_PUB_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sensors.h"
+
+// Optional MQTT publisher (enable under "MQTT Publisher" in menuconfig).
+// Samples are queued in a RAM ring, batched per task and published to
+// <prefix>/<task> (or <prefix>/<task>/<channel>). While the broker is
+// unreachable or QoS 1 acks lag, the oldest samples spill to a file and are
+// replayed first once publishing catches up. With the option off every call
+// is a no-op.
+
+typedef struct {
+    bool enabled;
+    bool connected;
+    uint32_t queued;            // Samples waiting in RAM
+    uint32_t spilled;           // Samples waiting in the spill file
+    uint32_t messages;          // Messages handed to the client
+    uint32_t samples;           // Samples carried by those messages
+    uint32_t bytes;             // Payload bytes
+    uint32_t dropped;           // Samples lost (ring and spill file full, or config replaced)
+    uint32_t acked;             // QoS 1 acknowledgements received
+    uint32_t ack_avg_us;        // Publish -> PUBACK
+    uint32_t ack_max_us;
+    uint32_t age_avg_ms;        // Sample timestamp -> handed to the client
+    uint32_t age_max_ms;
+    uint32_t elapsed_ms;        // Since the stats were last reset
+} mqtt_pub_stats_t;
+
+// Connect to the configured broker and start the publisher task
+void mqtt_pub_init(void);
+
+// Queue one sample of a task's channels; never blocks on the network
+void mqtt_pub_sample(int task_id, uint8_t channel_mask, const sensor_readings_t *readings);
+
+// Discard every queued and spilled sample; the next config reuses the task ids
+void mqtt_pub_clear(void);
+
+void mqtt_pub_get_stats(mqtt_pub_stats_t *stats);
+void mqtt_pub_reset_stats(void);
+
+#endif // MQTT_PUB_H
@@ -0,0 +1,48 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+#ifndef CONFIG_PROFILER_SAMPLES
+#define CONFIG_PROFILER_SAMPLES 1024
+#endif
+#ifndef CONFIG_PROFILER_DEPTH
+#define CONFIG_PROFILER_DEPTH 4
+#endif
+
+#define PROFILER_MAX_TASKS 32
+
+// Statistical PC sampler. A hardware timer per core interrupts at the
+// configured rate and the ISR stores the interrupted program counter, up to
+// CONFIG_PROFILER_DEPTH - 1 callers and the running task into a ring. A full
+// ring drops new samples (counted as lost) until it is drained.
+typedef struct {
+    uint8_t core;
+    uint8_t task;               // Index into the task name table
+    uint8_t depth;              // Valid entries in pc[], leaf first
+    uint32_t pc[CONFIG_PROFILER_DEPTH];
+} profiler_sample_t;
+
+typedef struct {
+    bool running;
+    uint32_t hz;
+    uint32_t taken;             // Samples stored since start
+    uint32_t lost;              // Samples dropped on a full ring
+    uint32_t pending;           // Samples waiting to be drained
+    uint32_t isr_cycles_avg;    // CPU cycles spent per sample
+    uint32_t overhead_ppm;      // Share of CPU time spent in the sampler
+} profiler_stats_t;
+
+// ESP_ERR_NOT_SUPPORTED on the Linux host build
+esp_err_t profiler_start(uint32_t hz);
+void profiler_stop(void);
+void profiler_get_stats(profiler_stats_t *stats);
+
+// Pops up to max samples, oldest first. Returns the number copied.
+int profiler_drain(profiler_sample_t *out, int max);
+const char *profiler_task_name(uint8_t task);
+
+#endif // PROFILER_H
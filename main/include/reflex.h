@@ -0,0 +1,70 @@
+#ifndef REFLEX_H
+#define REFLEX_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sensors.h"
+
+#define REFLEX_MAX_RULES 4
+#define REFLEX_NAME_LEN 16
+#define REFLEX_MAX_CALLBACKS 8
+
+// What a rule does when it trips and releases
+typedef enum {
+    REFLEX_ACTION_GPIO,         // Drive a pin to its active level, back when released
+    REFLEX_ACTION_CALLBACK,     // Call a registered function
+} reflex_action_t;
+
+typedef struct {
+    const char *rule;
+    int task_id;
+    bool active;                // Tripped (true) or released
+    float value;                // The sample that changed the state
+    int64_t sample_us;          // When that sample was produced
+} reflex_event_t;
+
+typedef void (*reflex_callback_t)(const reflex_event_t *event, void *arg);
+
+// Condition on one channel of a task, checked on every raw sample the task
+// reads (not the per-cycle average), so the reaction does not wait for the
+// cycle to finish or for anything to cross the link.
+typedef struct {
+    char name[REFLEX_NAME_LEN];
+    sensor_channel_t channel;
+    bool below;                 // Trip when the value is below threshold (else above)
+    float threshold;
+    float hysteresis;           // Release once past threshold by this much the other way
+    uint8_t debounce;           // Consecutive samples needed to trip or release
+    reflex_action_t action;
+    int gpio;
+    bool active_low;
+    int callback;               // Index into the callback registry
+    // State, owned by the sampling task
+    bool active;
+    uint8_t streak;             // Samples in a row arguing for a change
+    uint32_t trips;
+    uint32_t latency_last_us;   // Sample produced -> action done
+    uint32_t latency_max_us;
+    uint64_t latency_sum_us;
+} reflex_rule_t;
+
+// Register a callback rules can name in "callback"; -1 if the table is full.
+// "report" is built in: it queues a REFLEX line on the task's telemetry.
+int reflex_register_callback(const char *name, reflex_callback_t fn, void *arg);
+int reflex_find_callback(const char *name);    // -1 if unknown
+
+// 0 if the rule's action can be set up: an output-capable pin other than
+// UART0's, or a registered callback. Touches no pin.
+int reflex_rule_check(const reflex_rule_t *rule);
+// Claim the rule's output pin and drive it inactive
+int reflex_rule_init(reflex_rule_t *rule);
+// Release the action (pin back to inactive) and clear the state
+void reflex_rule_release(reflex_rule_t *rule, int task_id);
+
+// Feed one raw sample carrying the channels in mask, produced at sample_us
+void reflex_on_sample(reflex_rule_t *rules, int count, int task_id, const sensor_readings_t *sample,
+                      uint8_t mask, int64_t sample_us);
+
+void reflex_reset_stats(reflex_rule_t *rule);
+
+#endif // REFLEX_H
@@ -0,0 +1,35 @@
+#ifndef SENSOR_CHANNELS_H
+#define SENSOR_CHANNELS_H
+
+// Sensor values as plain data, without the drivers: shared by the firmware
+// and by code that is also built on the host (history_codec.c)
+
+// Result of the averaged read functions (for dynamic tasks)
+typedef struct {
+    float dht_humidity;
+    float dht_temperature;
+    int ultrasonic_distance;
+    float mpu_accel_x;
+    float mpu_accel_y;
+    float mpu_accel_z;
+} sensor_readings_t;
+
+// Scalar channels carried by sensor_readings_t
+typedef enum {
+    CHANNEL_HUMIDITY,
+    CHANNEL_TEMPERATURE,
+    CHANNEL_DISTANCE,
+    CHANNEL_ACCEL_X,
+    CHANNEL_ACCEL_Y,
+    CHANNEL_ACCEL_Z,
+    CHANNEL_COUNT,
+    CHANNEL_NONE = CHANNEL_COUNT
+} sensor_channel_t;
+
+// Channel names as used in JSON configs: hum, temp, dist, ax, ay, az
+sensor_channel_t sensor_channel_from_name(const char *name);
+const char *sensor_channel_name(sensor_channel_t channel);
+float sensor_readings_get(const sensor_readings_t *readings, sensor_channel_t channel);
+void sensor_readings_set(sensor_readings_t *readings, sensor_channel_t channel, float value);
+
+#endif // SENSOR_CHANNELS_H
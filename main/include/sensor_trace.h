@@ -0,0 +1,51 @@
+#ifndef SENSOR_TRACE_H
+#define SENSOR_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SENSOR_TRACE_VALUES 3
+#define SENSOR_TRACE_MAX_RECORDS 1024
+
+// Record/replay of raw sensor reads underneath the averaged read functions.
+// A trace is a list of lines
+//   TRACE <sensor id> <latency_us> <ok> <v0> <v1> <v2>
+// with values in the drivers' integer units: DHT11 humidity and temperature in
+// tenths, ultrasonic distance in cm, MPU6050 acceleration in milli-g.
+// Recording emits one such line per read; replay hands each instance its own
+// records in order (wrapping at the end) and busy-waits the recorded latency
+// under the instance mutex, so runs see the same values and timing.
+typedef enum {
+    SENSOR_TRACE_LIVE,
+    SENSOR_TRACE_RECORD,
+    SENSOR_TRACE_REPLAY,
+} sensor_trace_mode_t;
+
+typedef struct {
+    sensor_trace_mode_t mode;
+    int records;
+    int streams;
+    uint32_t replayed;          // Reads served from the trace
+    uint32_t wraps;             // Times a stream ran out and restarted
+    uint32_t misses;            // Reads of instances with no records
+} sensor_trace_stats_t;
+
+// Start replaying CONFIG_SENSOR_TRACE_REPLAY_FILE if one is set
+void sensor_trace_init(void);
+
+sensor_trace_mode_t sensor_trace_mode(void);
+void sensor_trace_set_mode(sensor_trace_mode_t mode);   // REPLAY needs records loaded
+
+// Loading is only allowed while not replaying. Both return -1 on error.
+int sensor_trace_load(const char *path);                 // Appends, returns records read
+int sensor_trace_add(const char *id, uint32_t latency_us, bool ok, const int32_t values[SENSOR_TRACE_VALUES]);
+void sensor_trace_clear(void);
+
+void sensor_trace_get_stats(sensor_trace_stats_t *stats);
+
+// Hooks for sensors.c. sensor_trace_replay returns 1 when not replaying,
+// otherwise 0 (values filled) or -1 for a recorded failed read.
+int sensor_trace_replay(const char *id, int32_t values[SENSOR_TRACE_VALUES]);
+void sensor_trace_record(const char *id, uint32_t latency_us, bool ok, const int32_t values[SENSOR_TRACE_VALUES]);
+
+#endif // SENSOR_TRACE_H
@@ -6,26 +6,109 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
+#include "driver/gpio.h"
+#include "dht.h"
+#include "mpu6050.h"
 #include "board.h"
+#include "calib.h"
+#include "sensor_channels.h"
 
-// Single read functions (existing)
-int get_ultrasonic_data(SemaphoreHandle_t);
-int get_dht11_data(SemaphoreHandle_t);
-int initialize_mpu(SemaphoreHandle_t);
-int get_mpu_acceleration_x();
+#define MAX_SENSOR_INSTANCES 12
+#define MAX_SENSOR_ID_LEN 16
 
-// Averaged read functions (for dynamic tasks)
+typedef enum {
+    SENSOR_DHT11,
+    SENSOR_ULTRASONIC,
+    SENSOR_MPU6050,
+    SENSOR_NONE
+} sensor_type_t;
+
+// Waits for an instance's mutex by sample reads
+typedef struct {
+    uint32_t takes;
+    uint32_t contended;         // Takes that found another task's read in progress
+    uint64_t wait_sum_us;
+    uint32_t wait_max_us;
+} sensor_lock_stats_t;
+
+// One physical sensor: wiring, driver state and its own mutex
 typedef struct {
-    float dht_humidity;
-    float dht_temperature;
-    int ultrasonic_distance;
-    float mpu_accel_x;
-    float mpu_accel_y;
-    float mpu_accel_z;
-} sensor_readings_t;
-
-int read_dht11_averaged(SemaphoreHandle_t handle, int samples, sensor_readings_t *out);
-int read_ultrasonic_averaged(SemaphoreHandle_t handle, int samples, sensor_readings_t *out);
-int read_mpu6050_averaged(SemaphoreHandle_t handle, int samples, sensor_readings_t *out);
+    char id[MAX_SENSOR_ID_LEN];
+    sensor_type_t type;
+    SemaphoreHandle_t mutex;
+    sensor_lock_stats_t lock_stats; // Updated while holding the mutex
+    bool ready;
+    union {
+        struct {
+            gpio_num_t pin;
+            dht_sensor_type_t kind;
+        } dht;
+        struct {
+            gpio_num_t trig;
+            gpio_num_t echo;
+        } ultrasonic;
+        struct {
+            mpu6050_dev_t dev;
+            int port;
+            gpio_num_t sda;
+            gpio_num_t scl;
+            uint8_t address;
+            imu_calib_t calib;      // Applied to every read; restored from NVS at registration
+        } mpu;
+    };
+} sensor_instance_t;
+
+// Instance registry. The built-in board.h sensors are registered by
+// sensors_register_defaults() under the ids "dht11", "ultrasonic" and "mpu6050",
+// so configs that name sensors by type keep working.
+void sensors_register_defaults(void);
+int sensors_add_instance(const sensor_instance_t *wiring);     // Returns index or -1
+int sensors_find_instance(const char *id);
+sensor_instance_t *sensors_get_instance(int index);
+// Copy of an instance's id, type and pins, without driver state; -1 if out of range
+int sensors_get_wiring(int index, sensor_instance_t *wiring);
+bool sensors_wiring_uses_pin(const sensor_instance_t *wiring, int pin);
+int sensors_instance_count(void);
+
+sensor_type_t sensor_type_from_name(const char *name);
+const char *sensor_type_name(sensor_type_t type);
+
+// Shortest spacing between two reads of a sensor type, as used by the averaging loops
+int sensor_min_gap_ms(sensor_type_t type);
+
+// Mutex contention of an instance's sample reads
+void sensors_get_lock_stats(int index, sensor_lock_stats_t *stats);
+void sensors_reset_lock_stats(void);
+
+// Uncalibrated accelerometer read in g (for calibration captures); -1 on failure
+int sensors_imu_sample_raw(sensor_instance_t *sensor, float out[3]);
+void sensors_set_imu_calib(int index, const imu_calib_t *calib);
+
+// Single read functions
+int get_ultrasonic_data(sensor_instance_t *sensor);
+int get_dht11_data(sensor_instance_t *sensor);
+int initialize_mpu(sensor_instance_t *sensor);
+int get_mpu_acceleration_x(sensor_instance_t *sensor);
+
+// Bit per sensor_channel_t a sensor type fills in
+uint8_t sensor_type_channels(sensor_type_t type);
+
+// Optional predicate polled before each sample; averaging stops early once it returns true
+typedef bool (*sensor_stop_fn_t)(void *ctx);
+
+// Optional observer of each raw sample as soon as it is read: the channels in
+// mask are set in sample, which was produced at sample_us (esp_timer time)
+typedef void (*sensor_sample_fn_t)(void *ctx, const sensor_readings_t *sample, uint8_t mask, int64_t sample_us);
+
+int read_dht11_averaged(sensor_instance_t *sensor, int samples, sensor_readings_t *out,
+                        sensor_stop_fn_t stop, sensor_sample_fn_t on_sample, void *ctx);
+int read_ultrasonic_averaged(sensor_instance_t *sensor, int samples, sensor_readings_t *out,
+                             sensor_stop_fn_t stop, sensor_sample_fn_t on_sample, void *ctx);
+int read_mpu6050_averaged(sensor_instance_t *sensor, int samples, sensor_readings_t *out,
+                          sensor_stop_fn_t stop, sensor_sample_fn_t on_sample, void *ctx);
+
+// read_*_averaged of the instance's type
+int read_sensor_averaged(sensor_instance_t *sensor, int samples, sensor_readings_t *out,
+                         sensor_stop_fn_t stop, sensor_sample_fn_t on_sample, void *ctx);
 
 #endif
@@ -4,36 +4,188 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
+#include "sensors.h"
+#include "adaptive.h"
+#include "task_stats.h"
+#include "telemetry.h"
+#include "expr.h"
+#include "reflex.h"
+#include "detect.h"
+#include "wcet.h"
 
 #define MAX_TASKS 32
 #define MAX_SENSORS_PER_TASK 3
 #define MAX_TASK_NAME_LEN 32
+#define MAX_MODES 4
+#define MAX_MODE_NAME_LEN 16
 
-typedef enum {
-    SENSOR_DHT11,
-    SENSOR_ULTRASONIC,
-    SENSOR_MPU6050,
-    SENSOR_NONE
-} sensor_type_t;
+// Channel computed each cycle from a config expression
+typedef struct {
+    char name[EXPR_MAX_NAME_LEN + 1];
+    uint8_t decimals;
+    expr_program_t program;
+} derived_channel_t;
 
 typedef struct {
     char name[MAX_TASK_NAME_LEN];
     int priority;
     int period_ms;
+    int offset_ms;          // First release after the mode starts (phase), below period_ms
     sensor_type_t sensors[MAX_SENSORS_PER_TASK];
+    int8_t sensor_instances[MAX_SENSORS_PER_TASK];  // Registry index per sensor slot
     int sensor_count;
+    uint8_t channel_mask;   // Bit per sensor_channel_t sampled by this task
+    uint8_t field_mask;     // Channels printed per cycle, a subset of channel_mask
+    uint32_t budget_us;     // CPU budget per period, 0 = unlimited
+    int mode;               // Index of the operating mode this task belongs to
+    adaptive_config_t adaptive;
+    telemetry_config_t telemetry;
+    derived_channel_t derived[EXPR_MAX_DERIVED];
+    int derived_count;
+    reflex_rule_t rules[REFLEX_MAX_RULES];     // Checked on every raw sample
+    int rule_count;
+    bool let;               // Publish records at the deadline (Logical Execution Time)
+    bool spread;            // Spread the averaged samples over the period
+    detect_config_t detectors[DETECT_MAX_PER_TASK];
+    int detector_count;
 } task_config_t;
 
-// Initialize task manager and mutexes
+// Evaluation cost and last value of a derived channel
+typedef struct {
+    const char *name;
+    uint8_t ops;                // Bytecode length
+    uint8_t depth;              // Stack slots used
+    float value;
+    uint32_t evals;
+    uint32_t avg_ns;
+    uint32_t max_ns;
+} derived_info_t;
+
+// Compiled config: everything the JSON yields, as plain data that can be
+// stored (see cfglib.h) and activated again without parsing
+#define CONFIG_IMAGE_VERSION 2
+
+typedef struct {
+    uint32_t version;           // CONFIG_IMAGE_VERSION
+    uint32_t config_size;       // sizeof(task_config_t), a layout change invalidates stored images
+    uint32_t sensor_size;       // sizeof(sensor_instance_t), likewise
+    int32_t admission;
+    int32_t mode_count;
+    int32_t initial_mode;
+    char mode_names[MAX_MODES][MAX_MODE_NAME_LEN];
+    int32_t sensor_count;
+    sensor_instance_t sensors[MAX_SENSOR_INSTANCES];    // Wiring only; the tasks' sensor_instances index this
+    int32_t task_count;
+    task_config_t tasks[];
+} config_image_t;
+
+#define CONFIG_IMAGE_SIZE(tasks) (sizeof(config_image_t) + (size_t)(tasks) * sizeof(task_config_t))
+
+// Initialize task manager, sensor instances and history
 void task_manager_init(void);
 
 // Parse JSON config and create tasks dynamically
 int task_manager_parse_and_create(const char *json_config);
 
-// Stop all dynamic tasks
+// Compile a JSON config without creating anything; the image is malloc'd
+// and *size set. NULL if the config is invalid.
+config_image_t *task_manager_compile(const char *json_config, size_t *size);
+// Stop the running tasks and create the image's. The image is only read, so
+// it can sit in mapped flash. Returns the number of tasks created, -1 if the
+// image is invalid, fails admission control or was compiled by another
+// firmware layout; the running tasks are left alone then. If a task still
+// cannot be created (out of memory), none of the image's keep running.
+int task_manager_activate(const config_image_t *image, size_t size);
+
+// Switch operating mode now or at the outgoing mode's next hyperperiod boundary
+int task_manager_switch_mode(const char *name, bool at_hyperperiod);
+
+// Print MODE_SWITCHED for a switch the hyperperiod timer made; command task only
+void task_manager_flush_reports(void);
+
+// Name of the active operating mode, NULL before a config is loaded
+const char *task_manager_active_mode(void);
+
+// Task id (index) by name, -1 if unknown
+int task_manager_find_task(const char *name);
+
+// Name of a task id, NULL if out of range
+const char *task_manager_task_name(int id);
+
+// Copy a task's name for tasks other than the command task, which may
+// outlive the config; false if the id is out of range
+bool task_manager_copy_task_name(int id, char *out, size_t size);
+
+// Number of created tasks (ids are 0..count-1)
+int task_manager_task_count(void);
+
+// Response-time statistics of a task; returns -1 for an unknown id
+int task_manager_get_stats(int id, task_stats_t *stats, uint32_t *overruns, uint32_t *throttled);
+void task_manager_reset_stats(void);
+
+// Derived channel index of a task; returns -1 when either is out of range
+int task_manager_get_derived(int id, int index, derived_info_t *info);
+
+// Detector state of a task; -1 when either index is out of range. avg_ns and
+// max_ns are the cost of running all of the task's detectors on one cycle.
+int task_manager_get_detector(int id, int index, const detect_config_t **config, detect_state_t *state,
+                              uint32_t *avg_ns, uint32_t *max_ns, bool *boosted);
+
+// Switch a task between LET output and output on completion; -1 for an unknown id
+int task_manager_set_let(int id, bool enabled);
+int task_manager_get_let(int id, bool *enabled, uint32_t *late);
+
+// Switch a task between samples spread over its period and one burst per
+// cycle; samples is how many a cycle takes. -1 for an unknown id.
+int task_manager_set_spread(int id, bool enabled);
+int task_manager_get_spread(int id, bool *enabled, int *samples);
+
+// Host subscription to a task's records (SUB / UNSUB). A task without one
+// formats and queues nothing; history and MQTT are not affected.
+typedef struct {
+    bool active;
+    telemetry_encoding_t encoding;
+    float max_hz;               // 0 = every cycle
+    uint8_t field_mask;         // Channels in the record, any the task samples
+    uint8_t derived_mask;       // Derived channels in the record, bit per index
+} task_subscription_t;
+
+// Subscribe to a task's records at most max_hz times a second (0 = every
+// cycle). fields is a comma separated list of channel and derived names, NULL
+// for the task's configured fields and all its derived channels. id -1 covers
+// every task with at least one of the fields, and the tasks of later configs.
+// Returns the number of tasks subscribed, -1 on an unknown id or field.
+int task_manager_subscribe(int id, float max_hz, telemetry_encoding_t encoding, const char *fields);
+// End a subscription; id -1 ends all of them, also for later configs
+int task_manager_unsubscribe(int id);
+int task_manager_get_subscription(int id, task_subscription_t *sub);
+
+// Copy of a task's reflex rule (config and statistics); -1 when either is out of range
+int task_manager_get_rule(int id, int index, reflex_rule_t *rule);
+void task_manager_reset_rules(void);
+
+// Store every task's adaptive filter and detector baselines in NVS; they are
+// restored when a task of the same name and settings is created again
+void task_manager_save_state(void);
+
+// Park all tasks, measure every sensor read and every task's cycle in
+// isolation (iterations cycles each, 0 = WCET_TASK_ITERATIONS), store the
+// costs and release the tasks again
+int task_manager_calibrate_wcet(int iterations);
+
+// Cycle cost of a task used by admission control; measured is false when it
+// is estimated from the sensor table (all zero when that is missing too)
+int task_manager_task_wcet(int id, wcet_cost_t *cpu, wcet_cost_t *wall, bool *measured);
+
+// Stop all dynamic tasks: running cycles are cut short and each task is
+// deleted once it holds no sensor, then its config is freed
 void task_manager_stop_all(void);
 
-// UART logging with mutex
+// Telemetry logging over the active transport (UART by default). Output of
+// the sensor tasks goes through the telemetry scheduler instead.
 void uart_log(const char *task_name, const char *format, ...);
 
+// Write a header line and a binary payload without other output in between
+void uart_write_frame(const char *header, const void *payload, size_t len);
+
 #endif // TASK_MANAGER_H
@@ -0,0 +1,36 @@
+#ifndef TASK_STATS_H
+#define TASK_STATS_H
+
+#include <stdint.h>
+
+// Log-scale histogram: 4 buckets per octave from 100 us, top bucket ~6.5 s
+#define TASK_STATS_BUCKETS 64
+#define TASK_STATS_MIN_US 100
+
+// Response times of a periodic task (release to output)
+typedef struct {
+    uint32_t jobs;
+    uint32_t misses;            // Response longer than the deadline
+    uint32_t errors;            // Cycles that produced no reading
+    uint32_t max_us;
+    uint64_t sum_us;
+    uint16_t hist[TASK_STATS_BUCKETS];
+    // Output latency: release to the record being handed to the link
+    uint32_t outputs;
+    uint32_t out_min_us;
+    uint32_t out_max_us;
+    uint64_t out_sum_us;
+} task_stats_t;
+
+void task_stats_reset(task_stats_t *stats);
+void task_stats_add(task_stats_t *stats, uint32_t response_us, uint32_t deadline_us);
+
+void task_stats_add_output(task_stats_t *stats, uint32_t latency_us);
+
+// Peak-to-peak variation of the output latency
+uint32_t task_stats_output_jitter(const task_stats_t *stats);
+
+// Upper edge of the bucket holding the pct-th percentile (within ~19%)
+uint32_t task_stats_percentile(const task_stats_t *stats, int pct);
+
+#endif // TASK_STATS_H
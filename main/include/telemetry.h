@@ -0,0 +1,74 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+
+#ifndef CONFIG_TELEMETRY_QUEUE_BYTES
+#define CONFIG_TELEMETRY_QUEUE_BYTES 1024
+#endif
+
+#define TELEMETRY_MAX_WEIGHT 16
+#define TELEMETRY_MAX_LINE 256
+
+// What a task's queue does when it is full (the link is saturated or the
+// task exceeds its rate)
+typedef enum {
+    TELEMETRY_DROP_OLD,     // Discard the oldest queued lines, keep the freshest data
+    TELEMETRY_DROP_NEW,     // Discard the new line
+    TELEMETRY_SUMMARIZE,    // Like DROP_OLD, then report the loss in a TXDROP line
+} telemetry_policy_t;
+
+// Record format of a host subscription to a task's output
+typedef enum {
+    TELEMETRY_TEXT,         // "[Task] T:23.5C Dist:52cm": labels and units
+    TELEMETRY_COMPACT,      // "@3,23.5,52": task id, then the values in subscription order
+} telemetry_encoding_t;
+
+// Per-task share of the link. Critical tasks are served before all others;
+// the rest share what is left in proportion to weight (deficit round robin).
+// A non-zero rate caps the task with a token bucket of burst bytes.
+typedef struct {
+    uint8_t weight;             // 1..TELEMETRY_MAX_WEIGHT
+    bool critical;
+    telemetry_policy_t policy;
+    uint32_t rate_bps;          // Bytes per second, 0 = unlimited
+    uint32_t burst;             // Bucket size in bytes
+} telemetry_config_t;
+
+typedef struct {
+    uint32_t lines_sent;
+    uint32_t bytes_sent;
+    uint32_t lines_dropped;
+    uint32_t bytes_dropped;
+    uint32_t queued;            // Bytes waiting now
+    uint32_t peak;              // Largest backlog seen
+    uint32_t elapsed_ms;        // Since the counters were reset
+} telemetry_stats_t;
+
+// Defaults used for tasks without a "telemetry" object
+void telemetry_default_config(telemetry_config_t *config);
+telemetry_policy_t telemetry_policy_from_name(const char *name);   // -1 if unknown
+const char *telemetry_policy_name(telemetry_policy_t policy);
+telemetry_encoding_t telemetry_encoding_from_name(const char *name);   // -1 if unknown
+const char *telemetry_encoding_name(telemetry_encoding_t encoding);
+
+// Starts the sender task
+void telemetry_init(void);
+
+// Bind a task id to its queue; -1 if the queue cannot be allocated
+int telemetry_configure(int task_id, const char *name, const telemetry_config_t *config);
+// Unbind one task id, e.g. when its task could not be created
+void telemetry_release(int task_id);
+// Drop every queue (the tasks are being deleted)
+void telemetry_reset(void);
+
+// Queue one line of a task's output. Never blocks on the link.
+void telemetry_submit(int task_id, const char *line, size_t len);
+
+int telemetry_get_stats(int task_id, telemetry_stats_t *stats, telemetry_config_t *config);
+void telemetry_reset_stats(void);
+
+#endif // TELEMETRY_H
@@ -0,0 +1,46 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <stddef.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_err.h"
+
+// Byte stream under the text protocol (config upload, commands, telemetry).
+// Implementations: UART0, a TCP listener (one client at a time) and a
+// file/pipe sink. The default is picked in menuconfig, LINK switches at run time.
+typedef struct transport {
+    const char *name;
+    esp_err_t (*open)(struct transport *self, const char *arg);
+    void (*close)(struct transport *self);
+    // Bytes read, 0 on timeout, negative on error. NULL for output-only sinks.
+    int (*read)(struct transport *self, void *buf, size_t len, TickType_t timeout);
+    // Bytes written, negative on error
+    int (*write)(struct transport *self, const void *buf, size_t len);
+} transport_t;
+
+extern transport_t transport_uart;
+extern transport_t transport_tcp;
+extern transport_t transport_file;
+
+// Open the build-time default transport
+esp_err_t transport_init(void);
+
+// Switch to "uart", "tcp" or "file"; arg is a port number or path (NULL = default)
+esp_err_t transport_select(const char *name, const char *arg);
+const char *transport_active_name(void);
+
+// Reads from the active transport, or from UART while an output-only sink is active
+int transport_read(void *buf, size_t len, TickType_t timeout);
+
+// Writes are serialized: each call reaches the link without interleaving
+int transport_write(const void *buf, size_t len);
+int transport_write_frame(const void *header, size_t header_len, const void *payload, size_t len);
+
+// Called when the host end of a connection goes away (a TCP client closing).
+// May run with the link's write lock held, so it must not write to the link.
+void transport_set_disconnect_handler(void (*handler)(void));
+// For implementations: report a lost host
+void transport_notify_disconnect(void);
+
+#endif // TRANSPORT_H
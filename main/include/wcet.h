@@ -0,0 +1,43 @@
+#ifndef WCET_H
+#define WCET_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sensors.h"
+
+#define WCET_TASK_ITERATIONS 5      // Task cycles measured per calibration by default
+
+// Measured execution cost of one operation, in microseconds
+typedef struct {
+    uint32_t n;
+    uint32_t p50_us;
+    uint32_t p99_us;
+    uint32_t max_us;
+} wcet_cost_t;
+
+// Loads the stored sensor cost table; returns false when there is none
+bool wcet_init(void);
+
+// Time iterations calls of op, gap_ms apart, on a dedicated task pinned to one
+// core at high priority so the CPU cycle counter measures it undisturbed.
+// cpu is the caller's run time (FreeRTOS run time counter), wall the cycle
+// counter span including any sleeps inside op; either may be NULL.
+int wcet_measure(void (*op)(void *arg), void *arg, int iterations, int gap_ms,
+                 wcet_cost_t *cpu, wcet_cost_t *wall);
+
+// Measure one read of every registered sensor instance and store the table
+int wcet_calibrate_sensors(void);
+
+// Cost of one read of a sensor instance; -1 if it was never measured
+int wcet_sensor_cost(int instance, wcet_cost_t *cost);
+
+// Add the estimated cost of an averaged read of samples reads to cpu and wall,
+// from the sensor table plus the sleeps between reads; -1 if never measured.
+// The sensor need not be registered yet: the table is keyed by sensor id.
+int wcet_estimate_read(const sensor_instance_t *sensor, int samples, wcet_cost_t *cpu, wcet_cost_t *wall);
+
+// Per-task cycle costs, stored under the task name
+int wcet_task_load(const char *task_name, wcet_cost_t *cpu, wcet_cost_t *wall);
+int wcet_task_save(const char *task_name, const wcet_cost_t *cpu, const wcet_cost_t *wall);
+
+#endif // WCET_H
@@ -0,0 +1,134 @@
+#include "line_encoder.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+typedef struct {
+    const char *label;      // Includes the leading space
+    const char *unit;
+    uint8_t decimals;
+} field_format_t;
+
+// Same labels and precision as the original all-channel record, so existing
+// parsers keep working on the fields that remain
+static const field_format_t formats[CHANNEL_COUNT] = {
+    [CHANNEL_HUMIDITY]    = { " H:",    "%",  1 },
+    [CHANNEL_TEMPERATURE] = { " T:",    "C",  1 },
+    [CHANNEL_DISTANCE]    = { " Dist:", "cm", 0 },
+    [CHANNEL_ACCEL_X]     = { " AccX:", "g",  3 },
+    [CHANNEL_ACCEL_Y]     = { " AccY:", "g",  3 },
+    [CHANNEL_ACCEL_Z]     = { " AccZ:", "g",  3 },
+};
+
+static const int32_t pow10_table[] = { 1, 10, 100, 1000, 10000 };
+
+// Longest formatted number: sign, 10 digits, point
+#define NUMBER_MAX_LEN 12
+
+void line_encoder_build(line_encoder_t *encoder, const char *task_name, uint8_t mask)
+{
+    memset(encoder, 0, sizeof(*encoder));
+    int n = 0;
+    encoder->prefix[n++] = '[';
+    for (const char *c = task_name; *c && n < LINE_ENCODER_PREFIX_LEN - 1; c++) {
+        encoder->prefix[n++] = *c;
+    }
+    if (n < LINE_ENCODER_PREFIX_LEN) encoder->prefix[n++] = ']';
+    encoder->prefix_len = (uint8_t)n;
+
+    for (int ch = 0; ch < CHANNEL_COUNT; ch++) {
+        if (mask & (1u << ch)) encoder->fields[encoder->count++] = (uint8_t)ch;
+    }
+}
+
+void line_encoder_set_compact(line_encoder_t *encoder, int task_id)
+{
+    encoder->prefix_len = (uint8_t)snprintf(encoder->prefix, LINE_ENCODER_PREFIX_LEN, "@%d", task_id);
+    encoder->compact = true;
+}
+
+int line_encoder_add_value(line_encoder_t *encoder, int index, const char *name, int decimals)
+{
+    if (encoder->value_count >= LINE_ENCODER_MAX_VALUES || index < 0 || index > UINT8_MAX || decimals < 0 ||
+        decimals >= (int)(sizeof(pow10_table) / sizeof(pow10_table[0])) ||
+        strlen(name) + 3 > LINE_ENCODER_LABEL_LEN) {
+        return -1;
+    }
+    int i = encoder->value_count++;
+    snprintf(encoder->value_labels[i], LINE_ENCODER_LABEL_LEN, " %s:", name);
+    encoder->value_index[i] = (uint8_t)index;
+    encoder->value_decimals[i] = (uint8_t)decimals;
+    return 0;
+}
+
+// Fixed-point decimal with the given number of places
+static int format_fixed(char *out, float value, int decimals)
+{
+    char digits[NUMBER_MAX_LEN];
+    int n = 0;
+    int len = 0;
+
+    // printf rounds the exact binary value half to even; rint in double does the same here
+    double scaled = (double)value * pow10_table[decimals];
+    if (!isfinite(scaled) || fabs(scaled) > 2.0e9) {
+        // Rare (a derived division by zero, a wild reading): let printf spell
+        // it as nan, inf or an exponent, which the host parses like the rest
+        return snprintf(out, NUMBER_MAX_LEN, "%.*e", decimals, (double)value);
+    }
+    int32_t fixed = (int32_t)rint(scaled);
+    uint32_t magnitude = fixed < 0 ? (uint32_t)-(int64_t)fixed : (uint32_t)fixed;
+
+    do {
+        digits[n++] = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude > 0 || n <= decimals);
+
+    if (fixed < 0) out[len++] = '-';
+    while (n > 0) {
+        if (n == decimals) out[len++] = '.';
+        out[len++] = digits[--n];
+    }
+    return len;
+}
+
+size_t line_encoder_encode(const line_encoder_t *encoder, const sensor_readings_t *readings,
+                           const float *values, char *out, size_t size)
+{
+    char buf[LINE_ENCODER_PREFIX_LEN + (CHANNEL_COUNT + LINE_ENCODER_MAX_VALUES) * 32 + 2];
+    size_t len = encoder->prefix_len;
+    memcpy(buf, encoder->prefix, len);
+
+    for (int i = 0; i < encoder->count; i++) {
+        sensor_channel_t channel = (sensor_channel_t)encoder->fields[i];
+        const field_format_t *f = &formats[channel];
+        if (encoder->compact) {
+            buf[len++] = ',';
+            len += format_fixed(buf + len, sensor_readings_get(readings, channel), f->decimals);
+            continue;
+        }
+        size_t label_len = strlen(f->label);
+        memcpy(buf + len, f->label, label_len);
+        len += label_len;
+        len += format_fixed(buf + len, sensor_readings_get(readings, channel), f->decimals);
+        size_t unit_len = strlen(f->unit);
+        memcpy(buf + len, f->unit, unit_len);
+        len += unit_len;
+    }
+    for (int i = 0; i < encoder->value_count; i++) {
+        if (encoder->compact) {
+            buf[len++] = ',';
+        } else {
+            size_t label_len = strlen(encoder->value_labels[i]);
+            memcpy(buf + len, encoder->value_labels[i], label_len);
+            len += label_len;
+        }
+        len += format_fixed(buf + len, values[encoder->value_index[i]], encoder->value_decimals[i]);
+    }
+    buf[len++] = '\n';
+
+    if (size == 0) return 0;
+    if (len > size - 1) len = size - 1;
+    memcpy(out, buf, len);
+    out[len] = '\0';
+    return len;
+}
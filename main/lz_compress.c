@@ -0,0 +1,104 @@
+#include "lz_compress.h"
+#include <string.h>
+
+// Greedy LZ4 block encoder with a 1K-entry hash table on the stack (2 KB)
+#define HASH_BITS 10
+#define MIN_MATCH 4
+#define LAST_LITERALS 5         // Format rule: the block ends with at least 5 literals
+#define MF_LIMIT 12             // Format rule: no match may start in the last 12 bytes
+
+static inline uint32_t read32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t hash4(uint32_t v)
+{
+    return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+static uint8_t *put_length(uint8_t *op, size_t len)
+{
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (uint8_t)len;
+    return op;
+}
+
+static uint8_t *put_sequence(uint8_t *op, const uint8_t *literals, size_t lit_len,
+                             uint16_t offset, size_t match_len, int has_match)
+{
+    uint8_t *token = op++;
+    *token = (uint8_t)((lit_len >= 15 ? 15 : lit_len) << 4);
+    if (lit_len >= 15) op = put_length(op, lit_len - 15);
+    memcpy(op, literals, lit_len);
+    op += lit_len;
+    
+    if (has_match) {
+        *op++ = (uint8_t)(offset & 0xFF);
+        *op++ = (uint8_t)(offset >> 8);
+        size_t ml = match_len - MIN_MATCH;
+        *token |= (uint8_t)(ml >= 15 ? 15 : ml);
+        if (ml >= 15) op = put_length(op, ml - 15);
+    }
+    return op;
+}
+
+size_t lz_compress(const uint8_t *in, size_t len, uint8_t *out, size_t out_cap)
+{
+    if (len > LZ_MAX_INPUT || out_cap < LZ_BOUND(len)) return 0;
+    
+    uint16_t table[1u << HASH_BITS];
+    memset(table, 0, sizeof(table));
+    
+    const uint8_t *ip = in;
+    const uint8_t *anchor = in;
+    const uint8_t *const end = in + len;
+    uint8_t *op = out;
+    
+    if (len >= MF_LIMIT + 1) {
+        const uint8_t *const match_limit = end - MF_LIMIT;
+        const uint8_t *const copy_limit = end - LAST_LITERALS;
+        
+        ip++;   // Position 0 stays in the table as the default candidate
+        while (ip < match_limit) {
+            uint32_t seq = read32(ip);
+            uint32_t h = hash4(seq);
+            const uint8_t *ref = in + table[h];
+            table[h] = (uint16_t)(ip - in);
+            
+            if (ref >= ip || read32(ref) != seq) {
+                ip++;
+                continue;
+            }
+            
+            // Extend backwards over pending literals, then forwards
+            while (ip > anchor && ref > in && ip[-1] == ref[-1]) {
+                ip--;
+                ref--;
+            }
+            const uint8_t *mp = ip + MIN_MATCH;
+            const uint8_t *rp = ref + MIN_MATCH;
+            while (mp < copy_limit && *mp == *rp) {
+                mp++;
+                rp++;
+            }
+            
+            op = put_sequence(op, anchor, (size_t)(ip - anchor), (uint16_t)(ip - ref),
+                              (size_t)(mp - ip), 1);
+            ip = mp;
+            anchor = ip;
+            if (ip < match_limit) {
+                table[hash4(read32(ip - 2))] = (uint16_t)(ip - 2 - in);
+            }
+        }
+    }
+    
+    // Trailing literals
+    op = put_sequence(op, anchor, (size_t)(end - anchor), 0, 0, 0);
+    return (size_t)(op - out);
+}
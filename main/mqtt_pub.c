@@ -0,0 +1,524 @@
+#include "mqtt_pub.h"
+#include "sdkconfig.h"
+#include <string.h>
+
+#ifdef CONFIG_MQTT_PUB_ENABLE
+
+#include "task_manager.h"
+#include "history_codec.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "mqtt_client.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include <stdio.h>
+
+#define PUB_RING_SAMPLES    CONFIG_MQTT_PUB_RING_SAMPLES
+#define PUB_BATCH_SAMPLES   CONFIG_MQTT_PUB_BATCH_SAMPLES
+#define PUB_CHUNK_SAMPLES   64      // Samples taken off the ring per publish round
+#define PUB_MAX_INFLIGHT    8       // Unacknowledged QoS 1 messages before spilling
+#define PUB_WINDOW_WAIT_MS  1000    // For an ack when the window fills mid-chunk
+#define PUB_PAYLOAD_MAX     4096
+#define PUB_SPILL_HIGH      (PUB_RING_SAMPLES * 3 / 4)
+#define PUB_SPILL_MAX       (CONFIG_MQTT_PUB_SPILL_MAX_KB * 1024 / sizeof(pub_sample_t))
+
+// One queued sample; also the on-disk record of the spill file
+typedef struct {
+    uint32_t ts_ms;
+    uint8_t task_id;
+    uint8_t channel_mask;
+    uint8_t generation;         // Config the task id belongs to
+    int16_t values[CHANNEL_COUNT];
+} pub_sample_t;
+
+typedef struct {
+    int msg_id;                 // -1 when free
+    int64_t sent_us;
+} inflight_t;
+
+// Posted by the MQTT event handler, consumed by the publisher task
+typedef struct {
+    int msg_id;
+    int64_t at_us;
+    bool expired;               // Dropped from the client outbox before its ack
+} ack_event_t;
+
+static const char *TAG = "MQTT";
+
+static pub_sample_t ring[PUB_RING_SAMPLES];
+static uint32_t ring_head = 0;  // Oldest sample
+static uint32_t ring_count = 0;
+static SemaphoreHandle_t pub_mutex = NULL;      // Ring and stats
+
+static esp_mqtt_client_handle_t client = NULL;
+static TaskHandle_t pub_task = NULL;
+static QueueHandle_t ack_queue = NULL;
+static volatile bool connected = false;
+static volatile uint8_t generation = 0; // Bumped by mqtt_pub_clear
+
+// Publisher task only
+static inflight_t inflight[PUB_MAX_INFLIGHT];
+static int inflight_used = 0;
+static FILE *spill = NULL;
+static uint32_t spill_read = 0; // Records already replayed
+static char payload[PUB_PAYLOAD_MAX];
+static char topic[96];
+
+static mqtt_pub_stats_t stats;
+static uint64_t ack_sum_us = 0;
+static uint64_t age_sum_ms = 0;
+static int64_t stats_start_us = 0;
+
+static uint32_t now_ms(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+void mqtt_pub_sample(int task_id, uint8_t channel_mask, const sensor_readings_t *readings)
+{
+    if (!pub_mutex || task_id < 0 || task_id >= MAX_TASKS) return;
+
+    pub_sample_t s = {
+        .ts_ms = now_ms(),
+        .task_id = (uint8_t)task_id,
+        .channel_mask = channel_mask,
+    };
+    history_quantize(readings, s.values);
+
+    xSemaphoreTake(pub_mutex, portMAX_DELAY);
+    s.generation = generation;
+    if (ring_count == PUB_RING_SAMPLES) {
+        // Publisher could not keep up or spill: lose the oldest sample
+        ring_head = (ring_head + 1) % PUB_RING_SAMPLES;
+        ring_count--;
+        stats.dropped++;
+    }
+    ring[(ring_head + ring_count) % PUB_RING_SAMPLES] = s;
+    ring_count++;
+    bool wake = ring_count >= PUB_BATCH_SAMPLES && (ring_count % PUB_BATCH_SAMPLES) == 0;
+    xSemaphoreGive(pub_mutex);
+
+    if (wake && pub_task) {
+        xTaskNotifyGive(pub_task);
+    }
+}
+
+static int ring_pop(pub_sample_t *out, int max)
+{
+    xSemaphoreTake(pub_mutex, portMAX_DELAY);
+    int n = 0;
+    while (n < max && ring_count > 0) {
+        out[n++] = ring[ring_head];
+        ring_head = (ring_head + 1) % PUB_RING_SAMPLES;
+        ring_count--;
+    }
+    xSemaphoreGive(pub_mutex);
+    return n;
+}
+
+// Append samples to the spill file; returns how many were stored
+static int spill_write(const pub_sample_t *samples, int n)
+{
+    if (!spill) return 0;
+    uint32_t room = PUB_SPILL_MAX - stats.spilled;
+    if ((uint32_t)n > room) n = (int)room;
+    if (n <= 0) return 0;
+
+    fseek(spill, 0, SEEK_END);
+    n = (int)fwrite(samples, sizeof(pub_sample_t), n, spill);
+    fflush(spill);
+
+    xSemaphoreTake(pub_mutex, portMAX_DELAY);
+    stats.spilled += n;
+    xSemaphoreGive(pub_mutex);
+    return n;
+}
+
+static int spill_take(pub_sample_t *out, int max)
+{
+    if (!spill || stats.spilled == 0) return 0;
+
+    if ((uint32_t)max > stats.spilled) max = (int)stats.spilled;
+    fseek(spill, (long)spill_read * sizeof(pub_sample_t), SEEK_SET);
+    int n = (int)fread(out, sizeof(pub_sample_t), max, spill);
+    spill_read += n;
+
+    xSemaphoreTake(pub_mutex, portMAX_DELAY);
+    if (n == 0) {
+        stats.dropped += stats.spilled;     // Unreadable file: give up on the backlog
+        stats.spilled = 0;
+    } else {
+        stats.spilled -= n;
+    }
+    bool empty = stats.spilled == 0;
+    xSemaphoreGive(pub_mutex);
+
+    // Fully replayed: start the file over
+    if (empty) {
+        spill = freopen(CONFIG_MQTT_PUB_SPILL_PATH, "w+b", spill);
+        spill_read = 0;
+    }
+    return n;
+}
+
+// Move the oldest half of a nearly full ring to the spill file
+static void spill_overflow(void)
+{
+    pub_sample_t chunk[PUB_CHUNK_SAMPLES];
+
+    if (ring_count < PUB_SPILL_HIGH) return;
+    int to_move = (int)ring_count / 2;
+    while (to_move > 0) {
+        int n = ring_pop(chunk, to_move < PUB_CHUNK_SAMPLES ? to_move : PUB_CHUNK_SAMPLES);
+        if (n == 0) break;
+        int kept = spill_write(chunk, n);
+        if (kept < n) {
+            xSemaphoreTake(pub_mutex, portMAX_DELAY);
+            stats.dropped += n - kept;
+            xSemaphoreGive(pub_mutex);
+        }
+        to_move -= n;
+    }
+}
+
+static void handle_ack(const ack_event_t *ev)
+{
+    for (int i = 0; i < PUB_MAX_INFLIGHT; i++) {
+        if (inflight[i].msg_id != ev->msg_id) continue;
+        if (!ev->expired) {
+            uint32_t us = (uint32_t)(ev->at_us - inflight[i].sent_us);
+            xSemaphoreTake(pub_mutex, portMAX_DELAY);
+            stats.acked++;
+            ack_sum_us += us;
+            if (us > stats.ack_max_us) stats.ack_max_us = us;
+            xSemaphoreGive(pub_mutex);
+        }
+        inflight[i].msg_id = -1;
+        inflight_used--;
+        break;
+    }
+}
+
+static void drain_acks(void)
+{
+    ack_event_t ev;
+    while (xQueueReceive(ack_queue, &ev, 0) == pdTRUE) {
+        handle_ack(&ev);
+    }
+}
+
+static bool window_full(void)
+{
+    return CONFIG_MQTT_PUB_QOS > 0 && inflight_used >= PUB_MAX_INFLIGHT;
+}
+
+// Room for one more message, waiting a little for an ack if need be
+static bool window_open(void)
+{
+    ack_event_t ev;
+    drain_acks();
+    while (window_full()) {
+        if (!connected || xQueueReceive(ack_queue, &ev, pdMS_TO_TICKS(PUB_WINDOW_WAIT_MS)) != pdTRUE) return false;
+        handle_ack(&ev);
+    }
+    return true;
+}
+
+// {"task":"env","ch":["hum","temp"],"s":[[ts,v,v],...]}   (one channel: "ch":"temp", [ts,v])
+static int format_batch(const char *task, int channel, const pub_sample_t **batch, int n)
+{
+    uint8_t mask = channel >= 0 ? (uint8_t)(1u << channel) : batch[0]->channel_mask;
+    int len = snprintf(payload, sizeof(payload), "{\"task\":\"%s\",\"ch\":", task);
+
+    if (channel >= 0) {
+        len += snprintf(payload + len, sizeof(payload) - len, "\"%s\"", sensor_channel_name(channel));
+    } else {
+        char sep = '[';
+        for (int ch = 0; ch < CHANNEL_COUNT && len < (int)sizeof(payload); ch++) {
+            if (!(mask & (1u << ch))) continue;
+            len += snprintf(payload + len, sizeof(payload) - len, "%c\"%s\"", sep, sensor_channel_name(ch));
+            sep = ',';
+        }
+        if (len < (int)sizeof(payload)) {
+            len += snprintf(payload + len, sizeof(payload) - len, sep == '[' ? "[]" : "]");
+        }
+    }
+
+    for (int i = 0; i < n && len < (int)sizeof(payload); i++) {
+        len += snprintf(payload + len, sizeof(payload) - len, "%s[%lu",
+                        i == 0 ? ",\"s\":[" : ",", (unsigned long)batch[i]->ts_ms);
+        for (int ch = 0; ch < CHANNEL_COUNT && len < (int)sizeof(payload); ch++) {
+            if (!(mask & (1u << ch))) continue;
+            len += snprintf(payload + len, sizeof(payload) - len, ",%g",
+                            history_dequantize(ch, batch[i]->values[ch]));
+        }
+        if (len < (int)sizeof(payload)) {
+            len += snprintf(payload + len, sizeof(payload) - len, "]");
+        }
+    }
+    if (len < (int)sizeof(payload)) {
+        len += snprintf(payload + len, sizeof(payload) - len, "]}");
+    }
+    return len < (int)sizeof(payload) ? len : -1;
+}
+
+// Publish one message; returns 0 when the client accepted it
+static int publish_batch(const char *task, int channel, const pub_sample_t **batch, int n)
+{
+    if (channel >= 0) {
+        snprintf(topic, sizeof(topic), "%s/%s/%s", CONFIG_MQTT_PUB_TOPIC_PREFIX, task,
+                 sensor_channel_name(channel));
+    } else {
+        snprintf(topic, sizeof(topic), "%s/%s", CONFIG_MQTT_PUB_TOPIC_PREFIX, task);
+    }
+
+    int len = format_batch(task, channel, batch, n);
+    if (len < 0) {
+        ESP_LOGW(TAG, "Batch for %s does not fit in %d bytes", task, PUB_PAYLOAD_MAX);
+        return -1;
+    }
+    // Every message needs an inflight slot, or its ack could not be matched
+    if (!window_open()) return -1;
+
+    int64_t sent_us = esp_timer_get_time();
+    int msg_id = esp_mqtt_client_publish(client, topic, payload, len, CONFIG_MQTT_PUB_QOS, 0);
+    if (msg_id < 0) return -1;
+
+    if (CONFIG_MQTT_PUB_QOS > 0) {
+        for (int i = 0; i < PUB_MAX_INFLIGHT; i++) {
+            if (inflight[i].msg_id < 0) {
+                inflight[i].msg_id = msg_id;
+                inflight[i].sent_us = sent_us;
+                inflight_used++;
+                break;
+            }
+        }
+    }
+
+    uint32_t age = (uint32_t)(sent_us / 1000) - batch[0]->ts_ms;
+    xSemaphoreTake(pub_mutex, portMAX_DELAY);
+    stats.messages++;
+    stats.samples += n;
+    stats.bytes += len;
+    age_sum_ms += age;
+    if (age > stats.age_max_ms) stats.age_max_ms = age;
+    xSemaphoreGive(pub_mutex);
+    return 0;
+}
+
+// Group a chunk by task and channel set (order kept within a task) and publish
+// it in batches. Whatever the client refuses goes to the spill file, with only
+// the channels still unpublished, so a replay sends no topic twice.
+static void publish_chunk(pub_sample_t *chunk, int n)
+{
+    bool done[PUB_CHUNK_SAMPLES] = {0};
+    const pub_sample_t *batch[PUB_BATCH_SAMPLES];
+    pub_sample_t failed[PUB_CHUNK_SAMPLES];
+    int failed_count = 0;
+
+    for (int first = 0; first < n; first++) {
+        if (done[first]) continue;
+        int task_id = chunk[first].task_id;
+        uint8_t mask = chunk[first].channel_mask;
+        // Samples of a replaced config or a deleted task: nowhere to publish
+        // them. A clear between the two generation reads may have handed out
+        // the next config's name. The copy also outlives a stop_all.
+        char task[MAX_TASK_NAME_LEN];
+        uint8_t current = generation;
+        bool stale = chunk[first].generation != current ||
+                     !task_manager_copy_task_name(task_id, task, sizeof(task)) ||
+                     generation != current;
+
+        int i = first;
+        while (i < n) {
+            int count = 0;
+            for (; i < n && count < PUB_BATCH_SAMPLES; i++) {
+                if (!done[i] && chunk[i].task_id == task_id && chunk[i].channel_mask == mask) {
+                    batch[count++] = &chunk[i];
+                    done[i] = true;
+                }
+            }
+            if (count == 0) break;
+
+            if (stale) {
+                xSemaphoreTake(pub_mutex, portMAX_DELAY);
+                stats.dropped += count;
+                xSemaphoreGive(pub_mutex);
+                continue;
+            }
+
+            uint8_t pending = mask;
+#ifdef CONFIG_MQTT_PUB_TOPIC_PER_CHANNEL
+            for (int ch = 0; ch < CHANNEL_COUNT; ch++) {
+                if (!(pending & (1u << ch))) continue;
+                if (publish_batch(task, ch, batch, count) != 0) break;
+                pending &= (uint8_t)~(1u << ch);
+            }
+#else
+            if (publish_batch(task, -1, batch, count) == 0) pending = 0;
+#endif
+
+            if (pending) {
+                for (int k = 0; k < count; k++) {
+                    failed[failed_count] = *batch[k];
+                    failed[failed_count++].channel_mask = pending;
+                }
+            }
+        }
+    }
+
+    if (failed_count > 0) {
+        int kept = spill_write(failed, failed_count);
+        xSemaphoreTake(pub_mutex, portMAX_DELAY);
+        stats.dropped += failed_count - kept;
+        xSemaphoreGive(pub_mutex);
+    }
+}
+
+static void publisher_task(void *pvParameters)
+{
+    pub_sample_t chunk[PUB_CHUNK_SAMPLES];
+
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(CONFIG_MQTT_PUB_FLUSH_MS));
+        drain_acks();
+
+        if (!connected || window_full()) {
+            spill_overflow();
+            continue;
+        }
+
+        // Spilled samples are older than anything in RAM: replay them first
+        while (connected && !window_full() && stats.spilled > 0) {
+            int n = spill_take(chunk, PUB_CHUNK_SAMPLES);
+            if (n == 0) break;
+            publish_chunk(chunk, n);
+            drain_acks();
+        }
+
+        while (connected && !window_full() && stats.spilled == 0) {
+            int n = ring_pop(chunk, PUB_CHUNK_SAMPLES);
+            if (n == 0) break;
+            publish_chunk(chunk, n);
+            drain_acks();
+        }
+    }
+}
+
+static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_t event_id, void *event_data)
+{
+    esp_mqtt_event_handle_t event = event_data;
+    ack_event_t ack;
+
+    switch ((esp_mqtt_event_id_t)event_id) {
+        case MQTT_EVENT_CONNECTED:
+            ESP_LOGI(TAG, "Connected to %s", CONFIG_MQTT_PUB_BROKER_URI);
+            connected = true;
+            xTaskNotifyGive(pub_task);
+            break;
+        case MQTT_EVENT_DISCONNECTED:
+            ESP_LOGW(TAG, "Disconnected");
+            connected = false;
+            break;
+        case MQTT_EVENT_PUBLISHED:
+        case MQTT_EVENT_DELETED:
+            ack.msg_id = event->msg_id;
+            ack.at_us = esp_timer_get_time();
+            ack.expired = event_id == MQTT_EVENT_DELETED;
+            xQueueSend(ack_queue, &ack, 0);
+            xTaskNotifyGive(pub_task);
+            break;
+        default:
+            break;
+    }
+}
+
+void mqtt_pub_init(void)
+{
+    pub_mutex = xSemaphoreCreateMutex();
+    ack_queue = xQueueCreate(PUB_MAX_INFLIGHT * 2, sizeof(ack_event_t));
+    for (int i = 0; i < PUB_MAX_INFLIGHT; i++) {
+        inflight[i].msg_id = -1;
+    }
+    stats_start_us = esp_timer_get_time();
+
+    spill = fopen(CONFIG_MQTT_PUB_SPILL_PATH, "w+b");
+    if (!spill) {
+        ESP_LOGW(TAG, "No spill file at %s, overflow drops oldest samples", CONFIG_MQTT_PUB_SPILL_PATH);
+    }
+
+    const esp_mqtt_client_config_t mqtt_cfg = {
+        .broker.address.uri = CONFIG_MQTT_PUB_BROKER_URI,
+    };
+    client = esp_mqtt_client_init(&mqtt_cfg);
+    if (!client) {
+        ESP_LOGE(TAG, "Failed to create MQTT client");
+        return;
+    }
+    esp_mqtt_client_register_event(client, ESP_EVENT_ANY_ID, mqtt_event_handler, NULL);
+
+    xTaskCreate(publisher_task, "mqtt_pub", 6144, NULL, 1, &pub_task);
+    esp_mqtt_client_start(client);
+    ESP_LOGI(TAG, "Publishing to %s/<task> (QoS %d, batch %d)",
+             CONFIG_MQTT_PUB_TOPIC_PREFIX, CONFIG_MQTT_PUB_QOS, PUB_BATCH_SAMPLES);
+}
+
+void mqtt_pub_clear(void)
+{
+    if (!pub_mutex) return;
+
+    xSemaphoreTake(pub_mutex, portMAX_DELAY);
+    stats.dropped += ring_count;
+    ring_head = 0;
+    ring_count = 0;
+    // The spill file belongs to the publisher task: it drops the old
+    // generation's records as it replays them
+    generation++;
+    xSemaphoreGive(pub_mutex);
+}
+
+void mqtt_pub_get_stats(mqtt_pub_stats_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    if (!pub_mutex) return;
+
+    xSemaphoreTake(pub_mutex, portMAX_DELAY);
+    *out = stats;
+    out->enabled = true;
+    out->connected = connected;
+    out->queued = ring_count;
+    out->ack_avg_us = stats.acked ? (uint32_t)(ack_sum_us / stats.acked) : 0;
+    out->age_avg_ms = stats.messages ? (uint32_t)(age_sum_ms / stats.messages) : 0;
+    out->elapsed_ms = (uint32_t)((esp_timer_get_time() - stats_start_us) / 1000);
+    xSemaphoreGive(pub_mutex);
+}
+
+void mqtt_pub_reset_stats(void)
+{
+    if (!pub_mutex) return;
+
+    xSemaphoreTake(pub_mutex, portMAX_DELAY);
+    uint32_t spilled = stats.spilled;
+    memset(&stats, 0, sizeof(stats));
+    stats.spilled = spilled;        // Backlog, not a counter
+    ack_sum_us = 0;
+    age_sum_ms = 0;
+    stats_start_us = esp_timer_get_time();
+    xSemaphoreGive(pub_mutex);
+}
+
+#else // !CONFIG_MQTT_PUB_ENABLE
+
+void mqtt_pub_init(void) {}
+void mqtt_pub_sample(int task_id, uint8_t channel_mask, const sensor_readings_t *readings) {}
+void mqtt_pub_clear(void) {}
+void mqtt_pub_reset_stats(void) {}
+
+void mqtt_pub_get_stats(mqtt_pub_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+#endif // CONFIG_MQTT_PUB_ENABLE
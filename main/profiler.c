@@ -0,0 +1,295 @@
+#include "profiler.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+#include <string.h>
+
+#if !CONFIG_IDF_TARGET_LINUX
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "driver/gptimer.h"
+#include "esp_attr.h"
+#include "esp_cpu.h"
+#include "esp_timer.h"
+#include "esp_debug_helpers.h"
+#include "esp_memory_utils.h"
+#include <stdlib.h>
+#if CONFIG_IDF_TARGET_ARCH_XTENSA
+#include "xtensa_context.h"
+#else
+#include "riscv/rvruntime-frames.h"
+#endif
+
+#define PROFILER_TIMER_HZ 1000000
+#define PROFILER_MAX_RATE 10000
+
+static const char *TAG = "Profiler";
+
+static gptimer_handle_t timers[portNUM_PROCESSORS];
+static profiler_sample_t *ring = NULL;
+static uint32_t head = 0;           // Next slot to fill
+static uint32_t count = 0;
+static char task_names[PROFILER_MAX_TASKS][configMAX_TASK_NAME_LEN];
+static const void *task_handles[PROFILER_MAX_TASKS];
+static int task_count = 0;
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+static volatile bool running = false;
+static uint32_t rate_hz = 0;
+static uint32_t taken = 0;
+static uint32_t lost = 0;
+static uint64_t isr_cycles = 0;
+static int64_t started_us = 0;
+static int64_t stopped_us = 0;
+
+// Called under the lock. Task names are copied the first time a handle is
+// seen, so samples stay attributable after the task is deleted. Samples that
+// interrupted another ISR go to a NULL handle named "(isr)".
+static uint8_t IRAM_ATTR intern_task(TaskHandle_t handle)
+{
+    for (int i = 0; i < task_count; i++) {
+        if (task_handles[i] == handle) return (uint8_t)i;
+    }
+    if (task_count >= PROFILER_MAX_TASKS) return PROFILER_MAX_TASKS - 1;
+
+    int i = task_count++;
+    task_handles[i] = handle;
+    const char *name = handle ? pcTaskGetName(handle) : "(isr)";
+    int n = 0;
+    for (; n < configMAX_TASK_NAME_LEN - 1 && name[n]; n++) {
+        task_names[i][n] = name[n];
+    }
+    task_names[i][n] = '\0';
+    return (uint8_t)i;
+}
+
+// The port saves the interrupted task's context on its own stack and stores
+// that stack pointer in pxTopOfStack (the first TCB field) on interrupt entry.
+static int IRAM_ATTR capture_stack(TaskHandle_t handle, uint32_t *pc)
+{
+    if (!handle || xPortInterruptedFromISRContext()) return 0;
+    const void *frame = *(void *const *)handle;
+    int depth = 0;
+
+#if CONFIG_IDF_TARGET_ARCH_XTENSA
+    const XtExcFrame *exc = frame;
+    esp_backtrace_frame_t bt = {
+        .pc = exc->pc,
+        .sp = exc->a1,
+        .next_pc = exc->a0,
+        .exc_frame = exc,
+    };
+    pc[depth++] = bt.pc;
+    while (depth < CONFIG_PROFILER_DEPTH && bt.next_pc != 0) {
+        if (!esp_backtrace_get_next_frame(&bt) || !esp_stack_ptr_is_sane(bt.sp)) break;
+        uint32_t caller = esp_cpu_process_stack_pc(bt.pc);
+        if (!esp_ptr_executable((void *)(uintptr_t)caller)) break;
+        pc[depth++] = caller;
+    }
+#else
+    // No frame pointers on RISC-V: the return address register is the only caller known
+    const RvExcFrame *exc = frame;
+    pc[depth++] = exc->mepc;
+    if (CONFIG_PROFILER_DEPTH > 1 && esp_ptr_executable((void *)(uintptr_t)exc->ra)) {
+        pc[depth++] = exc->ra - 4;
+    }
+#endif
+    return depth;
+}
+
+static bool IRAM_ATTR on_alarm(gptimer_handle_t timer, const gptimer_alarm_event_data_t *event, void *arg)
+{
+    uint32_t t0 = esp_cpu_get_cycle_count();
+    if (!running) return false;
+
+    uint32_t pc[CONFIG_PROFILER_DEPTH];
+    TaskHandle_t handle = xTaskGetCurrentTaskHandle();
+    int depth = capture_stack(handle, pc);
+
+    portENTER_CRITICAL_ISR(&lock);
+    if (count >= CONFIG_PROFILER_SAMPLES) {
+        lost++;
+    } else {
+        profiler_sample_t *s = &ring[head];
+        s->core = (uint8_t)esp_cpu_get_core_id();
+        s->task = intern_task(depth ? handle : NULL);
+        s->depth = (uint8_t)depth;
+        memcpy(s->pc, pc, depth * sizeof(uint32_t));
+        head = (head + 1) % CONFIG_PROFILER_SAMPLES;
+        count++;
+        taken++;
+    }
+    isr_cycles += esp_cpu_get_cycle_count() - t0;
+    portEXIT_CRITICAL_ISR(&lock);
+    return false;
+}
+
+typedef struct {
+    int core;
+    SemaphoreHandle_t done;
+    esp_err_t err;
+} timer_setup_t;
+
+// The timer interrupt is allocated on the core that registers its callbacks
+static void timer_setup_task(void *arg)
+{
+    timer_setup_t *setup = arg;
+    gptimer_handle_t timer = NULL;
+    gptimer_config_t config = {
+        .clk_src = GPTIMER_CLK_SRC_DEFAULT,
+        .direction = GPTIMER_COUNT_UP,
+        .resolution_hz = PROFILER_TIMER_HZ,
+    };
+    gptimer_event_callbacks_t callbacks = { .on_alarm = on_alarm };
+
+    setup->err = gptimer_new_timer(&config, &timer);
+    if (setup->err == ESP_OK) setup->err = gptimer_register_event_callbacks(timer, &callbacks, NULL);
+    if (setup->err == ESP_OK) setup->err = gptimer_enable(timer);
+    if (setup->err == ESP_OK) {
+        timers[setup->core] = timer;
+    } else if (timer) {
+        gptimer_del_timer(timer);
+    }
+    xSemaphoreGive(setup->done);
+    vTaskDelete(NULL);
+}
+
+static esp_err_t create_timers(void)
+{
+    timer_setup_t setup = { .done = xSemaphoreCreateBinary() };
+    if (!setup.done) return ESP_ERR_NO_MEM;
+
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        if (timers[core]) continue;
+        setup.core = core;
+        setup.err = ESP_FAIL;
+        if (xTaskCreatePinnedToCore(timer_setup_task, "prof_setup", 3072, &setup,
+                                    configMAX_PRIORITIES - 1, NULL, core) != pdPASS) {
+            setup.err = ESP_ERR_NO_MEM;
+        } else {
+            xSemaphoreTake(setup.done, portMAX_DELAY);
+        }
+        if (setup.err != ESP_OK) {
+            ESP_LOGE(TAG, "Timer on core %d: %s", core, esp_err_to_name(setup.err));
+            break;
+        }
+    }
+    vSemaphoreDelete(setup.done);
+    return setup.err;
+}
+
+esp_err_t profiler_start(uint32_t hz)
+{
+    if (running || hz == 0 || hz > PROFILER_MAX_RATE) return ESP_ERR_INVALID_ARG;
+
+    if (!ring) {
+        ring = malloc(CONFIG_PROFILER_SAMPLES * sizeof(profiler_sample_t));
+        if (!ring) return ESP_ERR_NO_MEM;
+    }
+    esp_err_t err = create_timers();
+    if (err != ESP_OK) return err;
+
+    portENTER_CRITICAL(&lock);
+    head = count = 0;
+    taken = lost = 0;
+    isr_cycles = 0;
+    task_count = 0;
+    portEXIT_CRITICAL(&lock);
+
+    rate_hz = hz;
+    started_us = esp_timer_get_time();
+    running = true;
+
+    // Cores sample at the same rate but out of phase, so they are not interrupted in lockstep
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        gptimer_alarm_config_t alarm = {
+            .alarm_count = PROFILER_TIMER_HZ / hz,
+            .reload_count = 0,
+            .flags.auto_reload_on_alarm = true,
+        };
+        gptimer_set_raw_count(timers[core], (uint64_t)core * alarm.alarm_count / portNUM_PROCESSORS);
+        gptimer_set_alarm_action(timers[core], &alarm);
+        gptimer_start(timers[core]);
+    }
+    ESP_LOGI(TAG, "Sampling at %lu Hz per core", (unsigned long)hz);
+    return ESP_OK;
+}
+
+void profiler_stop(void)
+{
+    if (!running) return;
+    running = false;
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        gptimer_stop(timers[core]);
+    }
+    stopped_us = esp_timer_get_time();
+}
+
+void profiler_get_stats(profiler_stats_t *stats)
+{
+    portENTER_CRITICAL(&lock);
+    uint64_t cycles = isr_cycles;
+    stats->taken = taken;
+    stats->lost = lost;
+    stats->pending = count;
+    portEXIT_CRITICAL(&lock);
+
+    stats->running = running;
+    stats->hz = rate_hz;
+    stats->isr_cycles_avg = taken ? (uint32_t)(cycles / taken) : 0;
+
+    // Interrupt entry and exit are not counted, so this is a lower bound
+    int64_t elapsed_us = (running ? esp_timer_get_time() : stopped_us) - started_us;
+    uint64_t budget = (uint64_t)elapsed_us * CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ * portNUM_PROCESSORS;
+    stats->overhead_ppm = budget ? (uint32_t)(cycles * 1000000ULL / budget) : 0;
+}
+
+int profiler_drain(profiler_sample_t *out, int max)
+{
+    if (!ring) return 0;
+
+    portENTER_CRITICAL(&lock);
+    int n = 0;
+    while (n < max && count > 0) {
+        uint32_t tail = (head + CONFIG_PROFILER_SAMPLES - count) % CONFIG_PROFILER_SAMPLES;
+        out[n++] = ring[tail];
+        count--;
+    }
+    portEXIT_CRITICAL(&lock);
+    return n;
+}
+
+const char *profiler_task_name(uint8_t task)
+{
+    return task < task_count ? task_names[task] : "?";
+}
+
+#else // CONFIG_IDF_TARGET_LINUX
+
+// The host build runs tasks as POSIX threads; there is no program counter to sample
+esp_err_t profiler_start(uint32_t hz)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+void profiler_stop(void)
+{
+}
+
+void profiler_get_stats(profiler_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+int profiler_drain(profiler_sample_t *out, int max)
+{
+    return 0;
+}
+
+const char *profiler_task_name(uint8_t task)
+{
+    return "?";
+}
+
+#endif
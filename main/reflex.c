@@ -0,0 +1,146 @@
+#include "reflex.h"
+#include "telemetry.h"
+#include "driver/gpio.h"
+#include "soc/uart_pins.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <stdio.h>
+#include <string.h>
+
+static const char *TAG = "Reflex";
+
+typedef struct {
+    const char *name;
+    reflex_callback_t fn;
+    void *arg;
+} callback_entry_t;
+
+static void report_callback(const reflex_event_t *event, void *arg);
+
+static callback_entry_t callbacks[REFLEX_MAX_CALLBACKS] = {
+    { "report", report_callback, NULL },
+};
+static int callback_count = 1;
+
+// Queued like the task's other output, so the link never stalls the reaction
+static void report_callback(const reflex_event_t *event, void *arg)
+{
+    char line[96];
+    int len = snprintf(line, sizeof(line), "REFLEX %s %s value=%.3f\n",
+                       event->rule, event->active ? "on" : "off", event->value);
+    if (len > 0) telemetry_submit(event->task_id, line, (size_t)len < sizeof(line) ? (size_t)len : sizeof(line) - 1);
+}
+
+int reflex_register_callback(const char *name, reflex_callback_t fn, void *arg)
+{
+    if (callback_count >= REFLEX_MAX_CALLBACKS || reflex_find_callback(name) >= 0) return -1;
+    callbacks[callback_count++] = (callback_entry_t){ name, fn, arg };
+    return 0;
+}
+
+int reflex_find_callback(const char *name)
+{
+    for (int i = 0; i < callback_count; i++) {
+        if (strcmp(callbacks[i].name, name) == 0) return i;
+    }
+    return -1;
+}
+
+static void drive(const reflex_rule_t *rule, bool active)
+{
+    gpio_set_level((gpio_num_t)rule->gpio, active != rule->active_low);
+}
+
+int reflex_rule_check(const reflex_rule_t *rule)
+{
+    if (rule->action == REFLEX_ACTION_CALLBACK) {
+        // A stored image may name a callback this firmware never registered
+        if (rule->callback < 0 || rule->callback >= callback_count) {
+            ESP_LOGE(TAG, "%s: no callback %d", rule->name, rule->callback);
+            return -1;
+        }
+        return 0;
+    }
+    if (rule->action != REFLEX_ACTION_GPIO || !GPIO_IS_VALID_OUTPUT_GPIO(rule->gpio)) {
+        ESP_LOGE(TAG, "%s: GPIO %d cannot drive an output", rule->name, rule->gpio);
+        return -1;
+    }
+    // Resetting the console UART's pins would cut the link the config came over
+    if (rule->gpio == U0TXD_GPIO_NUM || rule->gpio == U0RXD_GPIO_NUM) {
+        ESP_LOGE(TAG, "%s: GPIO %d belongs to UART0", rule->name, rule->gpio);
+        return -1;
+    }
+    return 0;
+}
+
+int reflex_rule_init(reflex_rule_t *rule)
+{
+    rule->active = false;
+    rule->streak = 0;
+    reflex_reset_stats(rule);
+    if (reflex_rule_check(rule) != 0) return -1;
+    if (rule->action != REFLEX_ACTION_GPIO) return 0;
+
+    gpio_reset_pin((gpio_num_t)rule->gpio);
+    gpio_set_direction((gpio_num_t)rule->gpio, GPIO_MODE_OUTPUT);
+    drive(rule, false);
+    return 0;
+}
+
+void reflex_rule_release(reflex_rule_t *rule, int task_id)
+{
+    if (rule->action == REFLEX_ACTION_GPIO) {
+        drive(rule, false);
+    } else if (rule->active) {
+        const reflex_event_t event = { rule->name, task_id, false, 0.0f, esp_timer_get_time() };
+        callbacks[rule->callback].fn(&event, callbacks[rule->callback].arg);
+    }
+    rule->active = false;
+    rule->streak = 0;
+}
+
+void reflex_reset_stats(reflex_rule_t *rule)
+{
+    rule->trips = 0;
+    rule->latency_last_us = 0;
+    rule->latency_max_us = 0;
+    rule->latency_sum_us = 0;
+}
+
+void reflex_on_sample(reflex_rule_t *rules, int count, int task_id, const sensor_readings_t *sample,
+                      uint8_t mask, int64_t sample_us)
+{
+    for (int i = 0; i < count; i++) {
+        reflex_rule_t *rule = &rules[i];
+        if (!(mask & (1u << rule->channel))) continue;
+
+        float value = sensor_readings_get(sample, rule->channel);
+        // Trip at the threshold, release only once clear of it by the hysteresis
+        bool tripping = rule->below ? value < rule->threshold : value > rule->threshold;
+        bool clear = rule->below ? value > rule->threshold + rule->hysteresis
+                                 : value < rule->threshold - rule->hysteresis;
+        bool change = rule->active ? clear : tripping;
+        if (!change) {
+            rule->streak = 0;
+            continue;
+        }
+        if (++rule->streak < rule->debounce) continue;
+
+        rule->streak = 0;
+        rule->active = !rule->active;
+        if (rule->action == REFLEX_ACTION_GPIO) {
+            drive(rule, rule->active);
+        } else {
+            const reflex_event_t event = { rule->name, task_id, rule->active, value, sample_us };
+            callbacks[rule->callback].fn(&event, callbacks[rule->callback].arg);
+        }
+
+        if (rule->active) {
+            uint32_t latency = (uint32_t)(esp_timer_get_time() - sample_us);
+            rule->trips++;
+            rule->latency_last_us = latency;
+            rule->latency_sum_us += latency;
+            if (latency > rule->latency_max_us) rule->latency_max_us = latency;
+        }
+    }
+}
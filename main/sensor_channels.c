@@ -0,0 +1,46 @@
+#include "sensor_channels.h"
+#include <string.h>
+
+static const char *const channel_names[CHANNEL_COUNT] = {
+    "hum", "temp", "dist", "ax", "ay", "az"
+};
+
+sensor_channel_t sensor_channel_from_name(const char *name)
+{
+    if (!name) return CHANNEL_NONE;
+    for (int i = 0; i < CHANNEL_COUNT; i++) {
+        if (strcmp(name, channel_names[i]) == 0) return (sensor_channel_t)i;
+    }
+    return CHANNEL_NONE;
+}
+
+const char *sensor_channel_name(sensor_channel_t channel)
+{
+    return channel < CHANNEL_COUNT ? channel_names[channel] : "none";
+}
+
+float sensor_readings_get(const sensor_readings_t *readings, sensor_channel_t channel)
+{
+    switch (channel) {
+        case CHANNEL_HUMIDITY:    return readings->dht_humidity;
+        case CHANNEL_TEMPERATURE: return readings->dht_temperature;
+        case CHANNEL_DISTANCE:    return (float)readings->ultrasonic_distance;
+        case CHANNEL_ACCEL_X:     return readings->mpu_accel_x;
+        case CHANNEL_ACCEL_Y:     return readings->mpu_accel_y;
+        case CHANNEL_ACCEL_Z:     return readings->mpu_accel_z;
+        default:                  return 0.0f;
+    }
+}
+
+void sensor_readings_set(sensor_readings_t *readings, sensor_channel_t channel, float value)
+{
+    switch (channel) {
+        case CHANNEL_HUMIDITY:    readings->dht_humidity = value; break;
+        case CHANNEL_TEMPERATURE: readings->dht_temperature = value; break;
+        case CHANNEL_DISTANCE:    readings->ultrasonic_distance = (int)value; break;
+        case CHANNEL_ACCEL_X:     readings->mpu_accel_x = value; break;
+        case CHANNEL_ACCEL_Y:     readings->mpu_accel_y = value; break;
+        case CHANNEL_ACCEL_Z:     readings->mpu_accel_z = value; break;
+        default:                  break;
+    }
+}
@@ -0,0 +1,183 @@
+#include "sensor_trace.h"
+#include "sensors.h"
+#include "task_manager.h"
+#include "esp_log.h"
+#include "esp_rom_sys.h"
+#include "sdkconfig.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifndef CONFIG_SENSOR_TRACE_REPLAY_FILE
+#define CONFIG_SENSOR_TRACE_REPLAY_FILE ""
+#endif
+
+static const char *TAG = "Trace";
+
+typedef struct {
+    uint8_t stream;
+    uint8_t ok;
+    uint32_t latency_us;
+    int16_t values[SENSOR_TRACE_VALUES];
+} trace_record_t;
+
+// Records of one sensor id, consumed in file order
+typedef struct {
+    char id[MAX_SENSOR_ID_LEN];
+    int cursor;                 // Index of the last record served, -1 before the first
+} trace_stream_t;
+
+static trace_record_t records[SENSOR_TRACE_MAX_RECORDS];
+static int record_count = 0;
+static trace_stream_t streams[MAX_SENSOR_INSTANCES];
+static int stream_count = 0;
+static volatile sensor_trace_mode_t mode = SENSOR_TRACE_LIVE;
+static uint32_t replayed = 0;
+static uint32_t wraps = 0;
+static uint32_t misses = 0;
+
+static int find_stream(const char *id)
+{
+    for (int i = 0; i < stream_count; i++) {
+        if (strcmp(streams[i].id, id) == 0) return i;
+    }
+    return -1;
+}
+
+void sensor_trace_clear(void)
+{
+    if (mode == SENSOR_TRACE_REPLAY) return;
+    record_count = 0;
+    stream_count = 0;
+    replayed = wraps = misses = 0;
+}
+
+int sensor_trace_add(const char *id, uint32_t latency_us, bool ok, const int32_t values[SENSOR_TRACE_VALUES])
+{
+    if (mode == SENSOR_TRACE_REPLAY || record_count >= SENSOR_TRACE_MAX_RECORDS) return -1;
+
+    int s = find_stream(id);
+    if (s < 0) {
+        if (stream_count >= MAX_SENSOR_INSTANCES) return -1;
+        s = stream_count++;
+        strncpy(streams[s].id, id, MAX_SENSOR_ID_LEN - 1);
+        streams[s].id[MAX_SENSOR_ID_LEN - 1] = '\0';
+        streams[s].cursor = -1;
+    }
+
+    trace_record_t *r = &records[record_count++];
+    r->stream = (uint8_t)s;
+    r->ok = ok;
+    r->latency_us = latency_us;
+    for (int i = 0; i < SENSOR_TRACE_VALUES; i++) {
+        r->values[i] = (int16_t)values[i];
+    }
+    return 0;
+}
+
+int sensor_trace_load(const char *path)
+{
+    if (mode == SENSOR_TRACE_REPLAY) return -1;
+
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        ESP_LOGE(TAG, "Cannot open %s", path);
+        return -1;
+    }
+
+    // Anything but TRACE lines is skipped, so a raw capture of the link can be replayed as is
+    char line[128];
+    int loaded = 0;
+    while (fgets(line, sizeof(line), f)) {
+        char id[MAX_SENSOR_ID_LEN];
+        unsigned long latency;
+        int ok;
+        long v0, v1, v2;
+        if (sscanf(line, "TRACE %15s %lu %d %ld %ld %ld", id, &latency, &ok, &v0, &v1, &v2) != 6) {
+            continue;
+        }
+        int32_t v[SENSOR_TRACE_VALUES] = { (int32_t)v0, (int32_t)v1, (int32_t)v2 };
+        if (sensor_trace_add(id, (uint32_t)latency, ok != 0, v) != 0) {
+            ESP_LOGW(TAG, "Trace full after %d records", record_count);
+            break;
+        }
+        loaded++;
+    }
+    fclose(f);
+
+    ESP_LOGI(TAG, "Loaded %d records from %s (%d sensors)", loaded, path, stream_count);
+    return loaded;
+}
+
+void sensor_trace_set_mode(sensor_trace_mode_t new_mode)
+{
+    if (new_mode == SENSOR_TRACE_REPLAY) {
+        if (record_count == 0) return;
+        for (int i = 0; i < stream_count; i++) {
+            streams[i].cursor = -1;
+        }
+        replayed = wraps = misses = 0;
+    }
+    mode = new_mode;
+}
+
+sensor_trace_mode_t sensor_trace_mode(void)
+{
+    return mode;
+}
+
+void sensor_trace_init(void)
+{
+    if (CONFIG_SENSOR_TRACE_REPLAY_FILE[0] == '\0') return;
+
+    if (sensor_trace_load(CONFIG_SENSOR_TRACE_REPLAY_FILE) > 0) {
+        sensor_trace_set_mode(SENSOR_TRACE_REPLAY);
+        ESP_LOGI(TAG, "Replaying sensor trace");
+    }
+}
+
+// Called with the instance mutex held, which also guards the stream cursor
+int sensor_trace_replay(const char *id, int32_t values[SENSOR_TRACE_VALUES])
+{
+    if (mode != SENSOR_TRACE_REPLAY) return 1;
+
+    int s = find_stream(id);
+    if (s < 0) {
+        misses++;
+        return -1;
+    }
+
+    trace_stream_t *stream = &streams[s];
+    int i = stream->cursor;
+    do {
+        if (++i >= record_count) {
+            i = 0;
+            wraps++;
+        }
+    } while (records[i].stream != s);
+    stream->cursor = i;
+
+    const trace_record_t *r = &records[i];
+    esp_rom_delay_us(r->latency_us);
+    for (int k = 0; k < SENSOR_TRACE_VALUES; k++) {
+        values[k] = r->values[k];
+    }
+    replayed++;
+    return r->ok ? 0 : -1;
+}
+
+void sensor_trace_record(const char *id, uint32_t latency_us, bool ok, const int32_t values[SENSOR_TRACE_VALUES])
+{
+    if (mode != SENSOR_TRACE_RECORD) return;
+    uart_log("TRACE", "TRACE %s %lu %d %ld %ld %ld\n", id, (unsigned long)latency_us, ok ? 1 : 0,
+             (long)values[0], (long)values[1], (long)values[2]);
+}
+
+void sensor_trace_get_stats(sensor_trace_stats_t *stats)
+{
+    stats->mode = mode;
+    stats->records = record_count;
+    stats->streams = stream_count;
+    stats->replayed = replayed;
+    stats->wraps = wraps;
+    stats->misses = misses;
+}
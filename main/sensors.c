@@ -1,60 +1,235 @@
 #include "sensors.h"
-#include "dht.h"
-#include "mpu6050.h"
+#include "sensor_trace.h"
+#include "fault.h"
 #include "esp_log.h"
 #include "driver/gpio.h"
 #include "esp_timer.h"
+#include "esp_rom_sys.h"
+#include <string.h>
 
+static const char *TAG = "Sensors";
 static const char *TAG_MPU = "MPU";
-static mpu6050_dev_t s_mpu_dev = {0};
-static bool s_mpu_inited = false;
 
-int get_ultrasonic_data(SemaphoreHandle_t handle)
+static sensor_instance_t s_instances[MAX_SENSOR_INSTANCES];
+static int s_instance_count = 0;
+
+static void init_instance_hw(sensor_instance_t *sensor)
 {
-    static bool pins_inited = false;
-    if (handle) xSemaphoreTake(handle, portMAX_DELAY);
+    switch (sensor->type) {
+        case SENSOR_DHT11:
+            gpio_set_pull_mode(sensor->dht.pin, GPIO_PULLUP_ONLY);
+            sensor->ready = true;
+            break;
+        case SENSOR_ULTRASONIC:
+            gpio_reset_pin(sensor->ultrasonic.trig);
+            gpio_reset_pin(sensor->ultrasonic.echo);
+            gpio_set_direction(sensor->ultrasonic.trig, GPIO_MODE_OUTPUT);
+            gpio_set_level(sensor->ultrasonic.trig, 0);
+            gpio_set_direction(sensor->ultrasonic.echo, GPIO_MODE_INPUT);
+            sensor->ready = true;
+            break;
+        case SENSOR_MPU6050:
+            initialize_mpu(sensor);
+            break;
+        default:
+            break;
+    }
+}
 
-    if (!pins_inited)
-    {
-        gpio_reset_pin(ULTRASONIC_TRIG_PIN);
-        gpio_reset_pin(ULTRASONIC_ECHO_PIN);
-        gpio_set_direction(ULTRASONIC_TRIG_PIN, GPIO_MODE_OUTPUT);
-        gpio_set_level(ULTRASONIC_TRIG_PIN, 0);
-        gpio_set_direction(ULTRASONIC_ECHO_PIN, GPIO_MODE_INPUT);
-        pins_inited = true;
+int sensors_add_instance(const sensor_instance_t *wiring)
+{
+    if (s_instance_count >= MAX_SENSOR_INSTANCES) {
+        ESP_LOGE(TAG, "Sensor instance limit %d reached", MAX_SENSOR_INSTANCES);
+        return -1;
+    }
+    if (sensors_find_instance(wiring->id) >= 0) {
+        ESP_LOGE(TAG, "Duplicate sensor id %s", wiring->id);
+        return -1;
+    }
+    
+    sensor_instance_t *sensor = &s_instances[s_instance_count];
+    *sensor = *wiring;
+    sensor->ready = false;
+    memset(&sensor->lock_stats, 0, sizeof(sensor->lock_stats));
+    if (sensor->type == SENSOR_MPU6050 && calib_imu_load(sensor->id, &sensor->mpu.calib) != 0) {
+        calib_imu_identity(&sensor->mpu.calib);
+    }
+    sensor->mutex = xSemaphoreCreateMutex();
+    if (!sensor->mutex) {
+        ESP_LOGE(TAG, "Failed to create mutex for %s", wiring->id);
+        return -1;
+    }
+    
+    init_instance_hw(sensor);
+    ESP_LOGI(TAG, "Sensor %s registered (type=%d, ready=%d)", sensor->id, sensor->type, sensor->ready);
+    return s_instance_count++;
+}
+
+void sensors_register_defaults(void)
+{
+    sensor_instance_t wiring;
+    
+    memset(&wiring, 0, sizeof(wiring));
+    strcpy(wiring.id, "dht11");
+    wiring.type = SENSOR_DHT11;
+    wiring.dht.pin = DHT_DATA_PIN;
+    wiring.dht.kind = DHT_SENSOR_TYPE;
+    sensors_add_instance(&wiring);
+    
+    memset(&wiring, 0, sizeof(wiring));
+    strcpy(wiring.id, "ultrasonic");
+    wiring.type = SENSOR_ULTRASONIC;
+    wiring.ultrasonic.trig = ULTRASONIC_TRIG_PIN;
+    wiring.ultrasonic.echo = ULTRASONIC_ECHO_PIN;
+    sensors_add_instance(&wiring);
+    
+    memset(&wiring, 0, sizeof(wiring));
+    strcpy(wiring.id, "mpu6050");
+    wiring.type = SENSOR_MPU6050;
+    wiring.mpu.port = 0;
+    wiring.mpu.sda = MPU_SDA_PIN;
+    wiring.mpu.scl = MPU_SCL_PIN;
+    wiring.mpu.address = MPU6050_I2C_ADDRESS_LOW;
+    sensors_add_instance(&wiring);
+}
+
+int sensors_find_instance(const char *id)
+{
+    for (int i = 0; i < s_instance_count; i++) {
+        if (strcmp(s_instances[i].id, id) == 0) return i;
     }
+    return -1;
+}
+
+sensor_instance_t *sensors_get_instance(int index)
+{
+    return (index >= 0 && index < s_instance_count) ? &s_instances[index] : NULL;
+}
+
+int sensors_get_wiring(int index, sensor_instance_t *wiring)
+{
+    if (index < 0 || index >= s_instance_count) return -1;
+    const sensor_instance_t *sensor = &s_instances[index];
+    memset(wiring, 0, sizeof(*wiring));
+    strcpy(wiring->id, sensor->id);
+    wiring->type = sensor->type;
+    switch (sensor->type) {
+        case SENSOR_DHT11:
+            wiring->dht.pin = sensor->dht.pin;
+            wiring->dht.kind = sensor->dht.kind;
+            break;
+        case SENSOR_ULTRASONIC:
+            wiring->ultrasonic.trig = sensor->ultrasonic.trig;
+            wiring->ultrasonic.echo = sensor->ultrasonic.echo;
+            break;
+        case SENSOR_MPU6050:
+            wiring->mpu.port = sensor->mpu.port;
+            wiring->mpu.sda = sensor->mpu.sda;
+            wiring->mpu.scl = sensor->mpu.scl;
+            wiring->mpu.address = sensor->mpu.address;
+            break;
+        default:
+            break;
+    }
+    return 0;
+}
+
+bool sensors_wiring_uses_pin(const sensor_instance_t *wiring, int pin)
+{
+    switch (wiring->type) {
+        case SENSOR_DHT11:
+            return wiring->dht.pin == pin;
+        case SENSOR_ULTRASONIC:
+            return wiring->ultrasonic.trig == pin || wiring->ultrasonic.echo == pin;
+        case SENSOR_MPU6050:
+            return wiring->mpu.sda == pin || wiring->mpu.scl == pin;
+        default:
+            return false;
+    }
+}
+
+int sensors_instance_count(void)
+{
+    return s_instance_count;
+}
+
+sensor_type_t sensor_type_from_name(const char *name)
+{
+    if (strcmp(name, "dht11") == 0) return SENSOR_DHT11;
+    if (strcmp(name, "ultrasonic") == 0) return SENSOR_ULTRASONIC;
+    if (strcmp(name, "mpu6050") == 0) return SENSOR_MPU6050;
+    return SENSOR_NONE;
+}
+
+uint8_t sensor_type_channels(sensor_type_t type)
+{
+    switch (type) {
+        case SENSOR_DHT11:      return (1u << CHANNEL_HUMIDITY) | (1u << CHANNEL_TEMPERATURE);
+        case SENSOR_ULTRASONIC: return 1u << CHANNEL_DISTANCE;
+        case SENSOR_MPU6050:    return (1u << CHANNEL_ACCEL_X) | (1u << CHANNEL_ACCEL_Y) | (1u << CHANNEL_ACCEL_Z);
+        default:                return 0;
+    }
+}
+
+int sensor_min_gap_ms(sensor_type_t type)
+{
+    switch (type) {
+        case SENSOR_DHT11:      return 100;
+        case SENSOR_ULTRASONIC: return 50;
+        case SENSOR_MPU6050:    return 10;
+        default:                return 0;
+    }
+}
+
+const char *sensor_type_name(sensor_type_t type)
+{
+    switch (type) {
+        case SENSOR_DHT11:      return "dht11";
+        case SENSOR_ULTRASONIC: return "ultrasonic";
+        case SENSOR_MPU6050:    return "mpu6050";
+        default:                return "none";
+    }
+}
+
+#define ULTRASONIC_TIMEOUT_US 30000
+
+// Echo level, or a stuck-high line when that fault is injected
+#define ECHO_LEVEL(echo, stuck) ((stuck) ? 1 : gpio_get_level(echo))
+
+// Echo pulse measurement; the caller holds the instance mutex. Returns cm or -1.
+static int ultrasonic_measure(sensor_instance_t *sensor, bool stuck)
+{
+    gpio_num_t trig = sensor->ultrasonic.trig;
+    gpio_num_t echo = sensor->ultrasonic.echo;
 
     // Send 10us pulse on TRIG
-    gpio_set_level(ULTRASONIC_TRIG_PIN, 0);
+    gpio_set_level(trig, 0);
     esp_rom_delay_us(2);
-    gpio_set_level(ULTRASONIC_TRIG_PIN, 1);
+    gpio_set_level(trig, 1);
     esp_rom_delay_us(10);
-    gpio_set_level(ULTRASONIC_TRIG_PIN, 0);
+    gpio_set_level(trig, 0);
 
     // Wait for ECHO to go high (max 30 ms)
-    int timeout_us = 30000;
+    int timeout_us = ULTRASONIC_TIMEOUT_US;
     int waited = 0;
-    while (gpio_get_level(ULTRASONIC_ECHO_PIN) == 0 && waited < timeout_us)
+    while (ECHO_LEVEL(echo, stuck) == 0 && waited < timeout_us)
     {
         esp_rom_delay_us(1);
         waited++;
     }
     if (waited >= timeout_us)
     {
-        if (handle) xSemaphoreGive(handle);
         return -1;
     }
 
     // Measure high pulse width up to 30 ms
     int duration_us = 0;
-    while (gpio_get_level(ULTRASONIC_ECHO_PIN) == 1 && duration_us < timeout_us)
+    while (ECHO_LEVEL(echo, stuck) == 1 && duration_us < timeout_us)
     {
         esp_rom_delay_us(1);
         duration_us++;
     }
 
-    if (handle) xSemaphoreGive(handle);
-
     if (duration_us <= 0 || duration_us >= timeout_us)
         return -1;
 
@@ -63,72 +238,252 @@ int get_ultrasonic_data(SemaphoreHandle_t handle)
     return distance_cm;
 }
 
-int get_dht11_data(SemaphoreHandle_t handle)
+// Latency and failure faults for one read. Called with the instance mutex
+// held, so a spike also delays every task contending for the sensor.
+static bool read_faulted(const sensor_instance_t *sensor)
+{
+    uint32_t us;
+    if (fault_hit(FAULT_LATENCY, sensor->id, &us)) {
+        esp_rom_delay_us(us);
+    }
+    if (fault_hit(FAULT_FAIL, sensor->id, &us)) {
+        esp_rom_delay_us(us);
+        return true;
+    }
+    return false;
+}
+
+// Take the instance mutex for a sample read, counting how often and how long
+// the caller had to wait for another task's read
+static void sensor_lock(sensor_instance_t *sensor)
+{
+    if (xSemaphoreTake(sensor->mutex, 0) == pdTRUE) {
+        sensor->lock_stats.takes++;
+        return;
+    }
+    int64_t t0 = esp_timer_get_time();
+    xSemaphoreTake(sensor->mutex, portMAX_DELAY);
+    uint32_t wait_us = (uint32_t)(esp_timer_get_time() - t0);
+    sensor_lock_stats_t *st = &sensor->lock_stats;
+    st->takes++;
+    st->contended++;
+    st->wait_sum_us += wait_us;
+    if (wait_us > st->wait_max_us) st->wait_max_us = wait_us;
+}
+
+int get_ultrasonic_data(sensor_instance_t *sensor)
+{
+    int32_t v[SENSOR_TRACE_VALUES] = {0};
+    uint32_t unused;
+    sensor_lock(sensor);
+    if (read_faulted(sensor)) {
+        xSemaphoreGive(sensor->mutex);
+        return -1;
+    }
+    bool stuck = fault_hit(FAULT_ECHO_STUCK, sensor->id, &unused);
+
+    // A replayed stuck echo costs what the live measurement would: the full pulse timeout
+    if (stuck && sensor_trace_mode() == SENSOR_TRACE_REPLAY) {
+        esp_rom_delay_us(ULTRASONIC_TIMEOUT_US);
+        xSemaphoreGive(sensor->mutex);
+        return -1;
+    }
+
+    int replay = sensor_trace_replay(sensor->id, v);
+    if (replay <= 0) {
+        xSemaphoreGive(sensor->mutex);
+        return replay == 0 ? (int)v[0] : -1;
+    }
+
+    int64_t t0 = esp_timer_get_time();
+    int distance_cm = ultrasonic_measure(sensor, stuck);
+    uint32_t latency_us = (uint32_t)(esp_timer_get_time() - t0);
+    xSemaphoreGive(sensor->mutex);
+
+    v[0] = distance_cm;
+    sensor_trace_record(sensor->id, latency_us, distance_cm > 0, v);
+    return distance_cm;
+}
+
+// One DHT read under the instance mutex, live or from the replayed trace
+static esp_err_t dht_sample(sensor_instance_t *sensor, int16_t *humidity, int16_t *temperature)
+{
+    int32_t v[SENSOR_TRACE_VALUES] = {0};
+    sensor_lock(sensor);
+    if (read_faulted(sensor)) {
+        xSemaphoreGive(sensor->mutex);
+        return ESP_ERR_TIMEOUT;
+    }
+
+    int replay = sensor_trace_replay(sensor->id, v);
+    if (replay <= 0) {
+        xSemaphoreGive(sensor->mutex);
+        *humidity = (int16_t)v[0];
+        *temperature = (int16_t)v[1];
+        return replay == 0 ? ESP_OK : ESP_FAIL;
+    }
+
+    int64_t t0 = esp_timer_get_time();
+    esp_err_t err = dht_read_data(sensor->dht.kind, sensor->dht.pin, humidity, temperature);
+    uint32_t latency_us = (uint32_t)(esp_timer_get_time() - t0);
+    xSemaphoreGive(sensor->mutex);
+
+    if (err == ESP_OK) {
+        v[0] = *humidity;
+        v[1] = *temperature;
+    }
+    sensor_trace_record(sensor->id, latency_us, err == ESP_OK, v);
+    return err;
+}
+
+// One MPU6050 motion read under the instance mutex, live or from the replayed
+// trace, before calibration (traces hold raw readings). calib, if given,
+// receives the calibration in force, copied under the same mutex.
+static esp_err_t mpu_sample_raw(sensor_instance_t *sensor, mpu6050_acceleration_t *accel, imu_calib_t *calib)
+{
+    int32_t v[SENSOR_TRACE_VALUES] = {0};
+    sensor_lock(sensor);
+    if (calib) *calib = sensor->mpu.calib;
+    if (read_faulted(sensor)) {
+        xSemaphoreGive(sensor->mutex);
+        return ESP_ERR_TIMEOUT;
+    }
+
+    int replay = sensor_trace_replay(sensor->id, v);
+    if (replay <= 0) {
+        xSemaphoreGive(sensor->mutex);
+        accel->x = v[0] / 1000.0f;
+        accel->y = v[1] / 1000.0f;
+        accel->z = v[2] / 1000.0f;
+        return replay == 0 ? ESP_OK : ESP_FAIL;
+    }
+
+    mpu6050_rotation_t rot = {0};
+    int64_t t0 = esp_timer_get_time();
+    esp_err_t err = mpu6050_get_motion(&sensor->mpu.dev, accel, &rot);
+    uint32_t latency_us = (uint32_t)(esp_timer_get_time() - t0);
+    xSemaphoreGive(sensor->mutex);
+
+    if (err == ESP_OK) {
+        v[0] = (int32_t)(accel->x * 1000.0f);
+        v[1] = (int32_t)(accel->y * 1000.0f);
+        v[2] = (int32_t)(accel->z * 1000.0f);
+    }
+    sensor_trace_record(sensor->id, latency_us, err == ESP_OK, v);
+    return err;
+}
+
+static esp_err_t mpu_sample(sensor_instance_t *sensor, mpu6050_acceleration_t *accel)
+{
+    imu_calib_t calib;
+    esp_err_t err = mpu_sample_raw(sensor, accel, &calib);
+    if (err == ESP_OK) calib_imu_apply(&calib, &accel->x, &accel->y, &accel->z);
+    return err;
+}
+
+// Readable unless the hardware is missing; replayed instances always are
+static bool sensor_available(const sensor_instance_t *sensor)
+{
+    return sensor->ready || sensor_trace_mode() == SENSOR_TRACE_REPLAY;
+}
+
+int get_dht11_data(sensor_instance_t *sensor)
 {   
-    xSemaphoreTake(handle, portMAX_DELAY);
     int16_t humidity, temperature;
-    esp_err_t err = dht_read_data(DHT_SENSOR_TYPE, DHT_DATA_PIN, &humidity, &temperature);
+    esp_err_t err = dht_sample(sensor, &humidity, &temperature);
     if (err == ESP_OK) {
         ESP_LOGI("DHT", "humidity=%d tenth%% temp=%d tenthC", humidity, temperature);
     } else {
         ESP_LOGE("DHT", "dht_read_data failed: %s", esp_err_to_name(err));
-        xSemaphoreGive(handle);
         return -1;
     }
-    xSemaphoreGive(handle);
     return humidity;
 }
 
-int initialize_mpu(SemaphoreHandle_t handle)
+int sensors_imu_sample_raw(sensor_instance_t *sensor, float out[3])
 {
-    if (s_mpu_inited) return 0;
-    if (handle) xSemaphoreTake(handle, portMAX_DELAY);
+    if (sensor->type != SENSOR_MPU6050 || !sensor_available(sensor)) return -1;
+    mpu6050_acceleration_t accel = {0};
+    if (mpu_sample_raw(sensor, &accel, NULL) != ESP_OK) return -1;
+    out[0] = accel.x;
+    out[1] = accel.y;
+    out[2] = accel.z;
+    return 0;
+}
+
+void sensors_get_lock_stats(int index, sensor_lock_stats_t *stats)
+{
+    sensor_instance_t *sensor = sensors_get_instance(index);
+    if (!sensor) return;
+    xSemaphoreTake(sensor->mutex, portMAX_DELAY);
+    *stats = sensor->lock_stats;
+    xSemaphoreGive(sensor->mutex);
+}
+
+void sensors_reset_lock_stats(void)
+{
+    for (int i = 0; i < s_instance_count; i++) {
+        xSemaphoreTake(s_instances[i].mutex, portMAX_DELAY);
+        memset(&s_instances[i].lock_stats, 0, sizeof(s_instances[i].lock_stats));
+        xSemaphoreGive(s_instances[i].mutex);
+    }
+}
+
+void sensors_set_imu_calib(int index, const imu_calib_t *calib)
+{
+    sensor_instance_t *sensor = sensors_get_instance(index);
+    if (!sensor || sensor->type != SENSOR_MPU6050) return;
+    // Readers copy it under the mutex, so none sees half an update
+    xSemaphoreTake(sensor->mutex, portMAX_DELAY);
+    sensor->mpu.calib = *calib;
+    xSemaphoreGive(sensor->mutex);
+}
+
+int initialize_mpu(sensor_instance_t *sensor)
+{
+    if (sensor->ready) return 0;
+    xSemaphoreTake(sensor->mutex, portMAX_DELAY);
 
     esp_err_t err;
-    err = mpu6050_init_desc(&s_mpu_dev, MPU6050_I2C_ADDRESS_LOW, 0, MPU_SDA_PIN, MPU_SCL_PIN);
+    err = mpu6050_init_desc(&sensor->mpu.dev, sensor->mpu.address, sensor->mpu.port,
+                            sensor->mpu.sda, sensor->mpu.scl);
     if (err != ESP_OK) {
-        ESP_LOGE(TAG_MPU, "init_desc failed: %s", esp_err_to_name(err));
-        if (handle) xSemaphoreGive(handle);
+        ESP_LOGE(TAG_MPU, "%s: init_desc failed: %s", sensor->id, esp_err_to_name(err));
+        xSemaphoreGive(sensor->mutex);
         return -1;
     }
 
-    err = mpu6050_init(&s_mpu_dev);
+    err = mpu6050_init(&sensor->mpu.dev);
     if (err != ESP_OK) {
-        ESP_LOGE(TAG_MPU, "mpu6050_init failed: %s", esp_err_to_name(err));
-        if (handle) xSemaphoreGive(handle);
+        ESP_LOGE(TAG_MPU, "%s: mpu6050_init failed: %s", sensor->id, esp_err_to_name(err));
+        mpu6050_free_desc(&sensor->mpu.dev);
+        xSemaphoreGive(sensor->mutex);
         return -1;
     }
 
-    s_mpu_inited = true;
-    if (handle) xSemaphoreGive(handle);
-    ESP_LOGI(TAG_MPU, "MPU6050 initialized");
+    sensor->ready = true;
+    xSemaphoreGive(sensor->mutex);
+    ESP_LOGI(TAG_MPU, "%s initialized at 0x%02x", sensor->id, sensor->mpu.address);
     return 0;
 }
 
-int get_mpu_acceleration_x()
+int get_mpu_acceleration_x(sensor_instance_t *sensor)
 {
-    if (!s_mpu_inited) return 0;
+    if (!sensor_available(sensor)) return 0;
     mpu6050_acceleration_t accel = {0};
-    mpu6050_rotation_t rot = {0};
-    float temp = 0;
-    esp_err_t err;
 
-    err = mpu6050_get_temperature(&s_mpu_dev, &temp);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG_MPU, "temp read failed: %s", esp_err_to_name(err));
-        return 0;
-    }
-    err = mpu6050_get_motion(&s_mpu_dev, &accel, &rot);
+    esp_err_t err = mpu_sample(sensor, &accel);
     if (err != ESP_OK) {
-        ESP_LOGE(TAG_MPU, "motion read failed: %s", esp_err_to_name(err));
+        ESP_LOGE(TAG_MPU, "%s: read failed: %s", sensor->id, esp_err_to_name(err));
         return 0;
     }
-    ESP_LOGI(TAG_MPU, "Accel(g): x=%.3f y=%.3f z=%.3f, Gyro(dps): x=%.1f y=%.1f z=%.1f, T=%.1fC", accel.x, accel.y, accel.z, rot.x, rot.y, rot.z, temp);
+    ESP_LOGI(TAG_MPU, "Accel(g): x=%.3f y=%.3f z=%.3f", accel.x, accel.y, accel.z);
     return (int)(accel.x * 1000.0f);
 }
 
 // Averaged sensor reading functions
-int read_dht11_averaged(SemaphoreHandle_t handle, int samples, sensor_readings_t *out)
+int read_dht11_averaged(sensor_instance_t *sensor, int samples, sensor_readings_t *out,
+                        sensor_stop_fn_t stop, sensor_sample_fn_t on_sample, void *ctx)
 {
     if (!out || samples <= 0) return -1;
     
@@ -136,17 +491,20 @@ int read_dht11_averaged(SemaphoreHandle_t handle, int samples, sensor_readings_t
     int valid_count = 0;
     
     for (int i = 0; i < samples; i++) {
-        xSemaphoreTake(handle, portMAX_DELAY);
+        if (stop && stop(ctx)) break;
         int16_t humidity, temperature;
-        esp_err_t err = dht_read_data(DHT_SENSOR_TYPE, DHT_DATA_PIN, &humidity, &temperature);
-        xSemaphoreGive(handle);
+        esp_err_t err = dht_sample(sensor, &humidity, &temperature);
         
         if (err == ESP_OK) {
             sum_hum += humidity / 10.0f;  // Convert to actual percentage
             sum_temp += temperature / 10.0f;  // Convert to actual Celsius
             valid_count++;
+            if (on_sample) {
+                sensor_readings_t sample = { .dht_humidity = humidity / 10.0f, .dht_temperature = temperature / 10.0f };
+                on_sample(ctx, &sample, (1u << CHANNEL_HUMIDITY) | (1u << CHANNEL_TEMPERATURE), esp_timer_get_time());
+            }
         }
-        if (i < samples - 1) vTaskDelay(pdMS_TO_TICKS(100)); // Small delay between reads
+        if (i < samples - 1) vTaskDelay(pdMS_TO_TICKS(sensor_min_gap_ms(SENSOR_DHT11)));
     }
     
     if (valid_count == 0) return -1;
@@ -156,7 +514,8 @@ int read_dht11_averaged(SemaphoreHandle_t handle, int samples, sensor_readings_t
     return 0;
 }
 
-int read_ultrasonic_averaged(SemaphoreHandle_t handle, int samples, sensor_readings_t *out)
+int read_ultrasonic_averaged(sensor_instance_t *sensor, int samples, sensor_readings_t *out,
+                             sensor_stop_fn_t stop, sensor_sample_fn_t on_sample, void *ctx)
 {
     if (!out || samples <= 0) return -1;
     
@@ -164,12 +523,17 @@ int read_ultrasonic_averaged(SemaphoreHandle_t handle, int samples, sensor_readi
     int valid_count = 0;
     
     for (int i = 0; i < samples; i++) {
-        int dist = get_ultrasonic_data(handle);
+        if (stop && stop(ctx)) break;
+        int dist = get_ultrasonic_data(sensor);
         if (dist > 0) {
             sum_dist += dist;
             valid_count++;
+            if (on_sample) {
+                sensor_readings_t sample = { .ultrasonic_distance = dist };
+                on_sample(ctx, &sample, 1u << CHANNEL_DISTANCE, esp_timer_get_time());
+            }
         }
-        if (i < samples - 1) vTaskDelay(pdMS_TO_TICKS(50)); // Small delay between reads
+        if (i < samples - 1) vTaskDelay(pdMS_TO_TICKS(sensor_min_gap_ms(SENSOR_ULTRASONIC)));
     }
     
     if (valid_count == 0) return -1;
@@ -178,28 +542,31 @@ int read_ultrasonic_averaged(SemaphoreHandle_t handle, int samples, sensor_readi
     return 0;
 }
 
-int read_mpu6050_averaged(SemaphoreHandle_t handle, int samples, sensor_readings_t *out)
+int read_mpu6050_averaged(sensor_instance_t *sensor, int samples, sensor_readings_t *out,
+                          sensor_stop_fn_t stop, sensor_sample_fn_t on_sample, void *ctx)
 {
-    if (!out || samples <= 0 || !s_mpu_inited) return -1;
+    if (!out || samples <= 0 || !sensor_available(sensor)) return -1;
     
     float sum_x = 0, sum_y = 0, sum_z = 0;
     int valid_count = 0;
     
     for (int i = 0; i < samples; i++) {
+        if (stop && stop(ctx)) break;
         mpu6050_acceleration_t accel = {0};
-        mpu6050_rotation_t rot = {0};
-        
-        if (handle) xSemaphoreTake(handle, portMAX_DELAY);
-        esp_err_t err = mpu6050_get_motion(&s_mpu_dev, &accel, &rot);
-        if (handle) xSemaphoreGive(handle);
+        esp_err_t err = mpu_sample(sensor, &accel);
         
         if (err == ESP_OK) {
             sum_x += accel.x;
             sum_y += accel.y;
             sum_z += accel.z;
             valid_count++;
+            if (on_sample) {
+                sensor_readings_t sample = { .mpu_accel_x = accel.x, .mpu_accel_y = accel.y, .mpu_accel_z = accel.z };
+                on_sample(ctx, &sample, (1u << CHANNEL_ACCEL_X) | (1u << CHANNEL_ACCEL_Y) | (1u << CHANNEL_ACCEL_Z),
+                          esp_timer_get_time());
+            }
         }
-        if (i < samples - 1) vTaskDelay(pdMS_TO_TICKS(10)); // Small delay between reads
+        if (i < samples - 1) vTaskDelay(pdMS_TO_TICKS(sensor_min_gap_ms(SENSOR_MPU6050)));
     }
     
     if (valid_count == 0) return -1;
@@ -208,4 +575,16 @@ int read_mpu6050_averaged(SemaphoreHandle_t handle, int samples, sensor_readings
     out->mpu_accel_y = sum_y / valid_count;
     out->mpu_accel_z = sum_z / valid_count;
     return 0;
-}
\ No newline at end of file
+}
+
+int read_sensor_averaged(sensor_instance_t *sensor, int samples, sensor_readings_t *out,
+                         sensor_stop_fn_t stop, sensor_sample_fn_t on_sample, void *ctx)
+{
+    if (!sensor) return -1;
+    switch (sensor->type) {
+        case SENSOR_DHT11:      return read_dht11_averaged(sensor, samples, out, stop, on_sample, ctx);
+        case SENSOR_ULTRASONIC: return read_ultrasonic_averaged(sensor, samples, out, stop, on_sample, ctx);
+        case SENSOR_MPU6050:    return read_mpu6050_averaged(sensor, samples, out, stop, on_sample, ctx);
+        default:                return -1;
+    }
+}
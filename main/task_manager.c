@@ -1,226 +1,2112 @@
 #include "task_manager.h"
 #include "sensors.h"
+#include "sensor_trace.h"
+#include "adaptive.h"
+#include "history.h"
+#include "task_stats.h"
+#include "mqtt_pub.h"
+#include "telemetry.h"
+#include "line_encoder.h"
+#include "reflex.h"
+#include "detect.h"
+#include "calib.h"
+#include "wcet.h"
 #include "board.h"
 #include "esp_log.h"
-#include "driver/uart.h"
+#include "transport.h"
 #include "driver/gpio.h"
+#include "esp_timer.h"
 #include "i2cdev.h"
 #include "cJSON.h"
 #include <string.h>
 #include <stdarg.h>
+#include <math.h>
 
 static const char *TAG = "TaskManager";
 
-// Global mutexes for sensors
-static SemaphoreHandle_t dht_mutex = NULL;
-static SemaphoreHandle_t ultrasonic_mutex = NULL;
-static SemaphoreHandle_t mpu_mutex = NULL;
-static SemaphoreHandle_t uart_mutex = NULL;
+// Inputs carried between cycles for prev() and dt, plus evaluation cost
+typedef struct {
+    float vars[EXPR_VAR_COUNT];
+    float prev[EXPR_VAR_COUNT];
+    bool primed;
+    TickType_t tick;
+    uint32_t evals;
+    uint64_t ns_sum[EXPR_MAX_DERIVED];
+    uint32_t ns_max[EXPR_MAX_DERIVED];
+} derived_state_t;
+
+// Logical Execution Time output: the cycle's record is held back and handed
+// to the link by a timer exactly at the deadline (the end of the period)
+typedef struct {
+    bool enabled;
+    esp_timer_handle_t timer;
+    portMUX_TYPE lock;
+    char line[TELEMETRY_MAX_LINE];
+    size_t len;                 // Pending record, 0 = none
+    int64_t release_us;         // Release of the job that produced it
+    uint32_t late;              // Jobs that finished after their deadline
+} let_state_t;
+
+// Filter state persisted across reboots, so a task starts from where its
+// filters had converged instead of re-learning from zero
+#define WARM_STATE_VERSION 1
+
+typedef struct {
+    uint8_t channel;
+    uint8_t method;
+    uint16_t n;
+    float mean;
+    float var;
+    float ewma;
+} warm_detector_t;
+
+typedef struct {
+    uint16_t version;
+    uint8_t adaptive_channel;   // CHANNEL_NONE when the task had no adaptive rate
+    uint8_t detector_count;
+    float level;
+    float trend;
+    int32_t period_ms;
+    warm_detector_t detectors[DETECT_MAX_PER_TASK];
+} warm_state_t;
+
+// Per-task runtime state (config persists for the task lifetime)
+typedef struct {
+    task_config_t *config;
+    TaskHandle_t handle;
+    uint32_t cycle_start_us;    // Runtime counter at start of the current cycle
+    int64_t cycle_wall_us;      // esp_timer time at start of the current cycle
+    uint32_t debt_us;           // Budget overrun carried into later periods
+    uint32_t overrun_count;
+    uint32_t throttled_count;
+    int period_ms;              // Effective period (differs from config when adaptive)
+    adaptive_state_t adaptive;
+    TickType_t last_sample_tick;    // Tick of the last adaptive update, 0 = none yet
+    TickType_t release_tick;    // Tick the current cycle was due, 0 = unknown
+    int64_t release_us;         // esp_timer time of the current cycle's release, 0 = unanchored
+    task_stats_t stats;
+    line_encoder_t encoder;     // Output record of the task's fields
+    derived_state_t derived;
+    let_state_t let;
+    detect_state_t detect[DETECT_MAX_PER_TASK];
+    uint32_t detect_runs;
+    uint64_t detect_ns_sum;
+    uint32_t detect_ns_max;
+    int64_t boost_until_us;     // Faster sampling after a detector event, until then
+    int boost_period_ms;
+    wcet_cost_t wcet_cpu;       // Cost of one cycle, measured or estimated
+    wcet_cost_t wcet_wall;
+    bool wcet_measured;
+    volatile bool in_cycle;     // Between the park check and the wait for the next period
+    bool spread;                // Samples spread over the period instead of one burst
+    task_subscription_t sub;    // Set by SUB / UNSUB under sub_lock
+    portMUX_TYPE sub_lock;
+    uint32_t sub_version;       // Bumped on every change of sub
+    uint32_t encoder_version;   // sub_version the encoder was built for
+    int64_t last_emit_us;       // Release of the last published record, for the rate limit
+} task_runtime_t;
 
 // Track created tasks
-static TaskHandle_t task_handles[MAX_TASKS] = {0};
+static task_runtime_t task_runtimes[MAX_TASKS] = {0};
 static int active_task_count = 0;
 
-// Task function that reads sensors and logs via UART
-static void dynamic_sensor_task(void *pvParameters)
+// Operating modes: every mode's tasks exist, only the active mode's are released
+static char mode_names[MAX_MODES][MAX_MODE_NAME_LEN] = {{0}};
+static int mode_count = 0;
+static volatile int active_mode = 0;
+static volatile int pending_mode = -1;
+static int mode_report = -1;                       // Deferred switch not yet printed
+static int64_t mode_report_us = 0;
+static portMUX_TYPE mode_lock = portMUX_INITIALIZER_UNLOCKED;
+static int64_t mode_start_us = 0;
+static volatile TickType_t release_origin = 0;    // Tick offset_ms counts from
+static esp_timer_handle_t mode_switch_timer = NULL;
+// Held while the task configs are freed, and by the state snapshot that reads them
+static SemaphoreHandle_t configs_mutex = NULL;
+
+// Admission control of new tasks against their WCET
+typedef enum {
+    ADMISSION_OFF,
+    ADMISSION_WARN,
+    ADMISSION_REJECT,
+} admission_t;
+
+#define ADMISSION_MAX_UTILIZATION 0.9f     // Per core, leaves room for the link and commands
+#define SAMPLES_PER_READ 10
+#define PARK_TIMEOUT_MS 5000
+
+static volatile bool calibrating = false;  // Tasks park while WCET is measured
+static volatile bool stopping = false;     // Tasks park to be deleted (config switch)
+
+// Subscription given to the tasks of later configs by SUB * / UNSUB *
+#define SUB_FIELDS_LEN 64
+
+static struct {
+    bool active;
+    float max_hz;
+    telemetry_encoding_t encoding;
+    char fields[SUB_FIELDS_LEN];    // Empty = each task's configured fields
+} default_sub = {
+#ifdef CONFIG_TELEMETRY_SUBSCRIBE_AT_BOOT
+    .active = true,
+#endif
+    .encoding = TELEMETRY_TEXT,
+};
+
+static void mode_switch_timer_cb(void *arg);
+static void unsubscribe_all(void);
+
+// CPU time consumed by the calling task, in run time stats ticks (us with the esp_timer source).
+// The kernel only folds the running slice into the counter on a context switch, so yield first.
+static uint32_t task_cpu_time_us(void)
 {
-    task_config_t *config = (task_config_t *)pvParameters;
-    sensor_readings_t readings = {0};
+    taskYIELD();
+    return (uint32_t)ulTaskGetRunTimeCounter(NULL);
+}
+
+static uint32_t cycle_cpu_used_us(const task_runtime_t *rt)
+{
+    return task_cpu_time_us() - rt->cycle_start_us;
+}
+
+// Cheap lower bound for the stop predicate, without forcing a switch: the
+// counter as of the task's last switch-in. The sensor loops sleep between
+// samples, so it lags by at most the slice since the last wake-up.
+static uint32_t cycle_cpu_used_bound_us(const task_runtime_t *rt)
+{
+    // CPU time cannot exceed the wall time since the cycle started
+    uint32_t wall = (uint32_t)(esp_timer_get_time() - rt->cycle_wall_us);
+    if (wall < rt->config->budget_us) return wall;
+    return (uint32_t)ulTaskGetRunTimeCounter(NULL) - rt->cycle_start_us;
+}
+
+// Status line of a sensor task (overrun, adaptation, event, read error),
+// queued for its share of the link. Rare and needed to notice trouble, so it
+// goes out whether or not the host subscribed to the task's records.
+static void task_log(task_runtime_t *rt, const char *format, ...)
+{
+    char buffer[TELEMETRY_MAX_LINE];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
     
-    char log_buffer[256];
+    if (len < 0) return;
+    telemetry_submit(rt - task_runtimes, buffer, len < (int)sizeof(buffer) ? (size_t)len : sizeof(buffer) - 1);
+}
+
+// Sensor stop predicate: abort sampling once the cycle has used up its budget,
+// or when the tasks are being stopped for a config switch
+static bool sampling_stopped(void *ctx)
+{
+    task_runtime_t *rt = (task_runtime_t *)ctx;
+    if (stopping) return true;
+    return rt->config->budget_us && cycle_cpu_used_bound_us(rt) >= rt->config->budget_us;
+}
+
+// The task has to park: its mode is switched out, WCET is being measured or
+// the tasks are being stopped
+static bool cycle_cancelled(const task_runtime_t *rt)
+{
+    return rt->config->mode != active_mode || calibrating || stopping;
+}
+
+// Raw sample observer: reflex rules react here, before the cycle is averaged
+static void check_rules(void *ctx, const sensor_readings_t *sample, uint8_t mask, int64_t sample_us)
+{
+    task_runtime_t *rt = (task_runtime_t *)ctx;
+    reflex_on_sample(rt->config->rules, rt->config->rule_count, rt - task_runtimes, sample, mask, sample_us);
+}
+
+static void release_rules(task_runtime_t *rt)
+{
+    for (int i = 0; i < rt->config->rule_count; i++) {
+        reflex_rule_release(&rt->config->rules[i], rt - task_runtimes);
+    }
+}
+
+// Move the effective period according to the signal dynamics and report periodically
+static void adapt_period(task_runtime_t *rt, const sensor_readings_t *readings, TickType_t now)
+{
+    const task_config_t *config = rt->config;
+    // A filter restored from NVS has no earlier sample in this run: count
+    // its first interval as one period, not the uptime
+    int elapsed_ms = rt->last_sample_tick ? (int)pdTICKS_TO_MS(now - rt->last_sample_tick) : rt->period_ms;
+    rt->last_sample_tick = now;
     
-    while (1) {
-        TickType_t start = xTaskGetTickCount();
-        
-        // Clear readings
-        memset(&readings, 0, sizeof(readings));
-        
-        // Read all configured sensors with averaging (10 samples)
-        int success = 1;
-        for (int i = 0; i < config->sensor_count; i++) {
-            switch (config->sensors[i]) {
-                case SENSOR_DHT11:
-                    if (read_dht11_averaged(dht_mutex, 10, &readings) != 0) {
-                        success = 0;
-                    }
-                    break;
-                case SENSOR_ULTRASONIC:
-                    if (read_ultrasonic_averaged(ultrasonic_mutex, 10, &readings) != 0) {
-                        success = 0;
-                    }
-                    break;
-                case SENSOR_MPU6050:
-                    if (read_mpu6050_averaged(mpu_mutex, 10, &readings) != 0) {
-                        success = 0;
-                    }
-                    break;
-                default:
-                    break;
+    float value = sensor_readings_get(readings, config->adaptive.channel);
+    rt->period_ms = adaptive_update(&config->adaptive, &rt->adaptive, value, elapsed_ms);
+    
+    if (rt->adaptive.elapsed_ms >= ADAPTIVE_REPORT_MS) {
+        task_log(rt, "[%s] ADAPT period=%dms rate=%.2fHz rms_err=%.3f\n",
+                 config->name, rt->period_ms,
+                 adaptive_sample_rate_hz(&rt->adaptive),
+                 adaptive_rms_error(&rt->adaptive));
+        adaptive_reset_stats(&rt->adaptive);
+    }
+}
+
+// Run the task's detectors on this cycle's readings; an event is reported and
+// can shorten the period for a while so the anomaly is seen in detail
+static void run_detectors(task_runtime_t *rt, const sensor_readings_t *readings)
+{
+    const task_config_t *config = rt->config;
+    int fired[DETECT_MAX_PER_TASK];
+    
+    uint32_t t0 = expr_clock();
+    for (int i = 0; i < config->detector_count; i++) {
+        const detect_config_t *dc = &config->detectors[i];
+        fired[i] = detect_update(dc, &rt->detect[i], sensor_readings_get(readings, dc->channel));
+    }
+    uint32_t ns = expr_clock_to_ns(expr_clock() - t0);
+    rt->detect_runs++;
+    rt->detect_ns_sum += ns;
+    if (ns > rt->detect_ns_max) rt->detect_ns_max = ns;
+    
+    for (int i = 0; i < config->detector_count; i++) {
+        if (!fired[i]) continue;
+        const detect_config_t *dc = &config->detectors[i];
+        const detect_state_t *st = &rt->detect[i];
+        task_log(rt, "[%s] EVENT %s %s%c value=%.3f mean=%.3f sd=%.3f score=%.1f\n",
+                 config->name, sensor_channel_name(dc->channel), detect_method_name(dc->method),
+                 fired[i] > 0 ? '+' : '-', sensor_readings_get(readings, dc->channel),
+                 st->mean, fmaxf(detect_sd(st), dc->min_sd), st->score);
+        if (dc->boost_period_ms > 0) {
+            int64_t until = esp_timer_get_time() + (int64_t)dc->boost_window_ms * 1000;
+            if (!rt->boost_until_us || esp_timer_get_time() >= rt->boost_until_us ||
+                dc->boost_period_ms < rt->boost_period_ms) {
+                rt->boost_period_ms = dc->boost_period_ms;
             }
+            if (until > rt->boost_until_us) rt->boost_until_us = until;
         }
-        
-        // Log results via UART
-        if (success) {
-            snprintf(log_buffer, sizeof(log_buffer),
-                     "[%s] H:%.1f%% T:%.1fC Dist:%dcm AccX:%.3fg AccY:%.3fg AccZ:%.3fg\n",
-                     config->name,
-                     readings.dht_humidity,
-                     readings.dht_temperature,
-                     readings.ultrasonic_distance,
-                     readings.mpu_accel_x,
-                     readings.mpu_accel_y,
-                     readings.mpu_accel_z);
-            uart_log(config->name, "%s", log_buffer);
-        } else {
-            uart_log(config->name, "Read error\n");
-        }
-        
-        vTaskDelayUntil(&start, pdMS_TO_TICKS(config->period_ms));
     }
 }
 
-void task_manager_init(void)
+// Compute the task's derived channels from this cycle's readings
+static void evaluate_derived(task_runtime_t *rt, const sensor_readings_t *readings, TickType_t now)
 {
-    // Create sensor mutexes
-    dht_mutex = xSemaphoreCreateMutex();
-    ultrasonic_mutex = xSemaphoreCreateMutex();
-    mpu_mutex = xSemaphoreCreateMutex();
-    uart_mutex = xSemaphoreCreateMutex();
+    const task_config_t *config = rt->config;
+    derived_state_t *d = &rt->derived;
     
-    // Initialize sensors
-    gpio_set_pull_mode(DHT_DATA_PIN, GPIO_PULLUP_ONLY);
-    vTaskDelay(pdMS_TO_TICKS(2000)); // DHT stabilization
+    for (int ch = 0; ch < CHANNEL_COUNT; ch++) {
+        d->vars[ch] = sensor_readings_get(readings, (sensor_channel_t)ch);
+    }
+    // First cycle: prev() is the current value and dt the nominal period
+    float dt = d->primed ? (float)pdTICKS_TO_MS(now - d->tick) / 1000.0f : (float)rt->period_ms / 1000.0f;
+    const float *prev = d->primed ? d->prev : d->vars;
     
-    // Initialize I2C for MPU6050
-    ESP_ERROR_CHECK(i2cdev_init());
-    initialize_mpu(mpu_mutex);
+    for (int i = 0; i < config->derived_count; i++) {
+        uint32_t t0 = expr_clock();
+        d->vars[CHANNEL_COUNT + i] = expr_eval(&config->derived[i].program, d->vars, prev, dt);
+        uint32_t ns = expr_clock_to_ns(expr_clock() - t0);
+        d->ns_sum[i] += ns;
+        if (ns > d->ns_max[i]) d->ns_max[i] = ns;
+    }
+    memcpy(d->prev, d->vars, sizeof(d->prev));
+    d->evals++;
+    d->tick = now;
+    d->primed = true;
+}
+
+// Period in force: the configured (or adaptive) one, shortened while a detector boost lasts
+static int effective_period_ms(const task_runtime_t *rt)
+{
+    if (rt->boost_until_us && esp_timer_get_time() < rt->boost_until_us && rt->boost_period_ms < rt->period_ms) {
+        return rt->boost_period_ms;
+    }
+    return rt->period_ms;
+}
+
+// Sleep until the next period, remembering when it is due for response times
+static void wait_next_period(task_runtime_t *rt, TickType_t *start)
+{
+    TickType_t period = pdMS_TO_TICKS(effective_period_ms(rt));
+    rt->in_cycle = false;
+    rt->release_tick = *start + period;
+    // Same grid in microseconds: whole ticks, as vTaskDelayUntil counts them
+    rt->release_us += (int64_t)pdTICKS_TO_MS(period) * 1000;
+    vTaskDelayUntil(start, period);
+}
+
+// Hand the pending LET record to the link; called by the deadline timer, or
+// by the task when a record is late
+static void let_publish(task_runtime_t *rt)
+{
+    char line[TELEMETRY_MAX_LINE];
+    size_t len;
+    portENTER_CRITICAL(&rt->let.lock);
+    len = rt->let.len;
+    if (len) {
+        memcpy(line, rt->let.line, len);
+        rt->let.len = 0;
+        task_stats_add_output(&rt->stats, (uint32_t)(esp_timer_get_time() - rt->let.release_us));
+    }
+    portEXIT_CRITICAL(&rt->let.lock);
+    if (len) telemetry_submit(rt - task_runtimes, line, len);
+}
+
+static void let_deadline_cb(void *arg)
+{
+    let_publish((task_runtime_t *)arg);
+}
+
+// Publish the cycle's record: now, or at the deadline in LET mode so the
+// latency from release to output is the period whatever the cycle took.
+// Spread cycles always publish at the deadline, the end of their sampling window.
+static void publish_record(task_runtime_t *rt, const char *line, size_t len)
+{
+    if (!(rt->let.enabled || rt->spread) || !rt->let.timer) {
+        telemetry_submit(rt - task_runtimes, line, len);
+        task_stats_add_output(&rt->stats, (uint32_t)(esp_timer_get_time() - rt->release_us));
+        return;
+    }
     
-    ESP_LOGI(TAG, "Task manager initialized");
+    // A previous record whose timer has not run yet goes out first, in order
+    esp_timer_stop(rt->let.timer);
+    let_publish(rt);
+    
+    portENTER_CRITICAL(&rt->let.lock);
+    memcpy(rt->let.line, line, len);
+    rt->let.len = len;
+    rt->let.release_us = rt->release_us;
+    portEXIT_CRITICAL(&rt->let.lock);
+    
+    int64_t deadline_us = rt->release_us + (int64_t)pdTICKS_TO_MS(pdMS_TO_TICKS(effective_period_ms(rt))) * 1000;
+    int64_t wait_us = deadline_us - esp_timer_get_time();
+    if (wait_us <= 0 || esp_timer_start_once(rt->let.timer, (uint64_t)wait_us) != ESP_OK) {
+        rt->let.late++;
+        let_publish(rt);
+    }
 }
 
-static sensor_type_t parse_sensor_type(const char *sensor_str)
+// Record layout of the current subscription. Only the task itself calls
+// this, so the encoder never changes under an encode.
+static void build_encoder(task_runtime_t *rt, const task_subscription_t *sub)
 {
-    if (strcmp(sensor_str, "dht11") == 0) return SENSOR_DHT11;
-    if (strcmp(sensor_str, "ultrasonic") == 0) return SENSOR_ULTRASONIC;
-    if (strcmp(sensor_str, "mpu6050") == 0) return SENSOR_MPU6050;
-    return SENSOR_NONE;
+    const task_config_t *config = rt->config;
+    line_encoder_build(&rt->encoder, config->name, sub->field_mask);
+    if (sub->encoding == TELEMETRY_COMPACT) {
+        line_encoder_set_compact(&rt->encoder, rt - task_runtimes);
+    }
+    for (int i = 0; i < config->derived_count; i++) {
+        if (sub->derived_mask & (1u << i)) {
+            line_encoder_add_value(&rt->encoder, i, config->derived[i].name, config->derived[i].decimals);
+        }
+    }
 }
 
-int task_manager_parse_and_create(const char *json_config)
+// Whether the host wants this cycle's record: subscribed, and the rate limit
+// has passed since the last one. Releases fall on ticks, so half a period of
+// slack keeps e.g. 5 Hz on a 10 Hz task at every other cycle, not every third.
+static bool record_due(task_runtime_t *rt, int64_t release_us)
 {
-    if (!json_config) return -1;
+    task_subscription_t sub;
+    uint32_t version;
+    portENTER_CRITICAL(&rt->sub_lock);
+    sub = rt->sub;
+    version = rt->sub_version;
+    portEXIT_CRITICAL(&rt->sub_lock);
     
-    cJSON *root = cJSON_Parse(json_config);
-    if (!root) {
-        ESP_LOGE(TAG, "JSON parse error");
-        return -1;
+    if (!sub.active) return false;
+    if (version != rt->encoder_version) {
+        build_encoder(rt, &sub);
+        rt->encoder_version = version;
+        rt->last_emit_us = 0;
+    }
+    if (sub.max_hz > 0.0f && rt->last_emit_us) {
+        int64_t interval_us = (int64_t)(1000000.0f / sub.max_hz) - (int64_t)effective_period_ms(rt) * 500;
+        if (release_us - rt->last_emit_us < interval_us) return false;
+    }
+    rt->last_emit_us = release_us;
+    return true;
+}
+
+// Read all of a task's sensors, averaged; returns 1 if every read succeeded
+static int read_task_sensors(task_runtime_t *rt, sensor_readings_t *readings,
+                             sensor_stop_fn_t stop, sensor_sample_fn_t on_sample)
+{
+    const task_config_t *config = rt->config;
+    int success = 1;
+    for (int i = 0; i < config->sensor_count; i++) {
+        if (stop && stop(rt)) {
+            success = 0;
+            break;
+        }
+        sensor_instance_t *sensor = sensors_get_instance(config->sensor_instances[i]);
+        if (read_sensor_averaged(sensor, SAMPLES_PER_READ, readings, stop, on_sample, rt) != 0) {
+            success = 0;
+        }
+    }
+    return success;
+}
+
+// Samples per period in spread mode: up to SAMPLES_PER_READ, as many as the
+// slowest sensor's minimum spacing and the tick allow
+static int spread_samples(const task_config_t *config, int period_ms)
+{
+    int gap_ms = 0;
+    for (int i = 0; i < config->sensor_count; i++) {
+        int gap = sensor_min_gap_ms(config->sensors[i]);
+        if (gap > gap_ms) gap_ms = gap;
     }
+    int n = SAMPLES_PER_READ;
+    if (gap_ms > 0 && period_ms / gap_ms < n) n = period_ms / gap_ms;
+    if ((int)pdMS_TO_TICKS(period_ms) < n) n = (int)pdMS_TO_TICKS(period_ms);
+    return n < 1 ? 1 : n;
+}
+
+// Spread mode: one sample of every sensor per slot, the slots evenly over the
+// period from start, so reads of different tasks interleave instead of
+// colliding in bursts. Returns 1 if every sensor got at least one sample, -1
+// if the cycle was cancelled between slots (the partial sums are not a record).
+static int read_task_sensors_spread(task_runtime_t *rt, sensor_readings_t *readings, sensor_stop_fn_t stop,
+                                    sensor_sample_fn_t on_sample, TickType_t start)
+{
+    const task_config_t *config = rt->config;
+    int period_ms = effective_period_ms(rt);
+    int samples = spread_samples(config, period_ms);
+    TickType_t slot = pdMS_TO_TICKS(period_ms) / samples;
+    TickType_t wake = start;
     
-    cJSON *tasks_array = cJSON_GetObjectItem(root, "tasks");
-    if (!cJSON_IsArray(tasks_array)) {
-        ESP_LOGE(TAG, "Invalid tasks array");
-        cJSON_Delete(root);
-        return -1;
+    float sum[CHANNEL_COUNT] = {0};
+    int count[MAX_SENSORS_PER_TASK] = {0};
+    for (int k = 0; k < samples; k++) {
+        if (k > 0) {
+            // A mode switch, WCET calibration or config switch ends the cycle,
+            // whether it comes before the slot or while waiting for it
+            if (cycle_cancelled(rt)) return -1;
+            vTaskDelayUntil(&wake, slot);
+            if (cycle_cancelled(rt)) return -1;
+        }
+        for (int i = 0; i < config->sensor_count; i++) {
+            if (stop && stop(rt)) break;
+            sensor_readings_t one = {0};
+            sensor_instance_t *sensor = sensors_get_instance(config->sensor_instances[i]);
+            if (read_sensor_averaged(sensor, 1, &one, stop, on_sample, rt) != 0) continue;
+            uint8_t mask = sensor_type_channels(config->sensors[i]);
+            for (int c = 0; c < CHANNEL_COUNT; c++) {
+                if (mask & (1u << c)) sum[c] += sensor_readings_get(&one, (sensor_channel_t)c);
+            }
+            count[i]++;
+        }
     }
     
-    int task_count = cJSON_GetArraySize(tasks_array);
-    if (task_count > MAX_TASKS) {
-        ESP_LOGW(TAG, "Task count %d exceeds max %d, truncating", task_count, MAX_TASKS);
-        task_count = MAX_TASKS;
+    int success = 1;
+    for (int i = 0; i < config->sensor_count; i++) {
+        if (count[i] == 0) {
+            success = 0;
+            continue;
+        }
+        uint8_t mask = sensor_type_channels(config->sensors[i]);
+        for (int c = 0; c < CHANNEL_COUNT; c++) {
+            if (mask & (1u << c)) sensor_readings_set(readings, (sensor_channel_t)c, sum[c] / (float)count[i]);
+        }
     }
+    return success;
+}
+
+// Task function that reads sensors and logs via UART
+
+static void dynamic_sensor_task(void *pvParameters)
+{
+    task_runtime_t *rt = (task_runtime_t *)pvParameters;
+    task_config_t *config = rt->config;
+    sensor_readings_t readings = {0};
+    sensor_stop_fn_t stop = sampling_stopped;
+    sensor_sample_fn_t on_sample = config->rule_count ? check_rules : NULL;
     
-    ESP_LOGI(TAG, "Creating %d tasks", task_count);
+    char log_buffer[256];
     
-    for (int i = 0; i < task_count; i++) {
-        cJSON *task_json = cJSON_GetArrayItem(tasks_array, i);
-        if (!task_json) continue;
-        
-        // Allocate config structure (persists for task lifetime)
-        task_config_t *config = (task_config_t *)malloc(sizeof(task_config_t));
-        if (!config) {
-            ESP_LOGE(TAG, "Failed to allocate task config");
+    while (1) {
+        // Park until this task's mode is switched in (or WCET calibration is over)
+        rt->in_cycle = true;
+        if (cycle_cancelled(rt)) {
+            rt->in_cycle = false;
+            release_rules(rt);              // Parked tasks do not hold outputs
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            rt->adaptive.primed = false;    // Parked time is not a sampling interval
+            rt->derived.primed = false;
+            rt->release_tick = 0;
             continue;
         }
         
-        memset(config, 0, sizeof(task_config_t));
+        // First cycle after a start: hold back to the task's phase. The wait
+        // counts as parked and a mode switch or stop cuts it short, so the
+        // loop goes round to recheck before sampling.
+        if (!rt->release_tick && config->offset_ms > 0) {
+            TickType_t first = release_origin + pdMS_TO_TICKS(config->offset_ms);
+            TickType_t now = xTaskGetTickCount();
+            if ((int32_t)(first - now) > 0) {
+                rt->in_cycle = false;
+                ulTaskNotifyTake(pdTRUE, first - now);
+                continue;
+            }
+        }
         
-        // Parse task properties
-        cJSON *name = cJSON_GetObjectItem(task_json, "name");
-        cJSON *priority = cJSON_GetObjectItem(task_json, "priority");
-        cJSON *period = cJSON_GetObjectItem(task_json, "period_ms");
-        cJSON *sensors = cJSON_GetObjectItem(task_json, "sensors");
+        TickType_t start = xTaskGetTickCount();
+        int64_t cycle_t0 = esp_timer_get_time();
+        // Time between the release and this task getting the CPU
+        uint32_t release_lag_us = rt->release_tick && start > rt->release_tick
+                                  ? (uint32_t)pdTICKS_TO_MS(start - rt->release_tick) * 1000 : 0;
+        if (!rt->release_tick) rt->release_us = cycle_t0;
         
-        if (!name || !priority || !period || !sensors) {
-            ESP_LOGE(TAG, "Missing required task fields");
-            free(config);
+        // Pay back earlier overruns by sitting out whole periods
+        if (config->budget_us && rt->debt_us >= config->budget_us) {
+            rt->debt_us -= config->budget_us;
+            rt->throttled_count++;
+            wait_next_period(rt, &start);
             continue;
         }
         
-        strncpy(config->name, name->valuestring, MAX_TASK_NAME_LEN - 1);
-        config->priority = priority->valueint;
-        config->period_ms = period->valueint;
+        // Only the budget checks read these, and the CPU snapshot costs a yield
+        if (config->budget_us) {
+            rt->cycle_start_us = task_cpu_time_us();
+            rt->cycle_wall_us = esp_timer_get_time();
+        }
+        
+        // Clear readings
+        memset(&readings, 0, sizeof(readings));
+        
+        // Read all configured sensors with averaging (10 samples), in one burst or spread over the period
+        int success = rt->spread ? read_task_sensors_spread(rt, &readings, stop, on_sample, start)
+                                 : read_task_sensors(rt, &readings, stop, on_sample);
         
-        // Parse sensors
-        int sensor_count = cJSON_GetArraySize(sensors);
-        config->sensor_count = (sensor_count > MAX_SENSORS_PER_TASK) ? MAX_SENSORS_PER_TASK : sensor_count;
+        // Cut short by a config switch, mode switch or WCET calibration: the
+        // partial cycle is neither a record nor a read error. The loop parks.
+        if (success < 0 || cycle_cancelled(rt)) continue;
         
-        for (int j = 0; j < config->sensor_count; j++) {
-            cJSON *sensor = cJSON_GetArrayItem(sensors, j);
-            if (sensor && sensor->valuestring) {
-                config->sensors[j] = parse_sensor_type(sensor->valuestring);
+        // Overrun: drop this cycle's output and defer the task to its next period
+        if (config->budget_us) {
+            uint32_t used = cycle_cpu_used_us(rt);
+            if (used > config->budget_us) {
+                rt->debt_us += used - config->budget_us;
+                rt->overrun_count++;
+                task_log(rt, "[%s] OVERRUN used=%luus budget=%luus count=%lu\n",
+                         config->name, (unsigned long)used, (unsigned long)config->budget_us,
+                         (unsigned long)rt->overrun_count);
+                wait_next_period(rt, &start);
+                continue;
             }
         }
         
-        // Create the task
-        BaseType_t ret = xTaskCreate(
-            dynamic_sensor_task,
-            config->name,
-            4096,
-            (void *)config,
-            config->priority,
-            &task_handles[active_task_count]
-        );
-        
-        if (ret == pdPASS) {
-            ESP_LOGI(TAG, "Created task: %s (priority=%d, period=%dms, sensors=%d)",
-                     config->name, config->priority, config->period_ms, config->sensor_count);
-            active_task_count++;
+        // Log results via UART
+        if (success) {
+            if (config->derived_count) {
+                evaluate_derived(rt, &readings, start);
+            }
+            if (record_due(rt, rt->release_us)) {
+                size_t len = line_encoder_encode(&rt->encoder, &readings, &rt->derived.vars[CHANNEL_COUNT],
+                                                 log_buffer, sizeof(log_buffer));
+                publish_record(rt, log_buffer, len);
+            }
+            history_append(rt - task_runtimes, config->channel_mask, &readings);
+            mqtt_pub_sample(rt - task_runtimes, config->channel_mask, &readings);
+            task_stats_add(&rt->stats, (uint32_t)(esp_timer_get_time() - cycle_t0) + release_lag_us,
+                           (uint32_t)effective_period_ms(rt) * 1000);
+            
+            if (config->detector_count) {
+                run_detectors(rt, &readings);
+            }
+            
+            if (config->adaptive.enabled) {
+                adapt_period(rt, &readings, start);
+            }
         } else {
-            ESP_LOGE(TAG, "Failed to create task: %s", config->name);
-            free(config);
+            task_log(rt, "Read error\n");
+            rt->stats.errors++;
         }
+        
+        wait_next_period(rt, &start);
+    }
+}
+
+static void build_warm_state(const task_runtime_t *rt, warm_state_t *ws)
+{
+    const task_config_t *config = rt->config;
+    memset(ws, 0, sizeof(*ws));
+    ws->version = WARM_STATE_VERSION;
+    ws->adaptive_channel = CHANNEL_NONE;
+    if (config->adaptive.enabled && rt->adaptive.primed) {
+        ws->adaptive_channel = (uint8_t)config->adaptive.channel;
+        ws->level = rt->adaptive.level;
+        ws->trend = rt->adaptive.trend;
+        ws->period_ms = rt->period_ms;
+    }
+    ws->detector_count = (uint8_t)config->detector_count;
+    for (int i = 0; i < config->detector_count; i++) {
+        const detect_state_t *st = &rt->detect[i];
+        warm_detector_t *wd = &ws->detectors[i];
+        wd->channel = (uint8_t)config->detectors[i].channel;
+        wd->method = (uint8_t)config->detectors[i].method;
+        // Only a learned baseline is worth keeping
+        if (st->n < config->detectors[i].warmup) continue;
+        wd->n = (uint16_t)st->n;
+        wd->mean = st->mean;
+        wd->var = st->var;
+        wd->ewma = st->ewma;
     }
+}
+
+// Restore what still matches the task's config; returns true if anything was
+static bool restore_warm_state(task_runtime_t *rt)
+{
+    const task_config_t *config = rt->config;
+    warm_state_t ws;
+    if (calib_state_load(config->name, &ws, sizeof(ws)) != 0 || ws.version != WARM_STATE_VERSION) return false;
     
-    cJSON_Delete(root);
-    return active_task_count;
+    bool restored = false;
+    if (config->adaptive.enabled && ws.adaptive_channel == config->adaptive.channel) {
+        rt->adaptive.primed = true;
+        rt->adaptive.level = ws.level;
+        rt->adaptive.last_value = ws.level;
+        rt->adaptive.trend = ws.trend;
+        int period = ws.period_ms;
+        if (period < config->adaptive.min_period_ms) period = config->adaptive.min_period_ms;
+        if (period > config->adaptive.max_period_ms) period = config->adaptive.max_period_ms;
+        rt->adaptive.period_ms = period;
+        rt->period_ms = period;
+        restored = true;
+    }
+    for (int i = 0; i < config->detector_count && i < ws.detector_count; i++) {
+        const warm_detector_t *wd = &ws.detectors[i];
+        const detect_config_t *dc = &config->detectors[i];
+        if (wd->channel != dc->channel || wd->method != dc->method || wd->n < dc->warmup) continue;
+        rt->detect[i].n = wd->n;
+        rt->detect[i].mean = wd->mean;
+        rt->detect[i].var = wd->var;
+        rt->detect[i].ewma = wd->ewma;
+        restored = true;
+    }
+    return restored;
 }
 
-void task_manager_stop_all(void)
+void task_manager_save_state(void)
 {
+    // Runs in the snapshot task too, while the command task may be stopping the tasks
+    xSemaphoreTake(configs_mutex, portMAX_DELAY);
     for (int i = 0; i < active_task_count; i++) {
-        if (task_handles[i]) {
-            vTaskDelete(task_handles[i]);
-            task_handles[i] = NULL;
+        const task_config_t *config = task_runtimes[i].config;
+        if (!config->adaptive.enabled && config->detector_count == 0) continue;
+        warm_state_t ws;
+        build_warm_state(&task_runtimes[i], &ws);
+        calib_state_save(config->name, &ws, sizeof(ws));
+    }
+    xSemaphoreGive(configs_mutex);
+}
+
+// Cycle cost from the stored measurement of this task, or else from the sensor
+// table; returns true if measured. image_sensors is where the task's sensor
+// indices point, or NULL once they are registry indices.
+static bool task_cycle_cost(const task_config_t *config, const sensor_instance_t *image_sensors,
+                            wcet_cost_t *cpu, wcet_cost_t *wall)
+{
+    memset(cpu, 0, sizeof(*cpu));
+    memset(wall, 0, sizeof(*wall));
+    if (wcet_task_load(config->name, cpu, wall) == 0) return true;
+    
+    for (int i = 0; i < config->sensor_count; i++) {
+        int idx = config->sensor_instances[i];
+        const sensor_instance_t *sensor = image_sensors ? &image_sensors[idx] : sensors_get_instance(idx);
+        if (wcet_estimate_read(sensor, SAMPLES_PER_READ, cpu, wall) != 0) {
+            // One unknown sensor makes the whole estimate meaningless
+            memset(cpu, 0, sizeof(*cpu));
+            memset(wall, 0, sizeof(*wall));
+            break;
         }
     }
-    active_task_count = 0;
-    ESP_LOGI(TAG, "All tasks stopped");
+    return false;
 }
 
-void uart_log(const char *task_name, const char *format, ...)
+static void load_task_wcet(task_runtime_t *rt)
 {
-    if (!uart_mutex) return;
+    rt->wcet_measured = task_cycle_cost(rt->config, NULL, &rt->wcet_cpu, &rt->wcet_wall);
+}
+
+// Shortest period the task can run at
+static int min_period_ms(const task_config_t *config)
+{
+    if (config->adaptive.enabled && config->adaptive.min_period_ms < config->period_ms) {
+        return config->adaptive.min_period_ms;
+    }
+    return config->period_ms;
+}
+
+// Check an image task's cycle against its period and its mode's CPU
+// utilization per core, adding it to *mode_utilization (the image's tasks of
+// that mode so far); returns -1 if the image must not be activated
+static int admit_task(const config_image_t *image, const task_config_t *config, float *mode_utilization)
+{
+    wcet_cost_t cpu, wall;
+    bool measured = task_cycle_cost(config, image->sensors, &cpu, &wall);
+    if (image->admission == ADMISSION_OFF || wall.max_us == 0) return 0;
+    
+    const char *source = measured ? "measured" : "estimated";
+    if (config->budget_us && config->budget_us < cpu.p99_us) {
+        ESP_LOGW(TAG, "%s: budget %luus is below the %s cycle cost %luus, expect overruns", config->name,
+                 (unsigned long)config->budget_us, source, (unsigned long)cpu.p99_us);
+    }
     
-    xSemaphoreTake(uart_mutex, portMAX_DELAY);
+    int period_us = min_period_ms(config) * 1000;
+    *mode_utilization += (float)cpu.p99_us / (float)period_us;
     
-    char buffer[256];
-    va_list args;
-    va_start(args, format);
-    vsnprintf(buffer, sizeof(buffer), format, args);
-    va_end(args);
+    bool fits = true;
+    if (wall.p99_us > (uint32_t)period_us) {
+        ESP_LOGW(TAG, "%s: %s cycle of %luus does not fit the %dms period", config->name, source,
+                 (unsigned long)wall.p99_us, min_period_ms(config));
+        fits = false;
+    }
+    if (*mode_utilization > ADMISSION_MAX_UTILIZATION * portNUM_PROCESSORS) {
+        ESP_LOGW(TAG, "%s: mode %s would load the CPUs to %.0f%% of %d cores", config->name,
+                 image->mode_names[config->mode], *mode_utilization * 100.0f, portNUM_PROCESSORS);
+        fits = false;
+    }
+    if (!fits && image->admission == ADMISSION_REJECT) {
+        uart_log("CONFIG", "CONFIG_ERROR task %s rejected by admission control\n", config->name);
+        return -1;
+    }
+    return 0;
+}
+
+// One isolated task cycle: the sensor reads and the record encoding, without
+// publishing, rules or filters, which would change the task's state
+static void measure_task_cycle(void *arg)
+{
+    task_runtime_t *rt = (task_runtime_t *)arg;
+    sensor_readings_t readings = {0};
+    char line[256];
+    read_task_sensors(rt, &readings, NULL, NULL);
+    line_encoder_encode(&rt->encoder, &readings, &rt->derived.vars[CHANNEL_COUNT], line, sizeof(line));
+}
+
+// Wait for the running cycles to finish once a flag that parks the tasks is
+// set; returns how many are still running after the timeout
+static int wait_tasks_parked(void)
+{
+    int running = 0;
+    int64_t give_up = esp_timer_get_time() + (int64_t)PARK_TIMEOUT_MS * 1000;
+    for (int i = 0; i < active_task_count; i++) {
+        while (task_runtimes[i].in_cycle && esp_timer_get_time() < give_up) {
+            vTaskDelay(pdMS_TO_TICKS(10));
+        }
+        if (task_runtimes[i].in_cycle) {
+            ESP_LOGW(TAG, "%s still running after %dms", task_runtimes[i].config->name, PARK_TIMEOUT_MS);
+            running++;
+        }
+    }
+    return running;
+}
+
+int task_manager_calibrate_wcet(int iterations)
+{
+    if (iterations < 1) iterations = WCET_TASK_ITERATIONS;
+    
+    // Let every running cycle finish; tasks park at their next release
+    calibrating = true;
+    if (wait_tasks_parked() > 0) {
+        ESP_LOGW(TAG, "Reads of running tasks will disturb the measurement");
+    }
+    
+    int result = wcet_calibrate_sensors();
+    for (int i = 0; i < active_task_count && result == 0; i++) {
+        task_runtime_t *rt = &task_runtimes[i];
+        // Sensors need a rest between reads, as they get from the period
+        int gap_ms = rt->config->period_ms < 1000 ? rt->config->period_ms : 1000;
+        wcet_cost_t cpu, wall;
+        if (wcet_measure(measure_task_cycle, rt, iterations, gap_ms, &cpu, &wall) != 0) {
+            ESP_LOGE(TAG, "%s: cycle measurement failed", rt->config->name);
+            result = -1;
+            break;
+        }
+        rt->wcet_cpu = cpu;
+        rt->wcet_wall = wall;
+        rt->wcet_measured = true;
+        ESP_LOGI(TAG, "%s: cycle cpu p99=%luus wall p99=%luus", rt->config->name,
+                 (unsigned long)cpu.p99_us, (unsigned long)wall.p99_us);
+        if (wcet_task_save(rt->config->name, &cpu, &wall) != 0) result = -1;
+    }
+    
+    calibrating = false;
+    release_origin = xTaskGetTickCount();
+    for (int i = 0; i < active_task_count; i++) {
+        if (task_runtimes[i].config->mode == active_mode) {
+            xTaskNotifyGive(task_runtimes[i].handle);
+        }
+    }
+    return result;
+}
+
+int task_manager_task_wcet(int id, wcet_cost_t *cpu, wcet_cost_t *wall, bool *measured)
+{
+    if (id < 0 || id >= active_task_count) return -1;
+    *cpu = task_runtimes[id].wcet_cpu;
+    *wall = task_runtimes[id].wcet_wall;
+    *measured = task_runtimes[id].wcet_measured;
+    return 0;
+}
+
+void task_manager_init(void)
+{
+    // Initialize I2C for MPU6050 instances
+    ESP_ERROR_CHECK(i2cdev_init());
+    
+    // Register the board.h sensors (each gets its own mutex)
+    sensors_register_defaults();
+    sensor_trace_init();
+    vTaskDelay(pdMS_TO_TICKS(2000)); // DHT stabilization
+    
+    const esp_timer_create_args_t timer_args = {
+        .callback = mode_switch_timer_cb,
+        .name = "mode_switch",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &mode_switch_timer));
+    configs_mutex = xSemaphoreCreateMutex();
+    
+    history_init();
+    transport_set_disconnect_handler(unsubscribe_all);
+    
+    ESP_LOGI(TAG, "Task manager initialized");
+}
+
+static int json_int(cJSON *obj, const char *key, int fallback)
+{
+    cJSON *item = cJSON_GetObjectItem(obj, key);
+    return cJSON_IsNumber(item) ? item->valueint : fallback;
+}
+
+// Wiring of a config-declared sensor instance:
+// {"id": "imu1", "type": "mpu6050", "sda": 22, "scl": 23, "address": 105, "port": 0}
+// {"id": "us2", "type": "ultrasonic", "trig": 25, "echo": 34}
+// {"id": "env2", "type": "dht11", "pin": 14}
+static int parse_sensor_instance(cJSON *json, sensor_instance_t *wiring)
+{
+    cJSON *id = cJSON_GetObjectItem(json, "id");
+    cJSON *type = cJSON_GetObjectItem(json, "type");
+    if (!cJSON_IsString(id) || !cJSON_IsString(type)) {
+        ESP_LOGE(TAG, "Sensor instance needs id and type");
+        return -1;
+    }
+    
+    memset(wiring, 0, sizeof(*wiring));
+    strncpy(wiring->id, id->valuestring, MAX_SENSOR_ID_LEN - 1);
+    wiring->type = sensor_type_from_name(type->valuestring);
     
-    // Send to UART0 (connected to USB)
-    uart_write_bytes(UART_NUM_0, buffer, strlen(buffer));
+    switch (wiring->type) {
+        case SENSOR_DHT11:
+            wiring->dht.pin = json_int(json, "pin", -1);
+            wiring->dht.kind = DHT_SENSOR_TYPE;
+            if (wiring->dht.pin < 0) return -1;
+            break;
+        case SENSOR_ULTRASONIC:
+            wiring->ultrasonic.trig = json_int(json, "trig", -1);
+            wiring->ultrasonic.echo = json_int(json, "echo", -1);
+            if (wiring->ultrasonic.trig < 0 || wiring->ultrasonic.echo < 0) return -1;
+            break;
+        case SENSOR_MPU6050:
+            wiring->mpu.port = json_int(json, "port", 0);
+            wiring->mpu.sda = json_int(json, "sda", MPU_SDA_PIN);
+            wiring->mpu.scl = json_int(json, "scl", MPU_SCL_PIN);
+            wiring->mpu.address = (uint8_t)json_int(json, "address", MPU6050_I2C_ADDRESS_LOW);
+            break;
+        default:
+            ESP_LOGE(TAG, "Unknown sensor type %s", type->valuestring);
+            return -1;
+    }
+    
+    return 0;
+}
+
+static uint8_t sensor_channel_mask(const task_config_t *config)
+{
+    uint8_t mask = 0;
+    for (int i = 0; i < config->sensor_count; i++) {
+        mask |= sensor_type_channels(config->sensors[i]);
+    }
+    return mask;
+}
+
+// Default channel that drives adaptation: the first one the task samples
+static sensor_channel_t default_channel(const task_config_t *config)
+{
+    switch (config->sensor_count > 0 ? config->sensors[0] : SENSOR_NONE) {
+        case SENSOR_DHT11:      return CHANNEL_TEMPERATURE;
+        case SENSOR_ULTRASONIC: return CHANNEL_DISTANCE;
+        case SENSOR_MPU6050:    return CHANNEL_ACCEL_X;
+        default:                return CHANNEL_NONE;
+    }
+}
+
+static int parse_adaptive(cJSON *json, task_config_t *config)
+{
+    adaptive_config_t *adaptive = &config->adaptive;
+    cJSON *channel = cJSON_GetObjectItem(json, "channel");
+    cJSON *min_period = cJSON_GetObjectItem(json, "min_period_ms");
+    cJSON *max_period = cJSON_GetObjectItem(json, "max_period_ms");
+    cJSON *threshold = cJSON_GetObjectItem(json, "threshold");
+    cJSON *alpha = cJSON_GetObjectItem(json, "alpha");
+    
+    if (!cJSON_IsNumber(min_period) || !cJSON_IsNumber(max_period) || !cJSON_IsNumber(threshold)) {
+        return -1;
+    }
     
-    xSemaphoreGive(uart_mutex);
+    adaptive->channel = cJSON_IsString(channel) ? sensor_channel_from_name(channel->valuestring)
+                                                : default_channel(config);
+    adaptive->min_period_ms = min_period->valueint;
+    adaptive->max_period_ms = max_period->valueint;
+    adaptive->threshold = (float)threshold->valuedouble;
+    adaptive->alpha = cJSON_IsNumber(alpha) ? (float)alpha->valuedouble : 0.3f;
+    
+    if (adaptive->channel == CHANNEL_NONE || adaptive->min_period_ms <= 0 ||
+        adaptive->max_period_ms < adaptive->min_period_ms || adaptive->threshold <= 0.0f ||
+        adaptive->alpha <= 0.0f || adaptive->alpha > 1.0f) {
+        return -1;
+    }
+    adaptive->enabled = true;
+    return 0;
+}
+
+static int parse_fields(cJSON *fields, task_config_t *config)
+{
+    uint8_t mask = 0;
+    cJSON *field;
+    cJSON_ArrayForEach(field, fields) {
+        sensor_channel_t channel = cJSON_IsString(field) ? sensor_channel_from_name(field->valuestring)
+                                                        : CHANNEL_NONE;
+        // Only channels the task samples; anything else would print a constant zero
+        if (channel == CHANNEL_NONE || !(config->channel_mask & (1u << channel))) return -1;
+        mask |= 1u << channel;
+    }
+    if (mask == 0) return -1;
+    config->field_mask = mask;
+    return 0;
+}
+
+// [{"name": "closing", "expr": "(dist - prev(dist)) / dt", "decimals": 1}, ...]
+static int parse_derived(cJSON *list, task_config_t *config)
+{
+    const char *names[EXPR_MAX_DERIVED] = { NULL };
+    cJSON *item;
+    cJSON_ArrayForEach(item, list) {
+        cJSON *name = cJSON_GetObjectItem(item, "name");
+        cJSON *source = cJSON_GetObjectItem(item, "expr");
+        if (config->derived_count >= EXPR_MAX_DERIVED || !cJSON_IsString(name) || !cJSON_IsString(source) ||
+            strlen(name->valuestring) > EXPR_MAX_NAME_LEN || expr_reserved_name(name->valuestring)) {
+            return -1;
+        }
+        
+        int i = config->derived_count;
+        derived_channel_t *derived = &config->derived[i];
+        strcpy(derived->name, name->valuestring);
+        int decimals = json_int(item, "decimals", 2);
+        if (decimals < 0 || decimals > 4) return -1;
+        derived->decimals = (uint8_t)decimals;
+        
+        // Sampled channels and the derived channels declared before this one
+        uint32_t vars = config->channel_mask | (((1u << i) - 1) << CHANNEL_COUNT);
+        char err[64];
+        if (expr_compile(source->valuestring, names, vars, &derived->program, err, sizeof(err)) != 0) {
+            // The host needs the column to fix the expression
+            uart_log("CONFIG", "CONFIG_ERROR %s.%s: %s\n", config->name, derived->name, err);
+            return -1;
+        }
+        names[i] = derived->name;
+        config->derived_count++;
+    }
+    return 0;
+}
+
+// [{"channel": "dist", "method": "cusum", "threshold": 5, "boost_period_ms": 100, "boost_window_ms": 5000}, ...]
+// Optional tuning: "slack" (cusum), "lambda" (ewma), "alpha", "min_sd", "warmup"
+static int parse_detectors(cJSON *list, task_config_t *config)
+{
+    cJSON *item;
+    cJSON_ArrayForEach(item, list) {
+        if (config->detector_count >= DETECT_MAX_PER_TASK) return -1;
+        cJSON *channel = cJSON_GetObjectItem(item, "channel");
+        cJSON *method = cJSON_GetObjectItem(item, "method");
+        sensor_channel_t ch = cJSON_IsString(channel) ? sensor_channel_from_name(channel->valuestring)
+                                                      : CHANNEL_NONE;
+        detect_method_t m = cJSON_IsString(method) ? detect_method_from_name(method->valuestring) : DETECT_CUSUM;
+        if (ch == CHANNEL_NONE || !(config->channel_mask & (1u << ch)) || m == DETECT_METHOD_COUNT) return -1;
+        
+        detect_config_t *dc = &config->detectors[config->detector_count];
+        detect_default_config(dc, ch, m);
+        const struct { const char *key; float *value; } tuning[] = {
+            { "threshold", &dc->threshold }, { "slack", &dc->slack }, { "lambda", &dc->lambda },
+            { "alpha", &dc->alpha }, { "min_sd", &dc->min_sd },
+        };
+        for (size_t i = 0; i < sizeof(tuning) / sizeof(tuning[0]); i++) {
+            cJSON *v = cJSON_GetObjectItem(item, tuning[i].key);
+            if (cJSON_IsNumber(v)) *tuning[i].value = (float)v->valuedouble;
+        }
+        int warmup = json_int(item, "warmup", dc->warmup);
+        dc->boost_period_ms = json_int(item, "boost_period_ms", 0);
+        dc->boost_window_ms = json_int(item, "boost_window_ms", 5000);
+        
+        if (dc->threshold <= 0.0f || dc->slack < 0.0f || dc->lambda <= 0.0f || dc->lambda > 1.0f ||
+            dc->alpha <= 0.0f || dc->alpha > 1.0f || dc->min_sd < 0.0f || warmup < 2 || warmup > 1000 ||
+            dc->boost_period_ms < 0 || dc->boost_window_ms < 0) {
+            return -1;
+        }
+        dc->warmup = (uint16_t)warmup;
+        config->detector_count++;
+    }
+    return 0;
+}
+
+// [{"name": "brake", "channel": "dist", "below": 20, "hysteresis": 5, "debounce": 2, "gpio": 4}, ...]
+// An action is either "gpio" (with optional "active_low") or "callback": "<registered name>"
+static int parse_rules(cJSON *list, task_config_t *config)
+{
+    cJSON *item;
+    cJSON_ArrayForEach(item, list) {
+        if (config->rule_count >= REFLEX_MAX_RULES) return -1;
+        reflex_rule_t *rule = &config->rules[config->rule_count];
+        cJSON *name = cJSON_GetObjectItem(item, "name");
+        cJSON *channel = cJSON_GetObjectItem(item, "channel");
+        cJSON *below = cJSON_GetObjectItem(item, "below");
+        cJSON *above = cJSON_GetObjectItem(item, "above");
+        cJSON *hysteresis = cJSON_GetObjectItem(item, "hysteresis");
+        cJSON *gpio = cJSON_GetObjectItem(item, "gpio");
+        cJSON *callback = cJSON_GetObjectItem(item, "callback");
+        
+        if (!cJSON_IsString(name) || !cJSON_IsString(channel)) return -1;
+        strncpy(rule->name, name->valuestring, REFLEX_NAME_LEN - 1);
+        rule->channel = sensor_channel_from_name(channel->valuestring);
+        // Only channels the task samples ever produce a value
+        if (rule->channel == CHANNEL_NONE || !(config->channel_mask & (1u << rule->channel))) return -1;
+        
+        // Exactly one of below / above
+        if (cJSON_IsNumber(below) == cJSON_IsNumber(above)) return -1;
+        rule->below = cJSON_IsNumber(below);
+        rule->threshold = (float)(rule->below ? below : above)->valuedouble;
+        rule->hysteresis = cJSON_IsNumber(hysteresis) ? (float)hysteresis->valuedouble : 0.0f;
+        int debounce = json_int(item, "debounce", 1);
+        if (rule->hysteresis < 0.0f || debounce < 1 || debounce > 255) return -1;
+        rule->debounce = (uint8_t)debounce;
+        
+        if (cJSON_IsNumber(gpio) && !callback) {
+            rule->action = REFLEX_ACTION_GPIO;
+            rule->gpio = gpio->valueint;
+            rule->active_low = cJSON_IsTrue(cJSON_GetObjectItem(item, "active_low"));
+        } else if (cJSON_IsString(callback) && !gpio) {
+            rule->action = REFLEX_ACTION_CALLBACK;
+            rule->callback = reflex_find_callback(callback->valuestring);
+            if (rule->callback < 0) return -1;
+        } else {
+            return -1;
+        }
+        // The pin is claimed when the task is created
+        if (rule->action == REFLEX_ACTION_GPIO && !GPIO_IS_VALID_OUTPUT_GPIO(rule->gpio)) return -1;
+        config->rule_count++;
+    }
+    return 0;
+}
+
+// {"weight": 4, "critical": false, "policy": "drop_old", "rate_bps": 500, "burst": 1024}
+static int parse_telemetry(cJSON *json, telemetry_config_t *telemetry)
+{
+    cJSON *critical = cJSON_GetObjectItem(json, "critical");
+    cJSON *policy = cJSON_GetObjectItem(json, "policy");
+    int weight = json_int(json, "weight", 1);
+    int rate = json_int(json, "rate_bps", 0);
+    int burst = json_int(json, "burst", rate);
+    
+    if (weight < 1 || weight > TELEMETRY_MAX_WEIGHT || rate < 0 || burst < 0) return -1;
+    if (cJSON_IsString(policy)) {
+        int p = (int)telemetry_policy_from_name(policy->valuestring);
+        if (p < 0) return -1;
+        telemetry->policy = (telemetry_policy_t)p;
+    }
+    
+    telemetry->weight = (uint8_t)weight;
+    telemetry->critical = cJSON_IsTrue(critical);
+    telemetry->rate_bps = (uint32_t)rate;
+    telemetry->burst = (uint32_t)burst;
+    return 0;
+}
+
+// Resolve a subscription's field list against one task: channels it samples
+// and its derived channels. Names the task lacks fail in strict mode and are
+// skipped otherwise; -1 when nothing is left.
+static int resolve_fields(const task_config_t *config, const char *fields, bool strict,
+                          uint8_t *field_mask, uint8_t *derived_mask)
+{
+    *field_mask = 0;
+    *derived_mask = 0;
+    if (!fields || !*fields) {
+        *field_mask = config->field_mask;
+        *derived_mask = (uint8_t)((1u << config->derived_count) - 1);
+        return 0;
+    }
+    
+    char list[SUB_FIELDS_LEN];
+    strncpy(list, fields, sizeof(list) - 1);
+    list[sizeof(list) - 1] = '\0';
+    char *save = NULL;
+    for (char *name = strtok_r(list, ",", &save); name; name = strtok_r(NULL, ",", &save)) {
+        sensor_channel_t channel = sensor_channel_from_name(name);
+        if (channel != CHANNEL_NONE && (config->channel_mask & (1u << channel))) {
+            *field_mask |= 1u << channel;
+            continue;
+        }
+        int d = 0;
+        while (d < config->derived_count && strcmp(config->derived[d].name, name) != 0) d++;
+        if (d < config->derived_count) {
+            *derived_mask |= 1u << d;
+        } else if (strict) {
+            return -1;
+        }
+    }
+    return *field_mask || *derived_mask ? 0 : -1;
+}
+
+static void set_subscription(task_runtime_t *rt, const task_subscription_t *sub)
+{
+    portENTER_CRITICAL(&rt->sub_lock);
+    rt->sub = *sub;
+    rt->sub_version++;
+    portEXIT_CRITICAL(&rt->sub_lock);
+}
+
+// A new task starts with the SUB * in force, if it has any of its fields
+static void apply_default_subscription(task_runtime_t *rt)
+{
+    task_subscription_t sub = {
+        .active = default_sub.active,
+        .encoding = default_sub.encoding,
+        .max_hz = default_sub.max_hz,
+    };
+    if (sub.active && resolve_fields(rt->config, default_sub.fields, false, &sub.field_mask, &sub.derived_mask) != 0) {
+        sub.active = false;
+    }
+    set_subscription(rt, &sub);
+}
+
+// Index of a sensor in the image's table, taking the wiring of a registered
+// instance the first time a task names it; -1 if the id is unknown
+static int image_sensor(config_image_t *image, const char *id)
+{
+    for (int i = 0; i < image->sensor_count; i++) {
+        if (strcmp(image->sensors[i].id, id) == 0) return i;
+    }
+    if (image->sensor_count >= MAX_SENSOR_INSTANCES ||
+        sensors_get_wiring(sensors_find_instance(id), &image->sensors[image->sensor_count]) != 0) {
+        return -1;
+    }
+    return image->sensor_count++;
+}
+
+// Compile one task of the JSON into config; its sensors index image->sensors
+static int parse_task(cJSON *task_json, int mode, config_image_t *image, task_config_t *config)
+{
+    memset(config, 0, sizeof(task_config_t));
+    
+    // Parse task properties
+    cJSON *name = cJSON_GetObjectItem(task_json, "name");
+    cJSON *priority = cJSON_GetObjectItem(task_json, "priority");
+    cJSON *period = cJSON_GetObjectItem(task_json, "period_ms");
+    cJSON *sensors = cJSON_GetObjectItem(task_json, "sensors");
+    
+    if (!name || !priority || !period || !sensors) {
+        ESP_LOGE(TAG, "Missing required task fields");
+        return -1;
+    }
+    
+    strncpy(config->name, name->valuestring, MAX_TASK_NAME_LEN - 1);
+    config->priority = priority->valueint;
+    config->period_ms = period->valueint;
+    config->mode = mode;
+    
+    // Optional phase: first release this long after the mode starts
+    config->offset_ms = json_int(task_json, "offset_ms", 0);
+    if (config->offset_ms < 0 || (config->offset_ms > 0 && config->offset_ms >= config->period_ms)) {
+        ESP_LOGE(TAG, "%s: offset_ms must be below period_ms", config->name);
+        return -1;
+    }
+    
+    // Optional CPU budget per period
+    cJSON *budget = cJSON_GetObjectItem(task_json, "budget_us");
+    if (cJSON_IsNumber(budget) && budget->valueint > 0) {
+        config->budget_us = (uint32_t)budget->valueint;
+    }
+    
+    // Parse sensors
+    int sensor_count = cJSON_GetArraySize(sensors);
+    config->sensor_count = (sensor_count > MAX_SENSORS_PER_TASK) ? MAX_SENSORS_PER_TASK : sensor_count;
+    
+    // Sensors are instance ids; the built-in instances are named after their type
+    for (int j = 0; j < config->sensor_count; j++) {
+        cJSON *sensor = cJSON_GetArrayItem(sensors, j);
+        int idx = cJSON_IsString(sensor) ? image_sensor(image, sensor->valuestring) : -1;
+        if (idx < 0) {
+            ESP_LOGE(TAG, "%s: unknown sensor %s", config->name,
+                     cJSON_IsString(sensor) ? sensor->valuestring : "?");
+            return -1;
+        }
+        
+        sensor_type_t type = image->sensors[idx].type;
+        for (int k = 0; k < j; k++) {
+            if (config->sensors[k] == type) {
+                // sensor_readings_t has one slot per sensor type
+                ESP_LOGE(TAG, "%s: more than one sensor of the same type", config->name);
+                return -1;
+            }
+        }
+        config->sensors[j] = type;
+        config->sensor_instances[j] = (int8_t)idx;
+    }
+    
+    config->channel_mask = sensor_channel_mask(config);
+    
+    // Optional subset of the sampled channels to print, e.g. "fields": ["dist"]
+    config->field_mask = config->channel_mask;
+    cJSON *fields = cJSON_GetObjectItem(task_json, "fields");
+    if (cJSON_IsArray(fields) && parse_fields(fields, config) != 0) {
+        ESP_LOGE(TAG, "Invalid fields for %s", config->name);
+        return -1;
+    }
+    
+    // Optional adaptive sampling rate
+    cJSON *adaptive = cJSON_GetObjectItem(task_json, "adaptive");
+    if (cJSON_IsObject(adaptive) && parse_adaptive(adaptive, config) != 0) {
+        ESP_LOGE(TAG, "Invalid adaptive settings for %s", config->name);
+        return -1;
+    }
+    
+    // Optional channels computed from expressions
+    cJSON *derived = cJSON_GetObjectItem(task_json, "derived");
+    if (cJSON_IsArray(derived) && parse_derived(derived, config) != 0) {
+        ESP_LOGE(TAG, "Invalid derived channels for %s", config->name);
+        return -1;
+    }
+    
+    // Optional change-point / anomaly detectors on the averaged channels
+    cJSON *detect = cJSON_GetObjectItem(task_json, "detect");
+    if (cJSON_IsArray(detect) && parse_detectors(detect, config) != 0) {
+        ESP_LOGE(TAG, "Invalid detectors for %s", config->name);
+        return -1;
+    }
+    
+    // Optional LET output: publish each record at its deadline
+    config->let = cJSON_IsTrue(cJSON_GetObjectItem(task_json, "let"));
+    
+    // Optional sample spreading: the averaged samples evenly over the period
+    config->spread = cJSON_IsTrue(cJSON_GetObjectItem(task_json, "spread"));
+    
+    // Optional reflex rules driving outputs straight from the samples
+    cJSON *rules = cJSON_GetObjectItem(task_json, "reflex");
+    if (cJSON_IsArray(rules) && parse_rules(rules, config) != 0) {
+        ESP_LOGE(TAG, "Invalid reflex rules for %s", config->name);
+        return -1;
+    }
+    
+    // Optional share of the link
+    telemetry_default_config(&config->telemetry);
+    cJSON *telemetry = cJSON_GetObjectItem(task_json, "telemetry");
+    if (cJSON_IsObject(telemetry) && parse_telemetry(telemetry, &config->telemetry) != 0) {
+        ESP_LOGE(TAG, "Invalid telemetry settings for %s", config->name);
+        return -1;
+    }
+    
+    return 0;
+}
+
+// Create a task from a compiled config (copied, so the image can be read-only
+// flash); sensor_map turns its image sensor indices into registry indices
+static int create_task(const task_config_t *compiled, const int8_t *sensor_map)
+{
+    if (active_task_count >= MAX_TASKS) {
+        ESP_LOGW(TAG, "Task limit %d reached, skipping", MAX_TASKS);
+        return -1;
+    }
+    
+    // Allocate config structure (persists for task lifetime)
+    task_config_t *config = (task_config_t *)malloc(sizeof(task_config_t));
+    if (!config) {
+        ESP_LOGE(TAG, "Failed to allocate task config");
+        return -1;
+    }
+    memcpy(config, compiled, sizeof(*config));
+    for (int j = 0; j < config->sensor_count; j++) {
+        config->sensor_instances[j] = sensor_map[config->sensor_instances[j]];
+    }
+    for (int r = 0; r < config->rule_count; r++) {
+        if (reflex_rule_init(&config->rules[r]) != 0) {
+            ESP_LOGE(TAG, "%s: cannot set up reflex rule %s", config->name, config->rules[r].name);
+            while (--r >= 0) reflex_rule_release(&config->rules[r], active_task_count);
+            free(config);
+            return -1;
+        }
+    }
+    int mode = config->mode;
+    
+    task_runtime_t *rt = &task_runtimes[active_task_count];
+    memset(rt, 0, sizeof(*rt));
+    rt->config = config;
+    rt->period_ms = config->period_ms;
+    line_encoder_build(&rt->encoder, config->name, config->field_mask);
+    for (int i = 0; i < config->derived_count; i++) {
+        line_encoder_add_value(&rt->encoder, i, config->derived[i].name, config->derived[i].decimals);
+    }
+    if (config->adaptive.enabled) {
+        adaptive_init(&config->adaptive, &rt->adaptive, config->period_ms);
+        rt->period_ms = rt->adaptive.period_ms;
+    }
+    if ((config->adaptive.enabled || config->detector_count) && restore_warm_state(rt)) {
+        ESP_LOGI(TAG, "%s: warm start from saved filter state", config->name);
+    }
+    
+    load_task_wcet(rt);
+    
+    portMUX_INITIALIZE(&rt->let.lock);
+    portMUX_INITIALIZE(&rt->sub_lock);
+    apply_default_subscription(rt);
+    rt->let.enabled = config->let;
+    rt->spread = config->spread;
+    const esp_timer_create_args_t let_timer_args = {
+        .callback = let_deadline_cb,
+        .arg = rt,
+        .name = "let",
+    };
+    if (esp_timer_create(&let_timer_args, &rt->let.timer) != ESP_OK) {
+        ESP_LOGW(TAG, "%s: no deadline timer, LET output unavailable", config->name);
+        rt->let.timer = NULL;
+    }
+    
+    if (telemetry_configure(active_task_count, config->name, &config->telemetry) != 0) {
+        ESP_LOGW(TAG, "%s: no telemetry queue, output goes straight to the link", config->name);
+    }
+    
+    BaseType_t ret = xTaskCreate(
+        dynamic_sensor_task,
+        config->name,
+        4096,
+        (void *)rt,
+        config->priority,
+        &rt->handle
+    );
+    
+    if (ret != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create task: %s", config->name);
+        release_rules(rt);
+        if (rt->let.timer) esp_timer_delete(rt->let.timer);
+        rt->let.timer = NULL;
+        telemetry_release(active_task_count);
+        free(config);
+        return -1;
+    }
+    
+    ESP_LOGI(TAG, "Created task: %s (mode=%s, priority=%d, period=%dms, sensors=%d, budget=%luus)",
+             config->name, mode_names[mode], config->priority, config->period_ms,
+             config->sensor_count, (unsigned long)config->budget_us);
+    active_task_count++;
+    return 0;
+}
+
+// A task that does not parse rejects the whole config, reported over the link
+static int compile_mode_tasks(config_image_t *image, cJSON *tasks_array, int mode)
+{
+    int task_count = cJSON_GetArraySize(tasks_array);
+    ESP_LOGI(TAG, "Compiling %d tasks for mode %s", task_count, image->mode_names[mode]);
+    
+    for (int i = 0; i < task_count && image->task_count < MAX_TASKS; i++) {
+        cJSON *task_json = cJSON_GetArrayItem(tasks_array, i);
+        if (!task_json || parse_task(task_json, mode, image, &image->tasks[image->task_count]) != 0) {
+            uart_log("CONFIG", "CONFIG_ERROR task %d of mode %s is invalid\n", i, image->mode_names[mode]);
+            return -1;
+        }
+        image->task_count++;
+    }
+    return 0;
+}
+
+static int find_mode(const char *name)
+{
+    for (int i = 0; i < mode_count; i++) {
+        if (strcmp(mode_names[i], name) == 0) return i;
+    }
+    return -1;
+}
+
+static config_image_t *compile_root(cJSON *root, size_t *size)
+{
+    cJSON *modes_array = cJSON_GetObjectItem(root, "modes");
+    cJSON *tasks_array = cJSON_GetObjectItem(root, "tasks");
+    
+    // Validate every mode up front and size the image for the declared tasks
+    int declared = 0;
+    if (cJSON_IsArray(modes_array)) {
+        int count = cJSON_GetArraySize(modes_array);
+        if (count < 1 || count > MAX_MODES) {
+            ESP_LOGE(TAG, "Mode count %d outside 1..%d", count, MAX_MODES);
+            return NULL;
+        }
+        for (int m = 0; m < count; m++) {
+            cJSON *mode_json = cJSON_GetArrayItem(modes_array, m);
+            cJSON *mode_name = cJSON_GetObjectItem(mode_json, "name");
+            cJSON *mode_tasks = cJSON_GetObjectItem(mode_json, "tasks");
+            if (!cJSON_IsString(mode_name) || !cJSON_IsArray(mode_tasks)) {
+                ESP_LOGE(TAG, "Mode %d needs a name and a tasks array", m);
+                return NULL;
+            }
+            declared += cJSON_GetArraySize(mode_tasks);
+        }
+        if (declared > MAX_TASKS) {
+            ESP_LOGE(TAG, "Modes declare %d tasks, max is %d", declared, MAX_TASKS);
+            return NULL;
+        }
+    } else if (cJSON_IsArray(tasks_array)) {
+        declared = cJSON_GetArraySize(tasks_array);
+        if (declared > MAX_TASKS) {
+            ESP_LOGW(TAG, "Task count %d exceeds max %d, truncating", declared, MAX_TASKS);
+            declared = MAX_TASKS;
+        }
+    } else {
+        ESP_LOGE(TAG, "Invalid tasks array");
+        return NULL;
+    }
+    
+    config_image_t *image = (config_image_t *)calloc(1, CONFIG_IMAGE_SIZE(declared));
+    if (!image) {
+        ESP_LOGE(TAG, "Failed to allocate config image");
+        return NULL;
+    }
+    image->version = CONFIG_IMAGE_VERSION;
+    image->config_size = sizeof(task_config_t);
+    image->sensor_size = sizeof(sensor_instance_t);
+    
+    // Admission control of the tasks against their WCET: "warn" (default), "reject" or "off"
+    image->admission = ADMISSION_WARN;
+    cJSON *admission_json = cJSON_GetObjectItem(root, "admission");
+    if (cJSON_IsString(admission_json)) {
+        if (strcmp(admission_json->valuestring, "reject") == 0) {
+            image->admission = ADMISSION_REJECT;
+        } else if (strcmp(admission_json->valuestring, "off") == 0) {
+            image->admission = ADMISSION_OFF;
+        } else if (strcmp(admission_json->valuestring, "warn") != 0) {
+            ESP_LOGE(TAG, "Unknown admission policy %s", admission_json->valuestring);
+            free(image);
+            return NULL;
+        }
+    }
+    
+    // Optional sensor instances, registered when the image is activated
+    cJSON *sensors_array = cJSON_GetObjectItem(root, "sensors");
+    if (cJSON_IsArray(sensors_array)) {
+        cJSON *sensor_json;
+        cJSON_ArrayForEach(sensor_json, sensors_array) {
+            sensor_instance_t *wiring = &image->sensors[image->sensor_count];
+            if (image->sensor_count >= MAX_SENSOR_INSTANCES || parse_sensor_instance(sensor_json, wiring) != 0) {
+                ESP_LOGE(TAG, "Invalid sensor instance");
+                free(image);
+                return NULL;
+            }
+            for (int k = 0; k < image->sensor_count; k++) {
+                if (strcmp(image->sensors[k].id, wiring->id) == 0) {
+                    ESP_LOGE(TAG, "Duplicate sensor id %s", wiring->id);
+                    free(image);
+                    return NULL;
+                }
+            }
+            image->sensor_count++;
+        }
+    }
+    
+    if (cJSON_IsArray(modes_array)) {
+        int count = cJSON_GetArraySize(modes_array);
+        for (int m = 0; m < count; m++) {
+            cJSON *mode_name = cJSON_GetObjectItem(cJSON_GetArrayItem(modes_array, m), "name");
+            for (int k = 0; k < m; k++) {
+                if (strncmp(image->mode_names[k], mode_name->valuestring, MAX_MODE_NAME_LEN - 1) == 0) {
+                    ESP_LOGE(TAG, "Duplicate mode name %s", mode_name->valuestring);
+                    free(image);
+                    return NULL;
+                }
+            }
+            strncpy(image->mode_names[m], mode_name->valuestring, MAX_MODE_NAME_LEN - 1);
+        }
+        image->mode_count = count;
+        
+        cJSON *initial = cJSON_GetObjectItem(root, "initial_mode");
+        if (cJSON_IsString(initial)) {
+            image->initial_mode = -1;
+            for (int m = 0; m < count; m++) {
+                if (strcmp(image->mode_names[m], initial->valuestring) == 0) image->initial_mode = m;
+            }
+            if (image->initial_mode < 0) {
+                ESP_LOGE(TAG, "Unknown initial_mode %s", initial->valuestring);
+                free(image);
+                return NULL;
+            }
+        }
+        
+        for (int m = 0; m < count; m++) {
+            if (compile_mode_tasks(image, cJSON_GetObjectItem(cJSON_GetArrayItem(modes_array, m), "tasks"), m) != 0) {
+                free(image);
+                return NULL;
+            }
+        }
+    } else {
+        // Plain task list: a single always-active mode
+        strcpy(image->mode_names[0], "default");
+        image->mode_count = 1;
+        if (compile_mode_tasks(image, tasks_array, 0) != 0) {
+            free(image);
+            return NULL;
+        }
+    }
+    
+    *size = CONFIG_IMAGE_SIZE(image->task_count);
+    return image;
+}
+
+config_image_t *task_manager_compile(const char *json_config, size_t *size)
+{
+    if (!json_config) return NULL;
+    
+    cJSON *root = cJSON_Parse(json_config);
+    if (!root) {
+        ESP_LOGE(TAG, "JSON parse error");
+        return NULL;
+    }
+    config_image_t *image = compile_root(root, size);
+    cJSON_Delete(root);
+    return image;
+}
+
+// Registry index for an image's sensor: the instance of that id if one is
+// registered (a running instance keeps its wiring), else a new instance
+static int bind_sensor(const sensor_instance_t *wiring)
+{
+    int idx = sensors_find_instance(wiring->id);
+    if (idx < 0) return sensors_add_instance(wiring);
+    
+    sensor_instance_t current;
+    sensors_get_wiring(idx, &current);
+    if (current.type != wiring->type) {
+        ESP_LOGE(TAG, "Sensor %s is already registered as another type", wiring->id);
+        return -1;
+    }
+    if (memcmp(&current, wiring, sizeof(current)) != 0) {
+        ESP_LOGW(TAG, "Sensor %s keeps its registered wiring until reboot", wiring->id);
+    }
+    return idx;
+}
+
+static bool image_task_valid(const config_image_t *image, const task_config_t *config)
+{
+    if (config->mode < 0 || config->mode >= image->mode_count ||
+        config->sensor_count < 0 || config->sensor_count > MAX_SENSORS_PER_TASK ||
+        config->rule_count < 0 || config->rule_count > REFLEX_MAX_RULES) {
+        return false;
+    }
+    for (int j = 0; j < config->sensor_count; j++) {
+        if (config->sensor_instances[j] < 0 || config->sensor_instances[j] >= image->sensor_count) return false;
+    }
+    for (int r = 0; r < config->rule_count; r++) {
+        if (reflex_rule_check(&config->rules[r]) != 0) return false;
+    }
+    return true;
+}
+
+// A rule's output pin must not belong to a sensor, whether already registered
+// or new in the image, nor to another rule
+static bool image_rule_pins_valid(const config_image_t *image)
+{
+    for (int i = 0; i < image->task_count; i++) {
+        const task_config_t *config = &image->tasks[i];
+        for (int r = 0; r < config->rule_count; r++) {
+            const reflex_rule_t *rule = &config->rules[r];
+            if (rule->action != REFLEX_ACTION_GPIO) continue;
+            
+            for (int s = 0; s < image->sensor_count; s++) {
+                if (sensors_wiring_uses_pin(&image->sensors[s], rule->gpio)) {
+                    ESP_LOGE(TAG, "%s: GPIO %d is wired to sensor %s", rule->name, rule->gpio, image->sensors[s].id);
+                    return false;
+                }
+            }
+            for (int s = 0; s < sensors_instance_count(); s++) {
+                sensor_instance_t wiring;
+                sensors_get_wiring(s, &wiring);
+                if (sensors_wiring_uses_pin(&wiring, rule->gpio)) {
+                    ESP_LOGE(TAG, "%s: GPIO %d is wired to sensor %s", rule->name, rule->gpio, wiring.id);
+                    return false;
+                }
+            }
+            // Rules seen before this one, in this task and the earlier ones
+            for (int j = 0; j <= i; j++) {
+                const task_config_t *other = &image->tasks[j];
+                int end = j < i ? other->rule_count : r;
+                for (int k = 0; k < end; k++) {
+                    if (other->rules[k].action == REFLEX_ACTION_GPIO && other->rules[k].gpio == rule->gpio) {
+                        ESP_LOGE(TAG, "%s: GPIO %d is already driven by rule %s", rule->name, rule->gpio,
+                                 other->rules[k].name);
+                        return false;
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// Everything activation could trip over, checked before the running tasks
+// are stopped: an image is taken whole or not at all
+static bool image_valid(const config_image_t *image, size_t size)
+{
+    if (size < sizeof(*image) || image->version != CONFIG_IMAGE_VERSION ||
+        image->config_size != sizeof(task_config_t) ||
+        image->sensor_size != sizeof(sensor_instance_t) ||
+        image->mode_count < 1 || image->mode_count > MAX_MODES ||
+        image->initial_mode < 0 || image->initial_mode >= image->mode_count ||
+        image->sensor_count < 0 || image->sensor_count > MAX_SENSOR_INSTANCES ||
+        image->task_count < 0 || image->task_count > MAX_TASKS ||
+        size < CONFIG_IMAGE_SIZE(image->task_count)) {
+        ESP_LOGE(TAG, "Invalid config image");
+        return false;
+    }
+    
+    // Same outcome bind_sensor() will have, without registering anything yet
+    int added = 0;
+    for (int i = 0; i < image->sensor_count; i++) {
+        int idx = sensors_find_instance(image->sensors[i].id);
+        if (idx < 0) {
+            added++;
+            continue;
+        }
+        sensor_instance_t current;
+        sensors_get_wiring(idx, &current);
+        if (current.type != image->sensors[i].type) {
+            ESP_LOGE(TAG, "Sensor %s is already registered as another type", image->sensors[i].id);
+            return false;
+        }
+    }
+    if (sensors_instance_count() + added > MAX_SENSOR_INSTANCES) {
+        ESP_LOGE(TAG, "Sensor instance limit %d reached", MAX_SENSOR_INSTANCES);
+        return false;
+    }
+    
+    for (int i = 0; i < image->task_count; i++) {
+        if (!image_task_valid(image, &image->tasks[i])) {
+            ESP_LOGE(TAG, "Invalid task %d in config image", i);
+            return false;
+        }
+    }
+    if (!image_rule_pins_valid(image)) return false;
+    
+    float utilization[MAX_MODES] = {0};
+    for (int i = 0; i < image->task_count; i++) {
+        const task_config_t *config = &image->tasks[i];
+        if (admit_task(image, config, &utilization[config->mode]) != 0) return false;
+    }
+    return true;
+}
+
+int task_manager_activate(const config_image_t *image, size_t size)
+{
+    if (!image_valid(image, size)) return -1;
+    
+    task_manager_stop_all();
+    
+    int8_t sensor_map[MAX_SENSOR_INSTANCES];
+    for (int i = 0; i < image->sensor_count; i++) {
+        int idx = bind_sensor(&image->sensors[i]);
+        if (idx < 0) return -1;     // Not after image_valid()
+        sensor_map[i] = (int8_t)idx;
+    }
+    
+    memcpy(mode_names, image->mode_names, sizeof(mode_names));
+    mode_count = image->mode_count;
+    active_mode = image->initial_mode;
+    mode_start_us = esp_timer_get_time();
+    release_origin = xTaskGetTickCount();
+    
+    // Only running out of memory or FreeRTOS resources is left to fail here;
+    // a partial config would run tasks whose peers are missing
+    for (int i = 0; i < image->task_count; i++) {
+        if (create_task(&image->tasks[i], sensor_map) != 0) {
+            uart_log("CONFIG", "CONFIG_ERROR task %s could not be created\n", image->tasks[i].name);
+            task_manager_stop_all();
+            return -1;
+        }
+    }
+    return active_task_count;
+}
+
+int task_manager_parse_and_create(const char *json_config)
+{
+    size_t size;
+    config_image_t *image = task_manager_compile(json_config, &size);
+    if (!image) return -1;
+    
+    int created = task_manager_activate(image, size);
+    free(image);
+    return created;
+}
+
+// Hyperperiod (LCM of periods) of a mode's task set, in microseconds
+static uint64_t mode_hyperperiod_us(int mode)
+{
+    uint64_t lcm = 0;
+    for (int i = 0; i < active_task_count; i++) {
+        const task_config_t *config = task_runtimes[i].config;
+        if (config->mode != mode || config->period_ms <= 0) continue;
+        uint64_t p = (uint64_t)config->period_ms;
+        if (lcm == 0) {
+            lcm = p;
+            continue;
+        }
+        uint64_t a = lcm, b = p;
+        while (b) {
+            uint64_t t = a % b;
+            a = b;
+            b = t;
+        }
+        lcm = lcm / a * p;
+    }
+    return lcm * 1000;
+}
+
+// Flip the active mode and release its parked tasks; returns the time it took
+static int64_t apply_mode_switch(int mode)
+{
+    int64_t t0 = esp_timer_get_time();
+    
+    active_mode = mode;
+    mode_start_us = t0;
+    release_origin = xTaskGetTickCount();
+    for (int i = 0; i < active_task_count; i++) {
+        if (task_runtimes[i].config->mode == mode) {
+            xTaskNotifyGive(task_runtimes[i].handle);
+        }
+    }
+    
+    return esp_timer_get_time() - t0;
+}
+
+static void set_pending_mode(int mode)
+{
+    portENTER_CRITICAL(&mode_lock);
+    pending_mode = mode;
+    portEXIT_CRITICAL(&mode_lock);
+}
+
+static void mode_switch_timer_cb(void *arg)
+{
+    // Take the request first: a MODE or STOP racing the timer may have cleared it
+    portENTER_CRITICAL(&mode_lock);
+    int mode = pending_mode;
+    pending_mode = -1;
+    portEXIT_CRITICAL(&mode_lock);
+    if (mode < 0 || mode >= mode_count) return;
+    
+    int64_t elapsed = apply_mode_switch(mode);
+    
+    // The esp_timer task must not block on the link; the command task prints it
+    portENTER_CRITICAL(&mode_lock);
+    mode_report = mode;
+    mode_report_us = elapsed;
+    portEXIT_CRITICAL(&mode_lock);
+}
+
+void task_manager_flush_reports(void)
+{
+    portENTER_CRITICAL(&mode_lock);
+    int mode = mode_report;
+    int64_t elapsed = mode_report_us;
+    mode_report = -1;
+    portEXIT_CRITICAL(&mode_lock);
+    
+    if (mode >= 0) {
+        uart_log("MODE", "MODE_SWITCHED %s %lldus\n", mode_names[mode], (long long)elapsed);
+    }
+}
+
+int task_manager_switch_mode(const char *name, bool at_hyperperiod)
+{
+    int mode = find_mode(name);
+    if (mode < 0) {
+        ESP_LOGE(TAG, "Unknown mode %s", name);
+        return -1;
+    }
+    
+    esp_timer_stop(mode_switch_timer);
+    set_pending_mode(-1);
+    task_manager_flush_reports();   // An earlier deferred switch prints first
+    
+    if (mode == active_mode) return 0;
+    
+    uint64_t hyperperiod = at_hyperperiod ? mode_hyperperiod_us(active_mode) : 0;
+    if (hyperperiod == 0) {
+        int64_t elapsed = apply_mode_switch(mode);
+        uart_log("MODE", "MODE_SWITCHED %s %lldus\n", mode_names[mode], (long long)elapsed);
+        return 0;
+    }
+    
+    // Defer to the next hyperperiod boundary of the outgoing mode
+    uint64_t since = (uint64_t)(esp_timer_get_time() - mode_start_us);
+    uint64_t wait = hyperperiod - (since % hyperperiod);
+    set_pending_mode(mode);
+    esp_timer_start_once(mode_switch_timer, wait);
+    ESP_LOGI(TAG, "Mode %s scheduled in %lluus", name, (unsigned long long)wait);
+    return 0;
+}
+
+int task_manager_find_task(const char *name)
+{
+    for (int i = 0; i < active_task_count; i++) {
+        if (strcmp(task_runtimes[i].config->name, name) == 0) return i;
+    }
+    return -1;
+}
+
+const char *task_manager_task_name(int id)
+{
+    return (id >= 0 && id < active_task_count) ? task_runtimes[id].config->name : NULL;
+}
+
+bool task_manager_copy_task_name(int id, char *out, size_t size)
+{
+    bool found = false;
+    xSemaphoreTake(configs_mutex, portMAX_DELAY);
+    if (id >= 0 && id < active_task_count) {
+        strncpy(out, task_runtimes[id].config->name, size - 1);
+        out[size - 1] = '\0';
+        found = true;
+    }
+    xSemaphoreGive(configs_mutex);
+    return found;
+}
+
+int task_manager_task_count(void)
+{
+    return active_task_count;
+}
+
+int task_manager_get_stats(int id, task_stats_t *stats, uint32_t *overruns, uint32_t *throttled)
+{
+    if (id < 0 || id >= active_task_count) return -1;
+    
+    task_runtime_t *rt = &task_runtimes[id];
+    *stats = rt->stats;
+    *overruns = rt->overrun_count;
+    *throttled = rt->throttled_count;
+    return 0;
+}
+
+int task_manager_get_derived(int id, int index, derived_info_t *info)
+{
+    if (id < 0 || id >= active_task_count) return -1;
+    const task_runtime_t *rt = &task_runtimes[id];
+    const task_config_t *config = rt->config;
+    if (index < 0 || index >= config->derived_count) return -1;
+    
+    const derived_state_t *d = &rt->derived;
+    info->name = config->derived[index].name;
+    info->ops = config->derived[index].program.len;
+    info->depth = config->derived[index].program.depth;
+    info->value = d->vars[CHANNEL_COUNT + index];
+    info->evals = d->evals;
+    info->avg_ns = d->evals ? (uint32_t)(d->ns_sum[index] / d->evals) : 0;
+    info->max_ns = d->ns_max[index];
+    return 0;
+}
+
+int task_manager_get_detector(int id, int index, const detect_config_t **config, detect_state_t *state,
+                              uint32_t *avg_ns, uint32_t *max_ns, bool *boosted)
+{
+    if (id < 0 || id >= active_task_count) return -1;
+    const task_runtime_t *rt = &task_runtimes[id];
+    if (index < 0 || index >= rt->config->detector_count) return -1;
+    
+    *config = &rt->config->detectors[index];
+    *state = rt->detect[index];
+    *avg_ns = rt->detect_runs ? (uint32_t)(rt->detect_ns_sum / rt->detect_runs) : 0;
+    *max_ns = rt->detect_ns_max;
+    *boosted = effective_period_ms(rt) != rt->period_ms;
+    return 0;
+}
+
+int task_manager_set_let(int id, bool enabled)
+{
+    if (id < 0 || id >= active_task_count || !task_runtimes[id].let.timer) return -1;
+    task_runtimes[id].let.enabled = enabled;
+    return 0;
+}
+
+int task_manager_get_let(int id, bool *enabled, uint32_t *late)
+{
+    if (id < 0 || id >= active_task_count) return -1;
+    *enabled = task_runtimes[id].let.enabled;
+    *late = task_runtimes[id].let.late;
+    return 0;
+}
+
+int task_manager_set_spread(int id, bool enabled)
+{
+    if (id < 0 || id >= active_task_count) return -1;
+    task_runtimes[id].spread = enabled;
+    return 0;
+}
+
+int task_manager_get_spread(int id, bool *enabled, int *samples)
+{
+    if (id < 0 || id >= active_task_count) return -1;
+    const task_runtime_t *rt = &task_runtimes[id];
+    *enabled = rt->spread;
+    *samples = rt->spread ? spread_samples(rt->config, effective_period_ms(rt)) : SAMPLES_PER_READ;
+    return 0;
+}
+
+int task_manager_subscribe(int id, float max_hz, telemetry_encoding_t encoding, const char *fields)
+{
+    if (!(max_hz >= 0.0f) || (encoding != TELEMETRY_TEXT && encoding != TELEMETRY_COMPACT) ||
+        (fields && strlen(fields) >= SUB_FIELDS_LEN)) {
+        return -1;
+    }
+    task_subscription_t sub = { .active = true, .encoding = encoding, .max_hz = max_hz };
+    
+    if (id >= 0) {
+        if (id >= active_task_count ||
+            resolve_fields(task_runtimes[id].config, fields, true, &sub.field_mask, &sub.derived_mask) != 0) {
+            return -1;
+        }
+        set_subscription(&task_runtimes[id], &sub);
+        return 1;
+    }
+    
+    default_sub.active = true;
+    default_sub.max_hz = max_hz;
+    default_sub.encoding = encoding;
+    strncpy(default_sub.fields, fields ? fields : "", sizeof(default_sub.fields) - 1);
+    int subscribed = 0;
+    for (int i = 0; i < active_task_count; i++) {
+        task_subscription_t task_sub = sub;
+        task_sub.active = resolve_fields(task_runtimes[i].config, fields, false,
+                                         &task_sub.field_mask, &task_sub.derived_mask) == 0;
+        set_subscription(&task_runtimes[i], &task_sub);
+        subscribed += task_sub.active;
+    }
+    return subscribed;
+}
+
+int task_manager_unsubscribe(int id)
+{
+    const task_subscription_t none = { .active = false };
+    if (id >= 0) {
+        if (id >= active_task_count) return -1;
+        set_subscription(&task_runtimes[id], &none);
+        return 0;
+    }
+    default_sub.active = false;
+    for (int i = 0; i < active_task_count; i++) {
+        set_subscription(&task_runtimes[i], &none);
+    }
+    return 0;
+}
+
+int task_manager_get_subscription(int id, task_subscription_t *sub)
+{
+    if (id < 0 || id >= active_task_count) return -1;
+    portENTER_CRITICAL(&task_runtimes[id].sub_lock);
+    *sub = task_runtimes[id].sub;
+    portEXIT_CRITICAL(&task_runtimes[id].sub_lock);
+    return 0;
+}
+
+// The host went away: stop producing records nobody will read
+static void unsubscribe_all(void)
+{
+    task_manager_unsubscribe(-1);
+    ESP_LOGI(TAG, "Host disconnected, telemetry subscriptions cleared");
+}
+
+int task_manager_get_rule(int id, int index, reflex_rule_t *rule)
+{
+    if (id < 0 || id >= active_task_count) return -1;
+    const task_config_t *config = task_runtimes[id].config;
+    if (index < 0 || index >= config->rule_count) return -1;
+    *rule = config->rules[index];
+    return 0;
+}
+
+void task_manager_reset_rules(void)
+{
+    for (int i = 0; i < active_task_count; i++) {
+        task_config_t *config = task_runtimes[i].config;
+        for (int r = 0; r < config->rule_count; r++) {
+            reflex_reset_stats(&config->rules[r]);
+        }
+    }
+}
+
+void task_manager_reset_stats(void)
+{
+    for (int i = 0; i < active_task_count; i++) {
+        task_stats_reset(&task_runtimes[i].stats);
+        task_runtimes[i].overrun_count = 0;
+        task_runtimes[i].throttled_count = 0;
+        task_runtimes[i].let.late = 0;
+    }
+}
+
+const char *task_manager_active_mode(void)
+{
+    return mode_count > 0 ? mode_names[active_mode] : NULL;
+}
+
+void task_manager_stop_all(void)
+{
+    // Cycles in progress cut their sampling short; the tasks are deleted once
+    // parked or sleeping, when they hold no sensor mutex and no half-queued line
+    stopping = true;
+    wait_tasks_parked();
+    esp_timer_stop(mode_switch_timer);
+    set_pending_mode(-1);
+    task_manager_flush_reports();
+    
+    xSemaphoreTake(configs_mutex, portMAX_DELAY);
+    int count = active_task_count;
+    active_task_count = 0;      // Commands stop seeing the tasks before they go
+    mqtt_pub_clear();           // Queued samples would be published under the next config's names
+    for (int i = 0; i < count; i++) {
+        task_runtime_t *rt = &task_runtimes[i];
+        if (rt->handle) {
+            vTaskDelete(rt->handle);
+            rt->handle = NULL;
+        }
+        // Outputs go back to their inactive level with the task that drove them
+        release_rules(rt);
+        if (rt->let.timer) {
+            esp_timer_stop(rt->let.timer);
+            esp_timer_delete(rt->let.timer);
+            rt->let.timer = NULL;
+        }
+        free(rt->config);
+        rt->config = NULL;
+    }
+    xSemaphoreGive(configs_mutex);
+    mode_count = 0;
+    active_mode = 0;
+    telemetry_reset();
+    history_clear();            // Task ids are reused by the next config
+    stopping = false;
+    if (count > 0) ESP_LOGI(TAG, "All tasks stopped");
+}
+
+void uart_log(const char *task_name, const char *format, ...)
+{
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    
+    // The transport serializes writers, so lines never interleave
+    transport_write(buffer, strlen(buffer));
+}
+
+void uart_write_frame(const char *header, const void *payload, size_t len)
+{
+    transport_write_frame(header, strlen(header), payload, len);
 }
@@ -0,0 +1,62 @@
+#include "task_stats.h"
+#include <math.h>
+#include <string.h>
+
+static int bucket_of(uint32_t us)
+{
+    if (us < TASK_STATS_MIN_US) return 0;
+    int b = 1 + (int)(4.0f * log2f((float)us / TASK_STATS_MIN_US));
+    return b < TASK_STATS_BUCKETS ? b : TASK_STATS_BUCKETS - 1;
+}
+
+static uint32_t bucket_upper_us(int b)
+{
+    return (uint32_t)(TASK_STATS_MIN_US * exp2f(b / 4.0f));
+}
+
+void task_stats_reset(task_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+void task_stats_add(task_stats_t *stats, uint32_t response_us, uint32_t deadline_us)
+{
+    stats->jobs++;
+    stats->sum_us += response_us;
+    if (response_us > stats->max_us) stats->max_us = response_us;
+    if (response_us > deadline_us) stats->misses++;
+    
+    int b = bucket_of(response_us);
+    if (stats->hist[b] < UINT16_MAX) stats->hist[b]++;
+}
+
+void task_stats_add_output(task_stats_t *stats, uint32_t latency_us)
+{
+    if (stats->outputs == 0 || latency_us < stats->out_min_us) stats->out_min_us = latency_us;
+    if (latency_us > stats->out_max_us) stats->out_max_us = latency_us;
+    stats->out_sum_us += latency_us;
+    stats->outputs++;
+}
+
+uint32_t task_stats_output_jitter(const task_stats_t *stats)
+{
+    return stats->outputs ? stats->out_max_us - stats->out_min_us : 0;
+}
+
+uint32_t task_stats_percentile(const task_stats_t *stats, int pct)
+{
+    uint32_t total = 0;
+    for (int b = 0; b < TASK_STATS_BUCKETS; b++) total += stats->hist[b];
+    if (total == 0) return 0;
+    
+    uint32_t rank = (total * (uint32_t)pct + 99) / 100;
+    uint32_t seen = 0;
+    for (int b = 0; b < TASK_STATS_BUCKETS; b++) {
+        seen += stats->hist[b];
+        if (seen >= rank) {
+            uint32_t upper = bucket_upper_us(b);
+            return upper < stats->max_us ? upper : stats->max_us;
+        }
+    }
+    return stats->max_us;
+}
@@ -0,0 +1,358 @@
+#include "telemetry.h"
+#include "task_manager.h"
+#include "transport.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef CONFIG_TELEMETRY_TASK_PRIORITY
+#define CONFIG_TELEMETRY_TASK_PRIORITY 5
+#endif
+
+static const char *TAG = "Telemetry";
+
+// DRR quantum per unit of weight: one maximum-length line, so every visit to a
+// backlogged queue sends at least one line
+#define QUANTUM_BYTES TELEMETRY_MAX_LINE
+#define LEN_BYTES 2
+// The drop loop in telemetry_submit() relies on a longest line fitting an empty queue
+#if CONFIG_TELEMETRY_QUEUE_BYTES < TELEMETRY_MAX_LINE + LEN_BYTES
+#error "CONFIG_TELEMETRY_QUEUE_BYTES must hold at least one TELEMETRY_MAX_LINE line"
+#endif
+// A flooding task under SUMMARIZE reports its losses at most this often
+#define SUMMARY_INTERVAL_US 1000000
+
+static const char *const policy_names[] = { "drop_old", "drop_new", "summarize" };
+static const char *const encoding_names[] = { "TEXT", "COMPACT" };
+
+typedef struct {
+    bool used;
+    char name[MAX_TASK_NAME_LEN];
+    telemetry_config_t config;
+    uint8_t *buf;               // Ring of <len lo><len hi><line> records
+    uint32_t start;
+    uint32_t fill;
+    uint32_t deficit;
+    bool visited;               // Quantum already granted in the current round
+    uint32_t tokens;
+    int64_t refill_us;
+    uint32_t lost_lines;        // Dropped since the last summary (SUMMARIZE)
+    uint32_t lost_bytes;
+    int64_t lost_since_us;
+    telemetry_stats_t stats;
+} queue_t;
+
+static queue_t queues[MAX_TASKS];
+static int rr = 0;              // DRR position
+static int64_t stats_since_us = 0;
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t sender = NULL;
+
+void telemetry_default_config(telemetry_config_t *config)
+{
+    config->weight = 1;
+    config->critical = false;
+    config->policy = TELEMETRY_DROP_OLD;
+    config->rate_bps = 0;
+    config->burst = 0;
+}
+
+telemetry_policy_t telemetry_policy_from_name(const char *name)
+{
+    for (int i = 0; i < (int)(sizeof(policy_names) / sizeof(policy_names[0])); i++) {
+        if (strcmp(policy_names[i], name) == 0) return (telemetry_policy_t)i;
+    }
+    return (telemetry_policy_t)-1;
+}
+
+const char *telemetry_policy_name(telemetry_policy_t policy)
+{
+    return policy_names[policy];
+}
+
+telemetry_encoding_t telemetry_encoding_from_name(const char *name)
+{
+    for (int i = 0; i < (int)(sizeof(encoding_names) / sizeof(encoding_names[0])); i++) {
+        if (strcmp(encoding_names[i], name) == 0) return (telemetry_encoding_t)i;
+    }
+    return (telemetry_encoding_t)-1;
+}
+
+const char *telemetry_encoding_name(telemetry_encoding_t encoding)
+{
+    return encoding_names[encoding];
+}
+
+static void ring_copy_in(queue_t *q, uint32_t pos, const void *src, uint32_t len)
+{
+    pos %= CONFIG_TELEMETRY_QUEUE_BYTES;
+    uint32_t first = CONFIG_TELEMETRY_QUEUE_BYTES - pos;
+    if (first > len) first = len;
+    memcpy(q->buf + pos, src, first);
+    memcpy(q->buf, (const uint8_t *)src + first, len - first);
+}
+
+static void ring_copy_out(const queue_t *q, uint32_t pos, void *dst, uint32_t len)
+{
+    pos %= CONFIG_TELEMETRY_QUEUE_BYTES;
+    uint32_t first = CONFIG_TELEMETRY_QUEUE_BYTES - pos;
+    if (first > len) first = len;
+    memcpy(dst, q->buf + pos, first);
+    memcpy((uint8_t *)dst + first, q->buf, len - first);
+}
+
+static uint16_t head_len(const queue_t *q)
+{
+    uint8_t len[LEN_BYTES];
+    ring_copy_out(q, q->start, len, LEN_BYTES);
+    return (uint16_t)(len[0] | (len[1] << 8));
+}
+
+static uint16_t pop(queue_t *q, char *out)
+{
+    uint16_t len = head_len(q);
+    if (out) ring_copy_out(q, q->start + LEN_BYTES, out, len);
+    q->start = (q->start + LEN_BYTES + len) % CONFIG_TELEMETRY_QUEUE_BYTES;
+    q->fill -= LEN_BYTES + len;
+    return len;
+}
+
+static void count_drop(queue_t *q, uint32_t len, int64_t now)
+{
+    if (q->lost_lines == 0) q->lost_since_us = now;
+    q->lost_lines++;
+    q->lost_bytes += len;
+    q->stats.lines_dropped++;
+    q->stats.bytes_dropped += len;
+}
+
+void telemetry_submit(int task_id, const char *line, size_t len)
+{
+    if (len > TELEMETRY_MAX_LINE) len = TELEMETRY_MAX_LINE;
+    if (task_id < 0 || task_id >= MAX_TASKS || !queues[task_id].used) {
+        transport_write(line, len);
+        return;
+    }
+
+    int64_t now = esp_timer_get_time();
+    queue_t *q = &queues[task_id];
+    portENTER_CRITICAL(&lock);
+    uint32_t need = LEN_BYTES + (uint32_t)len;
+    if (q->fill + need > CONFIG_TELEMETRY_QUEUE_BYTES) {
+        if (q->config.policy == TELEMETRY_DROP_NEW) {
+            count_drop(q, len, now);
+            portEXIT_CRITICAL(&lock);
+            return;
+        }
+        while (q->fill + need > CONFIG_TELEMETRY_QUEUE_BYTES) {
+            count_drop(q, pop(q, NULL), now);
+        }
+    }
+    uint8_t len_bytes[LEN_BYTES] = { (uint8_t)len, (uint8_t)(len >> 8) };
+    uint32_t tail = q->start + q->fill;
+    ring_copy_in(q, tail, len_bytes, LEN_BYTES);
+    ring_copy_in(q, tail + LEN_BYTES, line, (uint32_t)len);
+    q->fill += need;
+    if (q->fill > q->stats.peak) q->stats.peak = q->fill;
+    portEXIT_CRITICAL(&lock);
+
+    if (sender) xTaskNotifyGive(sender);
+}
+
+// Token bucket: true when the head line may go now
+static bool may_send(queue_t *q, uint16_t len, int64_t now)
+{
+    if (q->config.rate_bps == 0) return true;
+    uint64_t add = (uint64_t)(now - q->refill_us) * q->config.rate_bps / 1000000;
+    if (add > 0) {
+        q->tokens = (uint32_t)(q->tokens + add > q->config.burst ? q->config.burst : q->tokens + add);
+        q->refill_us += (int64_t)(add * 1000000 / q->config.rate_bps);
+        if (q->tokens == q->config.burst) q->refill_us = now;
+    }
+    return q->tokens >= len;
+}
+
+typedef struct {
+    const char *name;
+    uint32_t lines;
+    uint32_t bytes;
+    uint32_t span_ms;
+} drop_summary_t;
+
+// Called under the lock: moves the next line into out and hands over what was
+// lost since the last summary once it spans SUMMARY_INTERVAL_US
+static int take(queue_t *q, char *out, drop_summary_t *summary, int64_t now)
+{
+    if (q->config.policy != TELEMETRY_SUMMARIZE) {
+        q->lost_lines = q->lost_bytes = 0;
+    } else if (q->lost_lines && now - q->lost_since_us >= SUMMARY_INTERVAL_US) {
+        summary->name = q->name;
+        summary->lines = q->lost_lines;
+        summary->bytes = q->lost_bytes;
+        summary->span_ms = (uint32_t)((now - q->lost_since_us) / 1000);
+        q->lost_lines = q->lost_bytes = 0;
+    }
+    uint16_t len = pop(q, out);
+    if (q->config.rate_bps) q->tokens -= len;
+    q->stats.lines_sent++;
+    q->stats.bytes_sent += len;
+    return len;
+}
+
+// Next line to write (out holds TELEMETRY_MAX_LINE), 0 if none may go now.
+// *throttled is set when lines are waiting only on token buckets.
+static int next_line(char *out, drop_summary_t *summary, bool *throttled)
+{
+    int64_t now = esp_timer_get_time();
+    int n = 0;
+    *throttled = false;
+    summary->lines = 0;
+
+    portENTER_CRITICAL(&lock);
+    for (int i = 0; i < MAX_TASKS; i++) {
+        queue_t *q = &queues[i];
+        if (!q->used || !q->config.critical || q->fill == 0) continue;
+        if (may_send(q, head_len(q), now)) {
+            n = take(q, out, summary, now);
+            goto done;
+        }
+        *throttled = true;
+    }
+
+    // Deficit round robin over the rest; each round grants a backlogged queue
+    // weight * QUANTUM_BYTES and serves it while its head line fits
+    for (int visits = 0; visits <= MAX_TASKS; visits++) {
+        queue_t *q = &queues[rr];
+        if (q->used && !q->config.critical && q->fill > 0) {
+            uint16_t len = head_len(q);
+            if (may_send(q, len, now)) {
+                if (!q->visited) {
+                    q->deficit += (uint32_t)q->config.weight * QUANTUM_BYTES;
+                    q->visited = true;
+                }
+                if (q->deficit >= len) {
+                    q->deficit -= len;
+                    n = take(q, out, summary, now);
+                    goto done;
+                }
+            } else {
+                *throttled = true;
+            }
+        }
+        // An idle or throttled queue does not bank credit
+        if (q->fill == 0 || !q->visited) q->deficit = 0;
+        q->visited = false;
+        rr = (rr + 1) % MAX_TASKS;
+    }
+done:
+    portEXIT_CRITICAL(&lock);
+    return n;
+}
+
+static void telemetry_sender(void *arg)
+{
+    char line[TELEMETRY_MAX_LINE];
+    char notice[MAX_TASK_NAME_LEN + 64];
+    drop_summary_t summary;
+    bool throttled;
+
+    while (1) {
+        int len = next_line(line, &summary, &throttled);
+        if (len == 0) {
+            ulTaskNotifyTake(pdTRUE, throttled ? 1 : portMAX_DELAY);
+            continue;
+        }
+        if (summary.lines) {
+            int n = snprintf(notice, sizeof(notice), "TXDROP %s lines=%lu bytes=%lu span=%lums\n",
+                             summary.name, (unsigned long)summary.lines, (unsigned long)summary.bytes,
+                             (unsigned long)summary.span_ms);
+            transport_write(notice, (size_t)n);
+        }
+        // Blocks while the link drains; producers keep queueing meanwhile
+        transport_write(line, (size_t)len);
+    }
+}
+
+void telemetry_init(void)
+{
+    stats_since_us = esp_timer_get_time();
+    if (xTaskCreate(telemetry_sender, "telemetry", 4096, NULL, CONFIG_TELEMETRY_TASK_PRIORITY,
+                    &sender) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create sender task, task output goes straight to the link");
+        sender = NULL;
+    }
+}
+
+int telemetry_configure(int task_id, const char *name, const telemetry_config_t *config)
+{
+    if (task_id < 0 || task_id >= MAX_TASKS || !sender) return -1;
+
+    queue_t *q = &queues[task_id];
+    // Buffers are kept across reloads, the slot count never exceeds MAX_TASKS
+    if (!q->buf) {
+        q->buf = malloc(CONFIG_TELEMETRY_QUEUE_BYTES);
+        if (!q->buf) return -1;
+    }
+
+    portENTER_CRITICAL(&lock);
+    strncpy(q->name, name, MAX_TASK_NAME_LEN - 1);
+    q->name[MAX_TASK_NAME_LEN - 1] = '\0';
+    q->config = *config;
+    // A bucket smaller than a line would never let the task send
+    if (config->rate_bps && q->config.burst < TELEMETRY_MAX_LINE) q->config.burst = TELEMETRY_MAX_LINE;
+    q->start = q->fill = 0;
+    q->deficit = 0;
+    q->visited = false;
+    q->tokens = q->config.burst;
+    q->refill_us = esp_timer_get_time();
+    q->lost_lines = q->lost_bytes = 0;
+    memset(&q->stats, 0, sizeof(q->stats));
+    q->used = true;
+    portEXIT_CRITICAL(&lock);
+    return 0;
+}
+
+void telemetry_release(int task_id)
+{
+    if (task_id < 0 || task_id >= MAX_TASKS) return;
+
+    portENTER_CRITICAL(&lock);
+    queues[task_id].used = false;
+    queues[task_id].fill = 0;
+    portEXIT_CRITICAL(&lock);
+}
+
+void telemetry_reset(void)
+{
+    portENTER_CRITICAL(&lock);
+    for (int i = 0; i < MAX_TASKS; i++) {
+        queues[i].used = false;
+        queues[i].fill = 0;
+    }
+    portEXIT_CRITICAL(&lock);
+}
+
+int telemetry_get_stats(int task_id, telemetry_stats_t *stats, telemetry_config_t *config)
+{
+    if (task_id < 0 || task_id >= MAX_TASKS || !queues[task_id].used) return -1;
+
+    portENTER_CRITICAL(&lock);
+    *stats = queues[task_id].stats;
+    stats->queued = queues[task_id].fill;
+    stats->elapsed_ms = (uint32_t)((esp_timer_get_time() - stats_since_us) / 1000);
+    if (config) *config = queues[task_id].config;
+    portEXIT_CRITICAL(&lock);
+    return 0;
+}
+
+void telemetry_reset_stats(void)
+{
+    portENTER_CRITICAL(&lock);
+    for (int i = 0; i < MAX_TASKS; i++) {
+        memset(&queues[i].stats, 0, sizeof(queues[i].stats));
+    }
+    stats_since_us = esp_timer_get_time();
+    portEXIT_CRITICAL(&lock);
+}
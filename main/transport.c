@@ -0,0 +1,120 @@
+#include "transport.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_rom_sys.h"
+#include "fault.h"
+#include "sdkconfig.h"
+#include <string.h>
+
+static const char *TAG = "Transport";
+
+static transport_t *const transports[] = {
+#if !CONFIG_IDF_TARGET_LINUX
+    &transport_uart,
+#endif
+    &transport_tcp,
+    &transport_file,
+};
+
+static transport_t *active = NULL;
+static SemaphoreHandle_t tx_mutex = NULL;
+static void (*disconnect_handler)(void) = NULL;
+
+static transport_t *find_transport(const char *name)
+{
+    for (size_t i = 0; i < sizeof(transports) / sizeof(transports[0]); i++) {
+        if (strcmp(transports[i]->name, name) == 0) return transports[i];
+    }
+    return NULL;
+}
+
+esp_err_t transport_init(void)
+{
+    tx_mutex = xSemaphoreCreateMutex();
+    if (!tx_mutex) return ESP_ERR_NO_MEM;
+    
+#if CONFIG_TRANSPORT_DEFAULT_TCP
+    return transport_select("tcp", NULL);
+#elif CONFIG_TRANSPORT_DEFAULT_FILE
+    return transport_select("file", NULL);
+#else
+    return transport_select("uart", NULL);
+#endif
+}
+
+esp_err_t transport_select(const char *name, const char *arg)
+{
+    transport_t *next = find_transport(name);
+    if (!next) {
+        ESP_LOGE(TAG, "Unknown transport %s", name);
+        return ESP_ERR_NOT_FOUND;
+    }
+    
+    xSemaphoreTake(tx_mutex, portMAX_DELAY);
+    esp_err_t err = next->open(next, arg);
+    if (err == ESP_OK) {
+        if (active && active != next) {
+            active->close(active);
+        }
+        active = next;
+        ESP_LOGI(TAG, "Using %s transport", name);
+    } else {
+        ESP_LOGE(TAG, "Failed to open %s transport: %s", name, esp_err_to_name(err));
+    }
+    xSemaphoreGive(tx_mutex);
+    return err;
+}
+
+const char *transport_active_name(void)
+{
+    return active ? active->name : "none";
+}
+
+int transport_read(void *buf, size_t len, TickType_t timeout)
+{
+    transport_t *source = active;
+#if !CONFIG_IDF_TARGET_LINUX
+    if (source && !source->read) {
+        source = &transport_uart;
+        source->open(source, NULL);
+    }
+#endif
+    if (!source || !source->read) {
+        vTaskDelay(timeout);
+        return 0;
+    }
+    return source->read(source, buf, len, timeout);
+}
+
+int transport_write(const void *buf, size_t len)
+{
+    return transport_write_frame(buf, len, NULL, 0);
+}
+
+int transport_write_frame(const void *header, size_t header_len, const void *payload, size_t len)
+{
+    if (!tx_mutex || !active) return -1;
+    
+    xSemaphoreTake(tx_mutex, portMAX_DELAY);
+    uint32_t stall_us;
+    if (fault_hit(FAULT_UART_STALL, active->name, &stall_us)) {
+        esp_rom_delay_us(stall_us);
+    }
+    int written = active->write(active, header, header_len);
+    if (written >= 0 && payload && len > 0) {
+        int n = active->write(active, payload, len);
+        written = n < 0 ? n : written + n;
+    }
+    xSemaphoreGive(tx_mutex);
+    return written;
+}
+
+void transport_set_disconnect_handler(void (*handler)(void))
+{
+    disconnect_handler = handler;
+}
+
+void transport_notify_disconnect(void)
+{
+    if (disconnect_handler) disconnect_handler();
+}
@@ -0,0 +1,53 @@
+#include "transport.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifndef CONFIG_TRANSPORT_FILE_PATH
+#define CONFIG_TRANSPORT_FILE_PATH "/tmp/esp32_telemetry.log"
+#endif
+
+static const char *TAG = "FileLink";
+
+// Output-only sink: telemetry is appended to a file or a named pipe.
+// Commands keep coming in over UART (see transport_read).
+static FILE *out = NULL;
+
+static esp_err_t file_open(transport_t *self, const char *arg)
+{
+    const char *path = arg ? arg : CONFIG_TRANSPORT_FILE_PATH;
+    FILE *f = fopen(path, "a");
+    if (!f) {
+        ESP_LOGE(TAG, "Cannot open %s", path);
+        return ESP_FAIL;
+    }
+    if (out) fclose(out);
+    out = f;
+    ESP_LOGI(TAG, "Writing telemetry to %s", path);
+    return ESP_OK;
+}
+
+static void file_close(transport_t *self)
+{
+    if (out) {
+        fclose(out);
+        out = NULL;
+    }
+}
+
+static int file_write(transport_t *self, const void *buf, size_t len)
+{
+    if (!out) return -1;
+    size_t n = fwrite(buf, 1, len, out);
+    fflush(out);
+    return (int)n;
+}
+
+transport_t transport_file = {
+    .name = "file",
+    .open = file_open,
+    .close = file_close,
+    .read = NULL,
+    .write = file_write,
+};
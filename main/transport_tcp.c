@@ -0,0 +1,159 @@
+#include "transport.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#if !CONFIG_IDF_TARGET_LINUX
+#include "esp_netif.h"
+#endif
+
+#ifndef CONFIG_TRANSPORT_TCP_PORT
+#define CONFIG_TRANSPORT_TCP_PORT 5555
+#endif
+
+static const char *TAG = "TCP";
+
+// Listens on a port and serves one client at a time. Needs a network
+// interface to be up (on the Linux host build this is the host's stack).
+static int listen_fd = -1;
+static int client_fd = -1;
+
+// Any interface up to listen on. The firmware brings none up itself, so on
+// hardware this only holds when something else (e.g. a Wi-Fi component) did.
+static bool netif_up(void)
+{
+#if CONFIG_IDF_TARGET_LINUX
+    return true;
+#else
+    for (esp_netif_t *netif = esp_netif_next_unsafe(NULL); netif; netif = esp_netif_next_unsafe(netif)) {
+        if (esp_netif_is_netif_up(netif)) return true;
+    }
+    return false;
+#endif
+}
+
+static void drop_client(void)
+{
+    if (client_fd >= 0) {
+        close(client_fd);
+        client_fd = -1;
+        ESP_LOGI(TAG, "Client disconnected");
+        transport_notify_disconnect();
+    }
+}
+
+static esp_err_t tcp_open(transport_t *self, const char *arg)
+{
+    int port = arg ? atoi(arg) : CONFIG_TRANSPORT_TCP_PORT;
+    if (port <= 0 || port > 65535) return ESP_ERR_INVALID_ARG;
+    if (!netif_up()) {
+        ESP_LOGE(TAG, "No network interface is up");
+        return ESP_ERR_INVALID_STATE;
+    }
+    
+    if (listen_fd >= 0) {
+        drop_client();
+        close(listen_fd);
+        listen_fd = -1;
+    }
+    
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return ESP_FAIL;
+    
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons((uint16_t)port);
+    
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 1) != 0) {
+        ESP_LOGE(TAG, "bind/listen on %d failed: errno %d", port, errno);
+        close(fd);
+        return ESP_FAIL;
+    }
+    
+    listen_fd = fd;
+    ESP_LOGI(TAG, "Listening on port %d", port);
+    return ESP_OK;
+}
+
+static void tcp_close(transport_t *self)
+{
+    drop_client();
+    if (listen_fd >= 0) {
+        close(listen_fd);
+        listen_fd = -1;
+    }
+}
+
+static int tcp_read(transport_t *self, void *buf, size_t len, TickType_t timeout)
+{
+    int fd = client_fd >= 0 ? client_fd : listen_fd;
+    if (fd < 0) {
+        vTaskDelay(timeout);
+        return 0;
+    }
+    
+    fd_set readable;
+    FD_ZERO(&readable);
+    FD_SET(fd, &readable);
+    struct timeval tv = {
+        .tv_sec = pdTICKS_TO_MS(timeout) / 1000,
+        .tv_usec = (pdTICKS_TO_MS(timeout) % 1000) * 1000,
+    };
+    if (select(fd + 1, &readable, NULL, NULL, &tv) <= 0) return 0;
+    
+    if (client_fd < 0) {
+        client_fd = accept(listen_fd, NULL, NULL);
+        if (client_fd >= 0) {
+            int one = 1;
+            setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            ESP_LOGI(TAG, "Client connected");
+        }
+        return 0;
+    }
+    
+    int n = recv(client_fd, buf, len, 0);
+    if (n <= 0) {
+        drop_client();
+        return 0;
+    }
+    return n;
+}
+
+// With no client connected output is discarded, like an unplugged serial cable
+static int tcp_write(transport_t *self, const void *buf, size_t len)
+{
+    if (client_fd < 0) return (int)len;
+    
+    const uint8_t *p = buf;
+    size_t left = len;
+    while (left > 0) {
+        int n = send(client_fd, p, left, 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            drop_client();
+            return (int)len;
+        }
+        p += n;
+        left -= (size_t)n;
+    }
+    return (int)len;
+}
+
+transport_t transport_tcp = {
+    .name = "tcp",
+    .open = tcp_open,
+    .close = tcp_close,
+    .read = tcp_read,
+    .write = tcp_write,
+};
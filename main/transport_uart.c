@@ -0,0 +1,54 @@
+#include "transport.h"
+#include "board.h"
+#include "esp_log.h"
+#include "driver/uart.h"
+
+#define UART_NUM UART_NUM_0
+#define UART_BUF_SIZE (4096)
+
+static const char *TAG = "UART";
+static bool installed = false;
+
+static esp_err_t uart_open(transport_t *self, const char *arg)
+{
+    if (installed) return ESP_OK;
+    
+    uart_config_t uart_config = {
+        .baud_rate = baudrate_uart,
+        .data_bits = UART_DATA_8_BITS,
+        .parity = UART_PARITY_DISABLE,
+        .stop_bits = UART_STOP_BITS_1,
+        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
+        .source_clk = UART_SCLK_DEFAULT,
+    };
+    
+    ESP_ERROR_CHECK(uart_param_config(UART_NUM, &uart_config));
+    ESP_ERROR_CHECK(uart_driver_install(UART_NUM, UART_BUF_SIZE * 2, 0, 0, NULL, 0));
+    installed = true;
+    
+    ESP_LOGI(TAG, "UART initialized at %d baud", baudrate_uart);
+    return ESP_OK;
+}
+
+// The driver stays installed: UART0 is also the console
+static void uart_close(transport_t *self)
+{
+}
+
+static int uart_read(transport_t *self, void *buf, size_t len, TickType_t timeout)
+{
+    return uart_read_bytes(UART_NUM, buf, len, timeout);
+}
+
+static int uart_write(transport_t *self, const void *buf, size_t len)
+{
+    return uart_write_bytes(UART_NUM, buf, len);
+}
+
+transport_t transport_uart = {
+    .name = "uart",
+    .open = uart_open,
+    .close = uart_close,
+    .read = uart_read,
+    .write = uart_write,
+};
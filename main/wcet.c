@@ -0,0 +1,227 @@
+#include "wcet.h"
+#include "calib.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if CONFIG_IDF_TARGET_LINUX
+#include <time.h>
+#else
+#include "esp_cpu.h"
+#endif
+
+static const char *TAG = "WCET";
+
+#define NAMESPACE "wcet"        // Not "calib": CALIBRATE CLEAR keeps the costs
+#define WCET_VERSION 1
+
+typedef struct {
+    char id[MAX_SENSOR_ID_LEN];
+    wcet_cost_t read;
+} sensor_cost_t;
+
+typedef struct {
+    uint32_t version;
+    uint32_t count;
+    sensor_cost_t sensors[MAX_SENSOR_INSTANCES];
+} sensor_table_t;
+
+typedef struct {
+    uint32_t version;
+    wcet_cost_t cpu;
+    wcet_cost_t wall;
+} task_record_t;
+
+// Reads measured per sensor type, spaced like the averaging loops in sensors.c
+static const int sensor_iterations[SENSOR_NONE] = {
+    [SENSOR_DHT11]      = 20,
+    [SENSOR_ULTRASONIC] = 50,
+    [SENSOR_MPU6050]    = 100,
+};
+
+static sensor_table_t table;
+
+typedef struct {
+    void (*op)(void *arg);
+    void *arg;
+    int iterations;
+    int gap_ms;
+    uint32_t *cpu_us;
+    uint32_t *wall_us;
+    TaskHandle_t caller;
+} measure_job_t;
+
+// CPU cycles on the target (per core, hence the pinned worker), ns on the host build
+static uint32_t clock_now(void)
+{
+#if CONFIG_IDF_TARGET_LINUX
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec);
+#else
+    return esp_cpu_get_cycle_count();
+#endif
+}
+
+static uint32_t clock_to_us(uint32_t ticks)
+{
+#if CONFIG_IDF_TARGET_LINUX
+    return ticks / 1000;
+#else
+    return ticks / CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ;
+#endif
+}
+
+static void measure_worker(void *arg)
+{
+    measure_job_t *job = (measure_job_t *)arg;
+    for (int i = 0; i < job->iterations; i++) {
+        // The kernel folds the running slice into the run time counter on a switch
+        taskYIELD();
+        uint32_t cpu0 = (uint32_t)ulTaskGetRunTimeCounter(NULL);
+        uint32_t t0 = clock_now();
+        job->op(job->arg);
+        uint32_t t1 = clock_now();
+        taskYIELD();
+        job->cpu_us[i] = (uint32_t)ulTaskGetRunTimeCounter(NULL) - cpu0;
+        job->wall_us[i] = clock_to_us(t1 - t0);
+        if (job->gap_ms > 0 && i < job->iterations - 1) vTaskDelay(pdMS_TO_TICKS(job->gap_ms));
+    }
+    xTaskNotifyGive(job->caller);
+    vTaskDelete(NULL);
+}
+
+static int compare_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void summarize(uint32_t *values, int n, wcet_cost_t *cost)
+{
+    qsort(values, n, sizeof(values[0]), compare_u32);
+    cost->n = (uint32_t)n;
+    cost->p50_us = values[(n * 50 + 99) / 100 - 1];
+    cost->p99_us = values[(n * 99 + 99) / 100 - 1];
+    cost->max_us = values[n - 1];
+}
+
+int wcet_measure(void (*op)(void *arg), void *arg, int iterations, int gap_ms,
+                 wcet_cost_t *cpu, wcet_cost_t *wall)
+{
+    if (iterations < 1) return -1;
+    uint32_t *samples = malloc(2 * iterations * sizeof(uint32_t));
+    if (!samples) return -1;
+
+    measure_job_t job = {
+        .op = op,
+        .arg = arg,
+        .iterations = iterations,
+        .gap_ms = gap_ms,
+        .cpu_us = samples,
+        .wall_us = samples + iterations,
+        .caller = xTaskGetCurrentTaskHandle(),
+    };
+    if (xTaskCreatePinnedToCore(measure_worker, "wcet", 4096, &job, configMAX_PRIORITIES - 2, NULL, 0) != pdPASS) {
+        free(samples);
+        return -1;
+    }
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    if (cpu) summarize(job.cpu_us, iterations, cpu);
+    if (wall) summarize(job.wall_us, iterations, wall);
+    free(samples);
+    return 0;
+}
+
+static void read_once(void *arg)
+{
+    sensor_readings_t readings;
+    read_sensor_averaged((sensor_instance_t *)arg, 1, &readings, NULL, NULL, NULL);
+}
+
+bool wcet_init(void)
+{
+    if (calib_blob_load(NAMESPACE, 'w', "sensors", &table, sizeof(table)) != 0 || table.version != WCET_VERSION) {
+        memset(&table, 0, sizeof(table));
+        return false;
+    }
+    ESP_LOGI(TAG, "Loaded costs of %lu sensors", (unsigned long)table.count);
+    return true;
+}
+
+int wcet_calibrate_sensors(void)
+{
+    sensor_table_t fresh = { .version = WCET_VERSION };
+    for (int i = 0; i < sensors_instance_count() && i < MAX_SENSOR_INSTANCES; i++) {
+        sensor_instance_t *sensor = sensors_get_instance(i);
+        if (sensor->type >= SENSOR_NONE) continue;
+        sensor_cost_t *entry = &fresh.sensors[fresh.count];
+        strncpy(entry->id, sensor->id, MAX_SENSOR_ID_LEN - 1);
+        // Wall time: the reads hold the sensor for their whole duration, sleeping or not
+        if (wcet_measure(read_once, sensor, sensor_iterations[sensor->type],
+                         sensor_min_gap_ms(sensor->type), NULL, &entry->read) != 0) {
+            ESP_LOGE(TAG, "%s: measurement failed", sensor->id);
+            return -1;
+        }
+        ESP_LOGI(TAG, "%s: p50=%luus p99=%luus max=%luus", sensor->id, (unsigned long)entry->read.p50_us,
+                 (unsigned long)entry->read.p99_us, (unsigned long)entry->read.max_us);
+        fresh.count++;
+    }
+    table = fresh;
+    return calib_blob_save(NAMESPACE, 'w', "sensors", &table, sizeof(table));
+}
+
+static int find_cost(const char *id, wcet_cost_t *cost)
+{
+    for (uint32_t i = 0; i < table.count; i++) {
+        if (strcmp(table.sensors[i].id, id) == 0) {
+            *cost = table.sensors[i].read;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int wcet_sensor_cost(int instance, wcet_cost_t *cost)
+{
+    sensor_instance_t *sensor = sensors_get_instance(instance);
+    return sensor ? find_cost(sensor->id, cost) : -1;
+}
+
+static void add_cost(wcet_cost_t *sum, uint32_t p50_us, uint32_t p99_us, uint32_t max_us)
+{
+    sum->n = 0;                 // Estimated, not measured
+    sum->p50_us += p50_us;
+    sum->p99_us += p99_us;
+    sum->max_us += max_us;
+}
+
+int wcet_estimate_read(const sensor_instance_t *sensor, int samples, wcet_cost_t *cpu, wcet_cost_t *wall)
+{
+    wcet_cost_t one;
+    if (!sensor || samples < 1 || find_cost(sensor->id, &one) != 0) return -1;
+    uint32_t n = (uint32_t)samples;
+    // DHT and ultrasonic reads busy-wait on their pins; counting the I2C
+    // transfers as CPU time too keeps the estimate an upper bound
+    add_cost(cpu, one.p50_us * n, one.p99_us * n, one.max_us * n);
+    uint32_t sleep_us = (n - 1) * (uint32_t)sensor_min_gap_ms(sensor->type) * 1000;
+    add_cost(wall, one.p50_us * n + sleep_us, one.p99_us * n + sleep_us, one.max_us * n + sleep_us);
+    return 0;
+}
+
+int wcet_task_load(const char *task_name, wcet_cost_t *cpu, wcet_cost_t *wall)
+{
+    task_record_t record;
+    if (calib_blob_load(NAMESPACE, 'c', task_name, &record, sizeof(record)) != 0 || record.version != WCET_VERSION) return -1;
+    *cpu = record.cpu;
+    *wall = record.wall;
+    return 0;
+}
+
+int wcet_task_save(const char *task_name, const wcet_cost_t *cpu, const wcet_cost_t *wall)
+{
+    task_record_t record = { .version = WCET_VERSION, .cpu = *cpu, .wall = *wall };
+    return calib_blob_save(NAMESPACE, 'c', task_name, &record, sizeof(record));
+}
@@ -0,0 +1,202 @@
+#!/usr/bin/env python3
+"""
+Benchmark suite: runs the loaded configuration under a series of fault
+scenarios and reports how response-time tails and deadline misses degrade
+against a fault-free baseline.
+
+Each scenario is a list of [offset_s, command] steps sent during the run
+(normally FAULT rules) plus a duration. Before every scenario the suite clears
+all faults, reseeds the fault generator and resets the task statistics, so
+runs with the same seed are repeatable. Scenarios can be replaced with a JSON
+file of the same shape as SCENARIOS below.
+
+A scenario with a "let" key switches every task's output mode first (LET ON
+or OFF), so the same contention can be compared with outputs published on
+completion and at the deadline. Output jitter (jit) is the peak-to-peak
+spread of the latency from release to the record reaching the link.
+
+Likewise a "spread" key switches every task between its samples in one burst
+per cycle and spread over the period (SPREAD ON / OFF). Each scenario also
+reports the sensor mutex contention from LOCKS: the share of sample reads that
+had to wait for another task's read, and how long.
+"""
+
+import argparse
+import json
+import sys
+import time
+
+from link import open_link
+
+SCENARIOS = [
+    {"name": "baseline", "seconds": 20, "steps": []},
+    {"name": "latency spikes", "seconds": 20, "steps": [
+        [0, "FAULT LATENCY * 50 8000"],
+    ]},
+    {"name": "i2c nack", "seconds": 20, "steps": [
+        [0, "FAULT FAIL mpu6050 100 500"],
+    ]},
+    {"name": "echo stuck", "seconds": 20, "steps": [
+        [0, "FAULT ECHO_STUCK ultrasonic 100 0"],
+    ]},
+    {"name": "uart stall", "seconds": 20, "steps": [
+        [0, "FAULT UART_STALL * 20 20000"],
+    ]},
+    {"name": "jitter", "seconds": 20, "let": False, "steps": [
+        [0, "FAULT LATENCY * 30 8000"],
+    ]},
+    {"name": "jitter let", "seconds": 20, "let": True, "steps": [
+        [0, "FAULT LATENCY * 30 8000"],
+    ]},
+    {"name": "combined", "seconds": 30, "steps": [
+        [0, "FAULT LATENCY * 20 5000"],
+        [5, "FAULT FAIL mpu6050 50 500"],
+        [10, "FAULT ECHO_STUCK ultrasonic 50 0"],
+        [15, "FAULT UART_STALL * 10 20000"],
+    ]},
+    {"name": "burst", "seconds": 20, "spread": False, "steps": []},
+    {"name": "spread", "seconds": 20, "spread": True, "steps": []},
+]
+
+STATS_KEYS = ("jobs", "miss", "err", "ovr", "thr", "avg", "p50", "p90", "p99", "max", "out", "jit")
+LOCKS_KEYS = ("takes", "contended", "avg", "max")
+
+
+def send(port, command, timeout=2.0, collect=None):
+    """Send one command and wait for its OK/ERROR reply.
+
+    Lines starting with `collect` seen before the reply are returned.
+    """
+    name = command.split()[0]
+    port.write((command + "\n").encode())
+    lines = []
+    deadline = time.time() + timeout
+    while time.time() < deadline:
+        line = port.readline().decode("utf-8", errors="ignore").strip()
+        if collect and line.startswith(collect):
+            lines.append(line)
+        elif line == f"OK {name}":
+            return True, lines
+        elif line == f"ERROR {name}":
+            return False, lines
+    return False, lines
+
+
+def parse_stats(lines, keys=STATS_KEYS):
+    """STATS <task> key=value... (or LOCKS <sensor> ...) -> {name: {key: int}}"""
+    stats = {}
+    for line in lines:
+        fields = line.split()
+        if len(fields) < 3:
+            continue
+        values = {}
+        for field in fields[2:]:
+            key, _, value = field.partition("=")
+            if key in keys:
+                values[key] = int(value.rstrip("us") or 0)
+        stats[fields[1]] = values
+    return stats
+
+
+def run_scenario(port, scenario, seed):
+    # Records are only formatted for a subscribed host, as with the GUI open
+    setup = ["SUB * 0", "FAULT CLEAR", f"FAULT SEED {seed}"]
+    if "let" in scenario:
+        setup.append("LET * " + ("ON" if scenario["let"] else "OFF"))
+    if "spread" in scenario:
+        setup.append("SPREAD * " + ("ON" if scenario["spread"] else "OFF"))
+    setup += ["STATS RESET", "LOCKS RESET"]
+    for command in setup:
+        ok, _ = send(port, command)
+        if not ok:
+            raise RuntimeError(f"{command} rejected")
+
+    start = time.time()
+    steps = sorted(scenario.get("steps", []), key=lambda s: s[0])
+    end = start + scenario["seconds"]
+    for offset, command in steps:
+        while time.time() < start + offset:
+            port.readline()
+        ok, _ = send(port, command)
+        if not ok:
+            print(f"  {command!r} rejected", file=sys.stderr)
+    while time.time() < end:
+        port.readline()
+
+    ok, lines = send(port, "STATS", collect="STATS ")
+    locks_ok, lock_lines = send(port, "LOCKS", collect="LOCKS ")
+    send(port, "FAULT CLEAR")
+    if not ok:
+        raise RuntimeError("STATS rejected")
+    if not locks_ok:
+        raise RuntimeError("LOCKS rejected")
+    return parse_stats(lines), parse_stats(lock_lines, LOCKS_KEYS)
+
+
+def ratio(value, base):
+    if not base:
+        return "-"
+    return f"x{value / base:.1f}"
+
+
+def report(results):
+    baseline = results[0][1] if results else {}
+    print(f"\n{'scenario':<16} {'task':<12} {'jobs':>6} {'miss':>6} {'err':>5} "
+          f"{'p50us':>8} {'p99us':>8} {'maxus':>8} {'p99/base':>9} {'miss+':>6} "
+          f"{'outus':>8} {'jitus':>8}")
+    for name, stats, _ in results:
+        for task, s in stats.items():
+            base = baseline.get(task, {})
+            print(f"{name:<16} {task:<12} {s.get('jobs', 0):>6} {s.get('miss', 0):>6} "
+                  f"{s.get('err', 0):>5} {s.get('p50', 0):>8} {s.get('p99', 0):>8} "
+                  f"{s.get('max', 0):>8} {ratio(s.get('p99', 0), base.get('p99')):>9} "
+                  f"{s.get('miss', 0) - base.get('miss', 0):>+6} "
+                  f"{s.get('out', 0):>8} {s.get('jit', 0):>8}")
+
+    print(f"\n{'scenario':<16} {'sensor':<12} {'takes':>7} {'waited':>7} {'wait%':>6} {'avgus':>8} {'maxus':>8}")
+    for name, _, locks in results:
+        for sensor, l in locks.items():
+            if not l.get("takes"):
+                continue
+            share = 100.0 * l.get("contended", 0) / l["takes"]
+            print(f"{name:<16} {sensor:<12} {l['takes']:>7} {l.get('contended', 0):>7} {share:>5.1f}% "
+                  f"{l.get('avg', 0):>8} {l.get('max', 0):>8}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Measure latency tails under injected faults")
+    parser.add_argument("--port", required=True,
+                        help="Serial port (e.g. /dev/ttyUSB0) or tcp:<host>:<port>")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--scenarios", help="JSON file with a list of scenarios")
+    parser.add_argument("--only", action="append", help="Run only the named scenario (repeatable)")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--seconds", type=float, help="Override every scenario's duration")
+    parser.add_argument("--json", help="Write raw results to this file")
+    args = parser.parse_args()
+
+    scenarios = SCENARIOS
+    if args.scenarios:
+        with open(args.scenarios) as f:
+            scenarios = json.load(f)
+    if args.only:
+        scenarios = [s for s in scenarios if s["name"] in args.only]
+
+    results = []
+    with open_link(args.port, args.baud) as port:
+        port.reset_input_buffer()
+        for scenario in scenarios:
+            if args.seconds:
+                scenario = dict(scenario, seconds=args.seconds)
+            print(f"Running {scenario['name']} for {scenario['seconds']:.0f}s...")
+            results.append((scenario["name"], *run_scenario(port, scenario, args.seed)))
+
+    report(results)
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump([{"scenario": n, "tasks": s, "locks": l} for n, s, l in results], f, indent=2)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
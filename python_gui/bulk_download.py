@@ -0,0 +1,128 @@
+#!/usr/bin/env python3
+"""
+Bulk download of the ESP32's recorded history.
+
+Sends DUMP (LZ4-compressed frames) or DUMP TEXT (one line per sample) and
+decodes the stream on the fly. With --compare both paths are run back to back
+and their effective transfer rates are printed side by side.
+"""
+
+import argparse
+import csv
+import sys
+import time
+import zlib
+
+from link import open_link
+from telemetry_codec import decode_history_stream, lz4_block_decompress
+
+
+class BulkResult:
+    def __init__(self, mode):
+        self.mode = mode
+        self.task_names = {}
+        self.samples = []       # (task, timestamp_ms, {channel: value})
+        self.wire_bytes = 0
+        self.raw_bytes = 0
+        self.crc_errors = 0
+        self.elapsed = 0.0
+        self.device_summary = ""
+
+    def task(self, task_id):
+        return self.task_names.get(task_id, str(task_id))
+
+    def report(self):
+        rate = len(self.samples) / self.elapsed if self.elapsed > 0 else 0.0
+        throughput = self.wire_bytes / self.elapsed if self.elapsed > 0 else 0.0
+        print(f"[{self.mode}] {len(self.samples)} samples, {self.wire_bytes} bytes on the wire "
+              f"in {self.elapsed:.2f}s -> {rate:.0f} samples/s, {throughput:.0f} B/s"
+              + (f", {self.crc_errors} bad frames" if self.crc_errors else ""))
+        if self.device_summary:
+            print(f"[{self.mode}] device: {self.device_summary}")
+
+
+def run_dump(port, compressed, timeout=600.0):
+    result = BulkResult("lz4" if compressed else "text")
+    port.reset_input_buffer()
+    start = time.time()
+    port.write(b"DUMP\n" if compressed else b"DUMP TEXT\n")
+
+    while time.time() - start < timeout:
+        raw_line = port.readline()
+        if not raw_line:
+            continue
+        result.wire_bytes += len(raw_line)
+        line = raw_line.decode("utf-8", errors="ignore").strip()
+
+        if line.startswith("BULK_TASK "):
+            _, task_id, name = line.split(" ", 2)
+            result.task_names[int(task_id)] = name
+        elif line.startswith("BULK_FRAME "):
+            _, raw_len, sent_len, crc = line.split()
+            raw_len, sent_len = int(raw_len), int(sent_len)
+            payload = port.read(sent_len)
+            result.wire_bytes += len(payload)
+            if len(payload) != sent_len or zlib.crc32(payload) != int(crc, 16):
+                result.crc_errors += 1
+                continue
+            data = payload if sent_len == raw_len else lz4_block_decompress(payload, raw_len)
+            result.raw_bytes += raw_len
+            for task_id, ts, values in decode_history_stream(data):
+                result.samples.append((result.task(task_id), ts, values))
+        elif line.startswith("BULK_SAMPLE "):
+            parts = line.split()
+            values = {}
+            for field in parts[3:]:
+                name, _, value = field.partition("=")
+                values[name] = float(value)
+            result.samples.append((result.task(int(parts[1])), int(parts[2]), values))
+        elif line.startswith("BULK_END"):
+            result.device_summary = line[len("BULK_END "):]
+            break
+
+    result.elapsed = time.time() - start
+    return result
+
+
+def write_csv(result, filename):
+    channels = sorted({ch for _, _, values in result.samples for ch in values})
+    with open(filename, "w", newline="") as f:
+        writer = csv.writer(f)
+        writer.writerow(["task", "timestamp_ms"] + channels)
+        for task, ts, values in result.samples:
+            writer.writerow([task, ts] + [values.get(ch, "") for ch in channels])
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Download recorded telemetry from the ESP32")
+    parser.add_argument("--port", required=True,
+                        help="Serial port (e.g. /dev/ttyUSB0) or tcp:<host>:<port>")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--text", action="store_true", help="Use the uncompressed text path")
+    parser.add_argument("--compare", action="store_true", help="Run text and compressed paths and compare")
+    parser.add_argument("--out", help="Write samples to this CSV file")
+    args = parser.parse_args()
+
+    with open_link(args.port, args.baud) as port:
+        if args.compare:
+            text = run_dump(port, compressed=False)
+            packed = run_dump(port, compressed=True)
+            text.report()
+            packed.report()
+            if packed.elapsed > 0 and text.elapsed > 0:
+                speedup = (len(packed.samples) / packed.elapsed) / max(len(text.samples) / text.elapsed, 1e-9)
+                print(f"compressed path is {speedup:.1f}x faster per sample "
+                      f"({text.wire_bytes / max(packed.wire_bytes, 1):.1f}x fewer bytes)")
+            result = packed
+        else:
+            result = run_dump(port, compressed=not args.text)
+            result.report()
+
+    if args.out:
+        write_csv(result, args.out)
+        print(f"Wrote {len(result.samples)} samples to {args.out}")
+    return 0 if result.crc_errors == 0 else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
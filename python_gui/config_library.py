@@ -0,0 +1,88 @@
+#!/usr/bin/env python3
+"""
+Manage the ESP32's config library (LIB command).
+
+The device compiles an uploaded JSON config and keeps the result in a flash
+slot under a name. Loading an entry later replaces the running tasks without
+an upload or a JSON parse, and one entry can be marked to start at boot.
+
+    config_library.py --port /dev/ttyUSB0 list
+    config_library.py --port /dev/ttyUSB0 install indoor config_example.json
+    config_library.py --port /dev/ttyUSB0 load indoor
+    config_library.py --port /dev/ttyUSB0 boot indoor      (or: boot NONE)
+    config_library.py --port /dev/ttyUSB0 erase indoor
+"""
+
+import argparse
+import json
+import sys
+import time
+
+from link import open_link
+
+
+def reply(port, collect="LIB ", timeout=5.0):
+    """Lines starting with `collect` until OK / ERROR LIB -> (ok, lines)"""
+    lines = []
+    deadline = time.time() + timeout
+    while time.time() < deadline:
+        line = port.readline().decode("utf-8", errors="ignore").strip()
+        if line == "OK LIB":
+            return True, lines
+        if line == "ERROR LIB":
+            return False, lines
+        if line.startswith(collect):
+            lines.append(line)
+    raise TimeoutError("no answer to LIB")
+
+
+def install(port, name, config, timeout=5.0):
+    port.write(f"LIB INSTALL {name}\n".encode())
+    deadline = time.time() + timeout
+    while time.time() < deadline:
+        if port.readline().decode("utf-8", errors="ignore").strip() == "READY":
+            break
+    else:
+        raise TimeoutError("device did not answer READY")
+    # Same pacing as the GUI upload: END must arrive in a read of its own
+    port.write(json.dumps(config, separators=(",", ":")).encode())
+    time.sleep(0.5)
+    port.write(b"END\n")
+    # Compiling and writing the flash slot takes a moment
+    return reply(port, timeout=30.0)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="List, install and load configs stored on the ESP32")
+    parser.add_argument("--port", required=True,
+                        help="Serial port (e.g. /dev/ttyUSB0) or tcp:<host>:<port>")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("action", choices=["list", "install", "load", "erase", "boot"])
+    parser.add_argument("entry", nargs="?", help="Slot number or name (NONE for boot clears it)")
+    parser.add_argument("config", nargs="?", help="JSON config file for install")
+    args = parser.parse_args()
+
+    if args.action != "list" and not args.entry:
+        parser.error(f"{args.action} needs a slot or name")
+    if args.action == "install" and not args.config:
+        parser.error("install needs a JSON config file")
+
+    with open_link(args.port, args.baud) as port:
+        port.reset_input_buffer()
+        if args.action == "install":
+            with open(args.config) as f:
+                ok, lines = install(port, args.entry, json.load(f))
+        else:
+            command = "LIB" if args.action == "list" else f"LIB {args.action.upper()} {args.entry}"
+            port.write((command + "\n").encode())
+            ok, lines = reply(port, timeout=10.0)
+
+    for line in lines:
+        print(line)
+    if not ok:
+        print(f"device rejected LIB {args.action}", file=sys.stderr)
+    return 0 if ok else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -2,7 +2,8 @@
 """
 ESP32 Dynamic Task Configuration Manager with Gantt Chart Visualization
 Tkinter UI for creating, loading, and sending task configurations to ESP32
-Real-time Gantt chart showing task execution timeline
+Real-time Gantt chart showing task execution timeline, overlaid on the
+schedule predicted by schedule_sim.py for the configured tasks
 """
 
 import tkinter as tk
@@ -11,16 +12,33 @@ import json
 import serial
 import serial.tools.list_ports
 import threading
+import multiprocessing
 import time
 from datetime import datetime
 from collections import defaultdict, deque
 import re
+from bisect import bisect_left
 
 import matplotlib
 matplotlib.use('TkAgg')
 from matplotlib.backends.backend_tkagg import FigureCanvasTkAgg
 from matplotlib.figure import Figure
 import matplotlib.pyplot as plt
+from matplotlib.patches import Patch
+
+import schedule_sim
+
+# Seconds of schedule first predicted from activation; a 32-task config takes
+# about a quarter of a second to simulate this far. Predictions run in a worker
+# process so the GUI keeps its interpreter. The prediction is extended (same
+# seed, so the same schedule) to fill the chart window and then as the observed
+# timeline approaches its end, up to PREDICT_MAX_SECONDS.
+PREDICT_SECONDS = 5.0
+PREDICT_MAX_SECONDS = 160.0
+
+# Milliseconds to wait for OK SUB before sending SUB * 0 again
+SUBSCRIBE_RETRY_MS = 1000
+SUBSCRIBE_ATTEMPTS = 5
 
 
 class TaskExecutionTracker:
@@ -54,10 +72,7 @@ class TaskExecutionTracker:
         if self.start_time is None:
             self.start_time = timestamp
             
-        # Assign color to new tasks
-        if task_name not in self.task_colors:
-            self.task_colors[task_name] = self.color_palette[self.next_color_idx % len(self.color_palette)]
-            self.next_color_idx += 1
+        self.color(task_name)
             
         # Store relative time
         relative_time = timestamp - self.start_time
@@ -70,6 +85,18 @@ class TaskExecutionTracker:
         while self.task_events[task_name] and self.task_events[task_name][0] < cutoff_time:
             self.task_events[task_name].popleft()
             
+    def color(self, task_name):
+        """Color of a task, assigned on first use"""
+        if task_name not in self.task_colors:
+            self.task_colors[task_name] = self.color_palette[self.next_color_idx % len(self.color_palette)]
+            self.next_color_idx += 1
+        return self.task_colors[task_name]
+        
+    def mark_start(self, timestamp=None):
+        """Restart the timeline at the moment the tasks were created"""
+        self.task_events.clear()
+        self.start_time = timestamp if timestamp is not None else time.time()
+        
     def get_gantt_data(self):
         """Get data formatted for Gantt chart plotting"""
         if not self.start_time:
@@ -92,6 +119,48 @@ class TaskExecutionTracker:
         return data, (start_window, current_time)
 
 
+def simulate_timeline(config, duration_s, baud, costs):
+    """Worker process: simulate a config and reduce it to plain, picklable data,
+    ({task: [(start, width)]}, {task: [(finish, missed)]}, summary, seconds taken)"""
+    start = time.time()
+    _, sim, result = schedule_sim.simulate(config, duration_s=duration_s, baud=baud, costs=costs,
+                                           trace_s=duration_s)
+    segments = defaultdict(list)
+    finishes = defaultdict(list)
+    names = [t.name for t in sim.tasks]
+    for index, _, start_us, end_us in sorted(sim.segments, key=lambda seg: seg[2]):
+        segments[names[index]].append((start_us / 1e6, (end_us - start_us) / 1e6))
+    for t in sim.tasks:
+        for release_us, finish_us in t.jobs:
+            if finish_us is not None:
+                missed = finish_us - release_us > t.period_ms * 1000
+                finishes[t.name].append((finish_us / 1e6, missed))
+    return dict(segments), dict(finishes), result, time.time() - start
+
+
+class SchedulePrediction:
+    """Predicted timeline of a config, in seconds from task creation"""
+    
+    def __init__(self, segments, finishes, result, duration_s):
+        self.duration_s = duration_s
+        self.result = result
+        self.segments = segments            # task -> [(start, width)] while running
+        self.finishes = finishes            # task -> [(finish, missed)]
+            
+    @property
+    def misses(self):
+        return {t['name']: t['deadline_misses'] for t in self.result['tasks'] if t['deadline_misses']}
+        
+    def window(self, task_name, start, end):
+        """(segments, finishes) of a task inside [start, end]"""
+        segments = self.segments.get(task_name, [])
+        lo = bisect_left(segments, (start - 1.0,))
+        finishes = self.finishes.get(task_name, [])
+        f_lo = bisect_left(finishes, (start,))
+        return ([seg for seg in segments[lo:] if seg[0] < end and seg[0] + seg[1] > start],
+                [f for f in finishes[f_lo:] if f[0] <= end])
+
+
 class TaskConfigApp:
     def __init__(self, root):
         self.root = root
@@ -99,14 +168,24 @@ class TaskConfigApp:
         self.root.geometry("1400x900")
         
         self.tasks = []
+        self.config_extras = {}  # Top-level config keys other than "tasks" (e.g. "sensors")
         self.serial_port = None
         self.serial_thread = None
         self.running = False
+        self.subscribe_attempts = 0     # SUB * 0 sent and not yet answered
         
         self.tracker = TaskExecutionTracker(time_window=10.0)
         self.gantt_update_interval = 200  # ms
         
+        self.prediction = None
+        self.prediction_config = None   # Config the prediction was made for
+        self.predict_generation = 0
+        self.predicting = False
+        self.predict_pool = None        # Worker process for the simulations
+        self.sim_costs = None           # wcet_fetch.py --out overrides of the cost model
+        
         self.setup_ui()
+        self.start_predict_pool()
         self.start_gantt_updates()
         
     def setup_ui(self):
@@ -169,6 +248,11 @@ class TaskConfigApp:
         time_entry.pack(side=tk.LEFT, padx=2)
         ttk.Label(control_frame, text="seconds").pack(side=tk.LEFT, padx=2)
         ttk.Button(control_frame, text="Apply", command=self.update_time_window).pack(side=tk.LEFT, padx=5)
+        ttk.Button(control_frame, text="Predict", command=self.predict_schedule).pack(side=tk.LEFT, padx=5)
+        ttk.Button(control_frame, text="Costs...", command=self.load_costs).pack(side=tk.LEFT, padx=2)
+        
+        self.predict_label = ttk.Label(control_frame, text="No prediction", foreground="gray")
+        self.predict_label.pack(side=tk.LEFT, padx=5)
         
         # Initial empty chart
         self.update_gantt_chart()
@@ -308,16 +392,44 @@ class TaskConfigApp:
             self.serial_thread.start()
             
             self.log_message("Connected to " + port)
+            # A device already running a config takes the subscription now;
+            # one still waiting for its config (opening the port often resets
+            # it) drops the line, so it is sent again on TASKS_CREATED
+            self.subscribe()
             
         except Exception as e:
             messagebox.showerror("Connection Error", f"Failed to connect: {str(e)}")
             
+    def subscribe(self):
+        """Ask for every task's records (SUB * 0), resending until OK SUB"""
+        self.subscribe_attempts = SUBSCRIBE_ATTEMPTS
+        self.send_subscription()
+        
+    def send_subscription(self):
+        if not self.subscribe_attempts or not self.serial_port or not self.serial_port.is_open:
+            return
+        self.subscribe_attempts -= 1
+        try:
+            # The device only sends the records of subscribed tasks; this also
+            # covers the tasks of configs sent later
+            self.serial_port.write(b"SUB * 0\n")
+        except serial.SerialException:
+            return
+        self.root.after(SUBSCRIBE_RETRY_MS, self.send_subscription)
+        
     def disconnect(self):
         self.running = False
+        self.subscribe_attempts = 0
         if self.serial_thread:
             self.serial_thread.join(timeout=1)
         
         if self.serial_port:
+            try:
+                # A serial port cannot tell the device the host went away
+                self.serial_port.write(b"UNSUB *\n")
+                self.serial_port.flush()
+            except serial.SerialException:
+                pass
             self.serial_port.close()
             
         self.status_label.config(text="Disconnected", foreground="red")
@@ -339,6 +451,18 @@ class TaskConfigApp:
             
     def parse_task_event(self, line):
         """Parse log line to extract task execution events"""
+        # The tasks start now: align the observed timeline with the prediction
+        if line == "TASKS_CREATED":
+            self.tracker.mark_start()
+            # The device was waiting for a config and ignored any earlier SUB
+            self.subscribe()
+            return
+        if line == "OK SUB":
+            if self.subscribe_attempts:
+                self.subscribe_attempts = 0
+                self.log_message("Subscribed to every task's records")
+            return
+            
         # Look for pattern: [TaskName] ...
         match = re.match(r'\[([^\]]+)\]', line)
         if match:
@@ -385,6 +509,7 @@ class TaskConfigApp:
             var.set(False)
             
         self.log_message(f"Added task: {name}")
+        self.predict_schedule()
         
     def remove_task(self):
         selected = self.task_tree.selection()
@@ -395,6 +520,7 @@ class TaskConfigApp:
         self.task_tree.delete(selected[0])
         del self.tasks[idx]
         self.log_message(f"Removed task at index {idx}")
+        self.predict_schedule()
         
     def clear_tasks(self):
         if messagebox.askyesno("Confirm", "Clear all tasks?"):
@@ -402,6 +528,7 @@ class TaskConfigApp:
             for item in self.task_tree.get_children():
                 self.task_tree.delete(item)
             self.log_message("Cleared all tasks")
+            self.predict_schedule()
             
     def load_config(self):
         filename = filedialog.askopenfilename(
@@ -417,6 +544,7 @@ class TaskConfigApp:
                 config = json.load(f)
                 
             self.clear_tasks()
+            self.config_extras = {k: v for k, v in config.items() if k != "tasks"}
             
             for task in config.get("tasks", []):
                 self.tasks.append(task)
@@ -428,6 +556,7 @@ class TaskConfigApp:
                 ))
                 
             self.log_message(f"Loaded config from {filename}")
+            self.predict_schedule()
             messagebox.showinfo("Success", f"Loaded {len(self.tasks)} tasks")
             
         except Exception as e:
@@ -448,7 +577,7 @@ class TaskConfigApp:
             return
             
         try:
-            config = {"tasks": self.tasks}
+            config = {**self.config_extras, "tasks": self.tasks}
             with open(filename, 'w') as f:
                 json.dump(config, f, indent=2)
                 
@@ -467,11 +596,17 @@ class TaskConfigApp:
             messagebox.showwarning("No Tasks", "No tasks to send")
             return
             
+        config = {**self.config_extras, "tasks": self.tasks}
+        if self.prediction and self.prediction_config == config and self.prediction.misses:
+            missing = ", ".join(f"{name} ({n})" for name, n in self.prediction.misses.items())
+            if not messagebox.askyesno("Predicted Deadline Misses",
+                                       f"The predicted schedule misses deadlines: {missing}.\n\nSend anyway?"):
+                return
+            
         try:
             # Reset tracker when sending new config
             self.tracker.reset()
             
-            config = {"tasks": self.tasks}
             json_str = json.dumps(config, separators=(',', ':'))
             
             self.log_message("Sending START signal...")
@@ -514,6 +649,88 @@ class TaskConfigApp:
             except Exception as e:
                 messagebox.showerror("Save Error", f"Failed to save log: {str(e)}")
                 
+    def predict_schedule(self, duration_s=PREDICT_SECONDS):
+        """Simulate the configured tasks in the background and show the predicted timeline"""
+        config = {**self.config_extras, "tasks": [dict(t) for t in self.tasks]}
+        self.predict_generation += 1
+        generation = self.predict_generation
+        if self.predicting and self.predict_pool is not None:
+            # The outdated simulation would hold up this one: drop its process
+            self.predict_pool.terminate()
+            self.predict_pool = None
+        if not config["tasks"] and "modes" not in config:
+            self.prediction = None
+            self.predicting = False
+            self.predict_label.config(text="No prediction", foreground="gray")
+            return
+        self.predicting = True
+        if duration_s == PREDICT_SECONDS:
+            self.predict_label.config(text="Predicting...", foreground="gray")
+        
+        costs = {k: dict(v) for k, v in schedule_sim.DEFAULT_COSTS.items()}
+        for sensor, overrides in (self.sim_costs or {}).items():
+            costs.setdefault(sensor, {}).update(overrides)
+        baud = int(self.baud_var.get()) if self.baud_var.get().isdigit() else 115200
+        
+        def done(timeline):
+            segments, finishes, result, elapsed = timeline
+            prediction = SchedulePrediction(segments, finishes, result, duration_s)
+            self.root.after(0, self.show_prediction, generation, config, prediction, elapsed)
+            
+        def failed(e):
+            self.root.after(0, self.show_prediction, generation, config, None, str(e))
+            
+        self.start_predict_pool()
+        self.predict_pool.apply_async(simulate_timeline, (config, duration_s, baud, costs),
+                                      callback=done, error_callback=failed)
+        
+    def start_predict_pool(self):
+        """Start the simulation worker ahead of use: a spawned worker imports this module first"""
+        # Spawned, not forked: the GUI has threads and an open serial port
+        if self.predict_pool is None:
+            self.predict_pool = multiprocessing.get_context("spawn").Pool(1)
+            
+    def show_prediction(self, generation, config, prediction, detail):
+        if generation != self.predict_generation:
+            return  # The task list changed while simulating
+        self.predicting = False
+        extended = prediction is not None and self.prediction_config == config and \
+            prediction.duration_s > PREDICT_SECONDS
+        self.prediction = prediction
+        self.prediction_config = config
+        if prediction is None:
+            self.predict_label.config(text="Prediction failed", foreground="red")
+            self.log_message(f"Prediction failed: {detail}")
+            return
+            
+        # A longer prediction can find misses the first seconds did not have
+        misses = prediction.misses
+        self.predict_label.config(text=f"{len(misses)} task(s) miss deadlines" if misses else "Feasible",
+                                  foreground="red" if misses else "green")
+        if extended:
+            return
+            
+        self.log_message(f"Predicted {prediction.duration_s:.0f}s of schedule in {detail * 1000:.0f}ms")
+        for t in prediction.result['tasks']:
+            self.log_message(f"  {t['name']}: p99 {t['p99_ms']:.1f}ms / period {t['period_ms']}ms, "
+                             f"misses {t['deadline_misses']}/{t['jobs']}, cpu {t['cpu_pct']:.1f}%")
+            
+    def load_costs(self):
+        """Use measured sensor costs (wcet_fetch.py --out) in the predictions"""
+        filename = filedialog.askopenfilename(
+            title="Load Sensor Costs",
+            filetypes=[("JSON files", "*.json"), ("All files", "*.*")]
+        )
+        if not filename:
+            return
+        try:
+            with open(filename, 'r') as f:
+                self.sim_costs = json.load(f)
+            self.log_message(f"Loaded sensor costs from {filename}")
+            self.predict_schedule()
+        except Exception as e:
+            messagebox.showerror("Load Error", f"Failed to load costs: {str(e)}")
+            
     def reset_gantt(self):
         """Reset Gantt chart data"""
         self.tracker.reset()
@@ -540,54 +757,75 @@ class TaskConfigApp:
         self.ax.clear()
         
         data, time_range = self.tracker.get_gantt_data()
-        
-        if not data:
+        prediction = self.prediction
+        if not data and prediction:
+            # Nothing observed yet: show the start of the predicted schedule
+            time_range = (0, self.tracker.time_window)
+        if prediction and not self.predicting and prediction.duration_s < PREDICT_MAX_SECONDS:
+            # Predict the whole chart window, and a window ahead of the records
+            horizon = time_range[1] + self.tracker.time_window if data else time_range[1]
+            if horizon > prediction.duration_s:
+                self.predict_schedule(min(prediction.duration_s * 2, PREDICT_MAX_SECONDS))
+        
+        if not data and not prediction:
             self.ax.text(0.5, 0.5, 'Waiting for task execution data...',
                         ha='center', va='center', transform=self.ax.transAxes,
                         fontsize=12, color='gray')
             self.ax.set_xlim(0, 10)
             self.ax.set_ylim(0, 1)
         else:
-            # Plot each task's events
-            y_pos = 0
+            observed = {d['task']: d['events'] for d in data}
+            predicted = [t['name'] for t in prediction.result['tasks']] if prediction else []
+            task_names = sorted(set(observed) | set(predicted))
+            
+            # Each row: predicted run segments and job finishes on top,
+            # observed records underneath
             y_labels = []
             y_ticks = []
             
-            bar_height = 0.8
-            
-            for task_data in data:
-                task_name = task_data['task']
-                events = task_data['events']
-                color = task_data['color']
+            for y_pos, task_name in enumerate(task_names):
+                color = self.tracker.color(task_name)
+                
+                if prediction:
+                    segments, finishes = prediction.window(task_name, *time_range)
+                    if segments:
+                        self.ax.broken_barh(segments, (y_pos - 0.42, 0.38), facecolors=color, alpha=0.35)
+                    if finishes:
+                        self.ax.vlines([f for f, _ in finishes], y_pos - 0.42, y_pos - 0.04,
+                                       colors=['red' if missed else 'black' for _, missed in finishes],
+                                       linewidth=0.8)
                 
-                # Plot each event as a small bar
-                for event_time in events:
+                events = observed.get(task_name)
+                if events:
                     # Show as 50ms bar (visual representation)
-                    self.ax.barh(y_pos, 0.05, left=event_time, height=bar_height,
-                               color=color, alpha=0.7, edgecolor='black', linewidth=0.5)
+                    self.ax.broken_barh([(t, 0.05) for t in events], (y_pos + 0.04, 0.38),
+                                        facecolors=color, alpha=0.7, edgecolor='black', linewidth=0.5)
                 
                 y_labels.append(task_name)
                 y_ticks.append(y_pos)
-                y_pos += 1
             
             # Set labels and limits
             self.ax.set_yticks(y_ticks)
             self.ax.set_yticklabels(y_labels, fontsize=9)
-            self.ax.set_xlabel('Time (seconds)', fontsize=10)
-            self.ax.set_title('Real-Time Task Execution Timeline', fontsize=12, fontweight='bold')
+            self.ax.set_xlabel('Time since tasks created (seconds)', fontsize=10)
+            self.ax.set_title('Predicted vs Observed Task Timeline', fontsize=12, fontweight='bold')
+            self.ax.set_ylim(len(task_names) - 0.5, -0.5)
             
             # Set x-axis range
             if time_range[1] > time_range[0]:
                 self.ax.set_xlim(time_range[0], time_range[1])
             else:
                 self.ax.set_xlim(0, self.tracker.time_window)
+            if prediction and time_range[1] > prediction.duration_s:
+                self.ax.axvline(prediction.duration_s, color='gray', linestyle=':', linewidth=1)
                 
             # Grid
             self.ax.grid(True, axis='x', alpha=0.3, linestyle='--')
             self.ax.set_axisbelow(True)
             
-            # Invert y-axis so first task is on top
-            self.ax.invert_yaxis()
+            self.ax.legend(handles=[Patch(facecolor='gray', alpha=0.35, label='predicted (top, red = missed)'),
+                                    Patch(facecolor='gray', alpha=0.7, label='observed records')],
+                           loc='upper right', fontsize=8)
         
         self.fig.tight_layout()
         self.canvas.draw()
@@ -595,6 +833,8 @@ class TaskConfigApp:
     def on_closing(self):
         if self.serial_port and self.serial_port.is_open:
             self.disconnect()
+        if self.predict_pool is not None:
+            self.predict_pool.terminate()
         self.root.destroy()
 
 
@@ -0,0 +1,510 @@
+#!/usr/bin/env python3
+"""
+Config optimizer: searches task priorities, periods and phase offsets.
+
+Takes a task config (the JSON the GUI uploads) plus, per task, the range its
+period may take and how much the task matters. It looks for the assignment
+that gives:
+
+- the most slack to the deadlines
+- the fastest rates for the important tasks
+- the least overlap between tasks sampling the same sensor
+
+It varies three things:
+
+- priorities, on the levels --priorities allows (1-10, as in the GUI)
+- periods, on the 10 ms tick within each task's bounds
+- offset_ms, the task's first release after the mode starts, which staggers
+  tasks sharing a sensor so their sampling bursts do not meet
+
+Candidates are scored analytically, hundreds per second, from the cost model
+of schedule_sim.py:
+
+- a response-time analysis in the style of global fixed-priority RTA over
+  both cores, with self-suspension as release jitter and blocking on the
+  sensor mutexes and DHT11 critical sections
+- the overlap of the sampling windows on each sensor, from the periods and
+  offsets
+
+The analysis is an estimate rather than a proof. The best few candidates are
+then run in schedule_sim.py. The one with the fewest simulated deadline
+misses is written out as a ready-to-send config, with its predicted metrics.
+
+Bounds file (tasks not listed keep their period and have the weight of "*",
+default 1):
+
+    {"ObstacleAvoid": {"period_ms": [100, 300], "weight": 4},
+     "EnvLog": {"period_ms": [1000, 5000]}}
+"""
+
+import argparse
+import copy
+import json
+import math
+import random
+import sys
+import time
+
+import schedule_sim
+from schedule_sim import BITS_PER_BYTE, LOG_FORMAT_US, SAMPLES_PER_READ, TICK_US, log_line_bytes, ms_to_ticks
+
+TICK_MS = TICK_US // 1000
+RESPONSE_CAP = 4                # Stop iterating once a response passes this many periods
+INFEASIBLE_PENALTY = 10.0
+OVERLAP_EXACT_STEPS = 16       # Phase steps summed exactly in overlap_rate
+
+
+class Demand:
+    """One cycle of a task at a given period"""
+
+    def __init__(self):
+        self.cpu_us = 0
+        self.suspend_us = 0         # Sample spacing, I2C transfers, UART drain
+        self.resumes = 0            # Wake-ups after a suspension
+        self.samples = []           # (samples per cycle, resources each sample holds)
+        self.holds = {}             # resource -> hold time of one sample
+        self.crit_us = 0            # Non-preemptible section per sample (DHT11)
+        self.crit_count = 0
+        self.windows = []           # (resource, instance, start_us, length_us, period_us) from the release
+
+
+class TaskModel:
+    """Per-cycle demand of one task from schedule_sim's cost model (worst case of the jitter)"""
+
+    def __init__(self, sim_task, spec, costs, i2c_port, us_per_byte):
+        self.name = sim_task.name
+        self.sensors = sim_task.sensors     # [(type, instance)]
+        self.spread = sim_task.spread
+        self.budget_us = sim_task.budget_us
+        self.costs = costs
+        self.i2c_port = i2c_port
+        self.line_us = int(log_line_bytes(self.name, sim_task.fields) * us_per_byte)
+        adaptive = spec.get("adaptive")
+        # An adaptive task may run at its minimum period whatever period_ms says
+        self.min_period_ms = adaptive["min_period_ms"] if adaptive else None
+        self.cache = {}
+
+    def sample(self, kind, instance):
+        """(cpu_us, io_us, resources held) of one sample"""
+        c = self.costs[kind]
+        if kind == "dht11":
+            return c["crit_us"] + c["jitter_us"], 0, [instance]
+        if kind == "ultrasonic":
+            return c["busy_us"] + c["us_per_cm"] * c["distance_cm"] + c["jitter_us"], 0, [instance]
+        bus = f"i2c{self.i2c_port.get(instance, 0)}"
+        return c["cpu_us"] + c["jitter_us"] // 2, c["io_us"] + c["jitter_us"], [instance, bus]
+
+    def spread_samples(self, period_ms):
+        gap_ms = max(self.costs[kind]["gap_ms"] for kind, _ in self.sensors) if self.sensors else 0
+        n = SAMPLES_PER_READ
+        if gap_ms > 0:
+            n = min(n, period_ms // gap_ms)
+        return max(1, min(n, ms_to_ticks(period_ms)))
+
+    def demand(self, period_ms):
+        if period_ms in self.cache:
+            return self.cache[period_ms]
+        d = Demand()
+        period_us = ms_to_ticks(period_ms) * TICK_US
+        if self.spread:
+            n = self.spread_samples(period_ms)
+            slot_us = ms_to_ticks(period_ms) // n * TICK_US
+            offset = 0
+            for kind, instance in self.sensors:
+                cpu, io, held = self.sample(kind, instance)
+                d.cpu_us += n * cpu
+                d.suspend_us += n * io
+                d.samples.append((n, held))
+                for r in held:
+                    d.holds[r] = max(d.holds.get(r, 0), cpu + io)
+                    d.windows.append((r, instance, offset, cpu + io, slot_us))
+                offset += cpu + io
+            d.suspend_us += (n - 1) * slot_us
+            d.resumes = n
+        else:
+            offset = 0
+            for kind, instance in self.sensors:
+                cpu, io, held = self.sample(kind, instance)
+                gap_us = ms_to_ticks(self.costs[kind]["gap_ms"]) * TICK_US
+                n = SAMPLES_PER_READ
+                length = n * (cpu + io) + (n - 1) * gap_us
+                d.cpu_us += n * cpu
+                d.suspend_us += n * io + (n - 1) * gap_us
+                d.resumes += n
+                d.samples.append((n, held))
+                for r in held:
+                    d.holds[r] = max(d.holds.get(r, 0), cpu + io)
+                    d.windows.append((r, instance, offset, length, period_us))
+                offset += length
+        for (kind, instance), (count, _) in zip(self.sensors, d.samples):
+            if kind == "dht11":
+                d.crit_us = max(d.crit_us, self.sample(kind, instance)[0])
+                d.crit_count += count
+        d.cpu_us += LOG_FORMAT_US
+        if self.budget_us:
+            d.cpu_us = min(d.cpu_us, self.budget_us)
+        d.suspend_us += self.line_us
+        self.cache[period_ms] = d
+        return d
+
+
+class Problem:
+    def __init__(self, config, mode, bounds, costs, cores, baud, levels, rate_weight, contention_weight):
+        self.config = config
+        self.mode, sim_tasks, i2c_port = schedule_sim.load_tasks(config, mode)
+        self.specs = self.task_specs(config)
+        self.cores = cores
+        self.baud = baud
+        self.costs = costs
+        self.levels = levels
+        self.rate_weight = rate_weight
+        self.contention_weight = contention_weight
+        us_per_byte = BITS_PER_BYTE * 1_000_000 / baud
+        self.models = [TaskModel(t, spec, costs, i2c_port, us_per_byte)
+                       for t, spec in zip(sim_tasks, self.specs)]
+
+        self.weights = []
+        self.period_range = []
+        for spec in self.specs:
+            b = bounds.get(spec["name"], {})
+            self.weights.append(float(b.get("weight", bounds.get("*", {}).get("weight", 1.0))))
+            lo, hi = b.get("period_ms", (spec["period_ms"], spec["period_ms"]))
+            # Periods on the tick, as the firmware rounds them
+            lo = max(TICK_MS, -(-lo // TICK_MS) * TICK_MS)
+            hi = max(lo, hi // TICK_MS * TICK_MS)
+            self.period_range.append((lo, hi))
+
+    def task_specs(self, config):
+        if "modes" in config:
+            names = [m["name"] for m in config["modes"]]
+            return config["modes"][names.index(self.mode)]["tasks"][:32]
+        return config.get("tasks", [])[:32]
+
+    # ------------------------------------------------------------------
+    # States: (periods, priorities, offsets), one entry per task
+
+    def initial(self):
+        periods, prios, offsets = [], [], []
+        for spec, (lo, hi) in zip(self.specs, self.period_range):
+            period = min(max(spec["period_ms"], lo), hi)
+            periods.append(period)
+            prios.append(min(max(spec["priority"], self.levels[0]), self.levels[1]))
+            offset = (spec.get("offset_ms", 0) or 0) // TICK_MS * TICK_MS
+            offsets.append(offset if offset < period else 0)
+        return tuple(periods), tuple(prios), tuple(offsets)
+
+    def rate_monotonic(self, state):
+        """Shorter period = higher priority (heavier weight first among equals), spread over the levels"""
+        periods, _, offsets = state
+        n = len(periods)
+        order = sorted(range(n), key=lambda i: (periods[i], -self.weights[i]))
+        lo, hi = self.levels
+        span = hi - lo + 1
+        prios = [0] * n
+        for rank, i in enumerate(order):
+            prios[i] = hi - (rank * span // n if n > span else rank)
+        return periods, tuple(prios), offsets
+
+    def mutate(self, state, rng):
+        periods, prios, offsets = (list(x) for x in state)
+        n = len(periods)
+        i = rng.randrange(n)
+        move = rng.random()
+        lo, hi = self.period_range[i]
+        if move < 0.35 and hi > lo:
+            if rng.random() < 0.2:
+                periods[i] = rng.randrange(lo, hi + 1, TICK_MS)
+            else:
+                step = rng.choice((1, 2, 5, 10)) * TICK_MS * rng.choice((-1, 1))
+                periods[i] = min(max(periods[i] + step, lo), hi)
+            if offsets[i] >= periods[i]:
+                offsets[i] = offsets[i] % periods[i] // TICK_MS * TICK_MS
+        elif move < 0.7:
+            if rng.random() < 0.5 and n > 1:
+                j = rng.randrange(n)
+                prios[i], prios[j] = prios[j], prios[i]
+            else:
+                prios[i] = min(max(prios[i] + rng.choice((-1, 1)), self.levels[0]), self.levels[1])
+        else:
+            offsets[i] = rng.randrange(0, periods[i], TICK_MS)
+        return tuple(periods), tuple(prios), tuple(offsets)
+
+    # ------------------------------------------------------------------
+    # Analytical evaluation
+
+    def response_times(self, state):
+        periods, prios, _ = state
+        n = len(periods)
+        demand = [m.demand(p) for m, p in zip(self.models, periods)]
+        T = [ms_to_ticks(p) * TICK_US for p in periods]
+        for i, m in enumerate(self.models):
+            if m.min_period_ms:
+                T[i] = min(T[i], ms_to_ticks(m.min_period_ms) * TICK_US)
+        R = [None] * n
+        for k in sorted(range(n), key=lambda i: -prios[i]):
+            d = demand[k]
+            # Equal priorities share the core by time slicing: count them as higher
+            hp = [i for i in range(n) if i != k and prios[i] >= prios[k]]
+            lp = [i for i in range(n) if prios[i] < prios[k]]
+            # One lower-priority sample ahead of each of ours on a shared mutex
+            # (priority inheritance bounds it to one); the sensor and its I2C
+            # bus are held together, so the longer of the two counts
+            blocking = 0
+            for count, held in d.samples:
+                blocking += count * max((demand[j].holds.get(r, 0) for j in lp for r in held), default=0)
+            crit_lp = [(demand[j].crit_us, demand[j].crit_count, T[j]) for j in lp if demand[j].crit_us]
+            crit_max = max((c for c, _, _ in crit_lp), default=0)
+
+            base = d.cpu_us + d.suspend_us + blocking
+            r = base
+            while True:
+                interference = 0
+                for i in hp:
+                    # Suspensions let a job's CPU demand arrive late: release jitter
+                    done = R[i] if R[i] is not None else T[i]
+                    jitter = max(0, min(done, T[i]) - demand[i].cpu_us)
+                    workload = math.ceil((r + jitter) / T[i]) * demand[i].cpu_us
+                    interference += min(workload, r - d.cpu_us + 1)
+                # A DHT11 read of a lower-priority task can hold a core at each wake-up
+                crit = min(d.resumes + 1, sum(math.ceil(r / t) * c for _, c, t in crit_lp)) * crit_max
+                new = base + (interference + crit) // self.cores
+                if new <= r or new > RESPONSE_CAP * T[k]:
+                    r = max(new, r)
+                    break
+                r = new
+            R[k] = r
+        return R, T
+
+    def contention(self, state):
+        """Weighted overlap of sampling windows per shared resource, summed over
+        pairs of tasks, in seconds per second"""
+        periods, _, offsets = state
+        by_res = {}
+        for i, (m, p) in enumerate(zip(self.models, periods)):
+            offset_us = ms_to_ticks(offsets[i]) * TICK_US
+            for res, instance, start, length, period_us in m.demand(p).windows:
+                by_res.setdefault(res, []).append((i, instance, (offset_us + start, length, period_us)))
+        result = {}
+        for res, windows in by_res.items():
+            total = 0.0
+            for a in range(len(windows)):
+                for b in range(a + 1, len(windows)):
+                    (ia, inst_a, wa), (ib, inst_b, wb) = windows[a], windows[b]
+                    # Two readers of one MPU6050 already meet on the sensor's own mutex
+                    if ia == ib or (inst_a == inst_b and res != inst_a):
+                        continue
+                    w = (self.weights[ia] + self.weights[ib]) / 2
+                    total += w * overlap_rate(wa, wb)
+            if total:
+                result[res] = total
+        return result
+
+    def evaluate(self, state):
+        periods = state[0]
+        R, T = self.response_times(state)
+        slack = [1.0 - r / t for r, t in zip(R, T)]
+        infeasible = sum(w * max(0.0, -s) for w, s in zip(self.weights, slack))
+        rate = 0.0
+        for w, p, (lo, hi) in zip(self.weights, periods, self.period_range):
+            if hi > lo:
+                rate += w * (hi - p) / (hi - lo)
+        contention = self.contention(state)
+        score = (sum(w * min(s, 1.0) for w, s in zip(self.weights, slack))
+                 + self.rate_weight * rate
+                 - self.contention_weight * sum(contention.values())
+                 - INFEASIBLE_PENALTY * infeasible)
+        return {"response_us": R, "period_us": T, "slack": slack, "infeasible": infeasible,
+                "contention": contention, "score": score}
+
+    # ------------------------------------------------------------------
+    # Output
+
+    def apply(self, state):
+        """The config with the state's periods, priorities and offsets"""
+        config = copy.deepcopy(self.config)
+        specs = self.task_specs(config)
+        for spec, period, prio, offset in zip(specs, *state):
+            spec["priority"] = prio
+            spec["period_ms"] = period
+            if offset:
+                spec["offset_ms"] = offset
+            else:
+                spec.pop("offset_ms", None)
+        return config
+
+    def simulate(self, state, seconds):
+        _, sim, result = schedule_sim.simulate(self.apply(state), self.mode, seconds, self.cores,
+                                               self.baud, self.costs)
+        misses = sum(w * t["deadline_misses"] / max(t["jobs"], 1)
+                     for w, t in zip(self.weights, result["tasks"]))
+        return misses, result
+
+
+def overlap_rate(a, b):
+    """Share of time two periodic windows (start_us, length_us, period_us) overlap"""
+    (sa, la, pa), (sb, lb, pb) = a, b
+    g = math.gcd(pa, pb)
+    if la + lb > OVERLAP_EXACT_STEPS * g:
+        # Phases repeat much finer than the windows: the offsets barely matter
+        # and the sum below is within a few percent of its integral
+        return la * lb / (pa * pb)
+    # Over one hyperperiod b's windows start at d0 + k*g relative to a's, each once
+    d0 = (sb - sa) % g
+    x = d0 + ((-lb - d0) // g + 1) * g
+    total = 0
+    while x < la:
+        total += max(0, min(la, x + lb) - max(0, x))
+        x += g
+    return total * g / (pa * pb)
+
+
+def search(problem, iterations, keep, seed):
+    rng = random.Random(seed)
+    start = problem.initial()
+    candidates = {start: problem.evaluate(start)}
+    rm = problem.rate_monotonic(start)
+    candidates[rm] = problem.evaluate(rm)
+    current = max(candidates, key=lambda s: candidates[s]["score"])
+    current_score = candidates[current]["score"]
+    best = dict(candidates)
+
+    temperature = 0.5
+    for it in range(iterations):
+        t = temperature * (1.0 - it / iterations) + 1e-3
+        state = problem.mutate(current, rng)
+        evaluation = problem.evaluate(state)
+        delta = evaluation["score"] - current_score
+        if delta >= 0 or rng.random() < math.exp(delta / t):
+            current, current_score = state, evaluation["score"]
+            if state not in best and (len(best) < keep or
+                                      evaluation["score"] > min(e["score"] for e in best.values())):
+                best[state] = evaluation
+                if len(best) > keep:
+                    del best[min(best, key=lambda s: best[s]["score"])]
+    ranked = sorted(best.items(), key=lambda kv: -kv[1]["score"])
+    return start, ranked
+
+
+def report(problem, label, state, evaluation, sim_result):
+    periods, prios, offsets = state
+    print(f"\n{label}: score {evaluation['score']:.2f}")
+    print(f"{'task':16} {'prio':>4} {'period':>7} {'offset':>7} {'weight':>6} {'R est':>9} {'slack':>6} "
+          f"{'sim p99':>9} {'miss':>8}")
+    for i, m in enumerate(problem.models):
+        t = sim_result["tasks"][i]
+        print(f"{m.name[:16]:16} {prios[i]:>4} {periods[i]:>5}ms {offsets[i]:>5}ms {problem.weights[i]:>6.1f} "
+              f"{evaluation['response_us'][i] / 1000:>7.1f}ms {100 * evaluation['slack'][i]:>5.0f}% "
+              f"{t['p99_ms']:>7.1f}ms {t['deadline_misses']:>4}/{t['jobs']:<4}")
+    for res, overlap in sorted(evaluation["contention"].items()):
+        print(f"sensor {res:12} sampling overlap {overlap:7.2f} s/s (weighted, over task pairs)")
+    for mx in sim_result["mutexes"]:
+        if mx["name"] != "uart":
+            print(f"sensor {mx['name']:12} simulated wait total {mx['wait_total_ms']:.1f}ms "
+                  f"max {mx['wait_max_ms']:.2f}ms")
+
+
+def metrics(problem, state, evaluation, sim_misses, sim_result):
+    periods, prios, offsets = state
+    return {
+        "score": evaluation["score"],
+        "weighted_miss_ratio": sim_misses,
+        "sensor_overlap_s_per_s": evaluation["contention"],
+        "mutexes": sim_result["mutexes"],
+        "core_util_pct": sim_result["core_util_pct"],
+        "tasks": [
+            {"name": m.name, "priority": prios[i], "period_ms": periods[i], "offset_ms": offsets[i],
+             "weight": problem.weights[i], "response_est_ms": evaluation["response_us"][i] / 1000,
+             "slack": evaluation["slack"][i], **{k: sim_result["tasks"][i][k] for k in
+                                                 ("p50_ms", "p99_ms", "max_ms", "jobs", "deadline_misses")}}
+            for i, m in enumerate(problem.models)
+        ],
+    }
+
+
+def parse_levels(text):
+    lo, _, hi = text.partition("-")
+    lo, hi = int(lo), int(hi or lo)
+    if not 1 <= lo <= hi:
+        raise argparse.ArgumentTypeError("expected LOW-HIGH, e.g. 1-10")
+    return lo, hi
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Search priorities, periods and offsets of a task config")
+    parser.add_argument("config", help="Task config JSON (as uploaded to the ESP32)")
+    parser.add_argument("--bounds", help="JSON file of per-task period_ms [min, max] and weight")
+    parser.add_argument("--mode", help="Mode to optimize (default: initial_mode)")
+    parser.add_argument("--priorities", type=parse_levels, default=(1, 10), help="Priority levels, e.g. 1-10")
+    parser.add_argument("--iterations", type=int, default=3000, help="Candidates scored analytically")
+    parser.add_argument("--verify", type=int, default=4, help="Best candidates checked in the simulator")
+    parser.add_argument("--verify-seconds", type=float, default=20.0, help="Simulated seconds per check")
+    parser.add_argument("--rate-weight", type=float, default=0.5,
+                        help="Reward for periods near the lower bound, per unit of weight")
+    parser.add_argument("--contention-weight", type=float, default=1.0,
+                        help="Penalty per second per second of overlapping sampling on a sensor")
+    parser.add_argument("--cores", type=int, default=2)
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--costs", help="JSON file overriding entries of the sensor cost model")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--out", help="Write the optimized config here (default: stdout)")
+    parser.add_argument("--metrics", help="Write the predicted metrics of both configs as JSON")
+    args = parser.parse_args()
+
+    with open(args.config) as f:
+        config = json.load(f)
+    bounds = {}
+    if args.bounds:
+        with open(args.bounds) as f:
+            bounds = json.load(f)
+    costs = {k: dict(v) for k, v in schedule_sim.DEFAULT_COSTS.items()}
+    if args.costs:
+        with open(args.costs) as f:
+            for sensor, overrides in json.load(f).items():
+                costs.setdefault(sensor, {}).update(overrides)
+
+    problem = Problem(config, args.mode, bounds, costs, args.cores, args.baud, args.priorities,
+                      args.rate_weight, args.contention_weight)
+    if not problem.models:
+        print("No tasks to optimize", file=sys.stderr)
+        return 1
+
+    wall = time.time()
+    start, ranked = search(problem, args.iterations, max(args.verify, 1), args.seed)
+    search_s = time.time() - wall
+    print(f"mode {problem.mode}: {len(problem.models)} tasks, {args.iterations} candidates scored in "
+          f"{search_s:.1f}s", file=sys.stderr)
+
+    # The simulator has the last word: fewest weighted misses, then the analytical score
+    wall = time.time()
+    base_misses, base_result = problem.simulate(start, args.verify_seconds)
+    checked = []
+    for state, evaluation in ranked[:args.verify]:
+        misses, result = problem.simulate(state, args.verify_seconds)
+        checked.append((misses, -evaluation["score"], state, evaluation, result))
+    checked.sort(key=lambda c: c[:2])
+    misses, _, best, evaluation, result = checked[0]
+    print(f"{len(checked) + 1} configs simulated for {args.verify_seconds:.0f}s each in "
+          f"{time.time() - wall:.1f}s", file=sys.stderr)
+
+    base_eval = problem.evaluate(start)
+    report(problem, "original", start, base_eval, base_result)
+    report(problem, "optimized", best, evaluation, result)
+
+    optimized = problem.apply(best)
+    if args.out:
+        with open(args.out, "w") as f:
+            json.dump(optimized, f, indent=2)
+        print(f"\nWrote optimized config to {args.out}")
+    else:
+        print()
+        print(json.dumps(optimized, indent=2))
+    if args.metrics:
+        with open(args.metrics, "w") as f:
+            json.dump({"mode": problem.mode, "simulated_s": args.verify_seconds,
+                       "original": metrics(problem, start, base_eval, base_misses, base_result),
+                       "optimized": metrics(problem, best, evaluation, misses, result)}, f, indent=2)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,92 @@
+#!/usr/bin/env python3
+"""
+Host side of the firmware's transport layer.
+
+open_link("tcp:127.0.0.1:5555") connects to the TCP transport (e.g. the Linux
+host build); anything else is treated as a serial port. Both objects expose
+the subset of the pyserial API the tools use.
+"""
+
+import socket
+import time
+
+import serial
+
+
+class TcpLink:
+    def __init__(self, host, port, timeout=0.5):
+        self.timeout = timeout
+        self.sock = socket.create_connection((host, port), timeout=5.0)
+        self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        self.sock.settimeout(timeout)
+        self.buffer = bytearray()
+        self.is_open = True
+
+    def _fill(self):
+        try:
+            chunk = self.sock.recv(65536)
+        except socket.timeout:
+            return False
+        if not chunk:
+            raise ConnectionError("link closed by device")
+        self.buffer += chunk
+        return True
+
+    @property
+    def in_waiting(self):
+        self.sock.setblocking(False)
+        try:
+            self._fill()
+        except (BlockingIOError, ConnectionError):
+            pass
+        finally:
+            self.sock.settimeout(self.timeout)
+        return len(self.buffer)
+
+    def readline(self):
+        deadline = time.time() + self.timeout
+        while b"\n" not in self.buffer and time.time() < deadline:
+            self._fill()
+        end = self.buffer.find(b"\n")
+        end = len(self.buffer) if end < 0 else end + 1
+        line = bytes(self.buffer[:end])
+        del self.buffer[:end]
+        return line
+
+    def read(self, size):
+        deadline = time.time() + self.timeout
+        while len(self.buffer) < size and time.time() < deadline:
+            if self._fill():
+                deadline = time.time() + self.timeout
+        data = bytes(self.buffer[:size])
+        del self.buffer[:size]
+        return data
+
+    def write(self, data):
+        self.sock.sendall(data)
+        return len(data)
+
+    def reset_input_buffer(self):
+        self.in_waiting
+        self.buffer.clear()
+
+    def close(self):
+        if self.is_open:
+            self.sock.close()
+            self.is_open = False
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+
+def open_link(spec, baud=115200, timeout=0.5):
+    """Open "tcp:<host>:<port>", "serial:<port>" or a bare serial port name"""
+    if spec.startswith("tcp:"):
+        host, _, port = spec[len("tcp:"):].rpartition(":")
+        return TcpLink(host or "127.0.0.1", int(port), timeout=timeout)
+    if spec.startswith("serial:"):
+        spec = spec[len("serial:"):]
+    return serial.Serial(spec, baud, timeout=timeout)
@@ -0,0 +1,248 @@
+#!/usr/bin/env python3
+"""
+Capture PC samples from the firmware profiler and turn them into folded
+stacks and flame graphs, per task.
+
+capture: starts PROFILE, drains the sample buffer periodically and saves the
+         raw PROF lines. The measured sampler overhead is printed at the end.
+fold:    symbolizes a capture against the application ELF with addr2line and
+         writes folded stacks ("task;outer;...;leaf count", the format of
+         flamegraph.pl and speedscope), optionally as a self-contained SVG.
+"""
+
+import argparse
+import collections
+import html
+import os
+import subprocess
+import sys
+import time
+import zlib
+
+from link import open_link
+
+
+def send(port, command, timeout=2.0, collect=None):
+    """Send one command and wait for its OK/ERROR reply.
+
+    Lines starting with `collect` seen before the reply are returned.
+    """
+    name = command.split()[0]
+    port.write((command + "\n").encode())
+    lines = []
+    deadline = time.time() + timeout
+    while time.time() < deadline:
+        line = port.readline().decode("utf-8", errors="ignore").strip()
+        if collect and line.startswith(collect):
+            lines.append(line)
+            deadline = time.time() + timeout
+        elif line == f"OK {name}":
+            return True, lines
+        elif line == f"ERROR {name}":
+            return False, lines
+    return False, lines
+
+
+def capture(port, seconds, hz, interval, path):
+    port.reset_input_buffer()
+    send(port, "PROFILE STOP")
+    ok, _ = send(port, f"PROFILE START {hz}" if hz else "PROFILE START")
+    if not ok:
+        print("PROFILE START rejected (not supported on the host build)", file=sys.stderr)
+        return 1
+
+    samples = 0
+    end = time.time() + seconds
+    with open(path, "w") as out:
+        while True:
+            last = time.time() >= end
+            if last:
+                send(port, "PROFILE STOP")
+            else:
+                time.sleep(min(interval, max(0.0, end - time.time())))
+            _, lines = send(port, "PROFILE DUMP", timeout=5.0, collect="PROF ")
+            for line in lines:
+                out.write(line + "\n")
+            samples += sum(1 for line in lines if not line.startswith("PROF TASK"))
+            if last:
+                break
+        _, status = send(port, "PROFILE", collect="PROFILE ")
+        for line in status:
+            out.write("# " + line + "\n")
+
+    print(f"Captured {samples} samples in {seconds:.0f}s to {path}")
+    for line in status:
+        print(line)
+    return 0
+
+
+def parse_capture(path):
+    """Returns ({task index: name}, [(core, task index, [pc leaf first])])."""
+    tasks = {}
+    samples = []
+    with open(path) as f:
+        for line in f:
+            fields = line.split()
+            if len(fields) < 3 or fields[0] != "PROF":
+                continue
+            if fields[1] == "TASK":
+                tasks[int(fields[2])] = fields[3] if len(fields) > 3 else "?"
+            else:
+                samples.append((int(fields[1]), int(fields[2]), [int(pc, 16) for pc in fields[3:]]))
+    return tasks, samples
+
+
+def symbolize(addresses, elf, addr2line):
+    """Map addresses to function names; unresolved ones stay as hex."""
+    names = {a: f"0x{a:08x}" for a in addresses}
+    if not elf:
+        return names
+
+    addresses = sorted(addresses)
+    for i in range(0, len(addresses), 500):
+        chunk = addresses[i:i + 500]
+        try:
+            result = subprocess.run([addr2line, "-f", "-C", "-e", elf] + [f"0x{a:x}" for a in chunk],
+                                    capture_output=True, text=True, check=True)
+        except (OSError, subprocess.CalledProcessError) as e:
+            print(f"addr2line failed: {e}", file=sys.stderr)
+            return names
+        lines = result.stdout.splitlines()
+        for a, function in zip(chunk, lines[0::2]):
+            if function and function != "??":
+                names[a] = function
+    return names
+
+
+def fold(tasks, samples, names, only_tasks=None, per_core=False):
+    stacks = collections.Counter()
+    for core, task, pcs in samples:
+        task_name = tasks.get(task, f"task{task}")
+        if only_tasks and task_name not in only_tasks:
+            continue
+        root = f"{task_name}@{core}" if per_core else task_name
+        frames = [names[pc] for pc in reversed(pcs)] or ["[isr]"]
+        stacks[";".join([root] + frames)] += 1
+    return stacks
+
+
+def print_top(stacks, limit):
+    """Self time per task: the leaf function of each sample."""
+    per_task = collections.defaultdict(collections.Counter)
+    for stack, n in stacks.items():
+        frames = stack.split(";")
+        per_task[frames[0]][frames[-1]] += n
+    for task in sorted(per_task, key=lambda t: -sum(per_task[t].values())):
+        total = sum(per_task[task].values())
+        print(f"\n{task}: {total} samples")
+        for function, n in per_task[task].most_common(limit):
+            print(f"  {100.0 * n / total:5.1f}%  {function}")
+
+
+def render_svg(stacks, path, title, width=1200, row=16):
+    tree = {"name": "all", "value": 0, "children": {}}
+    for stack, n in stacks.items():
+        node = tree
+        node["value"] += n
+        for frame in stack.split(";"):
+            node = node["children"].setdefault(frame, {"name": frame, "value": 0, "children": {}})
+            node["value"] += n
+
+    rects = []
+    total = max(tree["value"], 1)
+
+    def walk(node, x, depth):
+        w = node["value"] * width / total
+        if w < 0.5:
+            return
+        rects.append((x, depth, w, node["name"], node["value"]))
+        child_x = x
+        for child in sorted(node["children"].values(), key=lambda c: c["name"]):
+            walk(child, child_x, depth + 1)
+            child_x += child["value"] * width / total
+
+    walk(tree, 0.0, 0)
+    max_depth = max((r[1] for r in rects), default=0)
+    height = (max_depth + 1) * row + 40
+
+    out = [f'<svg xmlns="http://www.w3.org/2000/svg" width="{width}" height="{height}" '
+           f'font-family="monospace" font-size="11">',
+           f'<text x="{width / 2}" y="16" text-anchor="middle" font-size="14">{html.escape(title)}</text>']
+    for x, depth, w, name, value in rects:
+        y = height - (depth + 1) * row - 4
+        hue = (zlib.crc32(name.encode()) % 40) + 10
+        label = html.escape(name)
+        out.append(f'<g><title>{label} ({value} samples, {100.0 * value / total:.1f}%)</title>'
+                   f'<rect x="{x:.1f}" y="{y}" width="{w:.1f}" height="{row - 1}" '
+                   f'fill="hsl({hue},90%,60%)"/>')
+        chars = int(w / 7)
+        if chars >= 3:
+            text = label if len(name) <= chars else html.escape(name[:chars - 2]) + ".."
+            out.append(f'<text x="{x + 2:.1f}" y="{y + row - 4}">{text}</text>')
+        out.append("</g>")
+    out.append("</svg>")
+    with open(path, "w") as f:
+        f.write("\n".join(out))
+
+
+def fold_command(args):
+    tasks, samples = parse_capture(args.capture)
+    if not samples:
+        print("No samples in capture", file=sys.stderr)
+        return 1
+
+    addresses = {pc for _, _, pcs in samples for pc in pcs}
+    names = symbolize(addresses, args.elf, args.addr2line)
+    stacks = fold(tasks, samples, names, args.task, args.per_core)
+
+    if args.out:
+        with open(args.out, "w") as f:
+            for stack, n in sorted(stacks.items()):
+                f.write(f"{stack} {n}\n")
+    if args.svg:
+        render_svg(stacks, args.svg, f"{os.path.basename(args.capture)} ({sum(stacks.values())} samples)")
+    if args.svg_dir:
+        os.makedirs(args.svg_dir, exist_ok=True)
+        roots = {stack.split(";")[0] for stack in stacks}
+        for root in sorted(roots):
+            own = {s: n for s, n in stacks.items() if s.split(";")[0] == root}
+            safe = "".join(c if c.isalnum() else "_" for c in root)
+            render_svg(own, os.path.join(args.svg_dir, f"{safe}.svg"), f"{root} ({sum(own.values())} samples)")
+    print_top(stacks, args.top)
+    return 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Profile the ESP32 firmware and build flame graphs")
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    cap = sub.add_parser("capture", help="Sample the running firmware")
+    cap.add_argument("--port", required=True,
+                     help="Serial port (e.g. /dev/ttyUSB0) or tcp:<host>:<port>")
+    cap.add_argument("--baud", type=int, default=115200)
+    cap.add_argument("--seconds", type=float, default=10.0)
+    cap.add_argument("--hz", type=int, help="Samples per second per core (firmware default if omitted)")
+    cap.add_argument("--interval", type=float, default=0.5,
+                     help="Seconds between buffer drains; shorten if samples are lost")
+    cap.add_argument("out")
+
+    fld = sub.add_parser("fold", help="Symbolize a capture into folded stacks / flame graphs")
+    fld.add_argument("capture")
+    fld.add_argument("--elf", help="Application ELF, e.g. build/os_lab_project.elf")
+    fld.add_argument("--addr2line", default=os.environ.get("ADDR2LINE", "xtensa-esp32-elf-addr2line"))
+    fld.add_argument("--task", action="append", help="Only this task (repeatable)")
+    fld.add_argument("--per-core", action="store_true", help="Split each task by core")
+    fld.add_argument("--out", help="Write folded stacks here")
+    fld.add_argument("--svg", help="Write one flame graph with a root per task")
+    fld.add_argument("--svg-dir", help="Write one flame graph per task into this directory")
+    fld.add_argument("--top", type=int, default=10, help="Functions listed per task")
+    args = parser.parse_args()
+
+    if args.command == "fold":
+        return fold_command(args)
+    with open_link(args.port, args.baud) as port:
+        return capture(port, args.seconds, args.hz, args.interval, args.out)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,768 @@
+#!/usr/bin/env python3
+"""
+Discrete-event simulation of the ESP32 task schedule.
+
+Runs a task config (the same JSON the GUI uploads) in virtual time instead of
+on hardware. The model follows the firmware:
+
+- FreeRTOS fixed-priority preemptive scheduling over both cores, with
+  round-robin time slicing between equal priorities on the 10 ms tick
+- vTaskDelay / vTaskDelayUntil on tick boundaries
+- one mutex per sensor instance (plus the I2C bus and the UART TX lock), with
+  priority inheritance
+- the per-read costs of main/sensors.c: 10 averaged samples per sensor per
+  cycle, the DHT11 read inside a critical section, the ultrasonic echo
+  busy-wait, and the MPU6050 I2C transfer
+- per-task CPU budgets with debt throttling, as in dynamic_sensor_task
+- "spread" tasks taking one sample per sensor in evenly spaced slots of the
+  period instead of the 10-sample burst
+- offset_ms, the first release of a task after the mode starts
+- the log line drained through the UART at the link's baud rate
+
+Every sample read is a few events, so the cost follows the task count: a
+simulated hour takes seconds for a handful of tasks and minutes for 32. The
+output gives:
+
+- response-time percentiles and deadline misses per task
+- core, mutex and UART figures
+- optionally a JSON trace of the first seconds, for the GUI timeline
+"""
+
+import argparse
+import heapq
+import json
+import operator
+import random
+import sys
+import time
+
+TICK_US = 10_000                # CONFIG_FREERTOS_HZ=100
+SAMPLES_PER_READ = 10           # read_*_averaged(..., 10, ...)
+LOG_FORMAT_US = 150             # snprintf of the log line + history append
+UART_FIFO_BYTES = 128           # No TX ring buffer: writers block on the hardware FIFO
+BITS_PER_BYTE = 10
+
+# Per-read cost model of main/sensors.c (microseconds unless noted)
+DEFAULT_COSTS = {
+    "dht11": {
+        # dht_read_data: 20 ms start pulse + 40 bits, all inside a critical section
+        "crit_us": 24000, "jitter_us": 800, "gap_ms": 100,
+    },
+    "ultrasonic": {
+        # Busy-waits on the echo pin: trigger + echo delay + 58 us/cm round trip
+        "busy_us": 470, "us_per_cm": 58, "distance_cm": 100, "jitter_us": 100,
+        "timeout_us": 30000, "fail_rate": 0.0, "gap_ms": 50,
+    },
+    "mpu6050": {
+        # 14-byte I2C burst read; the task sleeps on the driver while the bus is busy
+        "cpu_us": 60, "io_us": 380, "jitter_us": 40, "gap_ms": 10,
+    },
+}
+
+DEFAULT_INSTANCES = {"dht11": "dht11", "ultrasonic": "ultrasonic", "mpu6050": "mpu6050"}
+
+READY, BLOCKED = 0, 1
+
+
+_by_order = operator.attrgetter("order")
+_by_prio = operator.attrgetter("prio")
+
+
+def rank(tasks):
+    # Scheduling order, in place: highest priority first, FIFO among equals.
+    # Two stable sorts on C-level keys beat one on a Python key function.
+    tasks.sort(key=_by_order)
+    tasks.sort(key=_by_prio, reverse=True)
+
+
+def ms_to_ticks(ms):
+    # pdMS_TO_TICKS truncates
+    return ms * 1000 // TICK_US
+
+
+# Typical text of each channel in a task's record (line_encoder.c)
+FIELD_TEXT = {"hum": " H:45.0%", "temp": " T:23.5C", "dist": " Dist:100cm",
+              "ax": " AccX:0.012g", "ay": " AccY:-0.034g", "az": " AccZ:0.998g"}
+SENSOR_FIELDS = {"dht11": ["hum", "temp"], "ultrasonic": ["dist"], "mpu6050": ["ax", "ay", "az"]}
+
+
+def log_line_bytes(name, fields):
+    return len(f"[{name}]") + sum(len(FIELD_TEXT[f]) for f in fields) + 1
+
+
+def overrun_line_bytes(name):
+    return len(f"[{name}] OVERRUN used=12345us budget=10000us count=1\n")
+
+
+class Mutex:
+    def __init__(self, name):
+        self.name = name
+        self.owner = None
+        self.waiters = []
+        self.wait_total_us = 0
+        self.wait_max_us = 0
+        self.acquisitions = 0
+
+
+class SimTask:
+    def __init__(self, index, spec):
+        self.index = index
+        self.name = spec["name"]
+        self.base_prio = spec["priority"]
+        self.prio = self.base_prio
+        self.period_ms = spec["period_ms"]
+        self.period_ticks = ms_to_ticks(self.period_ms)
+        self.offset_ticks = ms_to_ticks(spec.get("offset_ms", 0) or 0)
+        self.budget_us = spec.get("budget_us", 0) or 0
+        self.spread = bool(spec.get("spread", False))
+        self.sensors = spec["sensors"]          # [(type, instance id)]
+        sampled = [f for kind, _ in self.sensors for f in SENSOR_FIELDS[kind]]
+        self.fields = [f for f in FIELD_TEXT if f in spec.get("fields", sampled)]
+        self.state = READY
+        self.order = 0                          # FIFO position among equal priorities
+        self.core = None
+        self.remaining = 0                      # CPU left in the current segment
+        self.pending = False                    # Its end is in the event heap (finish)
+        self.finish = 0
+        self.epoch = 0                          # Bumped when the task loses its core
+        self.acct = 0                           # CPU time accounted up to here
+        self.crit = False                       # Current segment cannot be preempted
+        self.cpu_us = 0
+        self.held = []
+        self.blocked_on_mutex = None
+        self.wait_start = 0
+        self.blocked_on = None
+        self.block_start = 0
+        self.program = None
+        # Statistics
+        self.release_us = 0
+        self.responses = []
+        self.misses = 0
+        self.overruns = 0
+        self.throttled = 0
+        self.read_errors = 0
+        self.jobs = []                          # (release, finish) inside the trace window
+
+
+class Simulator:
+    def __init__(self, tasks, cores=2, baud=115200, costs=None, seed=1, trace_us=0, i2c_port=None):
+        self.tasks = tasks
+        self.i2c_port = i2c_port or {}
+        self.cores = cores
+        self.costs = costs or DEFAULT_COSTS
+        self.rng = random.Random(seed)
+        self.now = 0
+        self.running = [None] * cores
+        self.run_start = [0] * cores
+        self.core_busy = [0] * cores
+        self.events = []                        # heap, see run()
+        self.seq = 0
+        self.order_seq = 0
+        self.mutexes = {}
+        self.uart_mutex = self.mutex("uart")
+        self.uart_us_per_byte = BITS_PER_BYTE * 1_000_000 / baud
+        self.uart_backlog = 0.0                 # Bytes queued at uart_backlog_t
+        self.uart_backlog_t = 0
+        self.uart_bytes = 0
+        self.uart_stall_us = 0
+        self.trace_us = trace_us
+        self.segments = []
+        self.blocks = []
+        self.ready = list(tasks)                # READY tasks, running or not
+        self.dirty = True                       # Ready set or priorities changed
+        self.contended = False                  # Ready tasks waiting for a time slice
+        for t in tasks:
+            t.program = self.task_program(t)
+            t.order = self.next_order()
+
+    def mutex(self, name):
+        if name not in self.mutexes:
+            self.mutexes[name] = Mutex(name)
+        return self.mutexes[name]
+
+    def next_order(self):
+        self.order_seq += 1
+        return self.order_seq
+
+    def jitter(self, us, spread):
+        if not spread:
+            return us
+        # rng.uniform(-spread, spread) without its Python-level call
+        low = -spread
+        us = int(us + (low + (spread - low) * self.rng.random()))
+        return us if us > 1 else 1
+
+    # ------------------------------------------------------------------
+    # Task behaviour (mirrors dynamic_sensor_task and sensors.c)
+
+    def read_sensor(self, task, sensor_type, instance, start_cpu, samples=SAMPLES_PER_READ):
+        c = self.costs[sensor_type]
+        lock = self.mutex(instance)
+        bus = self.mutex(f"i2c{self.i2c_port.get(instance, 0)}") if sensor_type == "mpu6050" else None
+        gap = ms_to_ticks(c["gap_ms"])
+        valid = 0
+        for i in range(samples):
+            if task.budget_us and task.cpu_us - start_cpu >= task.budget_us:
+                break
+            if sensor_type == "dht11":
+                yield ("lock", lock, self.jitter(c["crit_us"], c["jitter_us"]), True)
+                valid += 1
+            elif sensor_type == "ultrasonic":
+                if c["fail_rate"] and self.rng.random() < c["fail_rate"]:
+                    yield ("lock", lock, c["timeout_us"], False)
+                else:
+                    us = c["busy_us"] + c["us_per_cm"] * c["distance_cm"]
+                    yield ("lock", lock, self.jitter(us, c["jitter_us"]), False)
+                    valid += 1
+            else:
+                yield ("lock", lock, 0, False)
+                yield ("lock", bus, self.jitter(c["cpu_us"], c["jitter_us"] // 2), False)
+                yield ("sleep_us", self.jitter(c["io_us"], c["jitter_us"]))
+                yield ("unlock", bus, 0)
+                valid += 1
+            yield ("unlock", lock, gap if i < samples - 1 else 0)
+        return valid > 0
+
+    def spread_samples(self, task):
+        # spread_samples() in task_manager.c: bounded by the slowest sensor's gap and the tick
+        gap_ms = max(self.costs[kind]["gap_ms"] for kind, _ in task.sensors) if task.sensors else 0
+        n = SAMPLES_PER_READ
+        if gap_ms > 0:
+            n = min(n, task.period_ms // gap_ms)
+        return max(1, min(n, task.period_ticks))
+
+    def read_spread(self, task, start_tick, start_cpu):
+        # One sample per sensor per slot; the firmware averages them and holds
+        # the record to the period boundary, which costs the same link bytes
+        samples = self.spread_samples(task)
+        slot = task.period_ticks // samples
+        release = task.release_us               # The slot waits must not count as new releases
+        valid = {instance: False for _, instance in task.sensors}
+        for k in range(samples):
+            if k > 0:
+                yield ("until", start_tick + k * slot)
+            for sensor_type, instance in task.sensors:
+                if task.budget_us and task.cpu_us - start_cpu >= task.budget_us:
+                    break
+                ok = yield from self.read_sensor(task, sensor_type, instance, start_cpu, 1)
+                valid[instance] = valid[instance] or ok
+        task.release_us = release
+        return all(valid.values())
+
+    def uart_write(self, nbytes):
+        yield ("cpu", LOG_FORMAT_US, False)
+        yield ("lock", self.uart_mutex, 0, False)
+        yield ("uart", nbytes)
+        yield ("unlock", self.uart_mutex, 0)
+
+    def task_program(self, task):
+        debt = 0
+        if task.offset_ticks:
+            # First release held back to the task's phase
+            yield ("until", task.offset_ticks)
+        while True:
+            start_tick = self.now // TICK_US
+            next_tick = start_tick + task.period_ticks
+
+            # Pay back earlier overruns by sitting out whole periods
+            if task.budget_us and debt >= task.budget_us:
+                debt -= task.budget_us
+                task.throttled += 1
+                self.finish_job(task, None)
+                yield ("until", next_tick)
+                continue
+
+            start_cpu = task.cpu_us
+            success = True
+            if task.spread:
+                success = yield from self.read_spread(task, start_tick, start_cpu)
+            else:
+                for sensor_type, instance in task.sensors:
+                    if task.budget_us and task.cpu_us - start_cpu >= task.budget_us:
+                        success = False
+                        break
+                    ok = yield from self.read_sensor(task, sensor_type, instance, start_cpu)
+                    success = success and ok
+
+            if task.budget_us:
+                used = task.cpu_us - start_cpu
+                if used > task.budget_us:
+                    debt += used - task.budget_us
+                    task.overruns += 1
+                    yield from self.uart_write(overrun_line_bytes(task.name))
+                    self.finish_job(task, None)
+                    yield ("until", next_tick)
+                    continue
+
+            if success:
+                yield from self.uart_write(log_line_bytes(task.name, task.fields))
+                self.finish_job(task, self.now - task.release_us)
+            else:
+                task.read_errors += 1
+                yield from self.uart_write(len("Read error\n"))
+                self.finish_job(task, None)
+            yield ("until", next_tick)
+
+    def finish_job(self, task, response_us):
+        if response_us is not None:
+            task.responses.append(response_us)
+            if response_us > task.period_ms * 1000:
+                task.misses += 1
+        if self.now < self.trace_us:
+            task.jobs.append((task.release_us, self.now if response_us is not None else None))
+
+    # ------------------------------------------------------------------
+    # Kernel
+
+    def block(self, task, until=None, on=None):
+        task.state = BLOCKED
+        ready = self.ready
+        ready.remove(task)
+        # Only a task waiting for a core can take the one freed here
+        if len(ready) >= self.cores:
+            self.dirty = True
+        task.blocked_on = on
+        task.block_start = self.now
+        if task.core is not None:
+            self.stop_running(task)
+        if until is not None:
+            self.seq += 1
+            heapq.heappush(self.events, (until, 1, self.seq, task))
+
+    def make_ready(self, task):
+        # Trace bookkeeping only inside the window; checked first, as most runs have none
+        if self.now < self.trace_us and task.blocked_on is not None and self.now > task.block_start:
+            self.blocks.append((task.index, task.blocked_on, task.block_start, self.now))
+        task.state = READY
+        task.blocked_on = None
+        self.order_seq += 1
+        task.order = self.order_seq
+        self.ready.append(task)
+        self.dirty = True
+
+    def stop_running(self, task):
+        core = task.core
+        used = self.now - task.acct
+        task.cpu_us += used
+        self.core_busy[core] += used
+        if task.pending:
+            # Preempted mid-segment
+            task.remaining = task.finish - self.now
+            task.pending = False
+        task.epoch += 1
+        if self.run_start[core] < self.trace_us and self.now > self.run_start[core]:
+            self.segments.append((task.index, core, self.run_start[core], self.now))
+        self.running[core] = None
+        task.core = None
+
+    def inherit(self, task, prio):
+        # Walk the chain of owners, raising each below prio
+        while task is not None and task.prio < prio:
+            task.prio = prio
+            task = task.blocked_on_mutex.owner if task.blocked_on_mutex else None
+
+    def restore_prio(self, task):
+        prio = task.base_prio
+        for m in task.held:
+            for w in m.waiters:
+                if w.prio > prio:
+                    prio = w.prio
+        task.prio = prio
+
+    def step(self, task):
+        """Run the task's program until it needs CPU time or blocks.
+
+        Actions: ("cpu", us, crit), ("lock", mutex, us, crit) to take a mutex
+        and then run, ("unlock", mutex, ticks) to release it and then delay,
+        ("delay", ticks), ("until", tick), ("sleep_us", us), ("uart", bytes).
+        The combined forms halve the generator steps of a sensor read.
+        """
+        program = task.program
+        while True:
+            action = next(program)
+            kind = action[0]
+            if kind == "cpu":
+                task.remaining = action[1]
+                task.crit = action[2]
+                if task.remaining > 0:
+                    return
+            elif kind == "lock":
+                m = action[1]
+                # Runs once the mutex is taken, whether now or when handed over
+                task.remaining = action[2]
+                task.crit = action[3]
+                if m.owner is None:
+                    m.owner = task
+                    m.acquisitions += 1
+                    task.held.append(m)
+                    if task.remaining > 0:
+                        return
+                else:
+                    m.waiters.append(task)
+                    task.blocked_on_mutex = m
+                    task.wait_start = self.now
+                    self.inherit(m.owner, task.prio)
+                    self.block(task, on=m.name)
+                    return
+            elif kind == "unlock":
+                m = action[1]
+                task.held.remove(m)
+                # Only a lost inheritance or a woken waiter can change the schedule
+                prio = task.prio
+                self.restore_prio(task)
+                if task.prio != prio:
+                    self.dirty = True
+                waiters = m.waiters
+                if waiters:
+                    # Highest priority waiter first, FIFO among equals
+                    w = waiters[0]
+                    for o in waiters:
+                        if o.prio > w.prio or (o.prio == w.prio and o.order < w.order):
+                            w = o
+                    waiters.remove(w)
+                    m.owner = w
+                    m.acquisitions += 1
+                    w.held.append(m)
+                    w.blocked_on_mutex = None
+                    waited = self.now - w.wait_start
+                    m.wait_total_us += waited
+                    m.wait_max_us = max(m.wait_max_us, waited)
+                    self.make_ready(w)
+                else:
+                    m.owner = None
+                if action[2] > 0:
+                    self.block(task, until=(self.now // TICK_US + action[2]) * TICK_US, on="delay")
+                    return
+            elif kind == "delay":
+                if action[1] > 0:
+                    self.block(task, until=(self.now // TICK_US + action[1]) * TICK_US, on="delay")
+                    return
+            elif kind == "until":
+                wake = action[1] * TICK_US
+                if wake > self.now:
+                    self.block(task, until=wake, on="period")
+                    task.release_us = wake
+                    return
+                task.release_us = self.now
+            elif kind == "sleep_us":
+                self.block(task, until=self.now + action[1], on="io")
+                return
+            elif kind == "uart":
+                drained = (self.now - self.uart_backlog_t) / self.uart_us_per_byte
+                backlog = max(0.0, self.uart_backlog - drained) + action[1]
+                self.uart_backlog = backlog
+                self.uart_backlog_t = self.now
+                self.uart_bytes += action[1]
+                wait = int((backlog - UART_FIFO_BYTES) * self.uart_us_per_byte)
+                if wait > 0:
+                    self.uart_stall_us += wait
+                    self.block(task, until=self.now + wait, on="uart")
+                    return
+
+    def place(self, task, idle):
+        # Give a task the lowest free core; one with nothing left to run goes
+        # to idle for its zero-time actions, in core order
+        core = self.running.index(None)
+        self.running[core] = task
+        self.run_start[core] = self.now
+        task.core = core
+        task.acct = self.now
+        if task.remaining:
+            self.schedule_end(task)
+        else:
+            idle.append(task)
+
+    def schedule_end(self, task):
+        task.pending = True
+        task.finish = self.now + task.remaining
+        heapq.heappush(self.events, (task.finish, 0, task.core, task.epoch, task))
+
+    def dispatch(self):
+        """Assign the cores; returns the tasks placed with nothing left to run."""
+        self.dirty = False
+        running = self.running
+        cores = self.cores
+        ready = self.ready
+        idle = []
+        if len(ready) <= cores:
+            # Everyone gets a core and keeps the one it has; only the order in
+            # which newcomers take the free cores needs ranking
+            waiting = [t for t in ready if t.core is None]
+            if len(waiting) > 1:
+                rank(waiting)
+            for t in waiting:
+                self.place(t, idle)
+            self.contended = False
+            return idle
+        # Tasks in a critical section keep their core
+        chosen = [t for t in running if t is not None and t.crit]
+        rank(ready)                             # Its order means nothing else
+        for t in ready:
+            if len(chosen) >= cores:
+                break
+            if t not in chosen:
+                chosen.append(t)
+        for t in running:
+            if t is not None and t not in chosen:
+                self.stop_running(t)
+        for t in chosen:
+            if t.core is None:
+                self.place(t, idle)
+        if len(chosen) < cores or len(ready) == len(chosen):
+            self.contended = False
+            return idle
+        # ready is ranked: the first task left without a core is the strongest
+        lowest = min(t.prio for t in chosen)
+        self.contended = next(t for t in ready if t.core is None).prio >= lowest
+        return idle
+
+    def time_slice(self):
+        # Tick: a running task yields to a ready task of the same priority
+        for t in self.running:
+            if t is None or t.crit:
+                continue
+            if any(o.core is None and o.prio == t.prio for o in self.ready):
+                t.order = self.next_order()
+                self.dirty = True
+
+    def run(self, duration_us):
+        # One heap orders every event: CPU segments ending (by core), then
+        # wakeups, then the time-slice tick, at equal times. A running task's
+        # CPU time is accounted when its segment ends or it loses the core.
+        # Tasks with no CPU left are stepped once they hold a core, so every
+        # zero-time action (lock, unlock, delay) happens while scheduled.
+        # The hot loop of every prediction: attributes are bound to locals.
+        end = duration_us
+        running = self.running
+        events = self.events
+        core_busy = self.core_busy
+        cores = range(self.cores)
+        step = self.step
+        dispatch = self.dispatch
+        schedule_end = self.schedule_end
+        make_ready = self.make_ready
+        heappop = heapq.heappop
+        heappush = heapq.heappush
+        now = self.now
+        sliced = -1                             # Tick whose time slice was taken
+        tick_due = -1                           # Tick already in the heap
+        while True:
+            # Zero-time actions of the tasks that just got a core, until the
+            # schedule settles: nothing wakes or completes in between
+            while self.dirty:
+                idle = dispatch()
+                if not idle:
+                    break
+                for t in idle:
+                    step(t)
+                    if t.core is not None:
+                        schedule_end(t)
+                if now % TICK_US == 0 and now != sliced:
+                    sliced = now
+                    if self.contended or self.dirty:
+                        self.time_slice()
+
+            if self.contended:
+                tick = (now // TICK_US + 1) * TICK_US
+                if tick != tick_due:
+                    tick_due = tick
+                    heappush(events, (tick, 2, 0, 0, None))
+
+            if not events or events[0][0] >= end:
+                break
+            self.now = now = events[0][0]
+            while events and events[0][0] == now:
+                event = heappop(events)
+                kind = event[1]
+                if kind == 0:
+                    t = event[4]
+                    if t.epoch != event[3] or not t.pending:
+                        continue                # Preempted or blocked since
+                    t.pending = False
+                    t.remaining = 0
+                    used = now - t.acct
+                    t.acct = now
+                    t.cpu_us += used
+                    core_busy[t.core] += used
+                    if t.crit:
+                        # Leaving a critical section: preemption can happen again
+                        t.crit = False
+                        self.dirty = True
+                    step(t)
+                    if t.core is not None:
+                        schedule_end(t)
+                elif kind == 1:
+                    make_ready(event[3])
+            # One slice per tick, even when several events fall on it. Without
+            # a ready task left waiting there is no one to yield to.
+            if now % TICK_US == 0 and now != sliced:
+                sliced = now
+                if self.contended or self.dirty:
+                    self.time_slice()
+
+        self.now = end
+        for t in running:
+            if t is not None:
+                self.stop_running(t)
+
+
+# ----------------------------------------------------------------------
+# Config loading (same rules as task_manager_parse_and_create)
+
+def load_tasks(config, mode=None):
+    instances = dict(DEFAULT_INSTANCES)
+    i2c_port = {"mpu6050": 0}
+    for s in config.get("sensors", []):
+        instances[s["id"]] = s["type"]
+        if s["type"] == "mpu6050":
+            i2c_port[s["id"]] = s.get("port", 0)
+
+    if "modes" in config:
+        names = [m["name"] for m in config["modes"]]
+        mode = mode or config.get("initial_mode") or names[0]
+        if mode not in names:
+            raise ValueError(f"unknown mode {mode}")
+        task_specs = config["modes"][names.index(mode)]["tasks"]
+    else:
+        mode = "default"
+        task_specs = config.get("tasks", [])
+
+    tasks = []
+    for i, spec in enumerate(task_specs[:32]):
+        sensors = []
+        for sensor_id in spec["sensors"][:3]:
+            if sensor_id not in instances:
+                raise ValueError(f"{spec['name']}: unknown sensor {sensor_id}")
+            sensors.append((instances[sensor_id], sensor_id))
+        tasks.append(SimTask(i, dict(spec, sensors=sensors)))
+    return mode, tasks, i2c_port
+
+
+def percentile(sorted_values, p):
+    if not sorted_values:
+        return 0
+    k = min(len(sorted_values) - 1, int(round(p / 100.0 * (len(sorted_values) - 1))))
+    return sorted_values[k]
+
+
+def summarize(sim, duration_us):
+    result = {"duration_s": duration_us / 1e6, "cores": sim.cores, "tasks": []}
+    for t in sim.tasks:
+        r = sorted(t.responses)
+        result["tasks"].append({
+            "name": t.name,
+            "priority": t.base_prio,
+            "period_ms": t.period_ms,
+            "jobs": len(r),
+            "p50_ms": percentile(r, 50) / 1000,
+            "p90_ms": percentile(r, 90) / 1000,
+            "p99_ms": percentile(r, 99) / 1000,
+            "max_ms": (r[-1] if r else 0) / 1000,
+            "deadline_misses": t.misses,
+            "overruns": t.overruns,
+            "throttled": t.throttled,
+            "read_errors": t.read_errors,
+            "cpu_pct": 100.0 * t.cpu_us / duration_us,
+        })
+    result["core_util_pct"] = [100.0 * b / duration_us for b in sim.core_busy]
+    result["mutexes"] = [
+        {"name": m.name, "acquisitions": m.acquisitions,
+         "wait_total_ms": m.wait_total_us / 1000, "wait_max_ms": m.wait_max_us / 1000}
+        for m in sim.mutexes.values() if m.acquisitions
+    ]
+    result["uart"] = {
+        "bytes": sim.uart_bytes,
+        "util_pct": 100.0 * sim.uart_bytes * sim.uart_us_per_byte / duration_us,
+        "stall_ms": sim.uart_stall_us / 1000,
+    }
+    return result
+
+
+def print_report(result, mode, wall_s):
+    print(f"mode {mode}: {result['duration_s']:.0f}s simulated in {wall_s:.2f}s "
+          f"({result['duration_s'] / max(wall_s, 1e-9):.0f}x real time)")
+    print(f"{'task':16} {'prio':>4} {'period':>7} {'jobs':>7} {'p50':>8} {'p90':>8} {'p99':>8} "
+          f"{'max':>8} {'miss':>6} {'ovr':>5} {'cpu%':>6}")
+    for t in result["tasks"]:
+        print(f"{t['name'][:16]:16} {t['priority']:>4} {t['period_ms']:>5}ms {t['jobs']:>7} "
+              f"{t['p50_ms']:>6.1f}ms {t['p90_ms']:>6.1f}ms {t['p99_ms']:>6.1f}ms {t['max_ms']:>6.1f}ms "
+              f"{t['deadline_misses']:>6} {t['overruns']:>5} {t['cpu_pct']:>6.1f}")
+    print("cores: " + "  ".join(f"{u:.1f}%" for u in result["core_util_pct"]))
+    for m in result["mutexes"]:
+        print(f"mutex {m['name']:12} taken {m['acquisitions']:>8}  wait total {m['wait_total_ms']:.1f}ms "
+              f"max {m['wait_max_ms']:.2f}ms")
+    u = result["uart"]
+    print(f"uart: {u['bytes']} bytes, {u['util_pct']:.1f}% busy, writers stalled {u['stall_ms']:.1f}ms")
+
+
+def write_trace(sim, path, mode):
+    trace = {
+        "mode": mode,
+        "tick_us": TICK_US,
+        "cores": sim.cores,
+        "window_us": sim.trace_us,
+        "tasks": [{"name": t.name, "priority": t.base_prio, "period_ms": t.period_ms} for t in sim.tasks],
+        "segments": sim.segments,           # [task, core, start_us, end_us] while running
+        "jobs": [[t.index, rel, fin] for t in sim.tasks for rel, fin in t.jobs],
+        "blocks": sim.blocks,               # [task, reason, start_us, end_us]
+    }
+    with open(path, "w") as f:
+        json.dump(trace, f)
+
+
+def simulate(config, mode=None, duration_s=3600.0, cores=2, baud=115200, costs=None, seed=1, trace_s=0.0,
+             spread=None):
+    """Run a config; returns (mode, simulator, summary). spread=True/False overrides every task's sampling."""
+    mode, tasks, i2c_port = load_tasks(config, mode)
+    if spread is not None:
+        for t in tasks:
+            t.spread = spread
+    sim = Simulator(tasks, cores=cores, baud=baud, costs=costs, seed=seed, trace_us=int(trace_s * 1e6),
+                    i2c_port=i2c_port)
+    duration_us = int(duration_s * 1e6)
+    sim.run(duration_us)
+    return mode, sim, summarize(sim, duration_us)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Simulate a task config in virtual time")
+    parser.add_argument("config", help="Task config JSON (as uploaded to the ESP32)")
+    parser.add_argument("--mode", help="Mode to simulate (default: initial_mode)")
+    parser.add_argument("--duration", type=float, default=3600.0, help="Simulated seconds")
+    parser.add_argument("--cores", type=int, default=2)
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--costs", help="JSON file overriding entries of the sensor cost model")
+    parser.add_argument("--trace", help="Write a JSON trace of the first --trace-window seconds")
+    parser.add_argument("--trace-window", type=float, default=10.0)
+    parser.add_argument("--json", help="Write the summary as JSON")
+    parser.add_argument("--spread", choices=["on", "off"], help="Override every task's sample spreading")
+    args = parser.parse_args()
+
+    with open(args.config) as f:
+        config = json.load(f)
+
+    costs = {k: dict(v) for k, v in DEFAULT_COSTS.items()}
+    if args.costs:
+        with open(args.costs) as f:
+            for sensor, overrides in json.load(f).items():
+                costs.setdefault(sensor, {}).update(overrides)
+
+    wall = time.time()
+    mode, sim, result = simulate(config, args.mode, args.duration, args.cores, args.baud, costs,
+                                 args.seed, args.trace_window if args.trace else 0.0,
+                                 None if args.spread is None else args.spread == "on")
+    wall = time.time() - wall
+
+    print_report(result, mode, wall)
+    if args.trace:
+        write_trace(sim, args.trace, mode)
+        print(f"Wrote trace of the first {args.trace_window:.0f}s to {args.trace}")
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump(result, f, indent=2)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
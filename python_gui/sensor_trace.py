@@ -0,0 +1,91 @@
+#!/usr/bin/env python3
+"""
+Capture and upload sensor traces.
+
+record: puts the firmware in TRACE RECORD mode for a while and saves every
+        TRACE line (one per raw sensor read) to a file.
+upload: sends a saved trace with TRACE ADD and starts TRACE REPLAY, for
+        targets without a filesystem (hardware, QEMU). The host build can
+        load the file directly with "TRACE REPLAY <path>" instead.
+"""
+
+import argparse
+import sys
+import time
+
+from link import open_link
+
+
+def send(port, command, timeout=2.0):
+    """Send one command and wait for its OK/ERROR reply."""
+    name = command.split()[0]
+    port.write((command + "\n").encode())
+    deadline = time.time() + timeout
+    while time.time() < deadline:
+        line = port.readline().decode("utf-8", errors="ignore").strip()
+        if line == f"OK {name}":
+            return True
+        if line == f"ERROR {name}":
+            return False
+    return False
+
+
+def record(port, seconds, path):
+    port.reset_input_buffer()
+    if not send(port, "TRACE RECORD"):
+        print("TRACE RECORD rejected", file=sys.stderr)
+        return 1
+
+    count = 0
+    end = time.time() + seconds
+    with open(path, "w") as out:
+        while time.time() < end:
+            line = port.readline().decode("utf-8", errors="ignore").strip()
+            if line.startswith("TRACE ") and len(line.split()) == 7:
+                out.write(line + "\n")
+                count += 1
+    send(port, "TRACE STOP")
+    print(f"Recorded {count} reads in {seconds:.0f}s to {path}")
+    return 0
+
+
+def upload(port, path):
+    with open(path) as f:
+        records = [line.strip() for line in f if line.startswith("TRACE ") and len(line.split()) == 7]
+
+    port.reset_input_buffer()
+    send(port, "TRACE STOP")
+    if not send(port, "TRACE CLEAR"):
+        print("TRACE CLEAR rejected", file=sys.stderr)
+        return 1
+    for i, line in enumerate(records):
+        fields = line.split()
+        if not send(port, "TRACE ADD " + " ".join(fields[1:])):
+            print(f"Record {i} rejected (trace full?)", file=sys.stderr)
+            break
+    ok = send(port, "TRACE REPLAY")
+    print(f"Uploaded {len(records)} records, replay {'started' if ok else 'failed'}")
+    return 0 if ok else 1
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Record or upload ESP32 sensor traces")
+    parser.add_argument("--port", required=True,
+                        help="Serial port (e.g. /dev/ttyUSB0) or tcp:<host>:<port>")
+    parser.add_argument("--baud", type=int, default=115200)
+    sub = parser.add_subparsers(dest="command", required=True)
+    rec = sub.add_parser("record", help="Capture a trace from live sensors")
+    rec.add_argument("--seconds", type=float, default=60.0)
+    rec.add_argument("out")
+    up = sub.add_parser("upload", help="Send a trace and start replaying it")
+    up.add_argument("trace")
+    args = parser.parse_args()
+
+    with open_link(args.port, args.baud) as port:
+        if args.command == "record":
+            return record(port, args.seconds, args.out)
+        return upload(port, args.trace)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,117 @@
+#!/usr/bin/env python3
+"""
+Decoders for the binary telemetry produced by the ESP32 firmware:
+LZ4 block decompression and compressed history blocks (main/history_codec.c)
+"""
+
+import struct
+
+# Channel order and fixed-point scale, matching sensor_channel_t / history_codec.c
+CHANNELS = ["hum", "temp", "dist", "ax", "ay", "az"]
+CHANNEL_SCALE = [10.0, 10.0, 1.0, 1000.0, 1000.0, 1000.0]
+
+# Serialized block header: task id, first/last timestamp, count, payload length, channel mask
+BLOCK_HEADER = struct.Struct("<BIIHHB")
+
+
+def lz4_block_decompress(src, raw_len):
+    """Decompress one LZ4 block (no frame header) of known decompressed size"""
+    dst = bytearray()
+    i = 0
+    n = len(src)
+    while i < n:
+        token = src[i]
+        i += 1
+
+        lit_len = token >> 4
+        if lit_len == 15:
+            while True:
+                b = src[i]
+                i += 1
+                lit_len += b
+                if b != 255:
+                    break
+        dst += src[i:i + lit_len]
+        i += lit_len
+        if i >= n:
+            break
+
+        offset = src[i] | (src[i + 1] << 8)
+        i += 2
+        if offset == 0 or offset > len(dst):
+            raise ValueError("corrupt LZ4 block: bad offset")
+
+        match_len = token & 0x0F
+        if match_len == 15:
+            while True:
+                b = src[i]
+                i += 1
+                match_len += b
+                if b != 255:
+                    break
+        match_len += 4
+
+        start = len(dst) - offset
+        if offset >= match_len:
+            dst += dst[start:start + match_len]
+        else:
+            for k in range(match_len):  # Overlapping copy
+                dst.append(dst[start + k])
+
+    if len(dst) != raw_len:
+        raise ValueError(f"corrupt LZ4 block: {len(dst)} bytes, expected {raw_len}")
+    return bytes(dst)
+
+
+def _zigzag(v):
+    return (v >> 1) ^ -(v & 1)
+
+
+def _varint(buf, pos):
+    result = 0
+    shift = 0
+    while True:
+        b = buf[pos]
+        pos += 1
+        result |= (b & 0x7F) << shift
+        if not b & 0x80:
+            return result, pos
+        shift += 7
+
+
+def _to_i16(v):
+    v &= 0xFFFF
+    return v - 0x10000 if v & 0x8000 else v
+
+
+def decode_history_block(payload, first_ts, count, mask):
+    """Yield (timestamp_ms, {channel: value}) for every sample in a block payload"""
+    pos = 0
+    ts = first_ts
+    delta = 0
+    prev = [0] * len(CHANNELS)
+    for index in range(count):
+        if index > 0:
+            raw, pos = _varint(payload, pos)
+            delta += _zigzag(raw)
+            ts = (ts + delta) & 0xFFFFFFFF
+        values = {}
+        for ch, name in enumerate(CHANNELS):
+            if not mask & (1 << ch):
+                continue
+            raw, pos = _varint(payload, pos)
+            prev[ch] = _to_i16(prev[ch] + _zigzag(raw))
+            values[name] = prev[ch] / CHANNEL_SCALE[ch]
+        yield ts, values
+
+
+def decode_history_stream(data):
+    """Yield (task_id, timestamp_ms, values) from concatenated serialized blocks"""
+    pos = 0
+    while pos + BLOCK_HEADER.size <= len(data):
+        task_id, first_ts, _last_ts, count, used, mask = BLOCK_HEADER.unpack_from(data, pos)
+        pos += BLOCK_HEADER.size
+        payload = data[pos:pos + used]
+        pos += used
+        for ts, values in decode_history_block(payload, first_ts, count, mask):
+            yield task_id, ts, values
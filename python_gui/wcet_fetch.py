@@ -0,0 +1,109 @@
+#!/usr/bin/env python3
+"""
+Fetch the ESP32's measured execution costs (WCET command).
+
+Prints the per-read cost of every sensor instance and the cycle cost of every
+task, and writes the sensor costs as a schedule_sim.py --costs file so the
+simulator runs on measured numbers instead of its built-in model. With
+--calibrate the device re-measures first (WCET CALIBRATE), which parks its
+tasks for a while.
+"""
+
+import argparse
+import json
+import sys
+import time
+
+from link import open_link
+
+# CPU share of an MPU6050 read in schedule_sim.py's model; the rest is I2C wait
+MPU6050_CPU_US = 60
+
+
+def parse_fields(tokens):
+    fields = {}
+    for token in tokens:
+        key, _, value = token.partition("=")
+        if value:
+            fields[key] = int(value.rstrip("us")) if value.rstrip("us").isdigit() else value
+    return fields
+
+
+def fetch(port, calibrate=False, iterations=None, timeout=10.0):
+    """Send the command and collect (sensors, tasks) until OK / ERROR WCET"""
+    command = "WCET"
+    if calibrate:
+        command += " CALIBRATE" + (f" {iterations}" if iterations else "")
+        timeout = max(timeout, 600.0)
+    port.reset_input_buffer()
+    port.write((command + "\n").encode())
+
+    sensors, tasks = [], []
+    start = time.time()
+    while time.time() - start < timeout:
+        line = port.readline().decode("utf-8", errors="ignore").strip()
+        if line.startswith("WCET SENSOR "):
+            _, _, sensor_id, sensor_type, *rest = line.split()
+            sensors.append({"id": sensor_id, "type": sensor_type, **parse_fields(rest)})
+        elif line.startswith("WCET TASK "):
+            _, _, name, *rest = line.split()
+            tasks.append({"name": name, **parse_fields(rest)})
+        elif line == "OK WCET":
+            return sensors, tasks
+        elif line == "ERROR WCET":
+            raise RuntimeError(f"device rejected {command}")
+    raise TimeoutError(f"no answer to {command} within {timeout:.0f}s")
+
+
+def sim_costs(sensors, stat="p99"):
+    """Per sensor type overrides in schedule_sim.py's cost model (worst instance wins)"""
+    costs = {}
+    for s in sensors:
+        cost, jitter = s[stat], max(s["max"] - s["p50"], 0)
+        if s["type"] == "dht11":
+            entry = {"crit_us": cost, "jitter_us": jitter}
+        elif s["type"] == "ultrasonic":
+            # The measurement already includes the echo time at the current distance
+            entry = {"busy_us": cost, "us_per_cm": 0, "jitter_us": jitter}
+        elif s["type"] == "mpu6050":
+            entry = {"cpu_us": MPU6050_CPU_US, "io_us": max(cost - MPU6050_CPU_US, 0), "jitter_us": jitter}
+        else:
+            continue
+        key = next(iter(entry))
+        if s["type"] not in costs or costs[s["type"]][key] < entry[key]:
+            costs[s["type"]] = entry
+    return costs
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Fetch measured sensor and task costs from the ESP32")
+    parser.add_argument("--port", required=True,
+                        help="Serial port (e.g. /dev/ttyUSB0) or tcp:<host>:<port>")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--calibrate", action="store_true", help="Re-measure on the device first")
+    parser.add_argument("--iterations", type=int, help="Task cycles per measurement with --calibrate")
+    parser.add_argument("--stat", choices=["p50", "p99", "max"], default="p99",
+                        help="Statistic used as the cost in the --out file")
+    parser.add_argument("--out", help="Write a schedule_sim.py --costs JSON file")
+    args = parser.parse_args()
+
+    with open_link(args.port, args.baud) as port:
+        sensors, tasks = fetch(port, args.calibrate, args.iterations)
+
+    print(f"{'sensor':<16}{'type':<12}{'n':>5}{'p50 us':>10}{'p99 us':>10}{'max us':>10}")
+    for s in sensors:
+        print(f"{s['id']:<16}{s['type']:<12}{s['n']:>5}{s['p50']:>10}{s['p99']:>10}{s['max']:>10}")
+    print(f"\n{'task':<20}{'cpu p99':>10}{'cpu max':>10}{'wall p99':>10}{'wall max':>10}  source")
+    for t in tasks:
+        source = "measured" if t["measured"] else "estimated"
+        print(f"{t['name']:<20}{t['cpu_p99']:>10}{t['cpu_max']:>10}{t['wall_p99']:>10}{t['wall_max']:>10}  {source}")
+
+    if args.out:
+        with open(args.out, "w") as f:
+            json.dump(sim_costs(sensors, args.stat), f, indent=2)
+        print(f"\nWrote {args.stat} sensor costs to {args.out} (schedule_sim.py --costs)")
+    return 0 if sensors else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,116 @@
+// Host benchmark of the history codec (main/history_codec.c), which has no
+// RTOS dependencies. Encodes synthetic task cycles into blocks, decodes them
+// back, checks the round trip and reports time and bytes per sample.
+//
+//   gcc -O2 -Imain/include -o history_codec_bench tools/history_codec_bench.c main/history_codec.c main/sensor_channels.c -lm
+//   ./history_codec_bench [samples] [channel mask, default all; 0x3c = ultrasonic + IMU]
+//
+// Exits non-zero if a decoded sample differs from what was encoded.
+
+#include "history_codec.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_SAMPLES 200000
+
+typedef struct {
+    uint32_t ts_ms;
+    int16_t values[CHANNEL_COUNT];
+} sample_t;
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Readings of a task sampling every channel at 100 ms with a little jitter:
+// slow drifts, sensor noise and the occasional step, as on the bench
+static void make_samples(sample_t *samples, int n)
+{
+    uint32_t seed = 1;
+    uint32_t ts = 0;
+    sensor_readings_t r = { 45.0f, 23.5f, 100, 0.01f, -0.03f, 1.0f };
+    for (int i = 0; i < n; i++) {
+        seed = seed * 1103515245u + 12345u;
+        int noise = (int)((seed >> 16) % 5) - 2;
+        ts += 100 + (uint32_t)((seed >> 8) % 3);
+        r.dht_humidity += noise * 0.05f;
+        r.dht_temperature += (i % 50 == 0) ? 0.1f : 0.0f;
+        r.ultrasonic_distance = (i % 400 < 200 ? 100 : 40) + noise;
+        r.mpu_accel_x = 0.01f + noise * 0.002f;
+        r.mpu_accel_y = -0.03f - noise * 0.001f;
+        r.mpu_accel_z = 1.0f + noise * 0.003f;
+        samples[i].ts_ms = ts;
+        history_quantize(&r, samples[i].values);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int n = argc > 1 ? atoi(argv[1]) : DEFAULT_SAMPLES;
+    if (n <= 0) n = DEFAULT_SAMPLES;
+    uint8_t mask = argc > 2 ? (uint8_t)strtoul(argv[2], NULL, 0) : (1u << CHANNEL_COUNT) - 1;
+    mask &= (1u << CHANNEL_COUNT) - 1;
+
+    sample_t *samples = malloc((size_t)n * sizeof(*samples));
+    // A block never holds fewer samples than its worst case allows
+    int max_blocks = n / (HISTORY_BLOCK_DATA_BYTES / HISTORY_SAMPLE_MAX_BYTES) + 1;
+    history_block_t *blocks = malloc((size_t)max_blocks * sizeof(*blocks));
+    if (!samples || !blocks) return 1;
+    make_samples(samples, n);
+    for (int i = 0; i < n; i++) {
+        // Channels outside the mask are not stored and decode as 0
+        for (int ch = 0; ch < CHANNEL_COUNT; ch++) {
+            if (!(mask & (1u << ch))) samples[i].values[ch] = 0;
+        }
+    }
+
+    int block_count = 1;
+    history_cursor_t enc;
+    double t0 = now_ns();
+    history_block_start(&blocks[0], &enc, mask);
+    for (int i = 0; i < n; i++) {
+        if (!history_block_append(&blocks[block_count - 1], &enc, samples[i].ts_ms, samples[i].values)) {
+            history_block_start(&blocks[block_count++], &enc, mask);
+            history_block_append(&blocks[block_count - 1], &enc, samples[i].ts_ms, samples[i].values);
+        }
+    }
+    double encode_ns = now_ns() - t0;
+
+    int decoded = 0;
+    int mismatches = 0;
+    t0 = now_ns();
+    for (int b = 0; b < block_count; b++) {
+        history_reader_t reader;
+        uint32_t ts;
+        int16_t values[CHANNEL_COUNT];
+        history_reader_init(&reader, &blocks[b]);
+        while (history_reader_next(&reader, &ts, values)) {
+            if (decoded >= n || ts != samples[decoded].ts_ms ||
+                memcmp(values, samples[decoded].values, sizeof(values)) != 0) {
+                mismatches++;
+            }
+            decoded++;
+        }
+    }
+    double decode_ns = now_ns() - t0;
+
+    size_t stored = (size_t)block_count * sizeof(history_block_t);
+    size_t raw = (size_t)n * (sizeof(uint32_t) + sizeof(sensor_readings_t));
+    printf("samples=%d channels=0x%02x blocks=%d\n", n, mask, block_count);
+    printf("encode %.1f ns/sample, decode %.1f ns/sample\n", encode_ns / n, decode_ns / n);
+    printf("%.2f bytes/sample with headers (raw %zu), %.1fx smaller\n",
+           (double)stored / n, sizeof(uint32_t) + sizeof(sensor_readings_t), (double)raw / stored);
+
+    free(samples);
+    free(blocks);
+    if (decoded != n || mismatches) {
+        printf("FAIL: %d of %d samples decoded, %d differ\n", decoded, n, mismatches);
+        return 1;
+    }
+    return 0;
+}